@@ -1,5 +1,8 @@
 #include <sys/time.h>
+#include <esp_timer.h>
 #include <host/util/util.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
 #include "nimble/nimble_port_freertos.h"
 #include "nimble/nimble_port.h"
 #include "host/ble_hs.h"
@@ -8,6 +11,27 @@
 #include "services/gatt/ble_svc_gatt.h"
 #include "sensors.h"
 #include "ble_host.h"
+#include "boot_profile.h"
+#include "diagnostics.h"
+#include "energy.h"
+#include "trace.h"
+#include "timebase.h"
+#include "i2c_bus.h"
+#include "notify.h"
+#include "summary.h"
+#include "phase.h"
+
+// Defaults of the stream command L<sensor mask>,<interval ms>,<duration s>,<store>
+#define STREAM_DEFAULT_INTERVAL 250
+#define STREAM_DEFAULT_DURATION 300
+
+// Default interval of the align command A<pair id>,<epoch s>,<interval ms>,<wall clock ms>
+#define ALIGN_DEFAULT_INTERVAL 60000
+
+// Longest attribute value of att, the diagnostics pages are shorter
+#define DIAG_SNAPSHOT_SIZE 512
+// A long read of the diagnostics page not continued within this time in ms starts over with a new page
+#define DIAG_SNAPSHOT_TIMEOUT 2000
 
 //static const ble_uuid128_t service_uuid =
 //    BLE_UUID128_INIT(0x9e, 0xca, 0xdc, 0x24, 0x0e, 0xe5, 0xa9, 0xe0, 0x93, 0xf3, 0xa3, 0xb5, 0x01, 0x00, 0x40, 0x6e);
@@ -25,13 +49,40 @@ static const char *device_name = "ai_sole";
 static uint8_t addr_type;
 static uint16_t connection_handle;
 
-uint8_t sensor_handle_val[64];
-uint8_t sensor_handle_val_length;
+// Value returned to reads of the sensor characteristic, only used by the host task
+static uint8_t sensor_handle_val[NOTIFY_FRAME_SIZE];
+static uint8_t sensor_handle_val_length;
 uint16_t sensor_handle;
 
 uint8_t rx_handle_buf[64];
 uint16_t rx_handle;
 
+/**
+ * Last command written before the sensor data was loaded, run by the service task once it is. Writes without response
+ * get no att error, so the command is kept instead of rejected
+ */
+static struct {
+    uint8_t data[sizeof(rx_handle_buf)];
+    uint16_t length;            // 0 if no command is pending
+} pending_command;
+
+static StaticSemaphore_t pending_lock_buffer;
+static SemaphoreHandle_t pending_lock = NULL;
+
+uint16_t diag_handle;
+
+/**
+ * Diagnostics page of a long read. Pages longer than the mtu are read in chunks by read blob requests, each calling the
+ * access callback again, so the chunks are served from the page built for the first one
+ */
+static struct {
+    uint16_t conn_handle;
+    uint16_t length;
+    uint16_t offset;            // Offset of the next chunk, 0 if no long read is in progress
+    int64_t time;               // Time of the last chunk in us
+    uint8_t data[DIAG_SNAPSHOT_SIZE];
+} diag_snapshot;
+
 static const ble_uuid128_t service_uuid =
     BLE_UUID128_INIT(0x9e, 0xca, 0xdc, 0x24, 0x0e, 0xe5, 0xa9, 0xe0, 0x93, 0xf3, 0xa3, 0xb5, 0x01, 0x00, 0x40, 0x6e);
 
@@ -58,18 +109,26 @@ int gap_event_cb(struct ble_gap_event *event, void *arg) {
 
     switch (event->type) {
         case BLE_GAP_EVENT_CONNECT:
-            ESP_LOGI(TAG, "connection %s; status=%d ",
+            TRACE(TRACE_GAP_CONNECT, event->connect.status, event->connect.conn_handle, 0);
+            TRACE_LOGI(TAG, "connection %s; status=%d ",
                      event->connect.status == 0 ? "established" : "failed",
                      event->connect.status);
 
             // Print connection information if connected
             if (event->connect.status == 0) {
                 connection_handle = event->connect.conn_handle;
+
+                // Stay awake while connected, even in deep sleep recording mode
+                sensors_deep_sleep_hold();
+
                 res = ble_gap_conn_find(event->connect.conn_handle, &desc);
 
                 ble_gattc_exchange_mtu(event->connect.conn_handle, mtu_cb, NULL);
 
-                ESP_LOGI(TAG, "connection uses mtu: %d", ble_att_mtu(event->connect.conn_handle));
+                // Connection interval is in units of 1.25 ms
+                energy_radio_state(ENERGY_RADIO_CONNECTED, desc.conn_itvl * 5 / 4);
+
+                TRACE_LOGI(TAG, "connection uses mtu: %d", ble_att_mtu(event->connect.conn_handle));
                 assert(res == 0);
 
                 //TODO: print connection information
@@ -85,54 +144,70 @@ int gap_event_cb(struct ble_gap_event *event, void *arg) {
 
             return 0;
         case BLE_GAP_EVENT_DISCONNECT:
-            ESP_LOGI(TAG, "disconnect, reason = %d", event->disconnect.reason);
+            TRACE(TRACE_GAP_DISCONNECT, 0, 0, event->disconnect.reason);
+            TRACE_LOGI(TAG, "disconnect, reason = %d", event->disconnect.reason);
             connection_handle = 0;
 
+            notify_disconnect(event->disconnect.conn.conn_handle);
+
             close_connection();
 
             // Restart advertisement if disconnected
             ble_start_advertising();
+
+            if (sensors_deep_sleep_active())
+                sensors_deep_sleep_schedule();
+
             return 0;
         case BLE_GAP_EVENT_CONN_UPDATE:
-            ESP_LOGI(TAG, "connection updated, status = %d", event->conn_update.status);
+            TRACE_LOGI(TAG, "connection updated, status = %d", event->conn_update.status);
 
             res = ble_gap_conn_find(event->conn_update.conn_handle, &desc);
             assert(res == 0);
 
+            TRACE(TRACE_GAP_CONN_UPDATE, event->conn_update.status, event->conn_update.conn_handle, desc.conn_itvl);
+
+            energy_radio_state(ENERGY_RADIO_CONNECTED, desc.conn_itvl * 5 / 4);
+
             return 0;
         case BLE_GAP_EVENT_CONN_UPDATE_REQ:
-            ESP_LOGI(TAG, "connection update request");
+            TRACE_LOGI(TAG, "connection update request");
 
             res = ble_gap_conn_find(event->conn_update_req.conn_handle, &desc);
             assert(res == 0);
 
             const struct ble_gap_upd_params *peer = event->conn_update_req.peer_params;
 
-            ESP_LOGI(TAG, "Peer params, itvl: %d - %d, con_evt_len: %d - %d, timeout: %d", peer->itvl_min,
+            TRACE(TRACE_GAP_CONN_UPDATE_REQ, 0, peer->itvl_min, peer->itvl_max);
+            TRACE_LOGI(TAG, "Peer params, itvl: %d - %d, con_evt_len: %d - %d, timeout: %d", peer->itvl_min,
                      peer->itvl_max, peer->min_ce_len, peer->max_ce_len, peer->supervision_timeout);
 
             struct ble_gap_upd_params *self = event->conn_update_req.self_params;
 
-            ESP_LOGI(TAG, "Self params, itvl: %d - %d, con_evt_len: %d - %d, timeout: %d", self->itvl_min,
+            TRACE_LOGI(TAG, "Self params, itvl: %d - %d, con_evt_len: %d - %d, timeout: %d", self->itvl_min,
                      self->itvl_max, self->min_ce_len, self->max_ce_len, self->supervision_timeout);
 
             return 0;
         case BLE_GAP_EVENT_ADV_COMPLETE:
-            ESP_LOGI(TAG, "advertise complete, reason = %d", event->adv_complete.reason);
+            TRACE(TRACE_GAP_ADV_COMPLETE, 0, 0, event->adv_complete.reason);
+            TRACE_LOGI(TAG, "advertise complete, reason = %d", event->adv_complete.reason);
 
             // Restart advertisement if finished
             ble_start_advertising();
 
             return 0;
         case BLE_GAP_EVENT_ENC_CHANGE:
-            ESP_LOGI(TAG, "encryption changed, status = %d", event->enc_change.status);
+            TRACE(TRACE_GAP_ENC_CHANGE, event->enc_change.status, event->enc_change.conn_handle, 0);
+            TRACE_LOGI(TAG, "encryption changed, status = %d", event->enc_change.status);
 
             res = ble_gap_conn_find(event->enc_change.conn_handle, &desc);
             assert(res == 0);
 
             return 0;
         case BLE_GAP_EVENT_NOTIFY_TX:
-            ESP_LOGI(TAG, "notify_tx event; conn_handle=%d attr_handle=%d "
+            TRACE(TRACE_GAP_NOTIFY_TX, event->notify_tx.status, event->notify_tx.attr_handle,
+                  event->notify_tx.indication);
+            TRACE_LOGI(TAG, "notify_tx event; conn_handle=%d attr_handle=%d "
                           "status=%d is_indication=%d",
                      event->notify_tx.conn_handle,
                      event->notify_tx.attr_handle,
@@ -141,7 +216,9 @@ int gap_event_cb(struct ble_gap_event *event, void *arg) {
 
             break;
         case BLE_GAP_EVENT_SUBSCRIBE:
-            ESP_LOGI(TAG, "subscribe event; conn_handle=%d attr_handle=%d "
+            TRACE(TRACE_GAP_SUBSCRIBE, event->subscribe.cur_notify, event->subscribe.attr_handle,
+                  event->subscribe.reason);
+            TRACE_LOGI(TAG, "subscribe event; conn_handle=%d attr_handle=%d "
                           "reason=%d prevn=%d curn=%d previ=%d curi=%d\n",
                      event->subscribe.conn_handle,
                      event->subscribe.attr_handle,
@@ -151,9 +228,14 @@ int gap_event_cb(struct ble_gap_event *event, void *arg) {
                      event->subscribe.prev_indicate,
                      event->subscribe.cur_indicate);
 
+            if (event->subscribe.attr_handle == sensor_handle)
+                notify_subscribe(event->subscribe.conn_handle, event->subscribe.cur_notify);
+
             if (event->subscribe.attr_handle == sensor_handle && event->subscribe.cur_notify == 1) {
-                // Notify device of current saved data count on subscription
-                sensors_notify_data_count();
+                // Notify device of current saved data count on subscription, the service task notifies it once the
+                // data is loaded
+                if (sensors_ready())
+                    sensors_notify_data_count();
 
                 struct ble_gap_upd_params params = {
                     .itvl_min = BLE_GAP_CONN_ITVL_MS(500),
@@ -170,7 +252,8 @@ int gap_event_cb(struct ble_gap_event *event, void *arg) {
 
             break;
         case BLE_GAP_EVENT_MTU:
-            ESP_LOGI(TAG, "mtu update event; conn_handle=%d cid=%d mtu=%d\n",
+            TRACE(TRACE_GAP_MTU, 0, event->mtu.conn_handle, event->mtu.value);
+            TRACE_LOGI(TAG, "mtu update event; conn_handle=%d cid=%d mtu=%d\n",
                      event->mtu.conn_handle,
                      event->mtu.channel_id,
                      event->mtu.value);
@@ -178,7 +261,7 @@ int gap_event_cb(struct ble_gap_event *event, void *arg) {
 //            res = ble_att_set_preferred_mtu(event->mtu.value);
 //            assert(res == 0);
 
-            ESP_LOGI(TAG, "connection uses mtu: %d", ble_att_mtu(event->mtu.conn_handle));
+            TRACE_LOGI(TAG, "connection uses mtu: %d", ble_att_mtu(event->mtu.conn_handle));
 
             return 0;
         case BLE_GAP_EVENT_REPEAT_PAIRING:
@@ -199,13 +282,50 @@ int gap_event_cb(struct ble_gap_event *event, void *arg) {
     return 0;
 }
 
+/**
+ * Sets the advertisement response data with the device name and the summary of the latest sample
+ * @return The error code of the gap response data set
+ */
+static int set_scan_response() {
+    struct ble_hs_adv_fields rsp_fields;
+
+    // Advertisement response data to allow more data to be sent
+    memset(&rsp_fields, 0, sizeof(rsp_fields));
+
+    // Advertised name for the app to display
+    rsp_fields.name = (uint8_t *) device_name;
+    rsp_fields.name_len = strlen(device_name);
+    rsp_fields.name_is_complete = 1;
+
+#if SUMMARY_ENABLED
+    // Service data starts with the uuid, the summary fits the remaining 22 bytes next to the name
+    uint8_t service_data[2 + sizeof(summary_t)] = {SUMMARY_UUID16 & 0xff, SUMMARY_UUID16 >> 8};
+
+    summary_get((summary_t *) &service_data[2]);
+
+    rsp_fields.svc_data_uuid16 = service_data;
+    rsp_fields.svc_data_uuid16_len = sizeof(service_data);
+#endif
+
+    return ble_gap_adv_rsp_set_fields(&rsp_fields);
+}
+
+void ble_host_update_advertising() {
+    // Samples are taken concurrently to the ble startup
+    if (!ble_hs_synced())
+        return;
+
+    int res = set_scan_response();
+    if (res != 0)
+        ESP_LOGW(TAG, "Updating adv response data failed, response: %d", res);
+}
+
 /**
  * Starts advertising and sets the needed field values for correct detection e.g. service uuid and name
  */
 static void ble_start_advertising() {
     struct ble_gap_adv_params adv_params;
     struct ble_hs_adv_fields fields;
-    struct ble_hs_adv_fields rsp_fields;
     int res;
 
     memset(&fields, 0, sizeof(fields));
@@ -233,15 +353,7 @@ static void ble_start_advertising() {
         return;
     }
 
-    // Advertisement response data to allow more data to be sent
-    memset(&rsp_fields, 0, sizeof(rsp_fields));
-
-    // Advertised name for the app to display
-    rsp_fields.name = (uint8_t *) device_name;
-    rsp_fields.name_len = strlen(device_name);
-    rsp_fields.name_is_complete = 1;
-
-    res = ble_gap_adv_rsp_set_fields(&rsp_fields);
+    res = set_scan_response();
     if (res != 0) {
         ESP_LOGE(TAG, "Error while setting adv response data, response: %d", res);
         return;
@@ -267,6 +379,9 @@ static void ble_start_advertising() {
         ESP_LOGE(TAG, "Error starting advertisement, response: %d", res);
         return;
     }
+
+    // Accounted with the mean of the advertising interval
+    energy_radio_state(ENERGY_RADIO_ADVERTISING, 750);
 }
 
 void ble_on_reset(int reason) {
@@ -293,6 +408,8 @@ void ble_on_sync() {
     print_address(addr_val);
 
     ble_start_advertising();
+
+    boot_profile_end(BOOT_PHASE_ADVERTISING);
 }
 
 void nimble_host_task(void *param) {
@@ -303,48 +420,200 @@ void nimble_host_task(void *param) {
     nimble_port_freertos_deinit();
 }
 
-void sole_receive_handler(const uint8_t *data, uint16_t len) {
-    if (len == 0)
-        return;
+/**
+ * Parses the next comma separated argument of a command
+ * @param cursor - The end of the previous argument, moved behind the parsed one
+ * @param fallback - The value if the argument is missing
+ */
+static long long next_argument(char **cursor, long long fallback) {
+    if (**cursor != ',')
+        return fallback;
 
-    char *end;
+    char *start = *cursor + 1;
+    long long value = strtoll(start, cursor, 10);
+
+    return *cursor == start ? fallback : value;
+}
+
+/**
+ * @return The command argument limited to the range of the field it is stored in
+ */
+static long long clamp_argument(long long value, long long min, long long max) {
+    return value < min ? min : value > max ? max : value;
+}
+
+/**
+ * Runs a command written to the rx characteristic, the sensor data has to be loaded
+ * @param data - The command, followed by a terminator
+ * @return 0 or the att error of the write
+ */
+static int sole_run_command(const uint8_t *data, uint16_t len) {
+    energy_begin(ENERGY_SUBSYSTEM_BLE);
 
-    time_t cur_time = strtoll((char *) &data[1], &end, 10);
+    char *end;
 
-    struct timeval time;
+    long long argument = strtoll((char *) &data[1], &end, 10);
+    bool has_argument = end != (char *) &data[1];
 
-    time.tv_sec = cur_time;
-    time.tv_usec = 0;
+    // The record and playback commands of older apps carry the current time, it is used as a sync
+    bool is_time_command = data[0] == 'R' || data[0] == 'S' || data[0] == 'P' || data[0] == 'H' || data[0] == 'C';
 
-    settimeofday(&time, NULL);
+    if (is_time_command && has_argument)
+        timebase_sync(argument);
 
     switch (data[0]) {
         case 'R':
             ESP_LOGD(TAG, "Received START command");
-            sensors_stop_data_play_task();
-            sensors_start_measurement_task();
+            sensors_leave_deep_sleep();
+            sensors_stop_data_play();
+            sensors_stop_stream();
+            sensors_start_measurement();
             break;
         case 'S':
             ESP_LOGD(TAG, "Received STOP command");
-            sensors_stop_measurement_task();
+            sensors_leave_deep_sleep();
+            sensors_stop_measurement();
             break;
         case 'P':
             ESP_LOGD(TAG, "Received PLAY command");
-            sensors_stop_measurement_task();
-            sensors_start_data_play_task();
+            sensors_leave_deep_sleep();
+            sensors_stop_measurement();
+            sensors_stop_stream();
+            sensors_start_data_play();
             break;
         case 'H':
             ESP_LOGD(TAG, "Received HALT command");
-            sensors_stop_data_play_task();
+            sensors_stop_data_play();
             break;
         case 'C':
             ESP_LOGD(TAG, "Received CLEAR command");
+            sensors_leave_deep_sleep();
             sensors_clear_data();
             break;
+        case 'D':
+            ESP_LOGD(TAG, "Received DEEP SLEEP command");
+            sensors_enter_deep_sleep();
+            break;
+        case 'I':
+            ESP_LOGD(TAG, "Received DEEP SLEEP INFO command");
+            sensors_notify_deep_sleep_stats();
+            break;
+        case 'B':
+            ESP_LOGD(TAG, "Received BOOT PROFILE command");
+            boot_profile_notify();
+            break;
+        case 'G':
+            ESP_LOGD(TAG, "Received DIAGNOSTICS PAGE command");
+            diag_select_page(has_argument ? argument : 0);
+            diag_snapshot.offset = 0;
+            break;
+        case 'Z':
+            ESP_LOGD(TAG, "Received DIAGNOSTICS RESET command");
+            diag_reset();
+            diag_snapshot.offset = 0;
+            break;
+        case 'T':
+            ESP_LOGD(TAG, "Received TRACE CURSOR command");
+            trace_set_cursor(has_argument ? argument : 0);
+            diag_snapshot.offset = 0;
+            break;
+        case 'K':
+            ESP_LOGD(TAG, "Received I2C CAPTURE command");
+            i2c_bus_capture(has_argument && argument != 0);
+            break;
+        case 'L':
+            ESP_LOGD(TAG, "Received STREAM command");
+            if (has_argument && argument == 0) {
+                sensors_stop_stream();
+                break;
+            }
+
+            sensors_leave_deep_sleep();
+            sensors_stop_measurement();
+            sensors_stop_data_play();
+            sensors_start_stream(&(sensors_stream_config_t) {
+                // Out of range values are limited before they are narrowed, the service task applies the stream limits
+                .sensor_mask = has_argument ? clamp_argument(argument, 0, UINT32_MAX) : SENSORS_ALL_MASK,
+                .interval = clamp_argument(next_argument(&end, STREAM_DEFAULT_INTERVAL), 0, UINT16_MAX),
+                .duration = clamp_argument(next_argument(&end, STREAM_DEFAULT_DURATION), 0, UINT16_MAX),
+                .store = next_argument(&end, 0) != 0
+            });
+            break;
+        case 'F':
+            ESP_LOGD(TAG, "Received FINE RESOLUTION command");
+            sensors_set_fine_resolution(has_argument && argument != 0);
+            break;
+        case 'U':
+            ESP_LOGD(TAG, "Received TIME SYNC command");
+            if (has_argument)
+                timebase_sync(argument);
+
+            timebase_notify();
+            break;
+        case 'A':
+            ESP_LOGD(TAG, "Received ALIGN command");
+            if (has_argument) {
+                uint32_t epoch = next_argument(&end, 0);
+                uint32_t interval = next_argument(&end, ALIGN_DEFAULT_INTERVAL);
+
+                sensors_set_alignment(argument, epoch, interval, next_argument(&end, (long long) epoch * 1000));
+            }
+
+            phase_notify();
+            break;
         default:
             ESP_LOGD(TAG, "Command not recognized");
             break;
     }
+
+    energy_end(ENERGY_SUBSYSTEM_BLE);
+
+    return 0;
+}
+
+/**
+ * Handles a command written to the rx characteristic
+ * @return 0 or the att error of the write
+ */
+static int sole_receive_handler(const uint8_t *data, uint16_t len) {
+    if (len == 0)
+        return 0;
+
+    // Commands need the loaded sensor data, the sensor startup runs concurrently to advertising. The host task does not
+    // wait for it, the command is kept until the service task loaded the data. The lock orders it with run_pending
+    xSemaphoreTake(pending_lock, portMAX_DELAY);
+
+    bool ready = sensors_ready();
+
+    if (!ready) {
+        if (pending_command.length > 0)
+            ESP_LOGW(TAG, "Command %c replaced by %c before the sensor data was loaded", pending_command.data[0],
+                     data[0]);
+
+        memset(pending_command.data, 0, sizeof(pending_command.data));
+        memcpy(pending_command.data, data, len);
+        pending_command.length = len;
+    }
+
+    xSemaphoreGive(pending_lock);
+
+    return ready ? sole_run_command(data, len) : 0;
+}
+
+/**
+ * Runs the command written before the sensor data was loaded, called by the service task once it is
+ */
+static void run_pending() {
+    xSemaphoreTake(pending_lock, portMAX_DELAY);
+
+    if (pending_command.length > 0) {
+        ESP_LOGI(TAG, "Running command %c written before the sensor data was loaded", pending_command.data[0]);
+
+        sole_run_command(pending_command.data, pending_command.length);
+        pending_command.length = 0;
+    }
+
+    xSemaphoreGive(pending_lock);
 }
 
 int mbuf_to_flat(struct os_mbuf *om, uint16_t min_len, uint16_t max_len,
@@ -354,7 +623,7 @@ int mbuf_to_flat(struct os_mbuf *om, uint16_t min_len, uint16_t max_len,
 
     om_len = OS_MBUF_PKTLEN(om);
 
-    ESP_LOGI(TAG, "Data write with len: %d", om_len);
+    TRACE_LOGI(TAG, "Data write with len: %d", om_len);
 
     if (om_len < min_len || om_len > max_len) {
         return BLE_ATT_ERR_INVALID_ATTR_VALUE_LEN;
@@ -367,7 +636,9 @@ int mbuf_to_flat(struct os_mbuf *om, uint16_t min_len, uint16_t max_len,
         return res;
     }
 
-    ESP_LOG_BUFFER_HEXDUMP(TAG, dst, max_len, ESP_LOG_INFO);
+#if TRACE_LOG_STRINGS
+    ESP_LOG_BUFFER_HEXDUMP(TAG, dst, data_length, ESP_LOG_DEBUG);
+#endif
 
     if (len)
         *len = data_length;
@@ -375,25 +646,72 @@ int mbuf_to_flat(struct os_mbuf *om, uint16_t min_len, uint16_t max_len,
     return 0;
 }
 
+/**
+ * Appends the diagnostics page to the memory buffer of a read, a new page is built unless a long read continues
+ * @return 0 on success, otherwise the os_mbuf error code
+ */
+static int diag_snapshot_read(uint16_t conn_handle, struct os_mbuf *om) {
+    int64_t now = esp_timer_get_time();
+
+    // nimble removes the offset of a read blob request from the appended value, the callback does not get the offset
+    bool continued = diag_snapshot.offset > 0 && diag_snapshot.conn_handle == conn_handle &&
+                     now - diag_snapshot.time < DIAG_SNAPSHOT_TIMEOUT * 1000LL;
+
+    if (continued) {
+        int res = os_mbuf_append(om, diag_snapshot.data, diag_snapshot.length);
+        if (res != 0)
+            return res;
+    } else {
+        uint16_t start = OS_MBUF_PKTLEN(om);
+
+        int res = diag_read(om);
+        if (res != 0)
+            return res;
+
+        uint16_t length = OS_MBUF_PKTLEN(om) - start;
+
+        diag_snapshot.conn_handle = conn_handle;
+        diag_snapshot.length = length < DIAG_SNAPSHOT_SIZE ? length : DIAG_SNAPSHOT_SIZE;
+        diag_snapshot.offset = 0;
+
+        os_mbuf_copydata(om, start, diag_snapshot.length, diag_snapshot.data);
+    }
+
+    // Each read returns mtu - 1 bytes, the client continues while the chunks are full, up to an empty one at the end
+    diag_snapshot.offset += ble_att_mtu(conn_handle) - 1;
+    diag_snapshot.time = now;
+
+    if (diag_snapshot.offset > diag_snapshot.length)
+        diag_snapshot.offset = 0;
+
+    return 0;
+}
+
 static int gatt_characteristic_access_cb(uint16_t conn_handle, uint16_t attr_handle,
                                          struct ble_gatt_access_ctxt *context, void *arg) {
 
     const ble_uuid_t *uuid;
     int res;
 
-    ESP_LOGI(TAG, "Server access with op: %d", context->op);
+    // Reads of the trace page would fill the ring with their own accesses
+    if (attr_handle != diag_handle)
+        TRACE(TRACE_GATT_ACCESS, context->op, attr_handle, conn_handle);
+
+    TRACE_LOGI(TAG, "Server access with op: %d", context->op);
 
     switch (context->op) {
         case BLE_GATT_ACCESS_OP_READ_CHR:
             if (conn_handle != BLE_HS_CONN_HANDLE_NONE)
-                ESP_LOGI(TAG, "Characteristic read, conn_handle = %d attr_handle = %d", conn_handle, attr_handle);
+                TRACE_LOGI(TAG, "Characteristic read, conn_handle = %d attr_handle = %d", conn_handle, attr_handle);
             else
-                ESP_LOGI(TAG, "Characteristic read by NimBLE stack, attr_handle = %d", attr_handle);
+                TRACE_LOGI(TAG, "Characteristic read by NimBLE stack, attr_handle = %d", attr_handle);
 
             uuid = context->chr->uuid;
             // Read event for sensor value characteristic (tx handle)
             if (attr_handle == sensor_handle) {
-                // Fills the events memory buffer with sensor data
+                // Fills the events memory buffer with the frame notified last
+                sensor_handle_val_length = notify_latest(sensor_handle_val);
+
                 res = os_mbuf_append(context->om, sensor_handle_val, sensor_handle_val_length);
 
                 return res == 0 ? 0 : BLE_ATT_ERR_INSUFFICIENT_RES;
@@ -403,12 +721,19 @@ static int gatt_characteristic_access_cb(uint16_t conn_handle, uint16_t attr_han
                 return 0;
             }
 
+            // Read event for the diagnostics characteristic, returns the selected diagnostics page
+            if (attr_handle == diag_handle) {
+                res = diag_snapshot_read(conn_handle, context->om);
+
+                return res == 0 ? 0 : BLE_ATT_ERR_INSUFFICIENT_RES;
+            }
+
             goto unknown;
         case BLE_GATT_ACCESS_OP_WRITE_CHR:
             if (conn_handle != BLE_HS_CONN_HANDLE_NONE)
-                ESP_LOGI(TAG, "Characteristic write, conn_handle = %d attr_handle = %d", conn_handle, attr_handle);
+                TRACE_LOGI(TAG, "Characteristic write, conn_handle = %d attr_handle = %d", conn_handle, attr_handle);
             else
-                ESP_LOGI(TAG, "Characteristic write by NimBLE stack, attr_handle = %d", attr_handle);
+                TRACE_LOGI(TAG, "Characteristic write by NimBLE stack, attr_handle = %d", attr_handle);
 
             uuid = context->chr->uuid;
             // Write event for rx characteristic
@@ -421,7 +746,10 @@ static int gatt_characteristic_access_cb(uint16_t conn_handle, uint16_t attr_han
                 res = mbuf_to_flat(context->om, 1, sizeof(rx_handle_buf),
                                    rx_handle_buf, &len);
 
-                sole_receive_handler(rx_handle_buf, len);
+                TRACE(TRACE_GATT_WRITE, rx_handle_buf[0], len, 0);
+
+                if (res == 0)
+                    res = sole_receive_handler(rx_handle_buf, len);
 
 //                ble_gatts_chr_updated(rx_handle);
 //
@@ -436,16 +764,16 @@ static int gatt_characteristic_access_cb(uint16_t conn_handle, uint16_t attr_han
             goto unknown;
         case BLE_GATT_ACCESS_OP_READ_DSC:
             if (conn_handle != BLE_HS_CONN_HANDLE_NONE)
-                ESP_LOGI(TAG, "Descriptor read, conn_handle = %d attr_handle = %d", conn_handle, attr_handle);
+                TRACE_LOGI(TAG, "Descriptor read, conn_handle = %d attr_handle = %d", conn_handle, attr_handle);
             else
-                ESP_LOGI(TAG, "Descriptor read by NimBLE stack, attr_handle = %d", attr_handle);
+                TRACE_LOGI(TAG, "Descriptor read by NimBLE stack, attr_handle = %d", attr_handle);
 
             goto unknown;
         case BLE_GATT_ACCESS_OP_WRITE_DSC:
             if (conn_handle != BLE_HS_CONN_HANDLE_NONE)
-                ESP_LOGI(TAG, "Descriptor write, conn_handle = %d attr_handle = %d", conn_handle, attr_handle);
+                TRACE_LOGI(TAG, "Descriptor write, conn_handle = %d attr_handle = %d", conn_handle, attr_handle);
             else
-                ESP_LOGI(TAG, "Descriptor write by NimBLE stack, attr_handle = %d", attr_handle);
+                TRACE_LOGI(TAG, "Descriptor write by NimBLE stack, attr_handle = %d", attr_handle);
 
             goto unknown;
         default:
@@ -480,6 +808,13 @@ static const struct ble_gatt_svc_def gatt_srv_services[] = {
                 .val_handle = &sensor_handle,
                 .flags = BLE_GATT_CHR_F_NOTIFY
             },
+            {
+                .uuid = BLE_UUID128_DECLARE(0x9e, 0xca, 0xdc, 0x24, 0x0e, 0xe5, 0xa9, 0xe0, 0x93, 0xf3, 0xa3, 0xb5,
+                                            0x04, 0x00, 0x40, 0x6e),
+                .access_cb = gatt_characteristic_access_cb,
+                .val_handle = &diag_handle,
+                .flags = BLE_GATT_CHR_F_READ
+            },
             {
                 0
             }
@@ -525,6 +860,9 @@ int ble_host_set_device_name() {
 }
 
 int ble_host_init() {
+    pending_lock = xSemaphoreCreateMutexStatic(&pending_lock_buffer);
+    sensors_set_ready_handler(run_pending);
+
     ble_hs_cfg.reset_cb = ble_on_reset;
     ble_hs_cfg.sync_cb = ble_on_sync;
     ble_hs_cfg.gatts_register_cb = ble_gatt_service_register_cb;
@@ -533,6 +871,8 @@ int ble_host_init() {
     ble_svc_gap_init();
     ble_svc_gatt_init();
 
+    notify_init();
+
     int res = ble_gatts_count_cfg(gatt_srv_services);
     if (res != 0)
         return res * -1;
@@ -549,6 +889,7 @@ void ble_host_start() {
 }
 
 static void close_connection() {
-    sensors_stop_measurement_task();
-    sensors_stop_data_play_task();
+    sensors_stop_measurement();
+    sensors_stop_data_play();
+    sensors_stop_stream();
 }
\ No newline at end of file
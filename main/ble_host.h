@@ -1,10 +1,9 @@
 #ifndef AISOLE_BLE_HOST_H
 #define AISOLE_BLE_HOST_H
 
-extern uint8_t sensor_handle_val[64];
-extern uint8_t sensor_handle_val_length;
 extern uint16_t sensor_handle;
 extern uint16_t rx_handle;
+extern uint16_t diag_handle;
 
 //void ble_gatt_service_register_cb(struct ble_gatt_register_ctxt *context, void *arg);
 
@@ -25,4 +24,9 @@ int ble_host_init();
  */
 void ble_host_start();
 
+/**
+ * Updates the advertisement response data with the current summary, ignored until the host is synced
+ */
+void ble_host_update_advertising();
+
 #endif //AISOLE_BLE_HOST_H
@@ -0,0 +1,44 @@
+#include <string.h>
+#include <esp_timer.h>
+#include "esp_log.h"
+#include "host/ble_hs.h"
+#include "notify.h"
+#include "boot_profile.h"
+
+static const char *TAG = "boot_profile";
+
+static const char *phase_names[BOOT_PHASE_COUNT] = {
+    "pm", "nvs", "nimble", "advertising", "i2c", "sensors", "load"
+};
+
+typedef struct __attribute__((packed)) {
+    uint32_t begin;
+    uint32_t end;
+} boot_phase_time_t;
+
+static boot_phase_time_t phase_times[BOOT_PHASE_COUNT];
+
+void boot_profile_begin(BOOT_PHASE phase) {
+    phase_times[phase].begin = esp_timer_get_time();
+}
+
+void boot_profile_end(BOOT_PHASE phase) {
+    if (phase_times[phase].end != 0)
+        return;
+
+    phase_times[phase].end = esp_timer_get_time();
+
+    ESP_LOGI(TAG, "Boot phase %s took %lu us (done at %lu us)", phase_names[phase],
+             phase_times[phase].end - phase_times[phase].begin, phase_times[phase].end);
+}
+
+void boot_profile_notify() {
+    uint8_t frame[4 + sizeof(phase_times)] = {0}; // 4 + 7 * 8
+
+    memcpy((void *) frame + 4, (void *) phase_times, sizeof(phase_times));
+
+    frame[0] = BOOT_PHASE_COUNT;
+    frame[3] = 33;
+
+    notify_send(frame, sizeof(frame), NOTIFY_POLICY_LATEST);
+}
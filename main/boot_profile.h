@@ -0,0 +1,37 @@
+#include <stdint.h>
+
+#ifndef AISOLE_BOOT_PROFILE_H
+#define AISOLE_BOOT_PROFILE_H
+
+/**
+ * Phases of the startup, the sensor phases run concurrently to the ble phases
+ */
+typedef enum {
+    BOOT_PHASE_PM = 0,
+    BOOT_PHASE_NVS,
+    BOOT_PHASE_NIMBLE,
+    BOOT_PHASE_ADVERTISING,
+    BOOT_PHASE_I2C,
+    BOOT_PHASE_SENSORS,
+    BOOT_PHASE_LOAD,
+    BOOT_PHASE_COUNT
+} BOOT_PHASE;
+
+/**
+ * Stores the start timestamp of the given boot phase
+ * @param phase - The boot phase that started
+ */
+void boot_profile_begin(BOOT_PHASE phase);
+
+/**
+ * Stores the end timestamp of the given boot phase, only the first call per phase is recorded
+ * @param phase - The boot phase that finished
+ */
+void boot_profile_end(BOOT_PHASE phase);
+
+/**
+ * Notifies the device of the start and end timestamps of all boot phases in us since startup
+ */
+void boot_profile_notify();
+
+#endif //AISOLE_BOOT_PROFILE_H
@@ -0,0 +1,117 @@
+#include <string.h>
+#include "esp_log.h"
+#include "host/ble_hs.h"
+#include "energy.h"
+#include "trace.h"
+#include "notify.h"
+#include "power.h"
+#include "wear.h"
+#include "diagnostics.h"
+
+static const char *TAG = "diagnostics";
+
+static uint8_t selected_page = DIAG_PAGE_LATENCY;
+
+#if DIAG_ENABLED
+
+typedef struct __attribute__((packed)) {
+    uint32_t max;
+    uint32_t buckets[DIAG_HIST_BUCKETS];
+} diag_hist_t;
+
+static diag_hist_t histograms[DIAG_HIST_COUNT];
+static uint32_t counters[DIAG_COUNTER_COUNT];
+
+void diag_hist_add(DIAG_HIST hist, uint32_t cycles) {
+    uint32_t scaled = cycles >> DIAG_HIST_SHIFT;
+    int bucket = scaled == 0 ? 0 : 32 - __builtin_clz(scaled);
+
+    if (bucket >= DIAG_HIST_BUCKETS)
+        bucket = DIAG_HIST_BUCKETS - 1;
+
+    histograms[hist].buckets[bucket]++;
+
+    if (cycles > histograms[hist].max)
+        histograms[hist].max = cycles;
+}
+
+void diag_count(DIAG_COUNTER counter, uint32_t value) {
+    __atomic_fetch_add(&counters[counter], value, __ATOMIC_RELAXED);
+}
+
+/**
+ * Page layout: hist count, bucket count, shift, reserved, followed by max and buckets of every histogram
+ */
+static int diag_read_latency(struct os_mbuf *om) {
+    uint8_t header[4] = {DIAG_HIST_COUNT, DIAG_HIST_BUCKETS, DIAG_HIST_SHIFT, 0};
+
+    int res = os_mbuf_append(om, header, sizeof(header));
+    if (res != 0)
+        return res;
+
+    return os_mbuf_append(om, histograms, sizeof(histograms));
+}
+
+/**
+ * Page layout: counter count, 3 reserved, followed by the counters
+ */
+static int diag_read_counters(struct os_mbuf *om) {
+    uint8_t header[4] = {DIAG_COUNTER_COUNT, 0, 0, 0};
+
+    int res = os_mbuf_append(om, header, sizeof(header));
+    if (res != 0)
+        return res;
+
+    return os_mbuf_append(om, counters, sizeof(counters));
+}
+
+#endif
+
+int diag_select_page(uint8_t page) {
+    if (page >= DIAG_PAGE_COUNT) {
+        ESP_LOGW(TAG, "Diagnostics page %d does not exist", page);
+        return 0;
+    }
+
+    selected_page = page;
+
+    return 1;
+}
+
+void diag_reset() {
+#if DIAG_ENABLED
+    memset(histograms, 0, sizeof(histograms));
+    memset(counters, 0, sizeof(counters));
+#endif
+
+    energy_reset();
+    notify_reset();
+    power_reset();
+}
+
+int diag_read(struct os_mbuf *om) {
+    int res = os_mbuf_append(om, &selected_page, sizeof(selected_page));
+    if (res != 0)
+        return res;
+
+    switch (selected_page) {
+#if DIAG_ENABLED
+        case DIAG_PAGE_LATENCY:
+            return diag_read_latency(om);
+        case DIAG_PAGE_COUNTERS:
+            return diag_read_counters(om);
+#endif
+        case DIAG_PAGE_ENERGY:
+            return energy_read(om);
+        case DIAG_PAGE_TRACE:
+            return trace_read(om);
+        case DIAG_PAGE_NOTIFY:
+            return notify_read(om);
+        case DIAG_PAGE_POWER:
+            return power_read(om);
+        case DIAG_PAGE_WEAR:
+            return wear_read(om);
+        default:
+            return 0;
+    }
+}
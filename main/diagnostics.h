@@ -0,0 +1,118 @@
+#include <stdint.h>
+
+#ifndef AISOLE_DIAGNOSTICS_H
+#define AISOLE_DIAGNOSTICS_H
+
+// Set to 0 to compile out the hot path latency instrumentation
+#ifndef DIAG_ENABLED
+#define DIAG_ENABLED 1
+#endif
+
+#define DIAG_HIST_BUCKETS 16
+// Cycles of the first bucket as power of two, bucket n holds [2^(shift+n-1), 2^(shift+n)) cycles
+#define DIAG_HIST_SHIFT 8
+
+/**
+ * Pages of the diagnostics characteristic, selected with the G command
+ */
+typedef enum {
+    DIAG_PAGE_LATENCY = 0,
+    DIAG_PAGE_ENERGY,
+    DIAG_PAGE_TRACE,
+    DIAG_PAGE_COUNTERS,
+    DIAG_PAGE_NOTIFY,
+    DIAG_PAGE_POWER,
+    DIAG_PAGE_WEAR,
+    DIAG_PAGE_COUNT
+} DIAG_PAGE;
+
+/**
+ * Instrumented hot paths with a latency histogram each
+ */
+typedef enum {
+    DIAG_HIST_I2C_TRIGGER = 0,
+    DIAG_HIST_I2C_READ,
+    DIAG_HIST_FLASH_WRITE,
+    DIAG_HIST_NVS_COMMIT,
+    DIAG_HIST_NOTIFY,
+    DIAG_HIST_PLAY_READ,
+    DIAG_HIST_COUNT
+} DIAG_HIST;
+
+/**
+ * Counters of the storage and ble work, evaluated against baselines by tools/bench_report
+ */
+typedef enum {
+    DIAG_COUNTER_FLASH_WRITES = 0,
+    DIAG_COUNTER_FLASH_WRITE_BYTES,
+    DIAG_COUNTER_FLASH_ERASES,
+    DIAG_COUNTER_NVS_COMMITS,
+    DIAG_COUNTER_RECORDS,
+    DIAG_COUNTER_NOTIFICATIONS,         // Notifications passed to the host by the notify queue
+    DIAG_COUNTER_NOTIFY_BYTES,
+    DIAG_COUNTER_SAMPLES,
+    DIAG_COUNTER_SAMPLE_AWAKE_US,       // Awake time of the samples, without the conversion time
+    DIAG_COUNTER_DRAIN_RECORDS,         // Records of completed playbacks
+    DIAG_COUNTER_DRAIN_MS,              // Duration of completed playbacks
+    DIAG_COUNTER_FLASH_READS,
+    DIAG_COUNTER_FLASH_READ_US,
+    DIAG_COUNTER_PLAYED_RECORDS,
+    DIAG_COUNTER_STREAM_SAMPLES,
+    DIAG_COUNTER_STREAM_NOTIFICATIONS,
+    DIAG_COUNTER_STREAM_LATENCY_MS,     // Sum over the samples of the time from the sensor read to the notification
+    DIAG_COUNTER_COUNT
+} DIAG_COUNTER;
+
+#if DIAG_ENABLED
+
+#include <esp_cpu.h>
+
+#define DIAG_TIME_BEGIN(name) uint32_t name = esp_cpu_get_cycle_count()
+#define DIAG_TIME_END(hist, name) diag_hist_add(hist, esp_cpu_get_cycle_count() - (name))
+
+/**
+ * Adds a measured duration to the histogram
+ * @param hist - The histogram of the instrumented path
+ * @param cycles - The duration in cpu cycles
+ */
+void diag_hist_add(DIAG_HIST hist, uint32_t cycles);
+
+#define DIAG_COUNT(counter, value) diag_count(counter, value)
+
+/**
+ * Adds the value to the counter
+ * @param counter - The counter
+ * @param value - The value to add
+ */
+void diag_count(DIAG_COUNTER counter, uint32_t value);
+
+#else
+
+#define DIAG_TIME_BEGIN(name)
+#define DIAG_TIME_END(hist, name)
+#define DIAG_COUNT(counter, value)
+
+#endif
+
+struct os_mbuf;
+
+/**
+ * Selects the page returned by reading the diagnostics characteristic
+ * @param page - The page to select
+ * @return If the page exists
+ */
+int diag_select_page(uint8_t page);
+
+/**
+ * Resets all diagnostics counters and histograms
+ */
+void diag_reset();
+
+/**
+ * Appends the selected diagnostics page to the given memory buffer
+ * @param om - The memory buffer of the read access
+ * @return 0 on success, otherwise the os_mbuf error code
+ */
+int diag_read(struct os_mbuf *om);
+
+#endif //AISOLE_DIAGNOSTICS_H
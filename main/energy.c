@@ -0,0 +1,266 @@
+#include <string.h>
+#include <esp_timer.h>
+#include <esp_pm.h>
+#include <esp_private/esp_clk.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "esp_log.h"
+#include "host/ble_hs.h"
+#include "energy.h"
+
+static const char *TAG = "energy";
+
+typedef enum {
+    ENERGY_FREQ_80MHZ = 0,
+    ENERGY_FREQ_40MHZ,
+    ENERGY_FREQ_OTHER,
+    ENERGY_FREQ_COUNT
+} ENERGY_FREQ;
+
+/**
+ * Report of the energy page. Awake, sleep and frequency times are estimates: awake is the time in the instrumented
+ * windows, not the time the cpu was kept out of light sleep by the stack, and sleep is the rest of the elapsed time.
+ * busy_ms is measured as the time outside the idle task if the run time stats of FreeRTOS are enabled
+ */
+typedef struct __attribute__((packed)) {
+    uint32_t elapsed_ms;
+    uint32_t awake_ms;
+    uint32_t sleep_ms;
+    uint32_t freq_ms[ENERGY_FREQ_COUNT];
+    uint32_t subsystem_awake_ms[ENERGY_SUBSYSTEM_COUNT];
+    uint32_t subsystem_radio_ms[ENERGY_SUBSYSTEM_COUNT];
+    uint32_t charge_per_day_uah;
+    uint32_t busy_ms;               // UINT32_MAX without CONFIG_FREERTOS_GENERATE_RUN_TIME_STATS
+} energy_report_t;
+
+static portMUX_TYPE energy_lock = portMUX_INITIALIZER_UNLOCKED;
+
+static int64_t reset_time = 0;
+
+// Awake time is counted while at least one subsystem window is open
+static uint8_t active_count = 0;
+static int64_t awake_start = 0;
+static uint64_t awake_time = 0;
+// The frequency is sampled at every window start and end, the time in between is charged at the sampled frequency
+static int64_t freq_start = 0;
+static uint64_t freq_time[ENERGY_FREQ_COUNT];
+
+// Windows of a subsystem opened by different tasks overlap, the subsystem is awake until the last one ends
+static uint8_t subsystem_depth[ENERGY_SUBSYSTEM_COUNT];
+static int64_t subsystem_start[ENERGY_SUBSYSTEM_COUNT];
+static uint64_t subsystem_time[ENERGY_SUBSYSTEM_COUNT];
+
+#if CONFIG_FREERTOS_GENERATE_RUN_TIME_STATS
+// Run time of the idle task in us, a 32 bit counter wraps after 71 min (CONFIG_FREERTOS_RUN_TIME_COUNTER_TYPE_U64)
+static configRUN_TIME_COUNTER_TYPE idle_at_reset = 0;
+#endif
+static uint64_t radio_time[ENERGY_SUBSYSTEM_COUNT];
+
+static ENERGY_RADIO_STATE radio_state = ENERGY_RADIO_OFF;
+static uint32_t radio_interval = 0;
+static int64_t radio_state_start = 0;
+
+static ENERGY_FREQ current_freq() {
+    switch (esp_clk_cpu_freq()) {
+        case 80000000:
+            return ENERGY_FREQ_80MHZ;
+        case 40000000:
+            return ENERGY_FREQ_40MHZ;
+        default:
+            return ENERGY_FREQ_OTHER;
+    }
+}
+
+/**
+ * Estimated radio time of the connection or advertising events since the last radio state change
+ */
+static uint64_t radio_state_time(int64_t now) {
+    if (radio_state == ENERGY_RADIO_OFF || radio_interval == 0)
+        return 0;
+
+    uint64_t events = (now - radio_state_start) / (radio_interval * 1000ULL);
+
+    return events * (radio_state == ENERGY_RADIO_ADVERTISING ? ENERGY_RADIO_ADV_EVENT_US : ENERGY_RADIO_CONN_EVENT_US);
+}
+
+/**
+ * Charges the awake time since the last window start or end to the given frequency, called in the lock
+ */
+static void charge_freq(int64_t now, ENERGY_FREQ freq) {
+    if (active_count > 0)
+        freq_time[freq] += now - freq_start;
+
+    freq_start = now;
+}
+
+void energy_begin(ENERGY_SUBSYSTEM subsystem) {
+    int64_t now = esp_timer_get_time();
+    ENERGY_FREQ freq = current_freq();
+
+    portENTER_CRITICAL(&energy_lock);
+
+    if (subsystem_depth[subsystem]++ == 0) {
+        subsystem_start[subsystem] = now;
+
+        charge_freq(now, freq);
+
+        if (active_count++ == 0)
+            awake_start = now;
+    }
+
+    portEXIT_CRITICAL(&energy_lock);
+}
+
+void energy_end(ENERGY_SUBSYSTEM subsystem) {
+    int64_t now = esp_timer_get_time();
+    ENERGY_FREQ freq = current_freq();
+
+    portENTER_CRITICAL(&energy_lock);
+
+    if (subsystem_depth[subsystem] > 0 && --subsystem_depth[subsystem] == 0) {
+        subsystem_time[subsystem] += now - subsystem_start[subsystem];
+
+        charge_freq(now, freq);
+
+        if (--active_count == 0)
+            awake_time += now - awake_start;
+    }
+
+    portEXIT_CRITICAL(&energy_lock);
+}
+
+void energy_radio_packet(ENERGY_SUBSYSTEM subsystem, uint16_t length) {
+    portENTER_CRITICAL(&energy_lock);
+
+    radio_time[subsystem] += ENERGY_RADIO_PACKET_US + length * 8;
+
+    portEXIT_CRITICAL(&energy_lock);
+}
+
+void energy_radio_state(ENERGY_RADIO_STATE state, uint32_t interval_ms) {
+    int64_t now = esp_timer_get_time();
+
+    portENTER_CRITICAL(&energy_lock);
+
+    radio_time[ENERGY_SUBSYSTEM_BLE] += radio_state_time(now);
+
+    radio_state = state;
+    radio_interval = interval_ms;
+    radio_state_start = now;
+
+    portEXIT_CRITICAL(&energy_lock);
+}
+
+void energy_reset() {
+#if CONFIG_PM_PROFILING
+    // Measured time per power mode and the holders of the pm locks since the last reset
+    esp_pm_dump_locks(stdout);
+#endif
+
+    int64_t now = esp_timer_get_time();
+
+#if CONFIG_FREERTOS_GENERATE_RUN_TIME_STATS
+    configRUN_TIME_COUNTER_TYPE idle = ulTaskGetIdleRunTimeCounter();
+#endif
+
+    portENTER_CRITICAL(&energy_lock);
+
+#if CONFIG_FREERTOS_GENERATE_RUN_TIME_STATS
+    idle_at_reset = idle;
+#endif
+
+
+    reset_time = now;
+
+    awake_time = 0;
+    memset(freq_time, 0, sizeof(freq_time));
+    memset(subsystem_time, 0, sizeof(subsystem_time));
+    memset(radio_time, 0, sizeof(radio_time));
+
+    // Open windows continue from now on
+    awake_start = now;
+    freq_start = now;
+
+    for (int i = 0; i < ENERGY_SUBSYSTEM_COUNT; i++)
+        subsystem_start[i] = now;
+
+    radio_state_start = now;
+
+    portEXIT_CRITICAL(&energy_lock);
+}
+
+int energy_read(struct os_mbuf *om) {
+    energy_report_t report;
+    uint64_t radio_total = 0;
+    uint64_t awake;
+    uint64_t freq[ENERGY_FREQ_COUNT];
+
+    int64_t now = esp_timer_get_time();
+    ENERGY_FREQ current = current_freq();
+
+#if CONFIG_FREERTOS_GENERATE_RUN_TIME_STATS
+    configRUN_TIME_COUNTER_TYPE idle = ulTaskGetIdleRunTimeCounter();
+#endif
+
+    portENTER_CRITICAL(&energy_lock);
+
+    uint64_t elapsed = now - reset_time;
+
+    awake = awake_time;
+    memcpy(freq, freq_time, sizeof(freq));
+
+    // Open windows are counted up to now at the current frequency
+    if (active_count > 0) {
+        awake += now - awake_start;
+        freq[current] += now - freq_start;
+    }
+
+#if CONFIG_FREERTOS_GENERATE_RUN_TIME_STATS
+    // The run time counter of the idle task uses the esp_timer time base, light sleep is entered from the idle task
+    uint64_t idle_time = (configRUN_TIME_COUNTER_TYPE) (idle - idle_at_reset);
+
+    report.busy_ms = elapsed > idle_time ? (elapsed - idle_time) / 1000 : 0;
+#else
+    report.busy_ms = UINT32_MAX;
+#endif
+
+    for (int i = 0; i < ENERGY_SUBSYSTEM_COUNT; i++) {
+        uint64_t subsystem = subsystem_time[i];
+        if (subsystem_depth[i] > 0)
+            subsystem += now - subsystem_start[i];
+
+        uint64_t radio = radio_time[i];
+        if (i == ENERGY_SUBSYSTEM_BLE)
+            radio += radio_state_time(now);
+
+        report.subsystem_awake_ms[i] = subsystem / 1000;
+        report.subsystem_radio_ms[i] = radio / 1000;
+
+        radio_total += radio;
+    }
+
+    portEXIT_CRITICAL(&energy_lock);
+
+    uint64_t sleep = elapsed > awake ? elapsed - awake : 0;
+
+    report.elapsed_ms = elapsed / 1000;
+    report.awake_ms = awake / 1000;
+    report.sleep_ms = sleep / 1000;
+
+    for (int i = 0; i < ENERGY_FREQ_COUNT; i++)
+        report.freq_ms[i] = freq[i] / 1000;
+
+    // Charge in uA * us, divided by the elapsed time gives the average current
+    uint64_t charge = freq[ENERGY_FREQ_80MHZ] * ENERGY_CURRENT_ACTIVE_80MHZ +
+                      freq[ENERGY_FREQ_40MHZ] * ENERGY_CURRENT_ACTIVE_40MHZ +
+                      freq[ENERGY_FREQ_OTHER] * ENERGY_CURRENT_ACTIVE_80MHZ +
+                      sleep * ENERGY_CURRENT_LIGHT_SLEEP +
+                      radio_total * ENERGY_CURRENT_RADIO;
+
+    report.charge_per_day_uah = elapsed > 0 ? charge * 24 / elapsed : 0;
+
+    ESP_LOGD(TAG, "Awake %lu ms of %lu ms, estimated %lu uAh per day", report.awake_ms, report.elapsed_ms,
+             report.charge_per_day_uah);
+
+    return os_mbuf_append(om, &report, sizeof(report));
+}
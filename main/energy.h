@@ -0,0 +1,81 @@
+#include <stdint.h>
+
+#ifndef AISOLE_ENERGY_H
+#define AISOLE_ENERGY_H
+
+// Current model of the sole in uA, used to estimate the charge per day
+#define ENERGY_CURRENT_ACTIVE_80MHZ 17000
+#define ENERGY_CURRENT_ACTIVE_40MHZ 12000
+#define ENERGY_CURRENT_LIGHT_SLEEP 150
+// Additional current while the radio is transmitting or receiving
+#define ENERGY_CURRENT_RADIO 15000
+
+// Estimated radio time of a single advertising or connection event in us (3 channels resp. one packet exchange)
+#define ENERGY_RADIO_ADV_EVENT_US 1500
+#define ENERGY_RADIO_CONN_EVENT_US 400
+// Estimated radio overhead of a notification in us, the payload adds 8 us per byte at 1 Mbit/s
+#define ENERGY_RADIO_PACKET_US 150
+
+/**
+ * Subsystems the awake and radio time is accounted for
+ */
+typedef enum {
+    ENERGY_SUBSYSTEM_SAMPLING = 0,
+    ENERGY_SUBSYSTEM_STORAGE,
+    ENERGY_SUBSYSTEM_BLE,
+    ENERGY_SUBSYSTEM_COUNT
+} ENERGY_SUBSYSTEM;
+
+/**
+ * State of the radio, the connection and advertising events are estimated from the interval
+ */
+typedef enum {
+    ENERGY_RADIO_OFF = 0,
+    ENERGY_RADIO_ADVERTISING,
+    ENERGY_RADIO_CONNECTED
+} ENERGY_RADIO_STATE;
+
+/**
+ * Starts an awake window of the given subsystem, windows may overlap and nest, also those of one subsystem opened by
+ * different tasks
+ * @param subsystem - The subsystem keeping the cpu awake
+ */
+void energy_begin(ENERGY_SUBSYSTEM subsystem);
+
+/**
+ * Ends the awake window of the given subsystem
+ * @param subsystem - The subsystem keeping the cpu awake
+ */
+void energy_end(ENERGY_SUBSYSTEM subsystem);
+
+/**
+ * Accounts a sent packet to the radio time of the given subsystem
+ * @param subsystem - The subsystem the packet was sent for
+ * @param length - The payload length in bytes
+ */
+void energy_radio_packet(ENERGY_SUBSYSTEM subsystem, uint16_t length);
+
+/**
+ * Sets the current radio state, the time in the previous state is accounted to the ble subsystem
+ * @param state - The new radio state
+ * @param interval_ms - The advertising or connection interval of the new state
+ */
+void energy_radio_state(ENERGY_RADIO_STATE state, uint32_t interval_ms);
+
+/**
+ * Resets all energy counters. With CONFIG_PM_PROFILING the measured time per power mode and the holders of the pm
+ * locks since the last reset are dumped to the log before
+ */
+void energy_reset();
+
+struct os_mbuf;
+
+/**
+ * Appends the energy report to the given memory buffer. Awake, sleep and charge are estimated from the instrumented
+ * windows, only the busy time is measured (with CONFIG_FREERTOS_GENERATE_RUN_TIME_STATS)
+ * @param om - The memory buffer of the read access
+ * @return 0 on success, otherwise the os_mbuf error code
+ */
+int energy_read(struct os_mbuf *om);
+
+#endif //AISOLE_ENERGY_H
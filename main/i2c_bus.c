@@ -0,0 +1,165 @@
+#include <esp_timer.h>
+#include <esp_rom_sys.h>
+#include "esp_log.h"
+#include "driver/i2c.h"
+#include "trace.h"
+#include "i2c_bus.h"
+
+#if I2C_REPLAY
+#include "i2c_replay_data.h"
+#endif
+
+// Timeout of a single transaction
+#define I2C_BUS_TIMEOUT 2
+
+static const char *TAG = "i2c_bus";
+
+static bool capture = false;
+
+// Transactions not matching the capture of the replay
+static uint32_t replay_mismatches = 0;
+
+#if I2C_REPLAY
+
+static size_t replay_index = 0;
+
+static esp_err_t result_to_err(uint8_t result) {
+    switch (result) {
+        case I2C_RESULT_OK:
+            return ESP_OK;
+        case I2C_RESULT_NACK:
+            return ESP_FAIL;
+        case I2C_RESULT_TIMEOUT:
+            return ESP_ERR_TIMEOUT;
+        case I2C_RESULT_INVALID_STATE:
+            return ESP_ERR_INVALID_STATE;
+        default:
+            return ESP_ERR_INVALID_ARG;
+    }
+}
+
+/**
+ * Answers a transaction with the next captured one, the capture is repeated after its end. A transaction differing
+ * from the captured one in kind, address or the first bytes written fails and the replay stays at the captured one,
+ * so a capture starting at a sampling cycle lines up with the next cycle after the boot
+ */
+static esp_err_t replay(bool read, uint8_t device_address, const uint8_t *write_buf, uint8_t write_len,
+                        uint8_t *read_buf, uint8_t read_len) {
+    const size_t count = sizeof(i2c_replay_entries) / sizeof(i2c_replay_entries[0]);
+    const i2c_replay_entry_t *entry = &i2c_replay_entries[replay_index];
+
+    bool match = entry->read == read && entry->address == device_address;
+
+    // The data of a captured write are the bytes written, of a read the bytes read
+    for (uint8_t i = 0; match && !read && i < write_len && i < sizeof(entry->data); i++)
+        match = entry->data[i] == write_buf[i];
+
+    if (!match) {
+        replay_mismatches++;
+
+        ESP_LOGE(TAG, "Replay entry %u (%s of 0x%02x, data %02x %02x) does not match the %s of 0x%02x", replay_index,
+                 entry->read ? "read" : "write", entry->address, entry->data[0], entry->data[1],
+                 read ? "read" : "write", device_address);
+
+        return ESP_ERR_INVALID_RESPONSE;
+    }
+
+    replay_index = (replay_index + 1) % count;
+
+    esp_rom_delay_us(entry->duration);
+
+    for (uint8_t i = 0; read && i < read_len && i < sizeof(entry->data); i++)
+        read_buf[i] = entry->data[i];
+
+    return result_to_err(entry->result);
+}
+
+#endif
+
+static uint8_t err_to_result(esp_err_t res) {
+    switch (res) {
+        case ESP_OK:
+            return I2C_RESULT_OK;
+        case ESP_FAIL:
+            return I2C_RESULT_NACK;
+        case ESP_ERR_TIMEOUT:
+            return I2C_RESULT_TIMEOUT;
+        case ESP_ERR_INVALID_STATE:
+            return I2C_RESULT_INVALID_STATE;
+        default:
+            return I2C_RESULT_OTHER;
+    }
+}
+
+/**
+ * Records a transaction in the trace ring.
+ * arg0: address, arg1: first two bytes (msb first), arg2: result | write length << 8 | read length << 12 | duration
+ * in us << 16
+ */
+static void capture_transaction(TRACE_EVENT event, uint8_t device_address, const uint8_t *data, uint8_t length,
+                                uint8_t write_len, uint8_t read_len, esp_err_t res, int64_t duration) {
+    uint16_t bytes = 0;
+
+    if (length > 0)
+        bytes = data[0] << 8;
+    if (length > 1)
+        bytes |= data[1];
+
+    if (duration > UINT16_MAX)
+        duration = UINT16_MAX;
+
+    TRACE(event, device_address, bytes,
+          err_to_result(res) | (write_len & 0x0f) << 8 | (read_len & 0x0f) << 12 | (uint32_t) duration << 16);
+}
+
+esp_err_t read_from_device(uint8_t device_address, const uint8_t *write_buf, uint8_t write_len, uint8_t *read_buf,
+                           uint8_t read_len) {
+#if I2C_REPLAY
+    return replay(true, device_address, write_buf, write_len, read_buf, read_len);
+#else
+    int64_t start = capture ? esp_timer_get_time() : 0;
+
+    esp_err_t res = i2c_master_write_read_device(I2C_NUM_0, device_address,
+                                                 write_buf, write_len,
+                                                 read_buf, read_len,
+                                                 pdMS_TO_TICKS(I2C_BUS_TIMEOUT));
+
+    if (capture)
+        capture_transaction(TRACE_I2C_READ, device_address, read_buf, read_len, write_len, read_len, res,
+                            esp_timer_get_time() - start);
+
+    return res;
+#endif
+}
+
+esp_err_t write_to_device(uint8_t device_address, const uint8_t *write_buf, uint8_t write_len) {
+#if I2C_REPLAY
+    return replay(false, device_address, write_buf, write_len, NULL, 0);
+#else
+    int64_t start = capture ? esp_timer_get_time() : 0;
+
+    esp_err_t res = i2c_master_write_to_device(I2C_NUM_0, device_address,
+                                               write_buf, write_len,
+                                               pdMS_TO_TICKS(I2C_BUS_TIMEOUT));
+
+    if (capture)
+        capture_transaction(TRACE_I2C_WRITE, device_address, write_buf, write_len, write_len, 0, res,
+                            esp_timer_get_time() - start);
+
+    return res;
+#endif
+}
+
+void i2c_bus_capture(bool enable) {
+    capture = enable;
+
+    ESP_LOGI(TAG, "I2C capture %s", enable ? "enabled" : "disabled");
+}
+
+bool i2c_bus_capturing() {
+    return capture;
+}
+
+uint32_t i2c_bus_replay_mismatches() {
+    return replay_mismatches;
+}
@@ -0,0 +1,101 @@
+#include <stdint.h>
+#include <stdbool.h>
+
+#ifndef AISOLE_I2C_BUS_H
+#define AISOLE_I2C_BUS_H
+
+// Set to 1 to answer the bus transactions from a capture instead of the sensors (main/i2c_replay_data.h, generated
+// with tools/trace_decode -g), so the sampling runs on a devkit without the sole
+#ifndef I2C_REPLAY
+#define I2C_REPLAY 0
+#endif
+
+/**
+ * Results of a captured transaction
+ */
+typedef enum {
+    I2C_RESULT_OK = 0,
+    I2C_RESULT_NACK,
+    I2C_RESULT_TIMEOUT,
+    I2C_RESULT_INVALID_STATE,
+    I2C_RESULT_OTHER
+} I2C_RESULT;
+
+/**
+ * A captured transaction as replayed by the I2C_REPLAY backend
+ */
+typedef struct {
+    uint8_t read;           // Write followed by a read, otherwise a write
+    uint8_t address;        // 7 bit address
+    uint8_t result;         // I2C_RESULT
+    uint16_t duration;      // us
+    uint8_t data[2];        // First bytes read
+} i2c_replay_entry_t;
+
+#ifdef ESP_PLATFORM
+
+#include <esp_err.h>
+
+/**
+ * @brief Perform a write followed by a read to a device on the I2C bus.
+ *        A repeated start signal is used between the `write` and `read`, thus, the bus is
+ *        not released until the two transactions are finished.
+ *        This function is a wrapper to 'i2c_master_write_read_device'
+ *        It shall only be called in I2C master mode.
+ *
+ * @param device_address I2C device's 7-bit address
+ * @param write_buf Bytes to send on the bus
+ * @param write_len Length, in bytes, of the write buffer
+ * @param read_buf Buffer to store the bytes received on the bus
+ * @param read_len Length, in bytes, of the read buffer
+ *
+ * @return
+ *     - ESP_OK Success
+ *     - ESP_ERR_INVALID_ARG Parameter error
+ *     - ESP_FAIL Sending command error, slave hasn't ACK the transfer.
+ *     - ESP_ERR_INVALID_STATE I2C driver not installed or not in master mode.
+ *     - ESP_ERR_TIMEOUT Operation timeout because the bus is busy.
+ */
+esp_err_t read_from_device(uint8_t device_address, const uint8_t *write_buf, uint8_t write_len, uint8_t *read_buf,
+                           uint8_t read_len);
+
+/**
+ * @brief Perform a write to a device connected to a particular I2C port.
+ *        This function is a wrapper to 'i2c_master_write_to_device'
+ *        It shall only be called in I2C master mode.
+ *
+ * @param device_address I2C device's 7-bit address
+ * @param write_buf Bytes to send on the bus
+ * @param write_len Length, in bytes, of the write buffer
+ *
+ * @return
+ *     - ESP_OK Success
+ *     - ESP_ERR_INVALID_ARG Parameter error
+ *     - ESP_FAIL Sending command error, slave hasn't ACK the transfer.
+ *     - ESP_ERR_INVALID_STATE I2C driver not installed or not in master mode.
+ *     - ESP_ERR_TIMEOUT Operation timeout because the bus is busy.
+ */
+esp_err_t write_to_device(uint8_t device_address, const uint8_t *write_buf, uint8_t write_len);
+
+/**
+ * Enables the capture of every bus transaction into the trace ring (TRACE_I2C_WRITE, TRACE_I2C_READ).\n
+ * A sample of all 31 sensors takes 63 transactions, so the ring of TRACE_RING_SIZE entries holds the last 4 samples.
+ * While streaming every 100 ms that is 400 ms, older transactions are overwritten unless the trace pages are read
+ * faster
+ * @param enable - If transactions are captured
+ */
+void i2c_bus_capture(bool enable);
+
+/**
+ * @return If bus transactions are captured into the trace ring
+ */
+bool i2c_bus_capturing();
+
+/**
+ * @return The transactions that failed as they did not match the capture of the I2C_REPLAY backend, 0 without it
+ */
+uint32_t i2c_bus_replay_mismatches();
+
+#endif
+
+#endif //AISOLE_I2C_BUS_H
@@ -8,12 +8,19 @@
 #include "services/gap/ble_svc_gap.h"
 #include "ble_host.h"
 #include "sensors.h"
+#include "boot_profile.h"
+#include "power.h"
 
 static const char *TAG = "ai-sole";
 
 void app_main() {
+    // Does not return while recording in deep sleep, except for the periodic full boot
+    sensors_handle_deep_sleep_wake();
+
     ESP_LOGI(TAG, "Starting...");
 
+    boot_profile_begin(BOOT_PHASE_PM);
+
     esp_pm_config_t pm_config = {
         .max_freq_mhz = 80,
         .min_freq_mhz = 40,
@@ -23,22 +30,17 @@ void app_main() {
     int res = esp_pm_configure(&pm_config);
     assert(res == 0);
 
-    vTaskDelay(pdMS_TO_TICKS(10));
+    // Sampling, flash writes and transfers lock the maximum frequency and keep the cpu awake while running
+    power_init();
 
     int freq = esp_clk_cpu_freq();
 
     ESP_LOGI(TAG, "Current cpu frequency is: %d", freq);
 
-    res = sensors_i2c_init();
-    if (res != 0) {
-        ESP_LOGE(TAG, "i2c init returned error %d", res);
-        return;
-    } else {
-        ESP_LOGI(TAG, "i2c init successful");
-    }
-
-    sensors_init_all();
+    boot_profile_end(BOOT_PHASE_PM);
+    boot_profile_begin(BOOT_PHASE_NVS);
 
+    // nvs is needed by the sensor data and the ble controller (phy calibration, bonds), so it is initialized first
     res = nvs_flash_init();
     if (res != 0) {
         ESP_LOGE(TAG, "flash init returned error %d", res);
@@ -47,9 +49,12 @@ void app_main() {
         ESP_LOGI(TAG, "flash init successful");
     }
 
-    sensors_load_data();
+    boot_profile_end(BOOT_PHASE_NVS);
+
+    // Sensor probing and loading of the stored data do not delay advertising
+    sensors_start_service_task();
 
-    ESP_LOGI(TAG, "loaded sensors data from flash");
+    boot_profile_begin(BOOT_PHASE_NIMBLE);
 
     res = nimble_port_init();
     if (res != 0) {
@@ -72,5 +77,13 @@ void app_main() {
 
     ESP_LOGI(TAG, "ble gap device name set successful");
 
+    boot_profile_end(BOOT_PHASE_NIMBLE);
+    boot_profile_begin(BOOT_PHASE_ADVERTISING);
+
     ble_host_start();
-}
\ No newline at end of file
+
+    if (sensors_deep_sleep_active()) {
+        ESP_LOGI(TAG, "Woke up from deep sleep recording, advertising before returning to deep sleep");
+        sensors_deep_sleep_schedule();
+    }
+}
@@ -0,0 +1,381 @@
+#include <string.h>
+#include <esp_timer.h>
+#include "esp_log.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+#include "host/ble_hs.h"
+#include "sdkconfig.h"
+#include "ble_host.h"
+#include "diagnostics.h"
+#include "energy.h"
+#include "sensors.h"
+#include "notify.h"
+
+#define NOTIFY_CONNECTIONS CONFIG_BT_NIMBLE_MAX_CONNECTIONS
+
+static const char *TAG = "notify";
+
+typedef struct {
+    uint8_t length;
+    uint8_t data[NOTIFY_FRAME_SIZE];
+} notify_frame_t;
+
+/**
+ * Outgoing ring of frames of a single connection
+ */
+typedef struct {
+    uint16_t conn_handle;
+    bool subscribed;
+    uint8_t head;
+    uint8_t count;
+    notify_frame_t frames[NOTIFY_QUEUE_LENGTH];
+} notify_queue_t;
+
+static notify_queue_t queues[NOTIFY_CONNECTIONS];
+static notify_stats_t stats;
+
+// Value of the sensor characteristic returned to reads, the frame passed last to notify_send
+static notify_frame_t latest;
+
+// Guards the queues and the statistics, held while frames are passed to the host
+static StaticSemaphore_t queue_lock_buffer;
+static SemaphoreHandle_t queue_lock = NULL;
+
+// Given whenever frames left a queue, wakes producers of the block policy
+static StaticSemaphore_t space_semaphore_buffer;
+static SemaphoreHandle_t space_semaphore = NULL;
+
+static esp_timer_handle_t retry_timer = NULL;
+
+static void retry_timer_cb(void *arg);
+
+void notify_init() {
+    queue_lock = xSemaphoreCreateMutexStatic(&queue_lock_buffer);
+    space_semaphore = xSemaphoreCreateBinaryStatic(&space_semaphore_buffer);
+
+    const esp_timer_create_args_t args = {
+        .callback = retry_timer_cb,
+        .name = "notify_retry"
+    };
+
+    if (esp_timer_create(&args, &retry_timer) != ESP_OK)
+        ESP_LOGE(TAG, "Creating the notify retry timer failed");
+
+    for (int i = 0; i < NOTIFY_CONNECTIONS; i++)
+        queues[i].conn_handle = BLE_HS_CONN_HANDLE_NONE;
+
+    notify_reset();
+}
+
+static notify_queue_t *queue_find(uint16_t conn_handle) {
+    for (int i = 0; i < NOTIFY_CONNECTIONS; i++) {
+        if (queues[i].conn_handle == conn_handle)
+            return &queues[i];
+    }
+
+    return NULL;
+}
+
+static void queue_clear(notify_queue_t *queue) {
+    stats.dropped += queue->count;
+
+    queue->head = 0;
+    queue->count = 0;
+}
+
+static void retry_schedule() {
+    if (retry_timer && !esp_timer_is_active(retry_timer))
+        esp_timer_start_once(retry_timer, NOTIFY_RETRY_INTERVAL * 1000ULL);
+}
+
+/**
+ * @return The subsystem the radio time of the frame is accounted to, by its data flag
+ */
+static ENERGY_SUBSYSTEM frame_subsystem(const notify_frame_t *frame) {
+    switch (frame->data[3]) {
+        case 11:
+        case 13:
+        case SENSOR_DATA_LIVE_FINE:
+            return ENERGY_SUBSYSTEM_SAMPLING;
+        case 12:
+        case SENSOR_DATA_PLAY_FINE:
+            return ENERGY_SUBSYSTEM_STORAGE;
+        default:
+            return ENERGY_SUBSYSTEM_BLE;
+    }
+}
+
+/**
+ * Passes the queued frames of the connection to the host until the mbuf pool runs low, the rest is sent by the retry
+ * timer. The queue lock has to be held
+ */
+static void queue_drain(notify_queue_t *queue) {
+    bool sent = false;
+
+    while (queue->count > 0) {
+        notify_frame_t *frame = &queue->frames[queue->head];
+
+        int free_blocks = os_msys_num_free();
+        if (free_blocks < stats.mbuf_low_water)
+            stats.mbuf_low_water = free_blocks;
+
+        struct os_mbuf *om = NULL;
+        if (free_blocks > NOTIFY_MBUF_RESERVE)
+            om = ble_hs_mbuf_from_flat(frame->data, frame->length);
+
+        // The host consumes the mbuf also on failure, the frame stays queued for the retry
+        int res = om ? ble_gatts_notify_custom(queue->conn_handle, sensor_handle, om) : BLE_HS_ENOMEM;
+
+        if (res == BLE_HS_ENOMEM) {
+            stats.mbuf_deferred++;
+            retry_schedule();
+            break;
+        }
+
+        if (res == 0) {
+            stats.sent++;
+
+            // Only frames passed to the host reach the air, not those without subscriber, replaced or dropped
+            energy_radio_packet(frame_subsystem(frame), frame->length);
+
+            DIAG_COUNT(DIAG_COUNTER_NOTIFICATIONS, 1);
+            DIAG_COUNT(DIAG_COUNTER_NOTIFY_BYTES, frame->length);
+        } else {
+            ESP_LOGW(TAG, "Notification to connection %d failed with code %d", queue->conn_handle, res);
+            stats.failed++;
+        }
+
+        queue->head = (queue->head + 1) % NOTIFY_QUEUE_LENGTH;
+        queue->count--;
+        sent = true;
+    }
+
+    if (sent)
+        xSemaphoreGive(space_semaphore);
+}
+
+static void drain_all() {
+    for (int i = 0; i < NOTIFY_CONNECTIONS; i++) {
+        if (queues[i].subscribed)
+            queue_drain(&queues[i]);
+    }
+}
+
+static void retry_timer_cb(void *arg) {
+    xSemaphoreTake(queue_lock, portMAX_DELAY);
+
+    drain_all();
+
+    xSemaphoreGive(queue_lock);
+}
+
+/**
+ * @return If the queue of any subscribed connection is full
+ */
+static bool queues_full() {
+    for (int i = 0; i < NOTIFY_CONNECTIONS; i++) {
+        if (queues[i].subscribed && queues[i].count >= NOTIFY_QUEUE_LENGTH)
+            return true;
+    }
+
+    return false;
+}
+
+/**
+ * Waits up to NOTIFY_BLOCK_TIMEOUT until the queues of all subscribed connections have space. The queue lock has to be
+ * held, it is released while waiting
+ * @return If all queues have space
+ */
+static bool wait_space() {
+    if (!queues_full())
+        return true;
+
+    TickType_t start = xTaskGetTickCount();
+    TickType_t timeout = pdMS_TO_TICKS(NOTIFY_BLOCK_TIMEOUT);
+
+    stats.blocked++;
+
+    while (queues_full()) {
+        xSemaphoreGive(queue_lock);
+
+        TickType_t waited = xTaskGetTickCount() - start;
+        bool woken = waited < timeout && xSemaphoreTake(space_semaphore, timeout - waited) == pdTRUE;
+
+        xSemaphoreTake(queue_lock, portMAX_DELAY);
+
+        if (!woken)
+            break;
+    }
+
+    stats.blocked_ms += pdTICKS_TO_MS(xTaskGetTickCount() - start);
+
+    return !queues_full();
+}
+
+/**
+ * Queues the frame, a frame of the latest policy replaces a queued frame of the same data flag
+ * @return If the frame was queued
+ */
+static bool queue_push(notify_queue_t *queue, const uint8_t *frame, uint8_t length, NOTIFY_POLICY policy) {
+    if (policy == NOTIFY_POLICY_LATEST) {
+        for (int i = 0; i < queue->count; i++) {
+            notify_frame_t *queued = &queue->frames[(queue->head + i) % NOTIFY_QUEUE_LENGTH];
+
+            if (queued->data[3] != frame[3])
+                continue;
+
+            memcpy(queued->data, frame, length);
+            queued->length = length;
+
+            stats.coalesced++;
+
+            return true;
+        }
+    }
+
+    if (queue->count >= NOTIFY_QUEUE_LENGTH) {
+        stats.dropped++;
+        return false;
+    }
+
+    notify_frame_t *queued = &queue->frames[(queue->head + queue->count) % NOTIFY_QUEUE_LENGTH];
+
+    memcpy(queued->data, frame, length);
+    queued->length = length;
+
+    queue->count++;
+
+    if (queue->count > stats.queue_high_water)
+        stats.queue_high_water = queue->count;
+
+    return true;
+}
+
+bool notify_send(const uint8_t *frame, uint8_t length, NOTIFY_POLICY policy) {
+    if (length > NOTIFY_FRAME_SIZE || length < 4)
+        return false;
+
+    xSemaphoreTake(queue_lock, portMAX_DELAY);
+
+    // Frees space for frames the retry timer did not send yet
+    drain_all();
+
+    // Not queued at all if the wait times out, so the producer can send the frame again without duplicates
+    if (policy == NOTIFY_POLICY_BLOCK && !wait_space()) {
+        stats.dropped++;
+        xSemaphoreGive(queue_lock);
+        return false;
+    }
+
+    memcpy(latest.data, frame, length);
+    latest.length = length;
+
+    bool queued = true;
+
+    for (int i = 0; i < NOTIFY_CONNECTIONS; i++) {
+        if (!queues[i].subscribed)
+            continue;
+
+        queued &= queue_push(&queues[i], frame, length, policy);
+        queue_drain(&queues[i]);
+    }
+
+    xSemaphoreGive(queue_lock);
+
+    return queued;
+}
+
+bool notify_wait_space() {
+    xSemaphoreTake(queue_lock, portMAX_DELAY);
+
+    drain_all();
+
+    bool space = wait_space();
+
+    xSemaphoreGive(queue_lock);
+
+    return space;
+}
+
+void notify_subscribe(uint16_t conn_handle, bool enabled) {
+    xSemaphoreTake(queue_lock, portMAX_DELAY);
+
+    notify_queue_t *queue = queue_find(conn_handle);
+
+    if (!queue && enabled)
+        queue = queue_find(BLE_HS_CONN_HANDLE_NONE);
+
+    if (queue) {
+        if (!enabled)
+            queue_clear(queue);
+
+        queue->conn_handle = conn_handle;
+        queue->subscribed = enabled;
+    } else if (enabled) {
+        ESP_LOGW(TAG, "No notify queue left for connection %d", conn_handle);
+    }
+
+    xSemaphoreGive(queue_lock);
+
+    // A blocked producer stops waiting for the unsubscribed connection
+    xSemaphoreGive(space_semaphore);
+}
+
+void notify_disconnect(uint16_t conn_handle) {
+    xSemaphoreTake(queue_lock, portMAX_DELAY);
+
+    notify_queue_t *queue = queue_find(conn_handle);
+
+    if (queue) {
+        queue_clear(queue);
+
+        queue->conn_handle = BLE_HS_CONN_HANDLE_NONE;
+        queue->subscribed = false;
+    }
+
+    xSemaphoreGive(queue_lock);
+
+    xSemaphoreGive(space_semaphore);
+}
+
+void notify_reset() {
+    if (queue_lock)
+        xSemaphoreTake(queue_lock, portMAX_DELAY);
+
+    memset(&stats, 0, sizeof(stats));
+
+    stats.queue_length = NOTIFY_QUEUE_LENGTH;
+    stats.mbuf_count = os_msys_count();
+    stats.mbuf_low_water = os_msys_num_free();
+
+    for (int i = 0; i < NOTIFY_CONNECTIONS; i++) {
+        if (queues[i].count > stats.queue_high_water)
+            stats.queue_high_water = queues[i].count;
+    }
+
+    if (queue_lock)
+        xSemaphoreGive(queue_lock);
+}
+
+uint8_t notify_latest(uint8_t *frame) {
+    xSemaphoreTake(queue_lock, portMAX_DELAY);
+
+    uint8_t length = latest.length;
+    memcpy(frame, latest.data, length);
+
+    xSemaphoreGive(queue_lock);
+
+    return length;
+}
+
+int notify_read(struct os_mbuf *om) {
+    notify_stats_t current;
+
+    xSemaphoreTake(queue_lock, portMAX_DELAY);
+
+    current = stats;
+
+    xSemaphoreGive(queue_lock);
+
+    return os_mbuf_append(om, &current, sizeof(current));
+}
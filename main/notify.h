@@ -0,0 +1,99 @@
+#include <stdint.h>
+#include <stdbool.h>
+
+#ifndef AISOLE_NOTIFY_H
+#define AISOLE_NOTIFY_H
+
+// Frames queued per connection before the policy applies
+#define NOTIFY_QUEUE_LENGTH 8
+#define NOTIFY_FRAME_SIZE 64
+// Free mbuf blocks left for the acl headers and incoming att requests, sending is deferred below
+#define NOTIFY_MBUF_RESERVE 2
+// Interval of the retry after the mbuf pool was exhausted in ms
+#define NOTIFY_RETRY_INTERVAL 20
+// Maximum time a producer of the block policy waits for space in the queues in ms
+#define NOTIFY_BLOCK_TIMEOUT 1000
+
+/**
+ * Handling of a frame if the outgoing queue of a connection is full
+ */
+typedef enum {
+    NOTIFY_POLICY_LATEST = 0,       // Replaces a queued frame of the same data flag, dropped if the queue is full
+    NOTIFY_POLICY_BLOCK,            // Waits for space in the queues of all subscribed connections
+    NOTIFY_POLICY_QUEUE             // Queued if there is space, dropped otherwise, never replaced
+} NOTIFY_POLICY;
+
+/**
+ * Statistics of the notify diagnostics page, 32 bytes little endian
+ */
+typedef struct __attribute__((packed)) notify_stats {
+    uint32_t sent;
+    uint32_t coalesced;             // Queued frames replaced by a newer frame of the same data flag
+    uint32_t dropped;
+    uint32_t failed;                // Frames rejected by the host for other reasons than the mbuf pool
+    uint32_t mbuf_deferred;         // Send attempts deferred as the mbuf pool was exhausted
+    uint32_t blocked;               // Frames of the block policy that waited for space
+    uint32_t blocked_ms;
+    uint8_t queue_length;
+    uint8_t queue_high_water;
+    uint8_t mbuf_count;
+    uint8_t mbuf_low_water;         // Lowest count of free mbuf blocks seen before a send
+} notify_stats_t;
+
+/**
+ * Creates the queue lock and the retry timer, has to be called before the first notification
+ */
+void notify_init();
+
+/**
+ * Queues the frame for all connections subscribed to the sensor characteristic and sends as much as the mbuf pool
+ * allows. Frames of the block policy must not be sent from the nimble host task
+ * @param frame - The frame, byte 3 holds the data flag
+ * @param length - The length of the frame, at most NOTIFY_FRAME_SIZE
+ * @param policy - The handling of the frame if a queue is full
+ * @return If the frame was queued for all subscribed connections
+ */
+bool notify_send(const uint8_t *frame, uint8_t length, NOTIFY_POLICY policy);
+
+/**
+ * Waits up to NOTIFY_BLOCK_TIMEOUT until every subscribed connection can queue a frame, so a producer of the block
+ * policy can wait before it starts its transfer window. Must not be called from the nimble host task
+ * @return If all queues have space
+ */
+bool notify_wait_space();
+
+/**
+ * Copies the frame passed last to notify_send, returned to reads of the sensor characteristic
+ * @param frame - Filled with the frame, NOTIFY_FRAME_SIZE bytes
+ * @return The length of the frame, 0 if none was sent yet
+ */
+uint8_t notify_latest(uint8_t *frame);
+
+/**
+ * Updates the subscription of a connection to the sensor characteristic, the queue is cleared on unsubscribe
+ * @param conn_handle - The connection
+ * @param enabled - If notifications are enabled
+ */
+void notify_subscribe(uint16_t conn_handle, bool enabled);
+
+/**
+ * Releases the queue of a closed connection, frames still queued are counted as dropped
+ * @param conn_handle - The connection
+ */
+void notify_disconnect(uint16_t conn_handle);
+
+/**
+ * Resets the statistics, the high-water and low-water marks start from the current state
+ */
+void notify_reset();
+
+struct os_mbuf;
+
+/**
+ * Appends the notify statistics to the given memory buffer
+ * @param om - The memory buffer of the read access
+ * @return 0 on success, otherwise the os_mbuf error code
+ */
+int notify_read(struct os_mbuf *om);
+
+#endif //AISOLE_NOTIFY_H
@@ -0,0 +1,131 @@
+#include <string.h>
+#include <esp_attr.h>
+#include <esp_private/esp_clk.h>
+#include "esp_log.h"
+#include "freertos/FreeRTOS.h"
+#include "notify.h"
+#include "phase.h"
+
+#define PHASE_MAGIC 0x50484153
+
+static const char *TAG = "phase";
+
+/**
+ * Alignment retained in rtc memory, the rtc timer is the local clock as it continues over deep sleep
+ */
+typedef struct {
+    uint32_t magic;
+    phase_t phase;
+    uint32_t next_slot;         // The slot following the one taken last, 0 if none was taken
+} phase_state_t;
+
+static RTC_DATA_ATTR phase_state_t phase_state;
+
+static portMUX_TYPE phase_lock = portMUX_INITIALIZER_UNLOCKED;
+
+static bool phase_aligned() {
+    return phase_state.magic == PHASE_MAGIC && phase_state.phase.pair_id != PHASE_PAIR_NONE;
+}
+
+void phase_set(uint16_t pair_id, uint32_t epoch, uint32_t interval, int64_t wall) {
+    int64_t local = esp_clk_rtc_time();
+
+    portENTER_CRITICAL(&phase_lock);
+
+    // The drift estimate is kept over a new pairing, it only depends on the clocks
+    if (phase_state.magic != PHASE_MAGIC) {
+        memset(&phase_state, 0, sizeof(phase_state));
+        phase_state.magic = PHASE_MAGIC;
+    }
+
+    phase_t *phase = &phase_state.phase;
+
+    if (pair_id == 0) {
+        phase->pair_id = PHASE_PAIR_NONE;
+    } else {
+        if (interval < PHASE_MIN_INTERVAL)
+            interval = PHASE_MIN_INTERVAL;
+
+        if (phase->pair_id != pair_id || phase->epoch != epoch || phase->interval != interval)
+            phase_state.next_slot = 0;
+
+        phase->pair_id = pair_id;
+        phase->epoch = epoch;
+        phase->interval = interval;
+
+        phase_align(phase, local, wall);
+    }
+
+    portEXIT_CRITICAL(&phase_lock);
+
+    if (pair_id == 0) {
+        ESP_LOGI(TAG, "Alignment ended");
+    } else {
+        ESP_LOGI(TAG, "Aligned pair %u to epoch %lu every %lu ms, error %ld ms, drift %ld ppm", pair_id, epoch,
+                 interval, phase->error_ms, phase->drift_ppm);
+    }
+}
+
+uint16_t phase_pair_id() {
+    return phase_aligned() ? phase_state.phase.pair_id : PHASE_PAIR_NONE;
+}
+
+int64_t phase_schedule() {
+    if (!phase_aligned())
+        return -1;
+
+    int64_t local = esp_clk_rtc_time();
+    uint32_t slot;
+
+    portENTER_CRITICAL(&phase_lock);
+
+    int64_t slot_local = phase_next_slot(&phase_state.phase, local, phase_state.next_slot, &slot);
+    phase_state.next_slot = slot + 1;
+
+    portEXIT_CRITICAL(&phase_lock);
+
+    return slot_local > local ? slot_local - local : 0;
+}
+
+int64_t phase_reschedule() {
+    if (!phase_aligned())
+        return -1;
+
+    if (phase_state.next_slot == 0)
+        return phase_schedule();
+
+    int64_t local = esp_clk_rtc_time();
+
+    portENTER_CRITICAL(&phase_lock);
+
+    int64_t slot_local = phase_slot_local(&phase_state.phase, phase_state.next_slot - 1);
+
+    portEXIT_CRITICAL(&phase_lock);
+
+    // A slot due by the corrected clock is sampled late rather than skipped
+    return slot_local > local ? slot_local - local : 0;
+}
+
+void phase_notify() {
+    phase_status_t status = {0};
+
+    portENTER_CRITICAL(&phase_lock);
+
+    if (phase_state.magic == PHASE_MAGIC) {
+        status.slot = phase_state.next_slot;
+        status.pair_id = phase_state.phase.pair_id;
+        status.epoch = phase_state.phase.epoch;
+        status.interval = phase_state.phase.interval;
+        status.drift_ppm = phase_state.phase.drift_ppm;
+        status.error_ms = phase_state.phase.error_ms;
+        status.alignments = phase_state.phase.alignments;
+    } else {
+        status.pair_id = PHASE_PAIR_NONE;
+    }
+
+    portEXIT_CRITICAL(&phase_lock);
+
+    status.data_flag = 34;
+
+    notify_send((const uint8_t *) &status, sizeof(status), NOTIFY_POLICY_LATEST);
+}
@@ -0,0 +1,169 @@
+#include <stdint.h>
+#include <stdbool.h>
+
+#ifndef AISOLE_PHASE_H
+#define AISOLE_PHASE_H
+
+/*
+ * Phase alignment of the left and right sole. The app sends both soles the same epoch, interval and pair id together
+ * with its wall clock, each sole then samples at the wall clock times epoch + n * interval as seen by its own clock.
+ * The drift of the local clock to the app is estimated between two alignments. The scheduling is host-safe, the
+ * simulation in tools/ runs it for two soles with drifting clocks
+ */
+
+// Pair id of records sampled without alignment, the erased value of the block header
+#define PHASE_PAIR_NONE 0xffff
+// Shortest aligned interval in ms, records keep the time in seconds
+#define PHASE_MIN_INTERVAL 1000
+// Local time spanned by a drift estimate in ms, long enough that the latency of the commands is negligible
+#define PHASE_MIN_DRIFT_INTERVAL 1800000
+// Shorter span of the first drift estimate, the clocks run apart without any
+#define PHASE_FIRST_DRIFT_INTERVAL 300000
+// Drift estimates above are rejected, the app changed its wall clock in between
+#define PHASE_MAX_DRIFT_PPM 50000
+
+/**
+ * Alignment of the local clock to the wall clock of the app
+ */
+typedef struct {
+    uint16_t pair_id;
+    uint32_t epoch;             // Wall clock time of slot 0 in s
+    uint32_t interval;          // Time between two slots in ms
+    int64_t local_ref;          // Local clock at the latest alignment in us
+    int64_t wall_ref;           // Wall clock of the app at the latest alignment in ms
+    int64_t drift_local;        // Reference of the next drift estimate, local clock in us
+    int64_t drift_wall;         // and wall clock in ms
+    int32_t drift_ppm;          // Deviation of the local clock from the wall clock, positive if the local clock is slow
+    int32_t error_ms;           // Predicted minus received wall clock at the latest alignment
+    uint32_t alignments;
+    uint32_t drift_estimates;
+} phase_t;
+
+/**
+ * Alignment state notified with data flag 34, 26 bytes little endian
+ */
+typedef struct __attribute__((packed)) phase_status {
+    uint32_t slot: 24;          // The next slot to sample
+    uint32_t data_flag: 8;
+    uint16_t pair_id;
+    uint32_t epoch;
+    uint32_t interval;
+    int32_t drift_ppm;
+    int32_t error_ms;
+    uint32_t alignments;
+} phase_status_t;
+
+/**
+ * @return The wall clock in ms at the given local clock in us
+ */
+static inline int64_t phase_local_to_wall(const phase_t *phase, int64_t local) {
+    int64_t elapsed = local - phase->local_ref;
+
+    return phase->wall_ref + (elapsed + elapsed * phase->drift_ppm / 1000000) / 1000;
+}
+
+/**
+ * @return The local clock in us at the given wall clock in ms
+ */
+static inline int64_t phase_wall_to_local(const phase_t *phase, int64_t wall) {
+    int64_t elapsed = (wall - phase->wall_ref) * 1000;
+
+    return phase->local_ref + elapsed * 1000000 / (1000000 + phase->drift_ppm);
+}
+
+/**
+ * @return The local clock in us at the wall clock of the slot
+ */
+static inline int64_t phase_slot_local(const phase_t *phase, uint32_t slot) {
+    return phase_wall_to_local(phase, (int64_t) phase->epoch * 1000 + (int64_t) slot * phase->interval);
+}
+
+/**
+ * Finds the first slot at or after the local clock, slots before the epoch are skipped
+ * @param phase - The alignment
+ * @param local - The local clock in us
+ * @param min_slot - Slots below are skipped, so a slot is sampled once even if the clock is corrected backwards
+ * @param slot - Filled with the number of the slot
+ * @return The local clock of the slot in us
+ */
+static inline int64_t phase_next_slot(const phase_t *phase, int64_t local, uint32_t min_slot, uint32_t *slot) {
+    int64_t offset = phase_local_to_wall(phase, local) - (int64_t) phase->epoch * 1000;
+    int64_t next = offset > 0 ? (offset + phase->interval - 1) / phase->interval : 0;
+
+    *slot = next > min_slot ? next : min_slot;
+
+    return phase_slot_local(phase, *slot);
+}
+
+/**
+ * Moves the alignment to a wall clock received from the app, the drift is estimated once enough time passed
+ * @param phase - The alignment
+ * @param local - The local clock in us when the wall clock was received
+ * @param wall - The wall clock of the app in ms
+ */
+static inline void phase_align(phase_t *phase, int64_t local, int64_t wall) {
+    if (phase->alignments == 0) {
+        phase->drift_local = local;
+        phase->drift_wall = wall;
+        phase->error_ms = 0;
+    } else {
+        phase->error_ms = phase_local_to_wall(phase, local) - wall;
+    }
+
+    int64_t elapsed = local - phase->drift_local;
+    int64_t span = phase->drift_estimates > 0 ? PHASE_MIN_DRIFT_INTERVAL : PHASE_FIRST_DRIFT_INTERVAL;
+
+    if (phase->alignments > 0 && elapsed >= span * 1000) {
+        int64_t measured = ((wall - phase->drift_wall) * 1000 - elapsed) * 1000000 / elapsed;
+
+        if (measured <= PHASE_MAX_DRIFT_PPM && measured >= -PHASE_MAX_DRIFT_PPM) {
+            phase->drift_ppm = measured;
+            phase->drift_estimates++;
+        }
+
+        phase->drift_local = local;
+        phase->drift_wall = wall;
+    }
+
+    phase->local_ref = local;
+    phase->wall_ref = wall;
+    phase->alignments++;
+}
+
+#ifdef ESP_PLATFORM
+
+/**
+ * Aligns the sampling to the epoch and interval distributed by the app, kept over deep sleep
+ * @param pair_id - The pair of the soles, 0 ends the alignment
+ * @param epoch - The wall clock time of slot 0 in s
+ * @param interval - The time between two samples in ms, at least PHASE_MIN_INTERVAL
+ * @param wall - The wall clock of the app when sending the command in ms
+ */
+void phase_set(uint16_t pair_id, uint32_t epoch, uint32_t interval, int64_t wall);
+
+/**
+ * @return The pair id of the alignment, PHASE_PAIR_NONE if not aligned
+ */
+uint16_t phase_pair_id();
+
+/**
+ * Takes the next slot to sample, each slot is returned once
+ * @return The time until the slot in us, 0 if it is due, negative if not aligned
+ */
+int64_t phase_schedule();
+
+/**
+ * Corrects the schedule of the slot taken last by the current alignment, takes the next slot if the epoch, interval
+ * or pair changed
+ * @return The time until the slot in us, 0 if it is due, negative if not aligned
+ */
+int64_t phase_reschedule();
+
+/**
+ * Notifies the device of the alignment state
+ */
+void phase_notify();
+
+#endif
+
+#endif //AISOLE_PHASE_H
@@ -0,0 +1,119 @@
+#include <string.h>
+#include <esp_pm.h>
+#include <esp_timer.h>
+#include "freertos/FreeRTOS.h"
+#include "esp_log.h"
+#include "host/ble_hs.h"
+#include "power.h"
+
+static const char *TAG = "power";
+
+static const char *activity_names[POWER_ACTIVITY_COUNT] = {"sampling", "flash", "transfer"};
+
+static portMUX_TYPE power_lock = portMUX_INITIALIZER_UNLOCKED;
+
+// The pm locks count their acquisitions, so nested windows take them again
+static esp_pm_lock_handle_t freq_locks[POWER_ACTIVITY_COUNT];
+static esp_pm_lock_handle_t sleep_locks[POWER_ACTIVITY_COUNT];
+
+static int64_t reset_time = 0;
+
+static uint8_t depth[POWER_ACTIVITY_COUNT];
+static int64_t hold_start[POWER_ACTIVITY_COUNT];
+static uint32_t hold_count[POWER_ACTIVITY_COUNT];
+static uint64_t hold_time[POWER_ACTIVITY_COUNT];
+static uint32_t hold_max[POWER_ACTIVITY_COUNT];
+
+void power_init() {
+    for (int i = 0; i < POWER_ACTIVITY_COUNT; i++) {
+        esp_err_t res = esp_pm_lock_create(ESP_PM_CPU_FREQ_MAX, 0, activity_names[i], &freq_locks[i]);
+
+        if (res == ESP_OK)
+            res = esp_pm_lock_create(ESP_PM_NO_LIGHT_SLEEP, 0, activity_names[i], &sleep_locks[i]);
+
+        if (res != ESP_OK) {
+            ESP_LOGW(TAG, "Creating the %s locks failed, reason %s", activity_names[i], esp_err_to_name(res));
+            return;
+        }
+    }
+}
+
+void power_begin(POWER_ACTIVITY activity) {
+    // Raises the frequency before the window is timed, the switch is part of the idle time
+    if (freq_locks[activity] && sleep_locks[activity]) {
+        esp_pm_lock_acquire(freq_locks[activity]);
+        esp_pm_lock_acquire(sleep_locks[activity]);
+    }
+
+    int64_t now = esp_timer_get_time();
+
+    portENTER_CRITICAL(&power_lock);
+
+    if (depth[activity]++ == 0)
+        hold_start[activity] = now;
+
+    portEXIT_CRITICAL(&power_lock);
+}
+
+void power_end(POWER_ACTIVITY activity) {
+    int64_t now = esp_timer_get_time();
+
+    portENTER_CRITICAL(&power_lock);
+
+    if (depth[activity] > 0 && --depth[activity] == 0) {
+        uint64_t hold = now - hold_start[activity];
+
+        hold_count[activity]++;
+        hold_time[activity] += hold;
+
+        if (hold > hold_max[activity])
+            hold_max[activity] = hold > UINT32_MAX ? UINT32_MAX : hold;
+    }
+
+    portEXIT_CRITICAL(&power_lock);
+
+    if (freq_locks[activity] && sleep_locks[activity]) {
+        esp_pm_lock_release(sleep_locks[activity]);
+        esp_pm_lock_release(freq_locks[activity]);
+    }
+}
+
+void power_reset() {
+    int64_t now = esp_timer_get_time();
+
+    portENTER_CRITICAL(&power_lock);
+
+    reset_time = now;
+
+    memset(hold_count, 0, sizeof(hold_count));
+    memset(hold_time, 0, sizeof(hold_time));
+    memset(hold_max, 0, sizeof(hold_max));
+
+    // Open windows continue from now on
+    for (int i = 0; i < POWER_ACTIVITY_COUNT; i++) {
+        if (depth[i] > 0)
+            hold_start[i] = now;
+    }
+
+    portEXIT_CRITICAL(&power_lock);
+}
+
+int power_read(struct os_mbuf *om) {
+    power_report_t report;
+
+    int64_t now = esp_timer_get_time();
+
+    portENTER_CRITICAL(&power_lock);
+
+    report.elapsed_ms = (now - reset_time) / 1000;
+
+    for (int i = 0; i < POWER_ACTIVITY_COUNT; i++) {
+        report.holds[i].count = hold_count[i];
+        report.holds[i].total_ms = hold_time[i] / 1000;
+        report.holds[i].max_us = hold_max[i];
+    }
+
+    portEXIT_CRITICAL(&power_lock);
+
+    return os_mbuf_append(om, &report, sizeof(report));
+}
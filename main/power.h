@@ -0,0 +1,64 @@
+#include <stdint.h>
+
+#ifndef AISOLE_POWER_H
+#define AISOLE_POWER_H
+
+/**
+ * Activities holding the cpu at the maximum frequency and blocking light sleep while active
+ */
+typedef enum {
+    POWER_ACTIVITY_SAMPLING = 0,        // i2c trigger and read bursts, not the conversion wait
+    POWER_ACTIVITY_FLASH,               // Record writes and the nvs commit
+    POWER_ACTIVITY_TRANSFER,            // Playback steps and notified frames
+    POWER_ACTIVITY_COUNT
+} POWER_ACTIVITY;
+
+/**
+ * Lock holds of an activity
+ */
+typedef struct __attribute__((packed)) power_hold {
+    uint32_t count;
+    uint32_t total_ms;
+    uint32_t max_us;
+} power_hold_t;
+
+/**
+ * Report of the power diagnostics page, 40 bytes little endian
+ */
+typedef struct __attribute__((packed)) power_report {
+    uint32_t elapsed_ms;
+    power_hold_t holds[POWER_ACTIVITY_COUNT];
+} power_report_t;
+
+/**
+ * Creates the pm locks, has to be called after esp_pm_configure. Windows before are counted without holding locks
+ */
+void power_init();
+
+/**
+ * Locks the cpu at the maximum frequency and blocks light sleep, windows of an activity may nest
+ * @param activity - The activity keeping the cpu busy
+ */
+void power_begin(POWER_ACTIVITY activity);
+
+/**
+ * Releases the locks of the window started last by power_begin
+ * @param activity - The activity keeping the cpu busy
+ */
+void power_end(POWER_ACTIVITY activity);
+
+/**
+ * Resets the hold counters
+ */
+void power_reset();
+
+struct os_mbuf;
+
+/**
+ * Appends the power report to the given memory buffer
+ * @param om - The memory buffer of the read access
+ * @return 0 on success, otherwise the os_mbuf error code
+ */
+int power_read(struct os_mbuf *om);
+
+#endif //AISOLE_POWER_H
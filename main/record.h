@@ -0,0 +1,216 @@
+#include <stdint.h>
+#include <stddef.h>
+
+#ifndef AISOLE_RECORD_H
+#define AISOLE_RECORD_H
+
+/*
+ * Layout of the sensor records in nvs_ext, shared with the host tools in tools/.
+ * The store is a sequence of flash sectors (blocks), each starting with a block header followed by fixed size
+ * records. Firmware versions before the block store wrote flat 35 byte records (time + values) without header.
+ * Raw and legacy records hold the wall clock time, relative records an offset to the monotonic time base of their
+ * block, the wall clock time is mapped by the sync entries of the firmware timebase.
+ * Fine records are relative records that additionally keep 3 fraction bits per value, packed behind the values
+ */
+
+#define RECORD_BLOCK_SIZE 4096
+#define RECORD_BLOCK_MAGIC 0x5353
+#define RECORD_SENSORS 31
+#define RECORD_LEGACY_SIZE 35
+// Bits below the 0.5 °C step of the values kept by fine records, 0.0625 °C resolution
+#define RECORD_FRACTION_BITS 3
+#define RECORD_FRACTIONS_SIZE ((RECORD_SENSORS * RECORD_FRACTION_BITS + 7) / 8)
+// Value of a sensor the record did not sample, stored records of a stream only hold the selected sensors. 127.5 °C
+// is out of the range of the sensors in the sole, a failed read is stored as 0
+#define RECORD_VALUE_NONE 0xff
+
+/**
+ * Formats of the records in a block, every record ends with the crc8 of its previous bytes
+ */
+typedef enum {
+    RECORD_FORMAT_LEGACY = 0,
+    RECORD_FORMAT_RAW,
+    RECORD_FORMAT_RELATIVE,
+    RECORD_FORMAT_FINE
+} RECORD_FORMAT;
+
+typedef struct __attribute__((packed)) record_block_header {
+    uint16_t magic;
+    uint8_t format;
+    uint8_t record_size;
+    uint32_t first_counter;     // Data counter of the first record in the block
+    uint32_t time_base;         // Monotonic time of relative records in seconds, erased (0xffffffff) for raw records
+    uint16_t pair_id;           // Pair of phase aligned soles the records were sampled for, erased (0xffff) if none
+    uint16_t crc;               // crc16 of the previous bytes
+} record_block_header_t;
+
+typedef struct __attribute__((packed)) record_raw {
+    uint32_t time;
+    uint8_t values[RECORD_SENSORS];  // 7.1 fixed point temperatures
+    uint8_t crc;                     // crc8 of the previous bytes
+} record_raw_t;
+
+typedef struct __attribute__((packed)) record_relative {
+    uint16_t time_offset;            // Seconds since the time base of the block
+    uint8_t values[RECORD_SENSORS];  // 7.1 fixed point temperatures
+    uint8_t crc;                     // crc8 of the previous bytes
+} record_relative_t;
+
+typedef struct __attribute__((packed)) record_fine {
+    uint16_t time_offset;            // Seconds since the time base of the block
+    uint8_t values[RECORD_SENSORS];  // 7.1 fixed point temperatures
+    uint8_t fractions[RECORD_FRACTIONS_SIZE];   // Packed fraction bits, little endian bit order
+    uint8_t crc;                     // crc8 of the previous bytes
+} record_fine_t;
+
+#define RECORD_BLOCK_CAPACITY(record_size) ((RECORD_BLOCK_SIZE - sizeof(record_block_header_t)) / (record_size))
+
+#ifdef ESP_PLATFORM
+
+#include <esp_rom_crc.h>
+
+#define record_crc8(data, length) esp_rom_crc8_le(0, (const uint8_t *) (data), length)
+#define record_crc16(data, length) esp_rom_crc16_le(0, (const uint8_t *) (data), length)
+
+#else
+
+/**
+ * Bitwise equivalent of the esp rom crc8_le (polynomial 0x07, reflected, inverted)
+ */
+static inline uint8_t record_crc8(const void *data, size_t length) {
+    const uint8_t *bytes = data;
+    uint8_t crc = 0xff;
+
+    for (size_t i = 0; i < length; i++) {
+        crc ^= bytes[i];
+
+        for (int bit = 0; bit < 8; bit++)
+            crc = crc & 1 ? (crc >> 1) ^ 0xe0 : crc >> 1;
+    }
+
+    return ~crc;
+}
+
+/**
+ * Bitwise equivalent of the esp rom crc16_le (polynomial 0x1021, reflected, inverted)
+ */
+static inline uint16_t record_crc16(const void *data, size_t length) {
+    const uint8_t *bytes = data;
+    uint16_t crc = 0xffff;
+
+    for (size_t i = 0; i < length; i++) {
+        crc ^= bytes[i];
+
+        for (int bit = 0; bit < 8; bit++)
+            crc = crc & 1 ? (crc >> 1) ^ 0x8408 : crc >> 1;
+    }
+
+    return ~crc;
+}
+
+#endif
+
+/**
+ * @return If all bytes are erased (0xff)
+ */
+static inline int record_is_erased(const void *data, size_t length) {
+    const uint8_t *bytes = data;
+
+    for (size_t i = 0; i < length; i++) {
+        if (bytes[i] != 0xff)
+            return 0;
+    }
+
+    return 1;
+}
+
+/**
+ * @return If the block header is complete and valid
+ */
+static inline int record_block_header_valid(const record_block_header_t *header) {
+    return header->magic == RECORD_BLOCK_MAGIC && header->record_size > 0 &&
+           header->crc == record_crc16(header, offsetof(record_block_header_t, crc));
+}
+
+/**
+ * @return If the record of a block is written completely, legacy records have no crc
+ */
+static inline int record_valid(const uint8_t *record, uint8_t record_size) {
+    return !record_is_erased(record, record_size) &&
+           record[record_size - 1] == record_crc8(record, record_size - 1);
+}
+
+/**
+ * @return The address of the record following the one at the given address, skips the padding at the block end
+ */
+static inline uint32_t record_next_slot(uint32_t address, uint8_t record_size) {
+    address += record_size;
+
+    uint32_t offset = address % RECORD_BLOCK_SIZE;
+    if (offset != 0 && offset + record_size > RECORD_BLOCK_SIZE)
+        address += RECORD_BLOCK_SIZE - offset;
+
+    return address;
+}
+
+/**
+ * @return The monotonic time of a relative record, the wall clock time of a raw or legacy record
+ */
+static inline uint32_t record_time(uint8_t format, uint32_t time_base, const uint8_t *record) {
+    if (format == RECORD_FORMAT_RELATIVE || format == RECORD_FORMAT_FINE)
+        return time_base + ((const record_relative_t *) record)->time_offset;
+
+    return ((const record_raw_t *) record)->time;
+}
+
+/**
+ * @return The 7.1 fixed point temperatures of the record
+ */
+static inline const uint8_t *record_values(uint8_t format, const uint8_t *record) {
+    if (format == RECORD_FORMAT_RELATIVE || format == RECORD_FORMAT_FINE)
+        return ((const record_relative_t *) record)->values;
+
+    return ((const record_raw_t *) record)->values;
+}
+
+/**
+ * @param fractions - The packed fraction bits
+ * @param sensor - The index of the value
+ * @return The fraction bits of the value in 1/16 °C
+ */
+static inline uint8_t record_fraction_get(const uint8_t *fractions, int sensor) {
+    int bit = sensor * RECORD_FRACTION_BITS;
+    uint16_t bits = fractions[bit / 8];
+
+    if (bit % 8 + RECORD_FRACTION_BITS > 8)
+        bits |= fractions[bit / 8 + 1] << 8;
+
+    return (bits >> (bit % 8)) & ((1 << RECORD_FRACTION_BITS) - 1);
+}
+
+/**
+ * Sets the fraction bits of a value, the packed bits have to be cleared before
+ */
+static inline void record_fraction_set(uint8_t *fractions, int sensor, uint8_t fraction) {
+    int bit = sensor * RECORD_FRACTION_BITS;
+    uint16_t bits = (fraction & ((1 << RECORD_FRACTION_BITS) - 1)) << (bit % 8);
+
+    fractions[bit / 8] |= bits;
+
+    if (bit % 8 + RECORD_FRACTION_BITS > 8)
+        fractions[bit / 8 + 1] |= bits >> 8;
+}
+
+/**
+ * @return The temperature of a value in 1/16 °C, records without fraction bits are at 0.5 °C steps
+ */
+static inline uint16_t record_value_fine(uint8_t format, const uint8_t *record, int sensor) {
+    uint16_t value = record_values(format, record)[sensor] << RECORD_FRACTION_BITS;
+
+    if (format == RECORD_FORMAT_FINE)
+        value |= record_fraction_get(((const record_fine_t *) record)->fractions, sensor);
+
+    return value;
+}
+
+#endif //AISOLE_RECORD_H
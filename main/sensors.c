@@ -2,14 +2,28 @@
 #include <sys/time.h>
 #include <string.h>
 #include <esp_bt.h>
+#include <esp_attr.h>
+#include <esp_sleep.h>
+#include <esp_timer.h>
+#include <esp_private/esp_clk.h>
 #include "esp_log.h"
+#include "freertos/event_groups.h"
 #include "driver/i2c.h"
 #include "host/ble_hs.h"
 #include "host/ble_uuid.h"
-#include "esp_partition.h"
-#include "nvs.h"
-#include "ble_host.h"
+#include "notify.h"
 #include "sensors.h"
+#include "store.h"
+#include "record.h"
+#include "i2c_bus.h"
+#include "timebase.h"
+#include "phase.h"
+#include "summary.h"
+#include "boot_profile.h"
+#include "diagnostics.h"
+#include "energy.h"
+#include "power.h"
+#include "trace.h"
 
 #define SDA_IO_NUM 6
 #define SCL_IO_NUM 7
@@ -17,15 +31,40 @@
 
 #define DATA_VALUE_INTERVAL 60000
 #define PLAY_DATA_INTERVAL 2000
+// Time of a one-shot conversion of the max31725 sensors
+#define CONVERSION_TIME 50
+
+// Fastest stream interval, the one-shot conversion and reading all 31 sensors take about 80 ms
+#define STREAM_MIN_INTERVAL 100
+#define STREAM_MAX_DURATION 1800
+// Payload of a notification at the preferred mtu
+#define STREAM_PAYLOAD_SIZE (NOTIFY_FRAME_SIZE - 3)
+// Samples of a storing stream written to flash at once, and the time between the nvs commits of the write position
+#define STREAM_STAGED_RECORDS 10
+#define STREAM_COMMIT_INTERVAL 60000
+
+#define SENSORS_SERVICE_STACK_SIZE 3072
+#define SENSORS_EVENT_QUEUE_LENGTH 8
+// Maximum time a caller waits for space in the event queue
+#define SENSORS_EVENT_TIMEOUT 100
+
+#define SENSORS_READY_BIT 0x01
+
+// Changed with the layout of the retained state
+#define DEEP_SLEEP_MAGIC 0x44534c51
+// Records kept in rtc memory before they are written to flash in one go
+#define DEEP_SLEEP_STAGED_RECORDS 8
+// Every n-th wake-up the full firmware is started to allow the app to connect
+#define DEEP_SLEEP_FULL_BOOT_INTERVAL 60
+// Time the sole advertises after a full boot before going back to deep sleep
+#define DEEP_SLEEP_ADVERTISE_WINDOW 30000
 
 static const char *TAG = "Sensors";
 
-static const char *DATA_COUNT_KEY = "data_count";
-static const char *ADDRESS_OFFSET_KEY = "address_offset";
-
-static uint32_t data_counter = 0;
 static uint32_t play_counter = 0;
-static uint32_t address_offset = 0;
+
+// Samples keep the fraction bits, set by the ble host
+static bool fine_resolution = false;
 
 // max31725 sensors i2c addresses in the sole
 // sensor u1 is not used
@@ -40,66 +79,124 @@ uint8_t sensor_address[MAX_SENSORS] = {
     0xbc, 0xbe, 0xae, 0xac, 0xb8, 0xba, 0xaa, 0xa8
 };
 
-uint8_t i2c_wbuf[2];
-uint8_t i2c_rbuf[2];
-uint8_t tx_buf[CONFIG_BT_NIMBLE_ATT_PREFERRED_MTU];
+/**
+ * Events handled by the sensor service task
+ */
+typedef enum {
+    SENSORS_EVENT_START_MEASUREMENT = 0,
+    SENSORS_EVENT_STOP_MEASUREMENT,
+    SENSORS_EVENT_START_DATA_PLAY,
+    SENSORS_EVENT_STOP_DATA_PLAY,
+    SENSORS_EVENT_CLEAR_DATA,
+    SENSORS_EVENT_DEEP_SLEEP,
+    SENSORS_EVENT_START_STREAM,
+    SENSORS_EVENT_STOP_STREAM,
+    SENSORS_EVENT_ALIGN
+} SENSORS_EVENT;
+
+/**
+ * States of the sensor service task, sampling, playback and streaming are exclusive
+ */
+typedef enum {
+    SENSORS_STATE_IDLE = 0,
+    SENSORS_STATE_MEASURING,
+    SENSORS_STATE_PLAYING,
+    SENSORS_STATE_STREAMING
+} SENSORS_STATE;
+
+static StackType_t service_stack[SENSORS_SERVICE_STACK_SIZE];
+static StaticTask_t service_task_buffer;
+
+static uint8_t event_queue_storage[SENSORS_EVENT_QUEUE_LENGTH * sizeof(SENSORS_EVENT)];
+static StaticQueue_t event_queue_buffer;
+static QueueHandle_t event_queue = NULL;
+
+static StaticEventGroup_t ready_event_group_buffer;
+static EventGroupHandle_t ready_event_group = NULL;
+static void (*ready_handler)() = NULL;
 
-TaskHandle_t sensor_task = NULL;
-TaskHandle_t data_play_task = NULL;
+static SENSORS_STATE service_state = SENSORS_STATE_IDLE;
+// Tick of the next sample or playback step
+static TickType_t next_step;
 
-_Noreturn static void read_sensor_loop();
+static store_reader_t play_reader;
+static store_read_buffer_t play_buffer;
+// Start of the current playback, for the drain counters
+static int64_t play_start_time;
+static uint32_t play_start_counter;
 
-static void data_play_loop();
+// Written by the ble host before posting the start event, read by the service task
+static sensors_stream_config_t stream_request;
 
 /**
- * @brief Perform a write followed by a read to a device on the I2C bus.
- *        A repeated start signal is used between the `write` and `read`, thus, the bus is
- *        not released until the two transactions are finished.
- *        This function is a wrapper to 'i2c_master_write_read_device'
- *        It shall only be called in I2C master mode.
- *
- * @param device_address I2C device's 7-bit address
- * @param write_buf Bytes to send on the bus
- * @param write_len Length, in bytes, of the write buffer
- * @param read_buf Buffer to store the bytes received on the bus
- * @param read_len Length, in bytes, of the read buffer
- *
- * @return
- *     - ESP_OK Success
- *     - ESP_ERR_INVALID_ARG Parameter error
- *     - ESP_FAIL Sending command error, slave hasn't ACK the transfer.
- *     - ESP_ERR_INVALID_STATE I2C driver not installed or not in master mode.
- *     - ESP_ERR_TIMEOUT Operation timeout because the bus is busy.
+ * State of the running stream, samples are packed until the notification is full
  */
-esp_err_t read_from_device(uint8_t device_address, const uint8_t *write_buf, uint8_t write_len, uint8_t *read_buf,
-                           uint8_t read_len) {
-    return i2c_master_write_read_device(I2C_NUM_0, device_address,
-                                        write_buf, write_len,
-                                        read_buf, read_len,
-                                        pdMS_TO_TICKS(2));
-}
+typedef struct {
+    sensors_stream_config_t config;
+    TickType_t end;
+    int64_t start_time;
+    uint32_t sequence;
+    uint32_t wall_start;
+    uint8_t sample_size;
+    uint8_t samples_per_packet;
+    // Read time of every packed sample for the latency counter, a sample has at least 4 + 1 bytes
+    int64_t read_times[(STREAM_PAYLOAD_SIZE - sizeof(stream_header_t)) / 5];
+    uint8_t length;
+    uint8_t packet[STREAM_PAYLOAD_SIZE];
+    // Samples of a storing stream not written yet and written samples not committed yet
+    uint8_t staged_count;
+    uint32_t uncommitted;
+    int64_t last_commit;
+    sensor_data_t staged[STREAM_STAGED_RECORDS];
+} stream_state_t;
+
+static stream_state_t stream;
 
 /**
- * @brief Perform a write to a device connected to a particular I2C port.
- *        This function is a wrapper to 'i2c_master_write_to_device'
- *        It shall only be called in I2C master mode.
- *
- * @param device_address I2C device's 7-bit address
- * @param write_buf Bytes to send on the bus
- * @param write_len Length, in bytes, of the write buffer
- *
- * @return
- *     - ESP_OK Success
- *     - ESP_ERR_INVALID_ARG Parameter error
- *     - ESP_FAIL Sending command error, slave hasn't ACK the transfer.
- *     - ESP_ERR_INVALID_STATE I2C driver not installed or not in master mode.
- *     - ESP_ERR_TIMEOUT Operation timeout because the bus is busy.
+ * State of the deep sleep recording mode, retained in rtc memory while the chip is in deep sleep
  */
-esp_err_t write_to_device(uint8_t device_address, const uint8_t *write_buf, uint8_t write_len) {
-    return i2c_master_write_to_device(I2C_NUM_0, device_address,
-                                      write_buf, write_len,
-                                      pdMS_TO_TICKS(2));
-}
+typedef struct {
+    uint32_t magic;
+    store_head_t head;
+    uint32_t wake_count;
+    uint32_t measured_wakes;
+    uint32_t last_wake_duration;
+    uint32_t max_wake_duration;
+    uint64_t total_wake_duration;
+    uint64_t wake_time;                 // Rtc time the timer wakes the chip at, in us
+    uint8_t active;
+    uint8_t fine;
+    uint8_t staged_count;
+    sensor_data_t staged[DEEP_SLEEP_STAGED_RECORDS];
+} deep_sleep_state_t;
+
+static RTC_DATA_ATTR deep_sleep_state_t deep_sleep_state;
+
+static esp_timer_handle_t deep_sleep_timer = NULL;
+
+static void measure_step();
+
+static bool data_play_start();
+
+static bool data_play_step();
+
+static void clear_data();
+
+static void stream_start();
+
+static bool stream_step();
+
+static void stream_flush();
+
+static void stream_end();
+
+static void deep_sleep_enter();
+
+static void sample_sensors(uint32_t sensor_mask, uint8_t *values, uint8_t *fractions);
+
+static bool measure_schedule_aligned(int64_t delay);
+
+static void deep_sleep_restore();
 
 esp_err_t sensors_i2c_init() {
     i2c_config_t cfg = {
@@ -122,6 +219,186 @@ esp_err_t sensors_i2c_init() {
     return i2c_driver_install(I2C_NUM_0, cfg.mode, 0, 0, 0);
 }
 
+/**
+ * Initializes the sensors and loads the stored data concurrently to the ble startup
+ */
+static void service_init() {
+    boot_profile_begin(BOOT_PHASE_I2C);
+
+    esp_err_t res = sensors_i2c_init();
+    if (res != ESP_OK) {
+        ESP_LOGE(TAG, "i2c init returned error %d", res);
+    } else {
+        ESP_LOGI(TAG, "i2c init successful");
+    }
+
+    boot_profile_end(BOOT_PHASE_I2C);
+    boot_profile_begin(BOOT_PHASE_SENSORS);
+
+    sensors_init_all();
+
+    boot_profile_end(BOOT_PHASE_SENSORS);
+    boot_profile_begin(BOOT_PHASE_LOAD);
+
+    sensors_load_data();
+
+    ESP_LOGI(TAG, "loaded sensors data from flash");
+
+    boot_profile_end(BOOT_PHASE_LOAD);
+
+    xEventGroupSetBits(ready_event_group, SENSORS_READY_BIT);
+
+    // Subscriptions before the data was loaded got no data count
+    sensors_notify_data_count();
+
+    if (ready_handler)
+        ready_handler();
+}
+
+/**
+ * Handles an event of the service task, only called between two steps so no bus or flash access is interrupted
+ */
+static void service_handle_event(SENSORS_EVENT event) {
+    switch (event) {
+        case SENSORS_EVENT_START_MEASUREMENT:
+            if (service_state == SENSORS_STATE_MEASURING)
+                break;
+
+            service_state = SENSORS_STATE_MEASURING;
+
+            if (!measure_schedule_aligned(phase_schedule()))
+                next_step = xTaskGetTickCount();
+            break;
+        case SENSORS_EVENT_STOP_MEASUREMENT:
+            if (service_state == SENSORS_STATE_MEASURING) {
+                service_state = SENSORS_STATE_IDLE;
+                summary_update(store_count(), store_count(), NULL, 0, 0);
+            }
+            break;
+        case SENSORS_EVENT_START_DATA_PLAY:
+            if (service_state == SENSORS_STATE_PLAYING)
+                break;
+
+            if (data_play_start()) {
+                service_state = SENSORS_STATE_PLAYING;
+                next_step = xTaskGetTickCount();
+            }
+            break;
+        case SENSORS_EVENT_STOP_DATA_PLAY:
+            // The play counter is kept, the next playback resumes at the halted record
+            if (service_state == SENSORS_STATE_PLAYING)
+                service_state = SENSORS_STATE_IDLE;
+            break;
+        case SENSORS_EVENT_CLEAR_DATA:
+            clear_data();
+            break;
+        case SENSORS_EVENT_DEEP_SLEEP:
+            deep_sleep_enter();
+            break;
+        case SENSORS_EVENT_START_STREAM:
+            if (service_state == SENSORS_STATE_STREAMING)
+                stream_end();
+
+            stream_start();
+            service_state = SENSORS_STATE_STREAMING;
+            next_step = xTaskGetTickCount();
+            break;
+        case SENSORS_EVENT_STOP_STREAM:
+            if (service_state == SENSORS_STATE_STREAMING) {
+                stream_end();
+                service_state = SENSORS_STATE_IDLE;
+                summary_update(store_count(), store_count(), NULL, 0, 0);
+            }
+            break;
+        case SENSORS_EVENT_ALIGN:
+            // The pending sample is corrected by the new alignment, without alignment the schedule continues
+            if (service_state == SENSORS_STATE_MEASURING)
+                measure_schedule_aligned(phase_reschedule());
+            break;
+    }
+}
+
+_Noreturn static void service_loop() {
+    service_init();
+
+    while (1) {
+        TickType_t timeout = portMAX_DELAY;
+
+        if (service_state != SENSORS_STATE_IDLE) {
+            int32_t remaining = (int32_t) (next_step - xTaskGetTickCount());
+
+            timeout = remaining > 0 ? remaining : 0;
+        }
+
+        SENSORS_EVENT event;
+
+        if (xQueueReceive(event_queue, &event, timeout) == pdTRUE) {
+            service_handle_event(event);
+            continue;
+        }
+
+        switch (service_state) {
+            case SENSORS_STATE_MEASURING:
+                measure_step();
+
+                if (!measure_schedule_aligned(phase_schedule()))
+                    next_step += pdMS_TO_TICKS(DATA_VALUE_INTERVAL);
+                break;
+            case SENSORS_STATE_PLAYING:
+                if (data_play_step()) {
+                    next_step += pdMS_TO_TICKS(PLAY_DATA_INTERVAL);
+                } else {
+                    ESP_LOGD(TAG, "Finished playing data");
+
+                    DIAG_COUNT(DIAG_COUNTER_DRAIN_RECORDS, play_counter - play_start_counter);
+                    DIAG_COUNT(DIAG_COUNTER_DRAIN_MS, (esp_timer_get_time() - play_start_time) / 1000);
+
+                    service_state = SENSORS_STATE_IDLE;
+                    play_counter = 0;
+                }
+                break;
+            case SENSORS_STATE_STREAMING:
+                if (stream_step()) {
+                    next_step += pdMS_TO_TICKS(stream.config.interval);
+                } else {
+                    ESP_LOGI(TAG, "Stream time limit reached after %lu samples", stream.sequence);
+
+                    stream_end();
+                    service_state = SENSORS_STATE_IDLE;
+                    summary_update(store_count(), store_count(), NULL, 0, 0);
+                }
+                break;
+            default:
+                break;
+        }
+    }
+}
+
+/**
+ * Posts an event to the service task
+ */
+static void service_post(SENSORS_EVENT event) {
+    if (xQueueSend(event_queue, &event, pdMS_TO_TICKS(SENSORS_EVENT_TIMEOUT)) != pdTRUE)
+        ESP_LOGW(TAG, "Sensor event queue full, dropped event %d", event);
+}
+
+void sensors_start_service_task() {
+    ready_event_group = xEventGroupCreateStatic(&ready_event_group_buffer);
+    event_queue = xQueueCreateStatic(SENSORS_EVENT_QUEUE_LENGTH, sizeof(SENSORS_EVENT), event_queue_storage,
+                                     &event_queue_buffer);
+
+    xTaskCreateStatic(service_loop, "sensors_task", SENSORS_SERVICE_STACK_SIZE, NULL, 4, service_stack,
+                      &service_task_buffer);
+}
+
+bool sensors_ready() {
+    return (xEventGroupGetBits(ready_event_group) & SENSORS_READY_BIT) != 0;
+}
+
+void sensors_set_ready_handler(void (*handler)()) {
+    ready_handler = handler;
+}
+
 /**
  * Inits the max31725 sensor for continuous conversion and starts it
  * @param address - The 8 bit address of the device (gets bit-shifted internally)
@@ -131,6 +408,8 @@ int sensor_init(uint8_t address) {
 
     address >>= 1;
 
+    uint8_t i2c_wbuf[2];
+
     // Access config
     i2c_wbuf[0] = 0x01;
     // Set to shutdown-mode for usage with one-shot operation
@@ -163,16 +442,25 @@ void sensors_init_all() {
 /**
  * Reads the sensor at the given address
  * @param address - The 8 bit address of the device (gets bit-shifted internally)
+ * @param fraction - Set to the 3 bits below the decimal point in 1/16 °C
  * @return The read temperature encoded as 7 bit Value, 1 bit decimal point
  */
-uint8_t read_sensor(uint8_t address) {
-    ESP_LOGV(TAG, "Read at 0x%02x ...", address);
+uint8_t read_sensor(uint8_t address, uint8_t *fraction) {
+    TRACE_LOGV(TAG, "Read at 0x%02x ...", address);
 
     address >>= 1;
 
-    i2c_wbuf[0] = 0x00;
+    uint8_t i2c_wbuf[1] = {0x00};
+    uint8_t i2c_rbuf[2] = {0};
 
     int res = read_from_device(address, i2c_wbuf, 1, i2c_rbuf, 2);
+
+    // A capture already holds the transaction
+    if (!i2c_bus_capturing())
+        TRACE(TRACE_SENSOR_READ, address, (i2c_rbuf[0] << 8) | i2c_rbuf[1], res);
+
+    *fraction = 0;
+
     if (res != 0)
         return 0;
 
@@ -183,221 +471,684 @@ uint8_t read_sensor(uint8_t address) {
     if (decimals & 0x80)
         temperature++;
 
-    ESP_LOGV(TAG, "Done reading, temperature: %.1f (%d) - %02x/%u %02x/%u", (float) temperature / 2.0, temperature,
+    // The lsb of the result is 1/256 °C, bits 6-4 are the next 3 bits below the 0.5 °C step
+    *fraction = (decimals >> 4) & 0x07;
+
+    TRACE_LOGV(TAG, "Done reading, temperature: %.1f (%d) - %02x/%u %02x/%u", (float) temperature / 2.0, temperature,
              raw_temperature, raw_temperature, decimals, decimals);
 
     return temperature;
 }
 
 void sensors_load_data() {
-    nvs_handle_t handle;
+    // Staged records are written first, the recovery scan of the store then finds them behind the nvs position
+    deep_sleep_restore();
 
-    esp_err_t res = nvs_open("sensor_data", NVS_READWRITE, &handle);
-    if (res != ESP_OK) {
-        ESP_LOGW(TAG, "Reading partition with sensor data flags failed, reason %s", esp_err_to_name(res));
-        goto end;
-    }
+    esp_err_t res = store_init();
+    if (res != ESP_OK)
+        ESP_LOGW(TAG, "Loading the sensor data store failed, reason %s", esp_err_to_name(res));
 
-    res = nvs_get_u32(handle, DATA_COUNT_KEY, &data_counter);
-    if (res == ESP_ERR_NVS_NOT_FOUND) {
-        ESP_LOGI(TAG, "No sensor metadata is stored in flash, returning");
-        goto end;
-    } else if (res != ESP_OK) {
-        ESP_LOGW(TAG, "Reading nvs key data_count failed, reason %s", esp_err_to_name(res));
-        goto end;
-    }
-
-    res = nvs_get_u32(handle, ADDRESS_OFFSET_KEY, &address_offset);
-    if (res != ESP_OK) {
-        ESP_LOGW(TAG, "Reading nvs key address_offset failed, reason %s", esp_err_to_name(res));
-        goto end;
-    }
+    timebase_init(store_last_time());
 
-    end:
-    nvs_close(handle);
+    summary_update(store_count(), store_count(), NULL, 0, 0);
 }
 
 void sensors_clear_data() {
-    nvs_handle_t handle;
+    service_post(SENSORS_EVENT_CLEAR_DATA);
+}
 
-    esp_err_t res = nvs_open("sensor_data", NVS_READWRITE, &handle);
-    if (res != ESP_OK) {
-        ESP_LOGW(TAG, "Reading partition with sensor data flags failed, reason %s", esp_err_to_name(res));
-        goto end;
+/**
+ * Clears the sensor data in nvs and nvs_ext, runs on the service task
+ */
+static void clear_data() {
+    store_clear();
+
+    play_counter = 0;
+
+    if (service_state == SENSORS_STATE_PLAYING)
+        service_state = SENSORS_STATE_IDLE;
+
+    store_get_head(&deep_sleep_state.head);
+    deep_sleep_state.staged_count = 0;
+    stream.staged_count = 0;
+    stream.uncommitted = 0;
+
+    summary_update(0, 0, NULL, 0, 0);
+}
+
+void sensors_start_measurement() {
+    service_post(SENSORS_EVENT_START_MEASUREMENT);
+}
+
+void sensors_stop_measurement() {
+    service_post(SENSORS_EVENT_STOP_MEASUREMENT);
+}
+
+void sensors_start_data_play() {
+    service_post(SENSORS_EVENT_START_DATA_PLAY);
+}
+
+void sensors_stop_data_play() {
+    service_post(SENSORS_EVENT_STOP_DATA_PLAY);
+}
+
+void sensors_set_fine_resolution(bool enabled) {
+    fine_resolution = enabled;
+}
+
+void sensors_set_alignment(uint16_t pair_id, uint32_t epoch, uint32_t interval, int64_t wall) {
+    phase_set(pair_id, epoch, interval, wall);
+
+    service_post(SENSORS_EVENT_ALIGN);
+}
+
+void sensors_start_stream(const sensors_stream_config_t *config) {
+    stream_request = *config;
+
+    service_post(SENSORS_EVENT_START_STREAM);
+}
+
+void sensors_stop_stream() {
+    service_post(SENSORS_EVENT_STOP_STREAM);
+}
+
+void sensors_notify_data_count() {
+    uint32_t count = store_count();
+    uint8_t frame[39] = {0};
+
+    memcpy((void *) frame, (void *) &count, sizeof(uint32_t));
+
+    frame[3] = 22;
+
+    notify_send(frame, sizeof(frame), NOTIFY_POLICY_LATEST);
+}
+
+/**
+ * Writes the records staged in rtc memory to the store in a single flash write, nvs is not updated
+ */
+static void deep_sleep_flush_staged() {
+    if (deep_sleep_state.staged_count == 0)
+        return;
+
+    store_set_head(&deep_sleep_state.head);
+    store_set_pair_id(phase_pair_id());
+
+    power_begin(POWER_ACTIVITY_FLASH);
+
+    esp_err_t res = store_write(deep_sleep_state.staged, deep_sleep_state.staged_count);
+
+    power_end(POWER_ACTIVITY_FLASH);
+
+    if (res != ESP_OK)
+        return;
+
+    store_get_head(&deep_sleep_state.head);
+    deep_sleep_state.staged_count = 0;
+}
+
+/**
+ * Writes the records still staged by the deep sleep recording. Called on every full boot before the store is loaded,
+ * the recovery scan of the store takes over the records written in deep sleep
+ */
+static void deep_sleep_restore() {
+    if (deep_sleep_state.magic != DEEP_SLEEP_MAGIC)
+        return;
+
+    if (deep_sleep_state.staged_count > 0)
+        ESP_LOGI(TAG, "Writing %u records staged in deep sleep", deep_sleep_state.staged_count);
+
+    deep_sleep_flush_staged();
+}
+
+static void deep_sleep_timer_cb(void *arg) {
+    ESP_LOGI(TAG, "No connection in advertising window, returning to deep sleep");
+
+    sensors_enter_deep_sleep();
+}
+
+void sensors_enter_deep_sleep() {
+    service_post(SENSORS_EVENT_DEEP_SLEEP);
+}
+
+/**
+ * Sleeps until the timer wakes the chip, the wakeup takes its duration from the time it was due
+ * @param time - The sleep time in us
+ */
+static void deep_sleep_start(uint64_t time) {
+    deep_sleep_state.wake_time = esp_clk_rtc_time() + time;
+
+    esp_deep_sleep(time);
+}
+
+/**
+ * Enters the deep sleep recording, runs on the service task so no flash write is interrupted
+ */
+static void deep_sleep_enter() {
+    if (deep_sleep_state.magic != DEEP_SLEEP_MAGIC) {
+        memset(&deep_sleep_state, 0, sizeof(deep_sleep_state));
+        deep_sleep_state.magic = DEEP_SLEEP_MAGIC;
     }
 
-    nvs_erase_key(handle, DATA_COUNT_KEY);
-    nvs_erase_key(handle, ADDRESS_OFFSET_KEY);
+    // The staged samples of a storing stream are written before the head is taken over
+    if (service_state == SENSORS_STATE_STREAMING)
+        stream_end();
 
-    nvs_commit(handle);
+    deep_sleep_state.active = 1;
+    deep_sleep_state.fine = fine_resolution;
+    store_get_head(&deep_sleep_state.head);
 
-    end:
-    nvs_close(handle);
+    ESP_LOGI(TAG, "Entering deep sleep recording at data counter %lu", deep_sleep_state.head.counter);
 
-    const esp_partition_t *partition = esp_partition_find_first(ESP_PARTITION_TYPE_DATA, ESP_PARTITION_SUBTYPE_DATA_NVS,
-                                                                "nvs_ext");
+    int64_t delay = phase_schedule();
 
-    if (partition)
-        esp_partition_erase_range(partition, 0, partition->size);
+    deep_sleep_start(delay >= 0 ? delay : DATA_VALUE_INTERVAL * 1000ULL);
+}
 
-    data_counter = 0;
-    play_counter = 0;
+void sensors_leave_deep_sleep() {
+    deep_sleep_state.active = 0;
+
+    sensors_deep_sleep_hold();
 }
 
-void save_sensor_data(sensor_data_t *sensor_data) {
-    nvs_handle_t handle;
+bool sensors_deep_sleep_active() {
+    return deep_sleep_state.magic == DEEP_SLEEP_MAGIC && deep_sleep_state.active;
+}
 
-    esp_err_t res = nvs_open("sensor_data", NVS_READWRITE, &handle);
-    if (res != ESP_OK) {
-        ESP_LOGW(TAG, "Reading partition with sensor data flags failed, reason %s", esp_err_to_name(res));
-        goto end;
+void sensors_deep_sleep_schedule() {
+    if (!deep_sleep_timer) {
+        const esp_timer_create_args_t args = {
+            .callback = deep_sleep_timer_cb,
+            .name = "deep_sleep"
+        };
+
+        if (esp_timer_create(&args, &deep_sleep_timer) != ESP_OK)
+            return;
     }
 
-    const esp_partition_t *partition = esp_partition_find_first(ESP_PARTITION_TYPE_DATA, ESP_PARTITION_SUBTYPE_DATA_NVS,
-                                                                "nvs_ext");
-    if (partition == NULL) {
-        ESP_LOGW(TAG, "Finding partition nvs_ext failed");
-        goto end;
+    esp_timer_stop(deep_sleep_timer);
+    esp_timer_start_once(deep_sleep_timer, DEEP_SLEEP_ADVERTISE_WINDOW * 1000ULL);
+}
+
+void sensors_deep_sleep_hold() {
+    if (deep_sleep_timer)
+        esp_timer_stop(deep_sleep_timer);
+}
+
+void sensors_handle_deep_sleep_wake() {
+    if (deep_sleep_state.magic != DEEP_SLEEP_MAGIC || !deep_sleep_state.active)
+        return;
+
+    // Any other wake-up (reset, power loss) ends the deep sleep recording, staged records are restored on load
+    if (esp_sleep_get_wakeup_cause() != ESP_SLEEP_WAKEUP_TIMER) {
+        deep_sleep_state.active = 0;
+        return;
     }
 
-    esp_partition_write(partition, address_offset, &sensor_data->time, sizeof(sensor_data_t) - 4);
+    deep_sleep_state.wake_count++;
+
+    if (sensors_i2c_init() == ESP_OK) {
+        sensor_data_t data = {0};
 
-    address_offset += sizeof(sensor_data_t) - 4;
+        data.data_flag = deep_sleep_state.fine ? SENSOR_DATA_LIVE_FINE : 11;
+        data.time = timebase_now();
 
-    nvs_set_u32(handle, DATA_COUNT_KEY, data_counter);
-    nvs_set_u32(handle, ADDRESS_OFFSET_KEY, address_offset);
+        sample_sensors(SENSORS_ALL_MASK, data.sensor_values, data.sensor_fractions);
 
-    nvs_commit(handle);
+        if (deep_sleep_state.staged_count == DEEP_SLEEP_STAGED_RECORDS)
+            deep_sleep_flush_staged();
+
+        if (deep_sleep_state.staged_count < DEEP_SLEEP_STAGED_RECORDS)
+            deep_sleep_state.staged[deep_sleep_state.staged_count++] = data;
+
+        if (deep_sleep_state.staged_count == DEEP_SLEEP_STAGED_RECORDS)
+            deep_sleep_flush_staged();
+    }
+
+    // Start the full firmware from time to time so the app is able to connect
+    if (deep_sleep_state.wake_count % DEEP_SLEEP_FULL_BOOT_INTERVAL == 0) {
+        i2c_driver_delete(I2C_NUM_0);
+        return;
+    }
 
-    end:
-    nvs_close(handle);
+    // Time since the wakeup was due, including the rom, bootloader and image loading time before the application
+    uint32_t duration = esp_clk_rtc_time() - deep_sleep_state.wake_time;
+
+    deep_sleep_state.measured_wakes++;
+    deep_sleep_state.last_wake_duration = duration;
+    deep_sleep_state.total_wake_duration += duration;
+    if (duration > deep_sleep_state.max_wake_duration)
+        deep_sleep_state.max_wake_duration = duration;
+
+    int64_t sleep_time = phase_schedule();
+
+    if (sleep_time < 0) {
+        sleep_time = DATA_VALUE_INTERVAL * 1000LL;
+        if (duration < sleep_time)
+            sleep_time -= duration;
+    }
+
+    deep_sleep_start(sleep_time);
 }
 
-void sensors_start_measurement_task() {
-    if (!sensor_task)
-        xTaskCreate(read_sensor_loop, "sensor_task", 2048, NULL, 4, &sensor_task);
+void sensors_notify_deep_sleep_stats() {
+    uint32_t average = 0;
+    if (deep_sleep_state.measured_wakes > 0)
+        average = deep_sleep_state.total_wake_duration / deep_sleep_state.measured_wakes;
+
+    uint8_t frame[16];
+
+    memcpy((void *) frame, (void *) &deep_sleep_state.measured_wakes, sizeof(uint32_t));
+    memcpy((void *) frame + 4, (void *) &deep_sleep_state.last_wake_duration, sizeof(uint32_t));
+    memcpy((void *) frame + 8, (void *) &average, sizeof(uint32_t));
+    memcpy((void *) frame + 12, (void *) &deep_sleep_state.max_wake_duration, sizeof(uint32_t));
+
+    frame[3] = 24;
+
+    notify_send(frame, sizeof(frame), NOTIFY_POLICY_LATEST);
 }
 
-void sensors_stop_measurement_task() {
-    if (sensor_task)
-        vTaskDelete(sensor_task);
+/**
+ * Triggers a one-shot conversion on the selected sensors and reads the results
+ * @param sensor_mask - Bit n selects the sensor n, must not be 0
+ * @param values - The temperatures indexed by sensor, values of not selected sensors are left untouched
+ * @param fractions - Optional, the packed fraction bits of the values are or-ed in, cleared by the caller
+ */
+static void sample_sensors(uint32_t sensor_mask, uint8_t *values, uint8_t *fractions) {
+    uint8_t i2c_wbuf[2] = {0x01, MAX_31725_ONE_SHOT | MAX_31725_SHUTDOWN};
+    uint8_t i2c_rbuf[1] = {0};
+
+    // The last triggered sensor is the last one to finish its conversion
+    int last = 31 - __builtin_clz(sensor_mask);
+
+    energy_begin(ENERGY_SUBSYSTEM_SAMPLING);
+    power_begin(POWER_ACTIVITY_SAMPLING);
+
+    DIAG_TIME_BEGIN(trigger_start);
+
+    for (int i = 0; i < MAX_SENSORS; i++) {
+        if (sensor_mask & (1UL << i))
+            write_to_device(sensor_address[i] >> 1, i2c_wbuf, 2);
+    }
+
+    DIAG_TIME_END(DIAG_HIST_I2C_TRIGGER, trigger_start);
+
+    power_end(POWER_ACTIVITY_SAMPLING);
+    energy_end(ENERGY_SUBSYSTEM_SAMPLING);
+
+    // The conversion wait may sleep at the minimum frequency
+    vTaskDelay(pdMS_TO_TICKS(CONVERSION_TIME));
+
+    energy_begin(ENERGY_SUBSYSTEM_SAMPLING);
+    power_begin(POWER_ACTIVITY_SAMPLING);
+
+    read_from_device(sensor_address[last] >> 1, i2c_wbuf, 1, i2c_rbuf, 1);
+
+    if ((i2c_rbuf[0] & MAX_31725_ONE_SHOT) != 0) {
+        ESP_LOGW(TAG, "Sensors temperature not ready after %dms", CONVERSION_TIME);
+    }
+
+    DIAG_TIME_BEGIN(read_start);
+
+    for (int i = 0; i < MAX_SENSORS; ++i) {
+        if (!(sensor_mask & (1UL << i)))
+            continue;
+
+        uint8_t fraction;
 
-    sensor_task = NULL;
+        values[i] = read_sensor(sensor_address[i], &fraction);
+
+        if (fractions)
+            record_fraction_set(fractions, i, fraction);
+    }
+
+    DIAG_TIME_END(DIAG_HIST_I2C_READ, read_start);
+
+    power_end(POWER_ACTIVITY_SAMPLING);
+    energy_end(ENERGY_SUBSYSTEM_SAMPLING);
 }
 
-void sensors_start_data_play_task() {
-    if (!data_play_task)
-        xTaskCreate(data_play_loop, "data_play_task", 2048, NULL, 4, &data_play_task);
+/**
+ * Samples all sensors, stores the data and notifies the device
+ */
+static void measure_step() {
+    int64_t step_start = esp_timer_get_time();
+    uint32_t current_time = timebase_now();
+
+    sensor_data_t data = {0};
+
+    data.counter = store_count() + 1;
+    data.data_flag = fine_resolution ? SENSOR_DATA_LIVE_FINE : 11;
+    data.time = current_time;
+
+    sample_sensors(SENSORS_ALL_MASK, data.sensor_values, data.sensor_fractions);
+
+    //ESP_LOGD(TAG, "* #%u time:%llu temperatures:%.1f %.1f %.1f ...\n", 0, current_time, (float) tx_buf[8] / 2.0,
+    //         (float) tx_buf[9] / 2.0, (float) tx_buf[10] / 2.0);
+
+    ESP_LOGD(TAG, "* #%u time:%lu temperatures:%.1f %.1f %.1f ...\n", 0, current_time,
+             (float) data.sensor_values[0] / 2.0,
+             (float) data.sensor_values[1] / 2.0, (float) data.sensor_values[2] / 2.0);
+
+    // Assigns the data counter, the device gets the wall clock time
+    store_set_pair_id(phase_pair_id());
+    store_append(&data);
+
+    summary_update(data.counter, store_count(), data.sensor_values, SENSORS_ALL_MASK, SUMMARY_FLAG_RECORDING);
+
+    data.time = timebase_to_wall(current_time);
+
+    // The sensor data is the frame, notify_send copies it
+    uint8_t length = fine_resolution ? SENSOR_DATA_FINE_FRAME_SIZE : SENSOR_DATA_FRAME_SIZE; // 4 + 4 + 31
+
+    energy_begin(ENERGY_SUBSYSTEM_BLE);
+    power_begin(POWER_ACTIVITY_TRANSFER);
+
+    DIAG_TIME_BEGIN(notify_start);
+
+    // A live frame not sent yet is replaced by the newer one
+    notify_send((const uint8_t *) &data, length, NOTIFY_POLICY_LATEST);
+
+    DIAG_TIME_END(DIAG_HIST_NOTIFY, notify_start);
+
+    power_end(POWER_ACTIVITY_TRANSFER);
+    energy_end(ENERGY_SUBSYSTEM_BLE);
+
+    DIAG_COUNT(DIAG_COUNTER_SAMPLES, 1);
+    DIAG_COUNT(DIAG_COUNTER_SAMPLE_AWAKE_US, esp_timer_get_time() - step_start - CONVERSION_TIME * 1000);
 }
 
-void sensors_stop_data_play_task() {
-    if (data_play_task)
-        vTaskDelete(data_play_task);
+/**
+ * Schedules the next sample of the recording to a slot of the phase alignment
+ * @param delay - The time until the slot in us, negative if not aligned
+ * @return If the sampling is aligned, otherwise next_step is left unchanged
+ */
+static bool measure_schedule_aligned(int64_t delay) {
+    if (delay < 0)
+        return false;
+
+    next_step = xTaskGetTickCount() + delay / 1000 / portTICK_PERIOD_MS;
 
-    data_play_task = NULL;
+    return true;
 }
 
-void sensors_notify_data_count() {
-    memcpy((void *) sensor_handle_val, (void *) &data_counter, sizeof(uint32_t));
+/**
+ * Prepares the playback of the stored data
+ * @return If there is data to play
+ */
+static bool data_play_start() {
+    uint32_t data_counter = store_count();
 
-    sensor_handle_val[3] = 22;
-    sensor_handle_val_length = 39;
+    ESP_LOGD(TAG, "Starting data playing, current play counter: %lu and data_counter: %lu", play_counter, data_counter);
 
-    ble_gatts_chr_updated(sensor_handle);
+    if (play_counter > data_counter || data_counter == 0) {
+        play_counter = 0;
+        return false;
+    } else if (play_counter == 0) {
+        play_counter = 1;
+    }
+
+    play_reader.buffer = &play_buffer;
+
+    esp_err_t res = store_reader_seek(&play_reader, play_counter);
+    if (res != ESP_OK) {
+        ESP_LOGW(TAG, "Seeking record %lu failed, reason %s", play_counter, esp_err_to_name(res));
+        play_counter = 0;
+        return false;
+    }
+
+    play_start_time = esp_timer_get_time();
+    play_start_counter = play_counter;
+
+    return true;
 }
 
-_Noreturn static void read_sensor_loop() {
-    while (1) {
-        data_counter++;
+/**
+ * Reads the next stored record and notifies the device
+ * @return If the playback continues
+ */
+static bool data_play_step() {
+    sensor_data_t data;
 
-        time_t current_time = time(NULL);
+    energy_begin(ENERGY_SUBSYSTEM_STORAGE);
+    power_begin(POWER_ACTIVITY_TRANSFER);
 
-        sensor_data_t data;
+    DIAG_TIME_BEGIN(read_start);
 
-        data.counter = data_counter;
-        data.data_flag = 11;
-        data.time = current_time;
+    // Skips torn records
+    esp_err_t res = store_reader_next(&play_reader, &data);
 
-        i2c_wbuf[0] = 0x01;
-        i2c_wbuf[1] = MAX_31725_ONE_SHOT | MAX_31725_SHUTDOWN;
+    DIAG_TIME_END(DIAG_HIST_PLAY_READ, read_start);
 
-        for (int i = 0; i < MAX_SENSORS; i++) {
-            write_to_device(sensor_address[i] >> 1, i2c_wbuf, 2);
-        }
+    power_end(POWER_ACTIVITY_TRANSFER);
+    energy_end(ENERGY_SUBSYSTEM_STORAGE);
+
+    if (res == ESP_ERR_NOT_FOUND) {
+        return false;
+    } else if (res != ESP_OK) {
+        ESP_LOGW(TAG, "Reading partition with sensor data failed, reason %s", esp_err_to_name(res));
+        return false;
+    }
 
-        vTaskDelay(pdMS_TO_TICKS(50));
+    // The reader sets the fine data flag for fine records
+    bool fine = data.data_flag == SENSOR_DATA_LIVE_FINE;
 
-        read_from_device(sensor_address[MAX_SENSORS - 1] >> 1, i2c_wbuf, 1, i2c_rbuf, 1);
+    data.data_flag = fine ? SENSOR_DATA_PLAY_FINE : 12;
 
-        if ((i2c_rbuf[0] & MAX_31725_ONE_SHOT) != 0) {
-            ESP_LOGW(TAG, "Sensors temperature not ready after 50ms");
-        }
+    uint8_t length = fine ? SENSOR_DATA_FINE_FRAME_SIZE : SENSOR_DATA_FRAME_SIZE;
 
-        for (int i = 0; i < MAX_SENSORS; ++i) {
-            data.sensor_values[i] = read_sensor(sensor_address[i]);
-        }
+    // Waits until the device took the previous records before the transfer window, the cpu may sleep meanwhile
+    bool queued = notify_wait_space();
 
-        //ESP_LOGD(TAG, "* #%u time:%llu temperatures:%.1f %.1f %.1f ...\n", 0, current_time, (float) tx_buf[8] / 2.0,
-        //         (float) tx_buf[9] / 2.0, (float) tx_buf[10] / 2.0);
+    if (queued) {
+        energy_begin(ENERGY_SUBSYSTEM_BLE);
+        power_begin(POWER_ACTIVITY_TRANSFER);
 
-        ESP_LOGD(TAG, "* #%u time:%llu temperatures:%.1f %.1f %.1f ...\n", 0, current_time,
-                 (float) data.sensor_values[0] / 2.0,
-                 (float) data.sensor_values[1] / 2.0, (float) data.sensor_values[2] / 2.0);
+        DIAG_TIME_BEGIN(notify_start);
 
-        memcpy((void *) sensor_handle_val, (void *) &data, sizeof(sensor_data_t));
+        // No stored record is skipped, only waits again if a frame of the host task took the space meanwhile
+        queued = notify_send((const uint8_t *) &data, length, NOTIFY_POLICY_BLOCK);
 
-        //memcpy((void *) sensor_handle_val, (void*) tx_buf, 39);
-        sensor_handle_val_length = sizeof(sensor_data_t); // 4 + 4 + 31
+        DIAG_TIME_END(DIAG_HIST_NOTIFY, notify_start);
+
+        power_end(POWER_ACTIVITY_TRANSFER);
+        energy_end(ENERGY_SUBSYSTEM_BLE);
+    }
 
-        save_sensor_data(&data);
+    if (!queued) {
+        ESP_LOGW(TAG, "Notify queue stalled, sending record %lu again", (uint32_t) data.counter);
 
-        ble_gatts_chr_updated(sensor_handle);
+        store_reader_seek(&play_reader, data.counter);
 
-        vTaskDelay(pdMS_TO_TICKS(DATA_VALUE_INTERVAL));
+        return true;
     }
+
+    DIAG_COUNT(DIAG_COUNTER_PLAYED_RECORDS, 1);
+
+    play_counter = play_reader.counter;
+
+    // The next chunk is read while the notification is sent
+    energy_begin(ENERGY_SUBSYSTEM_STORAGE);
+    power_begin(POWER_ACTIVITY_TRANSFER);
+
+    store_reader_prefetch(&play_reader);
+
+    power_end(POWER_ACTIVITY_TRANSFER);
+    energy_end(ENERGY_SUBSYSTEM_STORAGE);
+
+    return true;
+}
+
+/**
+ * Applies the requested stream settings and starts an empty notification
+ */
+static void stream_start() {
+    stream.config = stream_request;
+
+    stream.config.sensor_mask &= SENSORS_ALL_MASK;
+    if (stream.config.sensor_mask == 0)
+        stream.config.sensor_mask = SENSORS_ALL_MASK;
+
+    if (stream.config.interval < STREAM_MIN_INTERVAL)
+        stream.config.interval = STREAM_MIN_INTERVAL;
+
+    if (stream.config.duration == 0 || stream.config.duration > STREAM_MAX_DURATION)
+        stream.config.duration = STREAM_MAX_DURATION;
+
+    stream.sample_size = sizeof(uint32_t) + __builtin_popcount(stream.config.sensor_mask);
+    stream.samples_per_packet = (STREAM_PAYLOAD_SIZE - sizeof(stream_header_t)) / stream.sample_size;
+
+    stream.start_time = esp_timer_get_time();
+    stream.wall_start = timebase_to_wall(timebase_now());
+    stream.end = xTaskGetTickCount() + pdMS_TO_TICKS(stream.config.duration * 1000);
+    stream.sequence = 0;
+    stream.length = sizeof(stream_header_t);
+    stream.staged_count = 0;
+    stream.uncommitted = 0;
+    stream.last_commit = stream.start_time;
+
+    ESP_LOGI(TAG, "Streaming sensors 0x%08lx every %u ms for %u s, %u samples per notification",
+             stream.config.sensor_mask, stream.config.interval, stream.config.duration, stream.samples_per_packet);
 }
 
-static void data_play_loop() {
-    const esp_partition_t *partition = esp_partition_find_first(ESP_PARTITION_TYPE_DATA, ESP_PARTITION_SUBTYPE_DATA_NVS,
-                                                                "nvs_ext");
+/**
+ * Writes the staged samples of a storing stream without committing the write position. The write position is committed
+ * every STREAM_COMMIT_INTERVAL and when the stream ends, written samples behind the committed position are taken over
+ * by the recovery scan of store_init
+ * @param commit - Commits the written samples regardless of the interval
+ */
+static void stream_store(bool commit) {
+    if (stream.staged_count == 0 && stream.uncommitted == 0)
+        return;
+
+    energy_begin(ENERGY_SUBSYSTEM_STORAGE);
+    power_begin(POWER_ACTIVITY_FLASH);
 
-    if (partition == NULL) {
-        ESP_LOGW(TAG, "Finding partition nvs_ext failed");
-        goto end;
+    if (stream.staged_count > 0) {
+        // Streamed samples follow the stream interval, not the slots of the pair
+        store_set_pair_id(PHASE_PAIR_NONE);
+
+        uint32_t count = store_count();
+
+        // Samples of a failed write are dropped like a failed store_append, the store logs the reason
+        store_write(stream.staged, stream.staged_count);
+
+        stream.uncommitted += store_count() - count;
+
+        stream.staged_count = 0;
     }
 
-    ESP_LOGD(TAG, "Starting data playing, current play counter: %lu and data_counter: %lu", play_counter, data_counter);
+    int64_t now = esp_timer_get_time();
 
-    while (1) {
-        if (play_counter > data_counter || data_counter == 0) {
-            goto end;
-        } else if (play_counter == 0) {
-            play_counter = 1;
-        }
+    if (stream.uncommitted > 0 && (commit || now - stream.last_commit >= STREAM_COMMIT_INTERVAL * 1000LL)) {
+        store_commit();
 
-        esp_err_t res = esp_partition_read(partition, (play_counter - 1) * (sizeof(sensor_data_t) - 4), tx_buf,
-                                           sizeof(sensor_data_t) - 4);
-        if (res != ESP_OK) {
-            ESP_LOGW(TAG, "Reading partition with sensor data failed, reason %s", esp_err_to_name(res));
-            goto end;
-        }
+        stream.uncommitted = 0;
+        stream.last_commit = now;
+    }
 
-        memcpy((void *) sensor_handle_val + 4, (void *) tx_buf, sizeof(sensor_data_t) - 4);
-        memcpy((void *) sensor_handle_val, (void *) &play_counter, sizeof(int));
+    power_end(POWER_ACTIVITY_FLASH);
+    energy_end(ENERGY_SUBSYSTEM_STORAGE);
+}
+
+/**
+ * Samples the selected sensors and packs the values, the notification is sent once it is full
+ * @return If the stream continues, false after the time limit
+ */
+static bool stream_step() {
+    if ((int32_t) (xTaskGetTickCount() - stream.end) >= 0)
+        return false;
+
+    sensor_data_t data = {0};
 
-        sensor_handle_val[3] = 12;
+    // Stored records keep which sensors the stream selected
+    memset(data.sensor_values, RECORD_VALUE_NONE, sizeof(data.sensor_values));
 
-        sensor_handle_val_length = sizeof(sensor_data_t);
-        ble_gatts_chr_updated(sensor_handle);
+    sample_sensors(stream.config.sensor_mask, data.sensor_values, NULL);
 
-        play_counter++;
+    int64_t read_time = esp_timer_get_time();
 
-        vTaskDelay(pdMS_TO_TICKS(PLAY_DATA_INTERVAL));
+    if (stream.config.store) {
+        data.data_flag = 11;
+        data.time = timebase_now();
+
+        stream.staged[stream.staged_count++] = data;
+
+        if (stream.staged_count == STREAM_STAGED_RECORDS)
+            stream_store(false);
     }
 
-    end:
-    ESP_LOGD(TAG, "Finished playing data");
-    play_counter = 0;
-    data_play_task = NULL;
-    vTaskDelete(NULL);
-}
\ No newline at end of file
+    uint8_t packed = (stream.length - sizeof(stream_header_t)) / stream.sample_size;
+    uint32_t offset = (read_time - stream.start_time) / 1000;
+
+    stream.read_times[packed] = read_time;
+
+    memcpy(stream.packet + stream.length, &offset, sizeof(offset));
+    stream.length += sizeof(offset);
+
+    for (int i = 0; i < MAX_SENSORS; i++) {
+        if (stream.config.sensor_mask & (1UL << i))
+            stream.packet[stream.length++] = data.sensor_values[i];
+    }
+
+    summary_update(stream.sequence + packed, store_count() + stream.staged_count, data.sensor_values,
+                   stream.config.sensor_mask, SUMMARY_FLAG_STREAMING);
+
+    DIAG_COUNT(DIAG_COUNTER_STREAM_SAMPLES, 1);
+
+    if (packed + 1 >= stream.samples_per_packet)
+        stream_flush();
+
+    return true;
+}
+
+/**
+ * Notifies the packed samples, a full queue drops the notification instead of delaying the sampling
+ */
+static void stream_flush() {
+    uint8_t count = (stream.length - sizeof(stream_header_t)) / stream.sample_size;
+    if (count == 0)
+        return;
+
+    stream_header_t header = {
+        .sequence = stream.sequence,
+        .data_flag = 13,
+        .start_time = stream.wall_start,
+        .sensor_mask = stream.config.sensor_mask,
+        .sample_count = count
+    };
+
+    memcpy(stream.packet, &header, sizeof(header));
+
+    energy_begin(ENERGY_SUBSYSTEM_BLE);
+    power_begin(POWER_ACTIVITY_TRANSFER);
+
+    DIAG_TIME_BEGIN(notify_start);
+
+    notify_send(stream.packet, stream.length, NOTIFY_POLICY_QUEUE);
+
+    DIAG_TIME_END(DIAG_HIST_NOTIFY, notify_start);
+
+    power_end(POWER_ACTIVITY_TRANSFER);
+    energy_end(ENERGY_SUBSYSTEM_BLE);
+
+    // Time from the sensor read to the hand over to the host, including the wait for the packet to fill
+    int64_t now = esp_timer_get_time();
+    uint32_t latency = 0;
+
+    for (int i = 0; i < count; i++)
+        latency += (now - stream.read_times[i]) / 1000;
+
+    DIAG_COUNT(DIAG_COUNTER_STREAM_NOTIFICATIONS, 1);
+    DIAG_COUNT(DIAG_COUNTER_STREAM_LATENCY_MS, latency);
+
+    stream.sequence += count;
+    stream.length = sizeof(stream_header_t);
+}
+
+/**
+ * Notifies the packed samples and writes and commits the staged ones
+ */
+static void stream_end() {
+    stream_flush();
+    stream_store(true);
+}
@@ -1,9 +1,14 @@
 #include <sys/cdefs.h>
+#include <stdbool.h>
+#include <stddef.h>
 
 #ifndef SOLE_SENSORS_H
 #define SOLE_SENSORS_H
 
 #define MAX_SENSORS 31
+#define SENSORS_ALL_MASK ((1UL << MAX_SENSORS) - 1)
+// Packed 3 bit fractions of the values in the fine resolution, same layout as the fine records
+#define SENSOR_FRACTIONS_SIZE ((MAX_SENSORS * 3 + 7) / 8)
 
 #define SENSOR_METADATA_MAX_ADDRESS (sizeof(SENSOR_DATA_FLAGS) + (30 * sizeof(sensor_metadata_t)))
 
@@ -14,13 +19,48 @@ typedef enum __attribute__((packed)) {
     SENSOR_DATA_OVERFLOWED = 0x02
 } SENSOR_DATA_FLAGS;
 
+/**
+ * Sensor data, also the layout of the live (data flag 11) and playback (12) notifications.\n
+ * In the fine resolution the notifications (14 live, 15 playback) include the fraction bits
+ */
 typedef struct __attribute__((packed)) sensor_data {
     uint32_t counter: 24;
     uint32_t data_flag: 8;
     uint32_t time;
     uint8_t sensor_values[31];
+    uint8_t sensor_fractions[SENSOR_FRACTIONS_SIZE];    // 1/16 °C below the 0.5 °C step of the values
 } sensor_data_t;
 
+// Data flags of the fine resolution, fine sensor data is stored as fine records
+#define SENSOR_DATA_LIVE_FINE 14
+#define SENSOR_DATA_PLAY_FINE 15
+
+// Notification length without and with the fraction bits
+#define SENSOR_DATA_FRAME_SIZE offsetof(sensor_data_t, sensor_fractions)
+#define SENSOR_DATA_FINE_FRAME_SIZE sizeof(sensor_data_t)
+
+/**
+ * Settings of the streaming mode
+ */
+typedef struct {
+    uint32_t sensor_mask;           // Bit n selects the sensor n
+    uint16_t interval;              // Sample interval in ms
+    uint16_t duration;              // Time after which the stream stops by itself in s
+    bool store;                     // Also stores every sample, the sensors not selected as RECORD_VALUE_NONE
+} sensors_stream_config_t;
+
+/**
+ * Header of a stream notification (data flag 13), followed by sample_count samples of a uint32_t time offset in ms
+ * since the stream start and the values of the selected sensors in sensor order
+ */
+typedef struct __attribute__((packed)) stream_header {
+    uint32_t sequence: 24;          // Sequence number of the first sample, gaps show dropped notifications
+    uint32_t data_flag: 8;
+    uint32_t start_time;            // Wall clock time of the stream start
+    uint32_t sensor_mask;
+    uint8_t sample_count;
+} stream_header_t;
+
 enum MAX_31725_CONFIG {
     MAX_31725_SHUTDOWN = 0x01,
     MAX_31725_INTERRUPT = 0x02,
@@ -39,6 +79,24 @@ esp_err_t sensors_i2c_init();
 
 //int sensor_init(uint8_t address);
 
+/**
+ * Starts the statically allocated sensor service task owning sampling, playback and storage.\n
+ * The task first initializes the i2c driver and all sensors and loads the saved sensor data from flash,
+ * concurrently to the ble startup. nvs has to be initialized before
+ */
+void sensors_start_service_task();
+
+/**
+ * @return If the service task initialized the sensors and loaded the sensor data, does not block
+ */
+bool sensors_ready();
+
+/**
+ * Sets the function the service task calls once the sensor data is loaded, after sensors_ready turned true
+ * @param handler - Called on the service task, NULL for none
+ */
+void sensors_set_ready_handler(void (*handler)());
+
 /**
  * Inits all available sensors in the sole
  */
@@ -52,33 +110,101 @@ void sensors_load_data();
 
 /**
  * Clears all sensor data stored in flash.\n
- * This includes: data_counter and current position/offset in nvs and the complete nvs_ext partition
+ * This includes: data_counter and current position/offset in nvs and the complete nvs_ext partition.
+ * Executed asynchronously by the service task
  */
 void sensors_clear_data();
 
 /**
- * Starts the sensor measurement task, only if the task is not running already
+ * Starts the periodic sensor measurement, only if it is not running already
  */
-void sensors_start_measurement_task();
+void sensors_start_measurement();
 
 /**
- * Stops the sensor measurement task
+ * Stops the sensor measurement after the current sample is stored
  */
-void sensors_stop_measurement_task();
+void sensors_stop_measurement();
 
 /**
- * Starts the data playback task, only if the task is not running already
+ * Starts the data playback, only if it is not running already. Resumes a halted playback
  */
-void sensors_start_data_play_task();
+void sensors_start_data_play();
 
 /**
- * Stops the data playback task
+ * Stops the data playback after the current record is sent
  */
-void sensors_stop_data_play_task();
+void sensors_stop_data_play();
+
+/**
+ * Aligns the recording of a left and right sole to the slots epoch + n * interval of the app, the next sample moves to
+ * the first slot. Records sampled aligned are tagged with the pair id, also in the deep sleep recording
+ * @param pair_id - The pair of the soles, 0 ends the alignment
+ * @param epoch - The wall clock time of slot 0 in s
+ * @param interval - The time between two samples in ms
+ * @param wall - The wall clock of the app when sending the command in ms
+ */
+void sensors_set_alignment(uint16_t pair_id, uint32_t epoch, uint32_t interval, int64_t wall);
+
+/**
+ * Starts streaming the selected sensors at a sub-second interval, stops the measurement and the playback.\n
+ * Several samples are packed into one notification, they are only written to flash if requested
+ * @param config - The stream settings, the interval and duration are clamped to the supported range
+ */
+void sensors_start_stream(const sensors_stream_config_t *config);
+
+/**
+ * Stops the stream after the current sample, samples not sent yet are notified
+ */
+void sensors_stop_stream();
+
+/**
+ * Enables the fine resolution, the following samples keep 0.0625 °C and are stored as fine records
+ * @param enabled - If the fraction bits are kept
+ */
+void sensors_set_fine_resolution(bool enabled);
 
 /**
  * Notifies the device of the current count of data stored in the flash
  */
 void sensors_notify_data_count();
 
+/**
+ * Enters the deep sleep recording mode once the service task finished its current step.\n
+ * The chip wakes up every data interval, samples all sensors and appends the data to flash without starting nimble
+ * or nvs. The data counter, flash offset and not yet written records are kept in rtc memory
+ */
+void sensors_enter_deep_sleep();
+
+/**
+ * Leaves the deep sleep recording mode, the sole stays awake after the next disconnect
+ */
+void sensors_leave_deep_sleep();
+
+/**
+ * @return If the deep sleep recording mode is active
+ */
+bool sensors_deep_sleep_active();
+
+/**
+ * Handles a wake-up from the deep sleep recording mode by sampling all sensors and going back to deep sleep.\n
+ * Only returns if the chip was not woken up by the deep sleep timer or if the full firmware has to be started
+ * for the app to connect
+ */
+void sensors_handle_deep_sleep_wake();
+
+/**
+ * Returns to deep sleep after the advertising window, if no connection is established until then
+ */
+void sensors_deep_sleep_schedule();
+
+/**
+ * Stops the pending return to deep sleep, e.g. when a device connects
+ */
+void sensors_deep_sleep_hold();
+
+/**
+ * Notifies the device of the deep sleep wake-up count and the wake-to-sleep durations in us (last, average, max)
+ */
+void sensors_notify_deep_sleep_stats();
+
 #endif //SOLE_SENSORS_H
@@ -0,0 +1,814 @@
+#include <string.h>
+#include <stdbool.h>
+#include <esp_timer.h>
+#include "esp_log.h"
+#include "esp_partition.h"
+#include "nvs.h"
+#include "record.h"
+#include "diagnostics.h"
+#include "energy.h"
+#include "power.h"
+#include "timebase.h"
+#include "phase.h"
+#include "wear.h"
+#include "store.h"
+
+// Records written to flash at once by store_write
+#define STORE_WRITE_BATCH 8
+
+// Version of the nvs keys, missing on devices with data of the flat record layout
+#define STORE_NVS_FORMAT 1
+
+static const char *TAG = "store";
+
+static const char *DATA_COUNT_KEY = "data_count";
+static const char *ADDRESS_OFFSET_KEY = "address_offset";
+static const char *STORE_FORMAT_KEY = "store_format";
+static const char *LEGACY_COUNT_KEY = "legacy_count";
+
+/**
+ * Data partition mapped into the address space of the store
+ */
+typedef struct {
+    const esp_partition_t *partition;
+    uint32_t start;         // Store address of the first byte of the partition
+    uint32_t size;          // Size of the whole blocks in the partition
+} store_extent_t;
+
+static const char *const extent_labels[] = {STORE_EXTENT_LABELS};
+
+#define STORE_EXTENT_COUNT (sizeof(extent_labels) / sizeof(extent_labels[0]))
+
+static store_extent_t extents[STORE_EXTENT_COUNT];
+static uint8_t extent_count = 0;
+static uint32_t store_size = 0;
+
+typedef enum {
+    EXTENT_READ,
+    EXTENT_WRITE,
+    EXTENT_ERASE
+} EXTENT_ACCESS;
+
+static store_head_t head = {0, 0};
+static uint32_t last_time = 0;
+
+// Layout of the block the head points into
+static uint8_t block_format = RECORD_FORMAT_RELATIVE;
+static uint8_t block_record_size = sizeof(record_relative_t);
+static uint32_t block_time_base = 0;
+static uint16_t block_pair_id = PHASE_PAIR_NONE;
+
+// Pair id of the following records, a change closes the block at the head
+static uint16_t record_pair_id = PHASE_PAIR_NONE;
+
+// Flat records of older firmware versions in front of the first block
+static uint32_t legacy_count = 0;
+static uint32_t store_start = 0;
+
+static uint32_t block_start(uint32_t address) {
+    return address - address % RECORD_BLOCK_SIZE;
+}
+
+/**
+ * Maps the partitions of STORE_EXTENT_LABELS one after the other into the address space of the store
+ * @return If at least the first partition was found
+ */
+static bool find_partition() {
+    if (extent_count > 0)
+        return true;
+
+    for (int i = 0; i < STORE_EXTENT_COUNT; i++) {
+        const esp_partition_t *partition = esp_partition_find_first(ESP_PARTITION_TYPE_DATA,
+                                                                    ESP_PARTITION_SUBTYPE_ANY, extent_labels[i]);
+
+        // The address space ends at a missing partition, the following ones would shift to other addresses
+        if (!partition) {
+            ESP_LOGW(TAG, "Finding partition %s failed", extent_labels[i]);
+            break;
+        }
+
+        extents[extent_count].partition = partition;
+        extents[extent_count].start = store_size;
+        extents[extent_count].size = block_start(partition->size);
+
+        store_size += extents[extent_count].size;
+        extent_count++;
+    }
+
+    if (extent_count > 0)
+        ESP_LOGI(TAG, "Store spans %d partitions with %lu bytes", extent_count, store_size);
+
+    return extent_count > 0;
+}
+
+/**
+ * Reads, writes or erases a range of the store address space, split at the partition borders
+ * @return ESP_ERR_INVALID_SIZE if the range exceeds the store, otherwise the esp error code of the partition access
+ */
+static esp_err_t extent_access(EXTENT_ACCESS access, uint32_t address, uint8_t *data, size_t length) {
+    int i = 0;
+
+    while (length > 0) {
+        while (i < extent_count && address - extents[i].start >= extents[i].size)
+            i++;
+
+        if (i == extent_count)
+            return ESP_ERR_INVALID_SIZE;
+
+        uint32_t offset = address - extents[i].start;
+        size_t part = extents[i].size - offset < length ? extents[i].size - offset : length;
+        esp_err_t res;
+
+        if (access == EXTENT_READ) {
+            res = esp_partition_read(extents[i].partition, offset, data, part);
+        } else if (access == EXTENT_WRITE) {
+            res = esp_partition_write(extents[i].partition, offset, data, part);
+        } else {
+            res = esp_partition_erase_range(extents[i].partition, offset, part);
+        }
+
+        if (res != ESP_OK)
+            return res;
+
+        if (data)
+            data += part;
+
+        address += part;
+        length -= part;
+    }
+
+    return ESP_OK;
+}
+
+static esp_err_t flash_write(uint32_t address, const void *data, size_t length) {
+    return extent_access(EXTENT_WRITE, address, (uint8_t *) data, length);
+}
+
+static esp_err_t flash_erase(uint32_t address, size_t length) {
+    return extent_access(EXTENT_ERASE, address, NULL, length);
+}
+
+_Static_assert(SENSOR_FRACTIONS_SIZE == RECORD_FRACTIONS_SIZE, "Fraction bits of sensor data and records differ");
+
+/**
+ * @return The format of the block a record of the sensor data is written to
+ */
+static uint8_t record_format(const sensor_data_t *data) {
+    return data->data_flag == SENSOR_DATA_LIVE_FINE ? RECORD_FORMAT_FINE : RECORD_FORMAT_RELATIVE;
+}
+
+/**
+ * Encodes the sensor data in the format of the block at the head
+ */
+static void record_encode(const sensor_data_t *data, uint8_t *record) {
+    record_fine_t *fine = (record_fine_t *) record;
+
+    fine->time_offset = data->time - block_time_base;
+    memcpy(fine->values, data->sensor_values, RECORD_SENSORS);
+
+    if (block_format == RECORD_FORMAT_FINE)
+        memcpy(fine->fractions, data->sensor_fractions, RECORD_FRACTIONS_SIZE);
+
+    record[block_record_size - 1] = record_crc8(record, block_record_size - 1);
+}
+
+static void record_decode(uint8_t format, uint32_t time_base, const uint8_t *record, sensor_data_t *data) {
+    data->time = record_time(format, time_base, record);
+
+    if (format == RECORD_FORMAT_RELATIVE || format == RECORD_FORMAT_FINE)
+        data->time = timebase_to_wall(data->time);
+
+    memcpy(data->sensor_values, record_values(format, record), RECORD_SENSORS);
+
+    if (format == RECORD_FORMAT_FINE) {
+        memcpy(data->sensor_fractions, ((const record_fine_t *) record)->fractions, RECORD_FRACTIONS_SIZE);
+        data->data_flag = SENSOR_DATA_LIVE_FINE;
+    } else {
+        memset(data->sensor_fractions, 0, RECORD_FRACTIONS_SIZE);
+        data->data_flag = 11;
+    }
+}
+
+static void block_select(const record_block_header_t *header) {
+    block_format = header->format;
+    block_record_size = header->record_size;
+    block_time_base = header->time_base;
+    block_pair_id = header->pair_id;
+}
+
+static esp_err_t flash_read(uint32_t address, void *data, size_t length) {
+#if DIAG_ENABLED
+    int64_t start = esp_timer_get_time();
+#endif
+
+    esp_err_t res = extent_access(EXTENT_READ, address, data, length);
+
+    DIAG_COUNT(DIAG_COUNTER_FLASH_READS, 1);
+    DIAG_COUNT(DIAG_COUNTER_FLASH_READ_US, esp_timer_get_time() - start);
+
+    return res;
+}
+
+/**
+ * @return If the block at the given address is a valid block continuing at the given data counter
+ */
+static bool block_continues(uint32_t address, uint32_t counter, record_block_header_t *header) {
+    if (address + RECORD_BLOCK_SIZE > store_size)
+        return false;
+
+    if (flash_read(address, header, sizeof(*header)) != ESP_OK)
+        return false;
+
+    return record_block_header_valid(header) && header->first_counter == counter;
+}
+
+void store_commit() {
+    nvs_handle_t handle;
+
+    esp_err_t res = nvs_open("sensor_data", NVS_READWRITE, &handle);
+    if (res != ESP_OK) {
+        ESP_LOGW(TAG, "Reading partition with sensor data flags failed, reason %s", esp_err_to_name(res));
+        return;
+    }
+
+    nvs_set_u32(handle, DATA_COUNT_KEY, head.counter);
+    nvs_set_u32(handle, ADDRESS_OFFSET_KEY, head.address);
+
+    DIAG_TIME_BEGIN(commit_start);
+
+    nvs_commit(handle);
+
+    DIAG_TIME_END(DIAG_HIST_NVS_COMMIT, commit_start);
+
+    DIAG_COUNT(DIAG_COUNTER_NVS_COMMITS, 1);
+
+    nvs_close(handle);
+
+    wear_commit();
+}
+
+/**
+ * Erases the block at the head and writes its header
+ */
+static esp_err_t open_block(uint32_t first_counter, uint32_t time_base, uint8_t format) {
+    if (head.address + RECORD_BLOCK_SIZE > store_size)
+        return ESP_ERR_NO_MEM;
+
+    esp_err_t res = flash_erase(head.address, RECORD_BLOCK_SIZE);
+    if (res != ESP_OK)
+        return res;
+
+    record_block_header_t header;
+    memset(&header, 0xff, sizeof(header));
+
+    header.magic = RECORD_BLOCK_MAGIC;
+    header.format = format;
+    header.record_size = format == RECORD_FORMAT_FINE ? sizeof(record_fine_t) : sizeof(record_relative_t);
+    header.first_counter = first_counter;
+    header.time_base = time_base;
+    header.pair_id = record_pair_id;
+    header.crc = record_crc16(&header, offsetof(record_block_header_t, crc));
+
+    res = flash_write(head.address, &header, sizeof(header));
+
+    DIAG_COUNT(DIAG_COUNTER_FLASH_ERASES, 1);
+    DIAG_COUNT(DIAG_COUNTER_FLASH_WRITES, 1);
+    DIAG_COUNT(DIAG_COUNTER_FLASH_WRITE_BYTES, sizeof(header));
+
+    if (res != ESP_OK)
+        return res;
+
+    block_select(&header);
+    head.address += sizeof(header);
+
+    return ESP_OK;
+}
+
+/**
+ * @return If the record does not fit the block at the head, the block is then closed before it is full
+ */
+static bool block_mismatch(const sensor_data_t *data) {
+    return block_format != record_format(data) || block_pair_id != record_pair_id || data->time < block_time_base ||
+           data->time - block_time_base > UINT16_MAX;
+}
+
+static esp_err_t write_batch(const uint8_t *batch, uint8_t count, uint32_t address) {
+    if (count == 0)
+        return ESP_OK;
+
+    DIAG_TIME_BEGIN(write_start);
+
+    esp_err_t res = flash_write(address, batch, count * block_record_size);
+
+    DIAG_TIME_END(DIAG_HIST_FLASH_WRITE, write_start);
+
+    DIAG_COUNT(DIAG_COUNTER_FLASH_WRITES, 1);
+    DIAG_COUNT(DIAG_COUNTER_FLASH_WRITE_BYTES, count * block_record_size);
+
+    if (res == ESP_OK)
+        DIAG_COUNT(DIAG_COUNTER_RECORDS, count);
+
+    return res;
+}
+
+/**
+ * Moves the head behind the records written after the last nvs commit.
+ * Only the tail is scanned: the rest of the current block and the following blocks written since
+ */
+static void store_recover() {
+    int64_t start = esp_timer_get_time();
+    uint32_t recovered = 0;
+    uint32_t torn = 0;
+
+    record_block_header_t header;
+    uint8_t record[UINT8_MAX];
+
+    if (head.address % RECORD_BLOCK_SIZE != 0) {
+        esp_err_t res = flash_read(block_start(head.address), &header, sizeof(header));
+
+        if (res != ESP_OK || !record_block_header_valid(&header)) {
+            // The block is erased and reopened on the next write
+            ESP_LOGW(TAG, "Header of the current block is invalid, reopening the block");
+            head.address = block_start(head.address);
+        } else {
+            block_select(&header);
+        }
+    }
+
+    while (1) {
+        if (head.address % RECORD_BLOCK_SIZE == 0) {
+            // An erased, torn or stale header is replaced by the next write
+            if (!block_continues(head.address, head.counter + 1, &header))
+                break;
+
+            block_select(&header);
+            head.address += sizeof(header);
+        }
+
+        if (flash_read(head.address, record, block_record_size) != ESP_OK)
+            break;
+
+        if (record_is_erased(record, block_record_size)) {
+            uint32_t next_block = block_start(head.address) + RECORD_BLOCK_SIZE;
+
+            // The block was closed early, the records continue in the next block
+            if (block_continues(next_block, head.counter + 1, &header)) {
+                head.address = next_block;
+                continue;
+            }
+
+            break;
+        }
+
+        // A torn record keeps its counter but is skipped by the readers
+        if (!record_valid(record, block_record_size))
+            torn++;
+
+        recovered++;
+        head.counter++;
+        head.address = record_next_slot(head.address, block_record_size);
+    }
+
+    if (recovered > 0) {
+        ESP_LOGW(TAG, "Recovered %lu records (%lu torn) behind the committed position", recovered, torn);
+        store_commit();
+    }
+
+    ESP_LOGI(TAG, "Recovery scan took %lld us, data counter %lu", esp_timer_get_time() - start, head.counter);
+}
+
+/**
+ * @return The time of the last stored record, 0 if there is none
+ */
+static uint32_t head_last_time() {
+    uint8_t record[UINT8_MAX];
+
+    // The recovery selected the block at the head, the last record is the slot in front of the head
+    if (head.counter > legacy_count &&
+        head.address % RECORD_BLOCK_SIZE >= sizeof(record_block_header_t) + block_record_size) {
+        if (flash_read(head.address - block_record_size, record, block_record_size) != ESP_OK)
+            return 0;
+
+        return record_time(block_format, block_time_base, record);
+    }
+
+    // The last record ends the previous block or is a legacy record
+    store_reader_t reader = {0};
+
+    if (store_reader_seek(&reader, head.counter) != ESP_OK ||
+        flash_read(reader.address, record, reader.record_size) != ESP_OK)
+        return 0;
+
+    return record_time(reader.format, reader.time_base, record);
+}
+
+esp_err_t store_init() {
+    if (!find_partition())
+        return ESP_ERR_NOT_FOUND;
+
+    nvs_handle_t handle;
+
+    esp_err_t res = nvs_open("sensor_data", NVS_READWRITE, &handle);
+    if (res != ESP_OK) {
+        ESP_LOGW(TAG, "Reading partition with sensor data flags failed, reason %s", esp_err_to_name(res));
+        return res;
+    }
+
+    uint32_t counter = 0;
+    uint32_t address = 0;
+    uint8_t format = 0;
+
+    res = nvs_get_u32(handle, DATA_COUNT_KEY, &counter);
+    if (res == ESP_OK)
+        res = nvs_get_u32(handle, ADDRESS_OFFSET_KEY, &address);
+
+    if (res == ESP_ERR_NVS_NOT_FOUND) {
+        ESP_LOGI(TAG, "No sensor metadata is stored in flash");
+    } else if (res != ESP_OK) {
+        // The recovery scan rebuilds the position from the start of the store
+        ESP_LOGW(TAG, "Reading nvs write position failed, reason %s", esp_err_to_name(res));
+    }
+
+    if (res != ESP_OK) {
+        counter = 0;
+        address = 0;
+    }
+
+    nvs_get_u8(handle, STORE_FORMAT_KEY, &format);
+    nvs_get_u32(handle, LEGACY_COUNT_KEY, &legacy_count);
+
+    if (format != STORE_NVS_FORMAT) {
+        // Flat records of older firmware stay readable in front of the first block
+        legacy_count = counter;
+        address = block_start(address + RECORD_BLOCK_SIZE - 1);
+
+        if (legacy_count > 0)
+            ESP_LOGI(TAG, "Keeping %lu records of the flat layout", legacy_count);
+
+        nvs_set_u8(handle, STORE_FORMAT_KEY, STORE_NVS_FORMAT);
+        nvs_set_u32(handle, LEGACY_COUNT_KEY, legacy_count);
+        nvs_set_u32(handle, DATA_COUNT_KEY, counter);
+        nvs_set_u32(handle, ADDRESS_OFFSET_KEY, address);
+
+        nvs_commit(handle);
+    }
+
+    nvs_close(handle);
+
+    store_start = block_start(legacy_count * RECORD_LEGACY_SIZE + RECORD_BLOCK_SIZE - 1);
+
+    head.counter = counter;
+    head.address = address < store_start ? store_start : address;
+
+    store_recover();
+
+    wear_init(store_size, head.address);
+
+    last_time = head_last_time();
+
+    return ESP_OK;
+}
+
+esp_err_t store_write(sensor_data_t *data, uint8_t count) {
+    if (!find_partition())
+        return ESP_ERR_NOT_FOUND;
+
+    uint8_t batch[STORE_WRITE_BATCH * sizeof(record_fine_t)];
+    uint8_t batched = 0;
+    uint32_t batch_address = head.address;
+
+    esp_err_t res = ESP_OK;
+
+    for (uint8_t i = 0; i < count && res == ESP_OK; i++) {
+        if (head.address % RECORD_BLOCK_SIZE != 0 && block_mismatch(&data[i])) {
+            res = write_batch(batch, batched, batch_address);
+            if (res != ESP_OK) {
+                head.counter -= batched;
+                head.address = batch_address;
+                break;
+            }
+
+            batched = 0;
+            head.address = block_start(head.address) + RECORD_BLOCK_SIZE;
+        }
+
+        if (head.address % RECORD_BLOCK_SIZE == 0) {
+            res = open_block(head.counter + 1, data[i].time, record_format(&data[i]));
+            if (res != ESP_OK)
+                break;
+        }
+
+        if (batched == 0)
+            batch_address = head.address;
+
+        data[i].counter = head.counter + 1;
+        record_encode(&data[i], &batch[batched++ * block_record_size]);
+
+        uint32_t next = record_next_slot(head.address, block_record_size);
+        bool contiguous = next == head.address + block_record_size && next % RECORD_BLOCK_SIZE != 0;
+
+        head.counter++;
+        head.address = next;
+        last_time = data[i].time;
+
+        if (!contiguous || batched == STORE_WRITE_BATCH || i == count - 1) {
+            res = write_batch(batch, batched, batch_address);
+
+            if (res != ESP_OK) {
+                // The records of the failed batch are written again at the same position
+                head.counter -= batched;
+                head.address = batch_address;
+            }
+
+            batched = 0;
+        }
+    }
+
+    wear_update(head.address);
+
+    if (res == ESP_ERR_NO_MEM) {
+        ESP_LOGW(TAG, "Store is full, record not written");
+    } else if (res != ESP_OK) {
+        ESP_LOGW(TAG, "Writing records failed, reason %s", esp_err_to_name(res));
+    }
+
+    return res;
+}
+
+esp_err_t store_append(sensor_data_t *data) {
+    energy_begin(ENERGY_SUBSYSTEM_STORAGE);
+    power_begin(POWER_ACTIVITY_FLASH);
+
+    esp_err_t res = store_write(data, 1);
+    if (res == ESP_OK)
+        store_commit();
+
+    power_end(POWER_ACTIVITY_FLASH);
+    energy_end(ENERGY_SUBSYSTEM_STORAGE);
+
+    return res;
+}
+
+void store_clear() {
+    // The partitions are erased first, a power loss before the nvs commit must not revive the old records
+    if (find_partition()) {
+        flash_erase(0, store_size);
+
+        DIAG_COUNT(DIAG_COUNTER_FLASH_ERASES, store_size / RECORD_BLOCK_SIZE);
+
+        wear_clear();
+    }
+
+    nvs_handle_t handle;
+
+    esp_err_t res = nvs_open("sensor_data", NVS_READWRITE, &handle);
+    if (res != ESP_OK) {
+        ESP_LOGW(TAG, "Reading partition with sensor data flags failed, reason %s", esp_err_to_name(res));
+    } else {
+        nvs_erase_key(handle, DATA_COUNT_KEY);
+        nvs_erase_key(handle, ADDRESS_OFFSET_KEY);
+        nvs_set_u8(handle, STORE_FORMAT_KEY, STORE_NVS_FORMAT);
+        nvs_set_u32(handle, LEGACY_COUNT_KEY, 0);
+
+        nvs_commit(handle);
+        nvs_close(handle);
+    }
+
+    head.counter = 0;
+    head.address = 0;
+    last_time = 0;
+    legacy_count = 0;
+    store_start = 0;
+
+    // Sync entries are kept as long as records map by them
+    timebase_clear();
+}
+
+void store_set_pair_id(uint16_t pair_id) {
+    record_pair_id = pair_id;
+}
+
+uint32_t store_count() {
+    return head.counter;
+}
+
+uint32_t store_last_time() {
+    return last_time;
+}
+
+void store_get_head(store_head_t *current) {
+    *current = head;
+}
+
+void store_set_head(const store_head_t *current) {
+    head = *current;
+
+    if (head.address % RECORD_BLOCK_SIZE == 0 || !find_partition())
+        return;
+
+    record_block_header_t header;
+
+    if (flash_read(block_start(head.address), &header, sizeof(header)) == ESP_OK &&
+        record_block_header_valid(&header))
+        block_select(&header);
+}
+
+esp_err_t store_reader_seek(store_reader_t *reader, uint32_t counter) {
+    if (!find_partition())
+        return ESP_ERR_NOT_FOUND;
+
+    if (counter == 0 || counter > head.counter)
+        return ESP_ERR_NOT_FOUND;
+
+    reader->counter = counter;
+
+    if (reader->buffer) {
+        reader->buffer->address[0] = UINT32_MAX;
+        reader->buffer->address[1] = UINT32_MAX;
+    }
+
+    if (counter <= legacy_count) {
+        reader->address = (counter - 1) * RECORD_LEGACY_SIZE;
+        reader->record_size = RECORD_LEGACY_SIZE;
+        reader->format = RECORD_FORMAT_LEGACY;
+        return ESP_OK;
+    }
+
+    record_block_header_t header;
+    esp_err_t res;
+
+    // The blocks up to the head were written in order with rising first counters, blocks may be closed early, so the
+    // block is the last one starting at or before the counter
+    if (head.address <= store_start)
+        return ESP_ERR_NOT_FOUND;
+
+    uint32_t low = store_start;
+    uint32_t high = head.address % RECORD_BLOCK_SIZE != 0 ? block_start(head.address)
+                                                          : head.address - RECORD_BLOCK_SIZE;
+
+    while (low < high) {
+        uint32_t middle = low + ((high - low) / RECORD_BLOCK_SIZE + 1) / 2 * RECORD_BLOCK_SIZE;
+
+        res = flash_read(middle, &header, sizeof(header));
+        if (res != ESP_OK)
+            return res;
+
+        if (!record_block_header_valid(&header))
+            return ESP_ERR_NOT_FOUND;
+
+        if (header.first_counter <= counter) {
+            low = middle;
+        } else {
+            high = middle - RECORD_BLOCK_SIZE;
+        }
+    }
+
+    res = flash_read(low, &header, sizeof(header));
+    if (res != ESP_OK)
+        return res;
+
+    if (!record_block_header_valid(&header) || counter < header.first_counter ||
+        counter - header.first_counter >= RECORD_BLOCK_CAPACITY(header.record_size))
+        return ESP_ERR_NOT_FOUND;
+
+    reader->address = low + sizeof(header) + (counter - header.first_counter) * header.record_size;
+    reader->record_size = header.record_size;
+    reader->format = header.format;
+    reader->time_base = header.time_base;
+
+    return ESP_OK;
+}
+
+/**
+ * @return The index of the buffered chunk at the given address, loaded if it is not buffered yet
+ */
+static int reader_chunk(store_read_buffer_t *buffer, uint32_t chunk_address, esp_err_t *res) {
+    for (int i = 0; i < 2; i++) {
+        if (buffer->address[i] == chunk_address)
+            return i;
+    }
+
+    // The chunk of the last read is kept, records may span both chunks
+    int slot = !buffer->current;
+    uint32_t length = STORE_READ_CHUNK;
+
+    if (chunk_address + length > store_size)
+        length = store_size - chunk_address;
+
+    *res = flash_read(chunk_address, buffer->data[slot], length);
+    buffer->address[slot] = *res == ESP_OK ? chunk_address : UINT32_MAX;
+
+    return slot;
+}
+
+/**
+ * Reads from the buffered chunks of the reader, or directly from flash without buffer
+ */
+static esp_err_t reader_read(store_reader_t *reader, uint32_t address, void *data, size_t length) {
+    if (!reader->buffer)
+        return flash_read(address, data, length);
+
+    uint8_t *out = data;
+
+    while (length > 0) {
+        esp_err_t res = ESP_OK;
+        uint32_t offset = address % STORE_READ_CHUNK;
+        int slot = reader_chunk(reader->buffer, address - offset, &res);
+
+        if (res != ESP_OK)
+            return res;
+
+        size_t part = STORE_READ_CHUNK - offset < length ? STORE_READ_CHUNK - offset : length;
+
+        memcpy(out, reader->buffer->data[slot] + offset, part);
+        reader->buffer->current = slot;
+
+        out += part;
+        address += part;
+        length -= part;
+    }
+
+    return ESP_OK;
+}
+
+void store_reader_prefetch(store_reader_t *reader) {
+    if (!reader->buffer || reader->counter > head.counter)
+        return;
+
+    uint32_t chunk_address = reader->address - reader->address % STORE_READ_CHUNK;
+    esp_err_t res = ESP_OK;
+
+    reader->buffer->current = reader_chunk(reader->buffer, chunk_address, &res);
+
+    if (res == ESP_OK && chunk_address + STORE_READ_CHUNK < store_size)
+        reader_chunk(reader->buffer, chunk_address + STORE_READ_CHUNK, &res);
+}
+
+esp_err_t store_reader_next(store_reader_t *reader, sensor_data_t *data) {
+    uint8_t record[UINT8_MAX];
+    esp_err_t res;
+
+    while (reader->counter <= head.counter) {
+        if (reader->counter <= legacy_count) {
+            res = reader_read(reader, reader->address, record, RECORD_LEGACY_SIZE);
+            if (res != ESP_OK)
+                return res;
+
+            data->counter = reader->counter;
+            record_decode(RECORD_FORMAT_LEGACY, 0, record, data);
+
+            reader->counter++;
+            reader->address += RECORD_LEGACY_SIZE;
+
+            if (reader->counter > legacy_count)
+                reader->address = store_start;
+
+            return ESP_OK;
+        }
+
+        if (reader->address % RECORD_BLOCK_SIZE == 0) {
+            record_block_header_t header;
+
+            res = reader_read(reader, reader->address, &header, sizeof(header));
+            if (res != ESP_OK)
+                return res;
+
+            if (!record_block_header_valid(&header) || header.first_counter != reader->counter) {
+                ESP_LOGW(TAG, "Block at 0x%lx does not continue at data counter %lu", reader->address,
+                         reader->counter);
+                return ESP_ERR_NOT_FOUND;
+            }
+
+            reader->record_size = header.record_size;
+            reader->format = header.format;
+            reader->time_base = header.time_base;
+            reader->address += sizeof(header);
+        }
+
+        res = reader_read(reader, reader->address, record, reader->record_size);
+        if (res != ESP_OK)
+            return res;
+
+        // Rest of a block closed early
+        if (record_is_erased(record, reader->record_size)) {
+            reader->address = block_start(reader->address) + RECORD_BLOCK_SIZE;
+            continue;
+        }
+
+        uint32_t counter = reader->counter;
+
+        reader->counter++;
+        reader->address = record_next_slot(reader->address, reader->record_size);
+
+        // Torn records are skipped
+        if (!record_valid(record, reader->record_size))
+            continue;
+
+        data->counter = counter;
+        record_decode(reader->format, reader->time_base, record, data);
+
+        return ESP_OK;
+    }
+
+    return ESP_ERR_NOT_FOUND;
+}
@@ -0,0 +1,131 @@
+#include <stdint.h>
+#include <esp_err.h>
+#include "sensors.h"
+
+#ifndef AISOLE_STORE_H
+#define AISOLE_STORE_H
+
+/**
+ * Write position of the record store
+ */
+typedef struct {
+    uint32_t counter;       // Data counter of the last stored record
+    uint32_t address;       // Address of the next record, at a block start if a new block has to be opened
+} store_head_t;
+
+// Data partitions spanned by the store in this order, sized in partitions.csv. nvs_ext has to stay first, so records of
+// older firmware keep their addresses and the store continues behind them in the added partitions
+#ifndef STORE_EXTENT_LABELS
+#define STORE_EXTENT_LABELS "nvs_ext", "rec_ext"
+#endif
+
+// Size of the flash reads of a buffered reader, aligned to the chunk size
+#define STORE_READ_CHUNK 1024
+
+/**
+ * Read-ahead buffer of a reader, the chunk following the current one is loaded by store_reader_prefetch
+ */
+typedef struct {
+    uint32_t address[2];    // Address of the chunks, UINT32_MAX if empty
+    uint8_t current;        // Chunk of the last read
+    uint8_t data[2][STORE_READ_CHUNK];
+} store_read_buffer_t;
+
+/**
+ * Sequential reader over the stored records
+ */
+typedef struct {
+    uint32_t counter;       // Data counter of the next record
+    uint32_t address;
+    uint8_t record_size;
+    uint8_t format;
+    uint32_t time_base;     // Monotonic time base of the current block
+    store_read_buffer_t *buffer;    // Optional, without it every record is read from flash by itself
+} store_reader_t;
+
+/**
+ * Loads the write position from nvs and recovers records written after the last nvs commit.\n
+ * The recovery scans only the tail behind the committed position, torn records are skipped
+ * @return ESP_ERR_NOT_FOUND if the first partition of STORE_EXTENT_LABELS is missing, otherwise the esp error code of
+ * nvs
+ */
+esp_err_t store_init();
+
+/**
+ * Appends a record and commits the new write position to nvs
+ * @param data - The sensor data with the monotonic time, the counter is assigned by the store
+ * @return ESP_ERR_NO_MEM if the store is full, otherwise the esp error code of the flash write
+ */
+esp_err_t store_append(sensor_data_t *data);
+
+/**
+ * Appends records without committing the write position to nvs, records of the same block are written at once.
+ * Used in deep sleep where nvs is not initialized, the records are recovered on the next store_init
+ * @param data - The sensor data with the monotonic time, the counters are assigned by the store
+ * @param count - The count of records
+ * @return ESP_ERR_NO_MEM if the store is full, otherwise the esp error code of the flash write
+ */
+esp_err_t store_write(sensor_data_t *data, uint8_t count);
+
+/**
+ * Commits the write position of the records written by store_write to nvs, so the next boot needs no recovery scan
+ */
+void store_commit();
+
+/**
+ * Erases all records and the write position in nvs
+ */
+void store_clear();
+
+/**
+ * Tags the following records with the pair id of the phase alignment, records of different pairs are kept in
+ * separate blocks
+ * @param pair_id - The pair id, PHASE_PAIR_NONE for records sampled without alignment
+ */
+void store_set_pair_id(uint16_t pair_id);
+
+/**
+ * @return The data counter of the last stored record
+ */
+uint32_t store_count();
+
+/**
+ * @return The monotonic time of the last stored record, 0 if there is none
+ */
+uint32_t store_last_time();
+
+/**
+ * @param head - Filled with the current write position
+ */
+void store_get_head(store_head_t *head);
+
+/**
+ * Sets the write position without reading nvs, used to resume the store from rtc memory
+ * @param head - The write position
+ */
+void store_set_head(const store_head_t *head);
+
+/**
+ * Positions the reader at the record with the given data counter, the read buffer is emptied
+ * @param reader - The reader, the buffer has to be set or NULL
+ * @param counter - The data counter, starting at 1
+ * @return ESP_ERR_NOT_FOUND if the record does not exist
+ */
+esp_err_t store_reader_seek(store_reader_t *reader, uint32_t counter);
+
+/**
+ * Reads the next valid record, invalid records are skipped
+ * @param reader - The reader
+ * @param data - Filled with counter, wall clock time and values of the record
+ * @return ESP_ERR_NOT_FOUND after the last record, otherwise the esp error code of the flash read
+ */
+esp_err_t store_reader_next(store_reader_t *reader, sensor_data_t *data);
+
+/**
+ * Loads the chunk following the current one of a buffered reader, called between two reads so the flash read is not
+ * in the path of the next record
+ * @param reader - The reader
+ */
+void store_reader_prefetch(store_reader_t *reader);
+
+#endif //AISOLE_STORE_H
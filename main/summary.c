@@ -0,0 +1,66 @@
+#include <esp_timer.h>
+#include "freertos/FreeRTOS.h"
+#include "ble_host.h"
+#include "summary.h"
+
+static portMUX_TYPE summary_lock = portMUX_INITIALIZER_UNLOCKED;
+
+static summary_t current;
+static summary_t advertised;
+static int64_t advertised_time = 0;
+
+static esp_timer_handle_t update_timer = NULL;
+
+static void advertise() {
+    portENTER_CRITICAL(&summary_lock);
+
+    advertised = current;
+    advertised_time = esp_timer_get_time();
+
+    portEXIT_CRITICAL(&summary_lock);
+
+    ble_host_update_advertising();
+}
+
+static void update_timer_cb(void *arg) {
+    advertise();
+}
+
+void summary_update(uint32_t counter, uint32_t stored, const uint8_t *values, uint32_t sensor_mask, uint8_t flags) {
+#if SUMMARY_ENABLED
+    if (!update_timer) {
+        const esp_timer_create_args_t args = {
+            .callback = update_timer_cb,
+            .name = "summary"
+        };
+
+        if (esp_timer_create(&args, &update_timer) != ESP_OK)
+            return;
+    }
+
+    portENTER_CRITICAL(&summary_lock);
+
+    summary_encode(&current, counter, stored, values, sensor_mask, flags);
+
+    uint32_t elapsed = (esp_timer_get_time() - advertised_time) / 1000;
+    bool due = advertised_time == 0 || summary_update_due(elapsed, &advertised, &current);
+
+    portEXIT_CRITICAL(&summary_lock);
+
+    if (due) {
+        esp_timer_stop(update_timer);
+        advertise();
+    } else if (!esp_timer_is_active(update_timer)) {
+        // The latest summary is advertised once the rate limit passed, also if no further sample follows
+        esp_timer_start_once(update_timer, (SUMMARY_MIN_INTERVAL - elapsed) * 1000ULL);
+    }
+#endif
+}
+
+void summary_get(summary_t *summary) {
+    portENTER_CRITICAL(&summary_lock);
+
+    *summary = advertised;
+
+    portEXIT_CRITICAL(&summary_lock);
+}
@@ -0,0 +1,123 @@
+#include <stdint.h>
+#include <stdbool.h>
+
+#ifndef AISOLE_SUMMARY_H
+#define AISOLE_SUMMARY_H
+
+/*
+ * Summary of the latest sample broadcast as service data in the scan response, so a hub can monitor soles without a
+ * connection. The layout is host-safe and shared with tools reading the scan response
+ */
+
+// Set to 0 to advertise without the summary
+#ifndef SUMMARY_ENABLED
+#define SUMMARY_ENABLED 1
+#endif
+
+// 16 bit uuid of the service data, not assigned by the bluetooth sig, hubs match it together with the name
+#define SUMMARY_UUID16 0x5353
+#define SUMMARY_VERSION 1
+// Minimum time between two updates of the advertising data in ms, changed flags are advertised immediately
+#define SUMMARY_MIN_INTERVAL 10000
+// Difference of the maximum to the mean temperature raising the alert flag, in 0.5 °C
+#define SUMMARY_ALERT_DELTA 4
+
+typedef enum {
+    SUMMARY_FLAG_SAMPLED = 0x01,        // max and mean hold a sample
+    SUMMARY_FLAG_ALERT = 0x02,          // A hot spot exceeds the mean by SUMMARY_ALERT_DELTA
+    SUMMARY_FLAG_RECORDING = 0x04,
+    SUMMARY_FLAG_STREAMING = 0x08
+} SUMMARY_FLAGS;
+
+/**
+ * Service data following the uuid, 10 bytes little endian
+ */
+typedef struct __attribute__((packed)) summary {
+    uint32_t counter: 24;               // Counter of the latest sample, the sequence number while streaming
+    uint32_t flags: 8;
+    uint32_t stored: 24;                // Records in the store
+    uint32_t version: 8;
+    uint8_t max;                        // Temperatures in 0.5 °C like the sensor values
+    uint8_t mean;
+} summary_t;
+
+/**
+ * Encodes the summary of a sample, sensors reading 0 failed and are left out
+ * @param summary - The summary to fill
+ * @param counter - The counter of the sample
+ * @param stored - The count of stored records
+ * @param values - The temperatures indexed by sensor, NULL keeps max and mean
+ * @param sensor_mask - Bit n selects the value n
+ * @param flags - The recording and streaming flags, the sample flags are set by the encoder
+ */
+static inline void summary_encode(summary_t *summary, uint32_t counter, uint32_t stored, const uint8_t *values,
+                                  uint32_t sensor_mask, uint8_t flags) {
+    summary->counter = counter;
+    summary->stored = stored;
+    summary->version = SUMMARY_VERSION;
+
+    if (!values) {
+        summary->flags = (summary->flags & (SUMMARY_FLAG_SAMPLED | SUMMARY_FLAG_ALERT)) | flags;
+        return;
+    }
+
+    uint32_t sum = 0;
+    uint8_t count = 0;
+    uint8_t max = 0;
+
+    for (int i = 0; (sensor_mask >> i) != 0; i++) {
+        if (!(sensor_mask & (1UL << i)) || values[i] == 0)
+            continue;
+
+        sum += values[i];
+        count++;
+
+        if (values[i] > max)
+            max = values[i];
+    }
+
+    summary->flags = flags;
+    summary->max = max;
+    summary->mean = count > 0 ? (sum + count / 2) / count : 0;
+
+    if (count > 0)
+        summary->flags |= SUMMARY_FLAG_SAMPLED;
+
+    if (count > 0 && max - summary->mean >= SUMMARY_ALERT_DELTA)
+        summary->flags |= SUMMARY_FLAG_ALERT;
+}
+
+/**
+ * @param elapsed - Time since the last update of the advertising data in ms
+ * @param advertised - The summary in the advertising data
+ * @param current - The new summary
+ * @return If the advertising data is updated now, otherwise after the rest of SUMMARY_MIN_INTERVAL
+ */
+static inline bool summary_update_due(uint32_t elapsed, const summary_t *advertised, const summary_t *current) {
+    if (advertised->flags != current->flags)
+        return true;
+
+    return elapsed >= SUMMARY_MIN_INTERVAL;
+}
+
+#ifdef ESP_PLATFORM
+
+/**
+ * Updates the summary, the advertising data is refreshed if due, otherwise once the rate limit passed
+ * @param counter - The counter of the latest sample
+ * @param stored - The count of stored records
+ * @param values - The temperatures indexed by sensor, NULL if only the counters changed
+ * @param sensor_mask - Bit n selects the value n
+ * @param flags - SUMMARY_FLAG_RECORDING or SUMMARY_FLAG_STREAMING
+ */
+void summary_update(uint32_t counter, uint32_t stored, const uint8_t *values, uint32_t sensor_mask, uint8_t flags);
+
+/**
+ * Copies the summary for the advertising data
+ * @param summary - Filled with the current summary
+ */
+void summary_get(summary_t *summary);
+
+#endif
+
+#endif //AISOLE_SUMMARY_H
@@ -0,0 +1,278 @@
+#include <string.h>
+#include <stdbool.h>
+#include <sys/time.h>
+#include <esp_attr.h>
+#include <esp_private/esp_clk.h>
+#include "esp_log.h"
+#include "freertos/FreeRTOS.h"
+#include "host/ble_hs.h"
+#include "nvs.h"
+#include "notify.h"
+#include "timebase.h"
+
+#define TIMEBASE_MAGIC 0x54494d45
+// Ring of the sync entries of older firmware versions
+#define LEGACY_SYNC_ENTRIES 8
+
+static const char *TAG = "timebase";
+
+// Keys of the ring of older firmware versions, taken over once
+static const char *LEGACY_ENTRIES_KEY = "entries";
+static const char *LEGACY_COUNT_KEY = "count";
+
+// Table of the sync entries ordered by monotonic time, the length of the blob gives the count
+static const char *SYNC_TABLE_KEY = "table";
+
+/**
+ * Offset of the monotonic time to the rtc timer, retained over deep sleep and software resets
+ */
+typedef struct {
+    uint32_t magic;
+    int64_t offset;
+} timebase_state_t;
+
+static RTC_DATA_ATTR timebase_state_t timebase_state;
+
+static timebase_sync_t sync_entries[TIMEBASE_SYNC_ENTRIES];
+static uint32_t sync_count = 0;
+
+static portMUX_TYPE timebase_lock = portMUX_INITIALIZER_UNLOCKED;
+
+static uint32_t rtc_seconds() {
+    return esp_clk_rtc_time() / 1000000;
+}
+
+static bool entry_synced(const timebase_sync_t *entry) {
+    return entry->wall != TIMEBASE_WALL_UNKNOWN;
+}
+
+static void timebase_save() {
+    nvs_handle_t handle;
+
+    esp_err_t res = nvs_open("time_sync", NVS_READWRITE, &handle);
+    if (res != ESP_OK) {
+        ESP_LOGW(TAG, "Opening nvs namespace time_sync failed, reason %s", esp_err_to_name(res));
+        return;
+    }
+
+    nvs_set_blob(handle, SYNC_TABLE_KEY, sync_entries, sync_count * sizeof(timebase_sync_t));
+    nvs_erase_key(handle, LEGACY_ENTRIES_KEY);
+    nvs_erase_key(handle, LEGACY_COUNT_KEY);
+
+    nvs_commit(handle);
+    nvs_close(handle);
+}
+
+/**
+ * Loads the table, or the ring of older firmware versions in order
+ * @return If the ring was taken over and the table has to be saved
+ */
+static bool timebase_load() {
+    nvs_handle_t handle;
+
+    sync_count = 0;
+
+    if (nvs_open("time_sync", NVS_READONLY, &handle) != ESP_OK)
+        return false;
+
+    size_t length = sizeof(sync_entries);
+
+    if (nvs_get_blob(handle, SYNC_TABLE_KEY, sync_entries, &length) == ESP_OK) {
+        sync_count = length / sizeof(timebase_sync_t);
+        nvs_close(handle);
+        return false;
+    }
+
+    timebase_sync_t ring[LEGACY_SYNC_ENTRIES];
+    uint32_t total;
+
+    length = sizeof(ring);
+
+    if (nvs_get_u32(handle, LEGACY_COUNT_KEY, &total) == ESP_OK &&
+        nvs_get_blob(handle, LEGACY_ENTRIES_KEY, ring, &length) == ESP_OK) {
+        sync_count = total < LEGACY_SYNC_ENTRIES ? total : LEGACY_SYNC_ENTRIES;
+
+        for (uint32_t i = 0; i < sync_count; i++)
+            sync_entries[i] = ring[(total - sync_count + i) % LEGACY_SYNC_ENTRIES];
+    }
+
+    nvs_close(handle);
+
+    return sync_count > 0;
+}
+
+void timebase_init(uint32_t last_time) {
+    bool changed = timebase_load();
+
+    // The rtc timer restarts at zero after a power loss, the time in between is unknown until the next sync
+    if (timebase_state.magic != TIMEBASE_MAGIC) {
+        uint32_t resume = last_time;
+
+        // A sync after the last record is behind it, the entries stay ordered
+        if (sync_count > 0 && sync_entries[sync_count - 1].mono > resume)
+            resume = sync_entries[sync_count - 1].mono;
+
+        timebase_state.magic = TIMEBASE_MAGIC;
+        timebase_state.offset = (int64_t) resume + 1 - rtc_seconds();
+
+        ESP_LOGI(TAG, "Continuing monotonic time at %lu", timebase_now());
+
+        // Records before the next sync must not be mapped by the entries before the power loss, a discontinuity
+        // right after another one adds nothing
+        bool synced_last = sync_count > 0 && entry_synced(&sync_entries[sync_count - 1]);
+
+        if ((synced_last || (sync_count == 0 && last_time > 0)) && sync_count < TIMEBASE_SYNC_ENTRIES) {
+            sync_entries[sync_count++] = (timebase_sync_t) {timebase_now(), TIMEBASE_WALL_UNKNOWN, 0};
+            changed = true;
+        }
+    }
+
+    if (changed)
+        timebase_save();
+}
+
+uint32_t timebase_now() {
+    return timebase_state.offset + rtc_seconds();
+}
+
+void timebase_sync(uint32_t wall) {
+    uint32_t mono = timebase_now();
+    bool added = false;
+
+    portENTER_CRITICAL(&timebase_lock);
+
+    const timebase_sync_t *last = sync_count > 0 ? &sync_entries[sync_count - 1] : NULL;
+    const timebase_sync_t *reference = NULL;
+    int32_t drift = 0;
+
+    // The drift of the latest synced entry and the latest synced entry old enough for an estimate, both without a
+    // power loss in between
+    for (int i = (int) sync_count - 1; i >= 0 && entry_synced(&sync_entries[i]); i--) {
+        if (i == (int) sync_count - 1)
+            drift = sync_entries[i].drift_ppm;
+
+        if (mono - sync_entries[i].mono >= TIMEBASE_MIN_DRIFT_INTERVAL) {
+            reference = &sync_entries[i];
+            break;
+        }
+    }
+
+    if (reference) {
+        int64_t elapsed = mono - reference->mono;
+        int64_t measured = ((int64_t) wall - reference->wall - elapsed) * 1000000 / elapsed;
+
+        if (measured > TIMEBASE_MAX_DRIFT_PPM || measured < -TIMEBASE_MAX_DRIFT_PPM) {
+            // Wall clock changed by the user, the drift estimate is kept
+        } else if (drift != 0) {
+            drift = (drift + measured) / 2;
+        } else {
+            drift = measured;
+        }
+    }
+
+    // Stored records map by the existing entries, so they are never moved. A sync the last entry already maps adds
+    // nothing, a wall clock step or a sync after a discontinuity adds an entry
+    int64_t deviation = last && entry_synced(last) ? (int64_t) wall - timebase_map(last, mono) : INT64_MAX;
+
+    if (deviation > TIMEBASE_SYNC_TOLERANCE || deviation < -TIMEBASE_SYNC_TOLERANCE) {
+        if (sync_count < TIMEBASE_SYNC_ENTRIES) {
+            sync_entries[sync_count++] = (timebase_sync_t) {mono, wall, drift};
+            added = true;
+        }
+    }
+
+    portEXIT_CRITICAL(&timebase_lock);
+
+    if (added) {
+        ESP_LOGI(TAG, "Synced wall clock %lu at monotonic time %lu, drift %ld ppm", wall, mono, drift);
+        timebase_save();
+    } else if (sync_count == TIMEBASE_SYNC_ENTRIES) {
+        ESP_LOGW(TAG, "Sync entries full, wall clock %lu not kept until the records are cleared", wall);
+    }
+
+    // The system time is only used for logs, records use the monotonic time
+    struct timeval time = {.tv_sec = wall, .tv_usec = 0};
+    settimeofday(&time, NULL);
+}
+
+void timebase_clear() {
+    portENTER_CRITICAL(&timebase_lock);
+
+    // The last synced entry and a discontinuity behind it map the records that follow
+    int keep = (int) sync_count - 1;
+
+    while (keep > 0 && !entry_synced(&sync_entries[keep]))
+        keep--;
+
+    if (keep > 0) {
+        memmove(sync_entries, &sync_entries[keep], (sync_count - keep) * sizeof(timebase_sync_t));
+        sync_count -= keep;
+    }
+
+    portEXIT_CRITICAL(&timebase_lock);
+
+    if (keep > 0)
+        timebase_save();
+}
+
+uint32_t timebase_to_wall(uint32_t mono) {
+    if (sync_count == 0)
+        return mono;
+
+    portENTER_CRITICAL(&timebase_lock);
+
+    // The latest entry at or before the time, -1 for times before the first entry
+    int found = -1;
+
+    while (found + 1 < (int) sync_count && sync_entries[found + 1].mono <= mono)
+        found++;
+
+    const timebase_sync_t *entry = NULL;
+
+    if (found >= 0 && entry_synced(&sync_entries[found])) {
+        entry = &sync_entries[found];
+    } else if (found + 1 < (int) sync_count && entry_synced(&sync_entries[found + 1])) {
+        // After a discontinuity or before the first entry, the next sync maps back without a power loss in between
+        entry = &sync_entries[found + 1];
+    } else {
+        // Not synced since the power loss, the latest sync before is the best guess until the next one
+        for (int i = found - 1; i >= 0 && !entry; i--) {
+            if (entry_synced(&sync_entries[i]))
+                entry = &sync_entries[i];
+        }
+
+        for (int i = found + 1; i < (int) sync_count && !entry; i++) {
+            if (entry_synced(&sync_entries[i]))
+                entry = &sync_entries[i];
+        }
+    }
+
+    uint32_t wall = entry ? timebase_map(entry, mono) : mono;
+
+    portEXIT_CRITICAL(&timebase_lock);
+
+    return wall;
+}
+
+void timebase_notify() {
+    timebase_sync_t last = {0, 0, 0};
+
+    portENTER_CRITICAL(&timebase_lock);
+
+    if (sync_count > 0)
+        last = sync_entries[sync_count - 1];
+
+    portEXIT_CRITICAL(&timebase_lock);
+
+    uint32_t now = timebase_now();
+
+    uint8_t frame[8 + sizeof(last)];
+
+    memcpy((void *) frame, (void *) &sync_count, sizeof(uint32_t));
+    memcpy((void *) frame + 4, (void *) &last, sizeof(last));
+    memcpy((void *) frame + 4 + sizeof(last), (void *) &now, sizeof(uint32_t));
+
+    frame[3] = 26;
+
+    notify_send(frame, sizeof(frame), NOTIFY_POLICY_LATEST);
+}
@@ -0,0 +1,71 @@
+#include <stdint.h>
+
+#ifndef AISOLE_TIMEBASE_H
+#define AISOLE_TIMEBASE_H
+
+// Wall clock sync points kept in nvs, entries are kept until the store is cleared since stored records map by them
+#define TIMEBASE_SYNC_ENTRIES 128
+// Syncs the last entry maps within this deviation in seconds add no entry
+#define TIMEBASE_SYNC_TOLERANCE 2
+// Wall clock time of a discontinuity entry, the monotonic time continued after a power loss of unknown length
+#define TIMEBASE_WALL_UNKNOWN 0
+// Minimum monotonic time between two syncs to estimate the drift in seconds
+#define TIMEBASE_MIN_DRIFT_INTERVAL 600
+// Drift estimates above are rejected as wrong syncs, the rc slow clock is within a few percent
+#define TIMEBASE_MAX_DRIFT_PPM 50000
+
+/**
+ * Maps the monotonic time to the wall clock time, valid from the monotonic time onwards
+ */
+typedef struct __attribute__((packed)) {
+    uint32_t mono;
+    uint32_t wall;
+    int32_t drift_ppm;      // Deviation of the rtc clock from the wall clock, positive if the rtc clock is slow
+} timebase_sync_t;
+
+/**
+ * @return The wall clock time of the monotonic time by the given sync entry, shared with the host tools
+ */
+static inline uint32_t timebase_map(const timebase_sync_t *entry, uint32_t mono) {
+    int64_t elapsed = (int64_t) mono - entry->mono;
+
+    return entry->wall + elapsed + elapsed * entry->drift_ppm / 1000000;
+}
+
+/**
+ * Loads the sync entries and continues the monotonic time after a power loss, the break is kept as a discontinuity
+ * entry so the records before the next sync are mapped by that sync
+ * @param last_time - The monotonic time of the last stored record, the time base continues behind it
+ */
+void timebase_init(uint32_t last_time);
+
+/**
+ * @return The monotonic time in seconds, it is not changed by syncs and continues over deep sleep and resets
+ */
+uint32_t timebase_now();
+
+/**
+ * Adds a sync entry for the current monotonic time unless the last entry maps it within TIMEBASE_SYNC_TOLERANCE, the
+ * drift is estimated against an entry at least TIMEBASE_MIN_DRIFT_INTERVAL older. Existing entries are never changed
+ * @param wall - The wall clock time of the app in seconds
+ */
+void timebase_sync(uint32_t wall);
+
+/**
+ * Drops the sync entries before the last synced one, called when the stored records are cleared
+ */
+void timebase_clear();
+
+/**
+ * Maps by the latest entry before the time, the time after a discontinuity by the first sync behind it
+ * @param mono - A monotonic time in seconds
+ * @return The wall clock time, the monotonic time itself if never synced
+ */
+uint32_t timebase_to_wall(uint32_t mono);
+
+/**
+ * Notifies the device of the sync state: entry count, drift, and the last entry
+ */
+void timebase_notify();
+
+#endif //AISOLE_TIMEBASE_H
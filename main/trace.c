@@ -0,0 +1,61 @@
+#include <string.h>
+#include <esp_timer.h>
+#include "freertos/FreeRTOS.h"
+#include "host/ble_hs.h"
+#include "trace.h"
+
+static portMUX_TYPE trace_lock = portMUX_INITIALIZER_UNLOCKED;
+
+static trace_entry_t trace_ring[TRACE_RING_SIZE];
+static uint32_t trace_written = 0;
+static uint32_t trace_cursor = 0;
+
+void trace_record(TRACE_EVENT event, uint8_t arg0, uint16_t arg1, uint32_t arg2) {
+#if TRACE_ENABLED
+    uint32_t timestamp = esp_timer_get_time();
+
+    portENTER_CRITICAL(&trace_lock);
+
+    trace_entry_t *entry = &trace_ring[trace_written % TRACE_RING_SIZE];
+
+    entry->timestamp = timestamp;
+    entry->event = event;
+    entry->arg0 = arg0;
+    entry->arg1 = arg1;
+    entry->arg2 = arg2;
+
+    trace_written++;
+
+    portEXIT_CRITICAL(&trace_lock);
+#endif
+}
+
+void trace_set_cursor(uint32_t sequence) {
+    trace_cursor = sequence;
+}
+
+int trace_read(struct os_mbuf *om) {
+    trace_entry_t entries[TRACE_PAGE_ENTRIES];
+    trace_page_header_t header;
+
+    portENTER_CRITICAL(&trace_lock);
+
+    header.written = trace_written;
+    header.first = trace_cursor;
+
+    // Entries older than the ring are already overwritten
+    if (trace_written > TRACE_RING_SIZE && header.first < trace_written - TRACE_RING_SIZE)
+        header.first = trace_written - TRACE_RING_SIZE;
+
+    header.count = 0;
+    for (uint32_t i = header.first; i < trace_written && header.count < TRACE_PAGE_ENTRIES; i++)
+        entries[header.count++] = trace_ring[i % TRACE_RING_SIZE];
+
+    portEXIT_CRITICAL(&trace_lock);
+
+    int res = os_mbuf_append(om, &header, sizeof(header));
+    if (res != 0)
+        return res;
+
+    return os_mbuf_append(om, entries, header.count * sizeof(trace_entry_t));
+}
@@ -0,0 +1,96 @@
+#include <stdint.h>
+
+#ifndef AISOLE_TRACE_H
+#define AISOLE_TRACE_H
+
+// Set to 0 to compile out the binary trace ring
+#ifndef TRACE_ENABLED
+#define TRACE_ENABLED 1
+#endif
+
+// Set to 1 to additionally log the traced hot path events as strings (formatted and sent over uart on the caller)
+#ifndef TRACE_LOG_STRINGS
+#define TRACE_LOG_STRINGS 0
+#endif
+
+#define TRACE_RING_SIZE 256
+// Entries returned per read of the trace diagnostics page
+#define TRACE_PAGE_ENTRIES 40
+
+/**
+ * Traced events, the ids are shared with the host decoder in tools/ and must not be reordered
+ */
+typedef enum {
+    TRACE_NONE = 0,
+    TRACE_GAP_CONNECT,              // arg0: status, arg1: conn handle
+    TRACE_GAP_DISCONNECT,           // arg2: reason
+    TRACE_GAP_CONN_UPDATE,          // arg0: status, arg1: conn handle, arg2: interval (1.25 ms)
+    TRACE_GAP_CONN_UPDATE_REQ,      // arg1: peer itvl min, arg2: peer itvl max
+    TRACE_GAP_ADV_COMPLETE,         // arg2: reason
+    TRACE_GAP_ENC_CHANGE,           // arg0: status, arg1: conn handle
+    TRACE_GAP_NOTIFY_TX,            // arg0: status, arg1: attr handle, arg2: indication
+    TRACE_GAP_SUBSCRIBE,            // arg0: cur notify, arg1: attr handle, arg2: reason
+    TRACE_GAP_MTU,                  // arg1: conn handle, arg2: mtu
+    TRACE_GATT_ACCESS,              // arg0: op, arg1: attr handle, arg2: conn handle
+    TRACE_GATT_WRITE,               // arg0: command, arg1: length
+    TRACE_SENSOR_READ,              // arg0: address, arg1: raw temperature (msb, lsb), arg2: result, off in captures
+    TRACE_I2C_WRITE,                // Captured bus transactions, see i2c_bus.c for the arguments
+    TRACE_I2C_READ,
+    TRACE_EVENT_COUNT
+} TRACE_EVENT;
+
+/**
+ * A single trace entry, 12 bytes little endian
+ */
+typedef struct __attribute__((packed)) trace_entry {
+    uint32_t timestamp;     // us since startup
+    uint8_t event;
+    uint8_t arg0;
+    uint16_t arg1;
+    uint32_t arg2;
+} trace_entry_t;
+
+/**
+ * Header of the trace diagnostics page, followed by up to TRACE_PAGE_ENTRIES entries
+ */
+typedef struct __attribute__((packed)) trace_page_header {
+    uint32_t written;       // Total count of entries recorded since startup
+    uint32_t first;         // Sequence number of the first entry in the page
+    uint8_t count;
+} trace_page_header_t;
+
+#if TRACE_ENABLED
+#define TRACE(event, arg0, arg1, arg2) trace_record(event, arg0, arg1, arg2)
+#else
+#define TRACE(event, arg0, arg1, arg2) do {} while (0)
+#endif
+
+#if TRACE_LOG_STRINGS
+#define TRACE_LOGI(tag, ...) ESP_LOGI(tag, __VA_ARGS__)
+#define TRACE_LOGV(tag, ...) ESP_LOGV(tag, __VA_ARGS__)
+#else
+#define TRACE_LOGI(tag, ...) do {} while (0)
+#define TRACE_LOGV(tag, ...) do {} while (0)
+#endif
+
+/**
+ * Records an event in the trace ring, the oldest entry is overwritten if the ring is full
+ */
+void trace_record(TRACE_EVENT event, uint8_t arg0, uint16_t arg1, uint32_t arg2);
+
+/**
+ * Sets the sequence number of the first entry returned by the trace diagnostics page
+ * @param sequence - The sequence number, older entries than the ring holds are skipped
+ */
+void trace_set_cursor(uint32_t sequence);
+
+struct os_mbuf;
+
+/**
+ * Appends the trace page header and the entries starting at the cursor to the given memory buffer
+ * @param om - The memory buffer of the read access
+ * @return 0 on success, otherwise the os_mbuf error code
+ */
+int trace_read(struct os_mbuf *om);
+
+#endif //AISOLE_TRACE_H
@@ -0,0 +1,277 @@
+#include <string.h>
+#include <stdbool.h>
+#include "freertos/FreeRTOS.h"
+#include "esp_log.h"
+#include "host/ble_hs.h"
+#include "nvs.h"
+#include "record.h"
+#include "timebase.h"
+#include "wear.h"
+
+#define WEAR_VERSION 1
+
+static const char *TAG = "wear";
+
+static const char *WEAR_KEY = "wear";
+
+/**
+ * Wear state saved as nvs blob, only the erase counts of the sectors in use are saved
+ */
+typedef struct __attribute__((packed)) {
+    uint16_t version;
+    uint16_t sector_count;
+    uint32_t address;               // Write position accounted last
+    uint32_t clears;
+    uint64_t bytes_written;
+    uint32_t window_start;          // Monotonic time the current window started in s, 0 before the first write
+    uint32_t window_bytes;
+    uint32_t window_erases;
+    uint32_t last_day_bytes;
+    uint32_t last_day_erases;
+    uint16_t erase_counts[WEAR_MAX_SECTORS];
+} wear_state_t;
+
+static wear_state_t state;
+
+static portMUX_TYPE wear_lock = portMUX_INITIALIZER_UNLOCKED;
+
+static bool loaded = false;
+// Set when a window ended, the state is saved with the next commit
+static bool save_pending = false;
+
+static size_t state_size() {
+    return offsetof(wear_state_t, erase_counts) + state.sector_count * sizeof(uint16_t);
+}
+
+static void sector_erased(uint32_t sector) {
+    if (state.erase_counts[sector] < UINT16_MAX)
+        state.erase_counts[sector]++;
+
+    state.window_erases++;
+}
+
+/**
+ * Accounts the blocks starting between the position accounted last and the given position, called in the lock
+ */
+static void account(uint32_t address) {
+    // The head was moved back to reopen a torn block, the block is erased again when reopened
+    if (address < state.address) {
+        state.address = address;
+        return;
+    }
+
+    uint32_t sector = (state.address + RECORD_BLOCK_SIZE - 1) / RECORD_BLOCK_SIZE;
+
+    for (; sector < state.sector_count && sector * RECORD_BLOCK_SIZE < address; sector++)
+        sector_erased(sector);
+
+    // Includes the unused tail of blocks closed early, so it is an upper bound of the written bytes
+    state.bytes_written += address - state.address;
+    state.window_bytes += address - state.address;
+    state.address = address;
+}
+
+/**
+ * Starts a new window once a day passed, called in the lock
+ */
+static void roll_window(uint32_t now) {
+    // The monotonic time is unset until the store is loaded after a power loss
+    if (state.window_start == 0 || now < state.window_start) {
+        state.window_start = now;
+        return;
+    }
+
+    uint32_t elapsed = now - state.window_start;
+
+    if (elapsed < WEAR_DAY)
+        return;
+
+    // A window ended long ago does not tell the rate of the previous day
+    state.last_day_bytes = elapsed < 2 * WEAR_DAY ? state.window_bytes : 0;
+    state.last_day_erases = elapsed < 2 * WEAR_DAY ? state.window_erases : 0;
+    state.window_bytes = 0;
+    state.window_erases = 0;
+    state.window_start = now;
+
+    save_pending = true;
+}
+
+static void wear_save() {
+    nvs_handle_t handle;
+
+    esp_err_t res = nvs_open("sensor_data", NVS_READWRITE, &handle);
+    if (res != ESP_OK) {
+        ESP_LOGW(TAG, "Opening nvs namespace sensor_data failed, reason %s", esp_err_to_name(res));
+        return;
+    }
+
+    // Only the service task changes the state, the lock is not held during the flash write
+    res = nvs_set_blob(handle, WEAR_KEY, &state, state_size());
+    if (res == ESP_OK)
+        res = nvs_commit(handle);
+
+    if (res != ESP_OK)
+        ESP_LOGW(TAG, "Saving the wear state failed, reason %s", esp_err_to_name(res));
+
+    nvs_close(handle);
+
+    save_pending = false;
+}
+
+void wear_init(uint32_t store_size, uint32_t address) {
+    uint32_t sector_count = store_size / RECORD_BLOCK_SIZE;
+
+    if (sector_count > WEAR_MAX_SECTORS) {
+        ESP_LOGW(TAG, "Tracking the first %d of %lu sectors", WEAR_MAX_SECTORS, sector_count);
+        sector_count = WEAR_MAX_SECTORS;
+    }
+
+    nvs_handle_t handle;
+    size_t length = sizeof(state);
+
+    memset(&state, 0, sizeof(state));
+
+    if (nvs_open("sensor_data", NVS_READONLY, &handle) == ESP_OK) {
+        if (nvs_get_blob(handle, WEAR_KEY, &state, &length) != ESP_OK || state.version != WEAR_VERSION ||
+            length != state_size())
+            memset(&state, 0, sizeof(state));
+
+        nvs_close(handle);
+    }
+
+    // An added partition starts without erases, counts of removed sectors are dropped
+    if (state.sector_count > sector_count)
+        memset(&state.erase_counts[sector_count], 0, (state.sector_count - sector_count) * sizeof(uint16_t));
+
+    state.version = WEAR_VERSION;
+    state.sector_count = sector_count;
+
+    portENTER_CRITICAL(&wear_lock);
+
+    // Without a saved state the blocks behind the position count as erased once
+    account(address);
+
+    loaded = true;
+
+    portEXIT_CRITICAL(&wear_lock);
+
+    ESP_LOGI(TAG, "%lu bytes written to %u sectors, %lu clears", (uint32_t) state.bytes_written, state.sector_count,
+             state.clears);
+}
+
+void wear_update(uint32_t address) {
+    if (!loaded)
+        return;
+
+    uint32_t now = timebase_now();
+
+    portENTER_CRITICAL(&wear_lock);
+
+    roll_window(now);
+    account(address);
+
+    portEXIT_CRITICAL(&wear_lock);
+}
+
+void wear_clear() {
+    if (!loaded)
+        return;
+
+    uint32_t now = timebase_now();
+
+    portENTER_CRITICAL(&wear_lock);
+
+    roll_window(now);
+
+    for (uint32_t sector = 0; sector < state.sector_count; sector++)
+        sector_erased(sector);
+
+    state.clears++;
+    state.address = 0;
+
+    portEXIT_CRITICAL(&wear_lock);
+
+    wear_save();
+}
+
+void wear_commit() {
+    if (loaded && save_pending)
+        wear_save();
+}
+
+/**
+ * @return The time in s until the given amount is reached at the rate of amount per window, UINT32_MAX if none
+ */
+static uint32_t projection(uint64_t remaining, uint64_t window_amount, uint32_t window) {
+    if (window_amount == 0 || window == 0)
+        return UINT32_MAX;
+
+    uint64_t time = remaining * window / window_amount;
+
+    return time < UINT32_MAX ? time : UINT32_MAX - 1;
+}
+
+int wear_read(struct os_mbuf *om) {
+    wear_report_t report = {0};
+
+    uint32_t now = timebase_now();
+
+    portENTER_CRITICAL(&wear_lock);
+
+    uint32_t sector_count = loaded ? state.sector_count : 0;
+    uint8_t per_group = (sector_count + WEAR_REPORT_GROUPS - 1) / WEAR_REPORT_GROUPS;
+
+    report.store_size = sector_count * RECORD_BLOCK_SIZE;
+    report.used = state.address;
+    report.sector_count = sector_count;
+    report.clears = state.clears;
+    report.bytes_written = state.bytes_written;
+    report.window_s = state.window_start != 0 && now > state.window_start ? now - state.window_start : 0;
+    report.window_bytes = state.window_bytes;
+    report.window_erases = state.window_erases;
+    report.last_day_bytes = state.last_day_bytes;
+    report.last_day_erases = state.last_day_erases;
+    report.sectors_per_group = per_group;
+    report.min_erases = sector_count > 0 ? UINT16_MAX : 0;
+
+    for (uint32_t sector = 0; sector < sector_count; sector++) {
+        uint16_t count = state.erase_counts[sector];
+        uint32_t group = sector / per_group;
+
+        report.erases += count;
+
+        if (count < report.min_erases)
+            report.min_erases = count;
+        if (count > report.max_erases)
+            report.max_erases = count;
+        if (count > report.group_max_erases[group])
+            report.group_max_erases[group] = count;
+
+        report.group_count = group + 1;
+    }
+
+    portEXIT_CRITICAL(&wear_lock);
+
+    if (report.store_size > 0)
+        report.fill_permille = (uint64_t) report.used * 1000 / report.store_size;
+
+    // The current window is used once long enough, the projections assume the rate continues
+    uint64_t bytes = report.window_bytes;
+    uint64_t erases = report.window_erases;
+    uint32_t window = report.window_s;
+
+    if (window < WEAR_MIN_RATE_WINDOW && report.last_day_bytes > 0) {
+        bytes = report.last_day_bytes;
+        erases = report.last_day_erases;
+        window = WEAR_DAY;
+    }
+
+    report.full_in_s = projection(report.store_size - report.used, bytes, window);
+
+    // Appending spreads the erases evenly, so the most erased sector wears at the mean rate of all sectors
+    uint32_t life = projection((uint64_t) (WEAR_ENDURANCE_CYCLES - report.max_erases) * sector_count, erases, window);
+
+    report.life_days = life == UINT32_MAX ? UINT32_MAX : life / WEAR_DAY;
+
+    return os_mbuf_append(om, &report, sizeof(report));
+}
@@ -0,0 +1,82 @@
+#include <stdint.h>
+
+#ifndef AISOLE_WEAR_H
+#define AISOLE_WEAR_H
+
+/*
+ * Wear and capacity telemetry of the record store. The store only appends, each block is erased when the write
+ * position reaches it and all blocks are erased by a clear. Erases and written bytes are therefore derived from the
+ * advance of the write position, which is already committed with every record. The wear state itself is saved to nvs
+ * once a day and on a clear, anything written since (including deep sleep) is accounted again from the position.
+ */
+
+// Sectors tracked, the store spans at most the whole flash
+#define WEAR_MAX_SECTORS 1024
+// Groups of adjacent sectors in the report, each with the highest erase count of its sectors
+#define WEAR_REPORT_GROUPS 64
+// Window of the write rate in s
+#define WEAR_DAY 86400
+// The current window is projected from once it is this long in s, before the previous window is used
+#define WEAR_MIN_RATE_WINDOW 3600
+// Rated erase cycles of a flash sector
+#define WEAR_ENDURANCE_CYCLES 100000
+
+/**
+ * Report of the wear diagnostics page, 190 bytes little endian
+ */
+typedef struct __attribute__((packed)) wear_report {
+    uint32_t store_size;            // Bytes of the store
+    uint32_t used;                  // Bytes up to the write position
+    uint16_t fill_permille;
+    uint16_t sector_count;
+    uint32_t clears;
+    uint32_t erases;                // Sum over all sectors
+    uint16_t min_erases;
+    uint16_t max_erases;
+    uint64_t bytes_written;
+    uint32_t window_s;              // Length of the current window
+    uint32_t window_bytes;
+    uint32_t window_erases;
+    uint32_t last_day_bytes;        // Bytes written in the previous window
+    uint32_t last_day_erases;
+    uint32_t full_in_s;             // Time until the store is full at the current write rate, UINT32_MAX if not writing
+    uint32_t life_days;             // Days until the most erased sector reaches WEAR_ENDURANCE_CYCLES, UINT32_MAX alike
+    uint8_t sectors_per_group;
+    uint8_t group_count;
+    uint16_t group_max_erases[WEAR_REPORT_GROUPS];
+} wear_report_t;
+
+/**
+ * Loads the wear state from nvs and accounts the blocks opened since it was saved
+ * @param store_size - The bytes of the store, a multiple of the block size
+ * @param address - The write position after the recovery of the store
+ */
+void wear_init(uint32_t store_size, uint32_t address);
+
+/**
+ * Accounts the blocks opened and bytes written up to the write position, a position moved back reopens its block.
+ * Does nothing before wear_init, in deep sleep the next full boot accounts the records
+ * @param address - The write position
+ */
+void wear_update(uint32_t address);
+
+/**
+ * Accounts the erase of all sectors by a store clear and saves the state
+ */
+void wear_clear();
+
+/**
+ * Saves the state to nvs if a window ended since the last save, called together with the commit of the store
+ */
+void wear_commit();
+
+struct os_mbuf;
+
+/**
+ * Appends the wear report to the given memory buffer, not reset by the diagnostics reset
+ * @param om - The memory buffer of the read access
+ * @return 0 on success, otherwise the os_mbuf error code
+ */
+int wear_read(struct os_mbuf *om);
+
+#endif //AISOLE_WEAR_H
@@ -0,0 +1,64 @@
+#include <stdio.h>
+#include <string.h>
+
+#ifndef AISOLE_TOOLS_BASELINE_H
+#define AISOLE_TOOLS_BASELINE_H
+
+/*
+ * Regression check of the benchmark tools against baseline files of "metric max" lines, # starts a comment
+ */
+
+typedef struct {
+    const char *name;
+    double value;
+} metric_t;
+
+/**
+ * @param path - The baseline file
+ * @param metrics - The measured metrics, metrics missing in the baseline are not checked
+ * @param metric_count - The count of metrics
+ * @param tolerance - The fraction a metric may exceed its baseline
+ * @return The count of metrics exceeding the baseline, -1 if the baseline can not be read
+ */
+static inline int compare_baseline(const char *path, const metric_t *metrics, int metric_count, double tolerance) {
+    FILE *file = fopen(path, "r");
+    if (!file) {
+        perror(path);
+        return -1;
+    }
+
+    char line[256];
+    char name[64];
+    double max;
+    int regressions = 0;
+
+    while (fgets(line, sizeof(line), file)) {
+        if (line[0] == '#' || sscanf(line, "%63s %lf", name, &max) != 2)
+            continue;
+
+        for (int i = 0; i < metric_count; i++) {
+            if (strcmp(metrics[i].name, name) != 0)
+                continue;
+
+            if (metrics[i].value > max * (1 + tolerance)) {
+                fprintf(stderr, "Regression: %s is %.3f, baseline %.3f\n", name, metrics[i].value, max);
+                regressions++;
+            }
+        }
+    }
+
+    fclose(file);
+
+    return regressions;
+}
+
+/**
+ * Prints the metrics as members of a JSON object
+ * @param indent - The indentation of the members
+ */
+static inline void print_metrics(const metric_t *metrics, int metric_count, const char *indent) {
+    for (int i = 0; i < metric_count; i++)
+        printf("%s\"%s\": %.3f%s\n", indent, metrics[i].name, metrics[i].value, i < metric_count - 1 ? "," : "");
+}
+
+#endif //AISOLE_TOOLS_BASELINE_H
@@ -0,0 +1,128 @@
+/**
+ * Evaluates a read of the counters diagnostics page (page byte, header, counters) of a recording run.\n
+ * Prints the counters and the metrics per record as JSON and compares the metrics with a baseline file of
+ * "metric max" lines, the exit code is 2 if a metric exceeds its baseline by more than the tolerance
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+#include "diagnostics.h"
+#include "baseline.h"
+
+static const char *counter_names[DIAG_COUNTER_COUNT] = {
+    [DIAG_COUNTER_FLASH_WRITES] = "flash_writes",
+    [DIAG_COUNTER_FLASH_WRITE_BYTES] = "flash_write_bytes",
+    [DIAG_COUNTER_FLASH_ERASES] = "flash_erases",
+    [DIAG_COUNTER_NVS_COMMITS] = "nvs_commits",
+    [DIAG_COUNTER_RECORDS] = "records",
+    [DIAG_COUNTER_NOTIFICATIONS] = "notifications",
+    [DIAG_COUNTER_NOTIFY_BYTES] = "notify_bytes",
+    [DIAG_COUNTER_SAMPLES] = "samples",
+    [DIAG_COUNTER_SAMPLE_AWAKE_US] = "sample_awake_us",
+    [DIAG_COUNTER_DRAIN_RECORDS] = "drain_records",
+    [DIAG_COUNTER_DRAIN_MS] = "drain_ms",
+    [DIAG_COUNTER_FLASH_READS] = "flash_reads",
+    [DIAG_COUNTER_FLASH_READ_US] = "flash_read_us",
+    [DIAG_COUNTER_PLAYED_RECORDS] = "played_records",
+    [DIAG_COUNTER_STREAM_SAMPLES] = "stream_samples",
+    [DIAG_COUNTER_STREAM_NOTIFICATIONS] = "stream_notifications",
+    [DIAG_COUNTER_STREAM_LATENCY_MS] = "stream_latency_ms",
+};
+
+static double ratio(uint32_t value, uint32_t count) {
+    return count == 0 ? 0 : (double) value / count;
+}
+
+static void usage(const char *name) {
+    fprintf(stderr, "Usage: %s [-b baseline] [-t tolerance_percent] counters_page\n", name);
+}
+
+int main(int argc, char **argv) {
+    const char *baseline = NULL;
+    double tolerance = 0.05;
+    int option;
+
+    while ((option = getopt(argc, argv, "b:t:")) != -1) {
+        switch (option) {
+            case 'b':
+                baseline = optarg;
+                break;
+            case 't':
+                tolerance = strtod(optarg, NULL) / 100;
+                break;
+            default:
+                usage(argv[0]);
+                return 1;
+        }
+    }
+
+    if (optind != argc - 1) {
+        usage(argv[0]);
+        return 1;
+    }
+
+    FILE *file = fopen(argv[optind], "rb");
+    if (!file) {
+        perror(argv[optind]);
+        return 1;
+    }
+
+    uint8_t page;
+    uint8_t header[4];
+    uint32_t counters[DIAG_COUNTER_COUNT] = {0};
+
+    if (fread(&page, 1, 1, file) != 1 || page != DIAG_PAGE_COUNTERS || fread(header, sizeof(header), 1, file) != 1) {
+        fprintf(stderr, "Not a counters diagnostics page\n");
+        return 1;
+    }
+
+    // Older firmware may report fewer counters
+    int counter_count = header[0] < DIAG_COUNTER_COUNT ? header[0] : DIAG_COUNTER_COUNT;
+
+    if (fread(counters, sizeof(uint32_t), counter_count, file) != (size_t) counter_count) {
+        fprintf(stderr, "Truncated counters page\n");
+        return 1;
+    }
+
+    fclose(file);
+
+    uint32_t records = counters[DIAG_COUNTER_RECORDS];
+
+    const metric_t metrics[] = {
+        {"flash_writes_per_record", ratio(counters[DIAG_COUNTER_FLASH_WRITES], records)},
+        {"flash_bytes_per_record", ratio(counters[DIAG_COUNTER_FLASH_WRITE_BYTES], records)},
+        {"flash_erases_per_1000_records", ratio(counters[DIAG_COUNTER_FLASH_ERASES], records) * 1000},
+        {"nvs_commits_per_record", ratio(counters[DIAG_COUNTER_NVS_COMMITS], records)},
+        {"notify_bytes_per_notification",
+         ratio(counters[DIAG_COUNTER_NOTIFY_BYTES], counters[DIAG_COUNTER_NOTIFICATIONS])},
+        {"awake_us_per_sample", ratio(counters[DIAG_COUNTER_SAMPLE_AWAKE_US], counters[DIAG_COUNTER_SAMPLES])},
+        {"drain_ms_per_record", ratio(counters[DIAG_COUNTER_DRAIN_MS], counters[DIAG_COUNTER_DRAIN_RECORDS])},
+        {"flash_reads_per_1000_played",
+         ratio(counters[DIAG_COUNTER_FLASH_READS], counters[DIAG_COUNTER_PLAYED_RECORDS]) * 1000},
+        {"flash_read_ms_per_1000_played",
+         ratio(counters[DIAG_COUNTER_FLASH_READ_US], counters[DIAG_COUNTER_PLAYED_RECORDS])},
+        {"stream_latency_ms_per_sample",
+         ratio(counters[DIAG_COUNTER_STREAM_LATENCY_MS], counters[DIAG_COUNTER_STREAM_SAMPLES])},
+    };
+    int metric_count = sizeof(metrics) / sizeof(metrics[0]);
+
+    printf("{\n  \"counters\": {\n");
+    for (int i = 0; i < DIAG_COUNTER_COUNT; i++)
+        printf("    \"%s\": %u%s\n", counter_names[i], counters[i], i < DIAG_COUNTER_COUNT - 1 ? "," : "");
+
+    printf("  },\n  \"metrics\": {\n");
+    print_metrics(metrics, metric_count, "    ");
+    printf("  }\n}\n");
+
+    if (!baseline)
+        return 0;
+
+    int regressions = compare_baseline(baseline, metrics, metric_count, tolerance);
+
+    if (regressions < 0)
+        return 1;
+
+    return regressions > 0 ? 2 : 0;
+}
@@ -0,0 +1,362 @@
+/**
+ * Benchmarks recordings of main/sensors.c and main/ble_host.c with the app connected, on the simulated clock, flash,
+ * sensor bus and ble peer of tools/host.\n
+ * Each case boots the firmware on an erased store, the simulated app connects, subscribes and starts the recording with
+ * R, stops it with S after a day, a week or once the store is full and drains the stored records with P. The app of the
+ * day case writes R before the sensor data is loaded. The deep sleep case records a day without the app, started with
+ * D, the app connects again with the last periodic full boot. Checks that every live and played record reached the app
+ * and that the notification counters only count what reached it, prints the counters of the recording and the drain and
+ * the metrics per record as JSON and compares them with a baseline file of "metric max" lines, the metrics are prefixed
+ * with the case. The exit code is 2 on a failed check or a regression
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <unistd.h>
+#include <esp_timer.h>
+#include "host/ble_hs.h"
+#include "host.h"
+#include "ble_host.h"
+#include "diagnostics.h"
+#include "record.h"
+#include "sensors.h"
+#include "store.h"
+#include "baseline.h"
+
+// Data partitions of partitions.csv
+#define BENCH_PARTITIONS "nvs_ext=0xf0000,rec_ext=0x180000"
+
+// Bytes of the partitions
+#define BENCH_STORE_SIZE (0xf0000 + 0x180000)
+
+// Relative records fitting the store
+#define BENCH_CAPACITY (BENCH_STORE_SIZE / RECORD_BLOCK_SIZE * RECORD_BLOCK_CAPACITY(sizeof(record_relative_t)))
+
+// DATA_VALUE_INTERVAL of sensors.c in us
+#define BENCH_INTERVAL 60000000LL
+
+// Connection interval of the app until the firmware requests a longer one, in ms
+#define BENCH_CONNECT_INTERVAL 30
+
+// Samples recorded after the store is full, they are not stored
+#define BENCH_OVERFLOW_SAMPLES 3
+
+// A drain that sends no record for this time is given up
+#define BENCH_DRAIN_STEP 60000000LL
+
+// DEEP_SLEEP_ADVERTISE_WINDOW of sensors.c in us, a full boot in the deep sleep recording advertises this long
+#define BENCH_ADVERTISE_WINDOW 30000000LL
+
+typedef enum {
+    CASE_DAY,
+    CASE_WEEK,
+    CASE_FULL,
+    CASE_DEEP_SLEEP,
+    CASE_COUNT
+} BENCH_CASE;
+
+static const char *case_names[CASE_COUNT] = {"day", "week", "full", "deep_sleep"};
+
+/**
+ * Case description and results, shared with the boots
+ */
+typedef struct {
+    uint32_t samples;                       // Samples of the recording
+    uint32_t expected_records;              // Records stored by the recording
+    uint32_t wakes;                         // Deep sleep wakeups so far, each takes a sample
+    uint32_t wake_average_us;               // Average duration of the deep sleep wakeups, read with I
+    uint32_t frames;                        // Frames received by the app since the counters were reset
+    uint32_t recording_frames;              // Frames received by the app while recording
+    uint32_t live_frames;                   // Live frames received by the app while recording
+    uint32_t played_frames;                 // Stored records received by the app while draining
+    uint32_t played_misses;                 // Played records not following the previous one
+    uint32_t last_played;
+    uint32_t stored_records;
+    uint32_t recording[DIAG_COUNTER_COUNT]; // Counters of the recording
+    uint32_t drain[DIAG_COUNTER_COUNT];     // Counters of the drain
+} bench_case_t;
+
+static bench_case_t *bench = NULL;
+
+/**
+ * Receiver of the simulated app, counts the frames and the sensor data frames by data flag
+ */
+static void receive(uint16_t conn_handle, const uint8_t *data, uint16_t length) {
+    sensor_data_t frame = {0};
+
+    bench->frames++;
+
+    if (length < 4)
+        return;
+
+    memcpy(&frame, data, length < sizeof(frame) ? length : sizeof(frame));
+
+    if (frame.data_flag == 11) {
+        bench->live_frames++;
+    } else if (frame.data_flag == 12) {
+        if (frame.counter != bench->last_played + 1)
+            bench->played_misses++;
+
+        bench->played_frames++;
+        bench->last_played = frame.counter;
+    } else if (frame.data_flag == 24 && length >= 12) {
+        memcpy(&bench->wake_average_us, data + 8, sizeof(uint32_t));
+    }
+}
+
+/**
+ * Connects the simulated app and subscribes to the notifications
+ */
+static uint16_t connect_app(BENCH_CASE id) {
+    uint16_t conn = host_ble_connect(BENCH_CONNECT_INTERVAL);
+
+    CHECK(conn != BLE_HS_CONN_HANDLE_NONE, "%s: app connected", case_names[id]);
+
+    host_ble_subscribe(conn, true);
+    host_run(1000000);
+
+    return conn;
+}
+
+/**
+ * Stops the recording, drains the stored records and disconnects the app
+ */
+static void drain_case(BENCH_CASE id, uint16_t conn) {
+    CHECK(host_ble_write(conn, "S") == 0, "%s: recording stopped", case_names[id]);
+    host_run(1000000);
+
+    bench->stored_records = store_count();
+    bench->recording_frames = bench->frames;
+    memcpy(bench->recording, host_counters(), sizeof(bench->recording));
+    memset(host_counters(), 0, DIAG_COUNTER_COUNT * sizeof(uint32_t));
+
+    CHECK(host_ble_write(conn, "P") == 0, "%s: playback started", case_names[id]);
+
+    // The service task counts the drain once the last record was sent
+    while (host_counters()[DIAG_COUNTER_DRAIN_RECORDS] == 0) {
+        uint32_t played = bench->played_frames;
+
+        host_run(BENCH_DRAIN_STEP);
+
+        if (bench->played_frames == played)
+            break;
+    }
+
+    // The last notifications are taken by the next connection events
+    host_run(2 * host_ble_interval(conn) * 1000LL);
+
+    memcpy(bench->drain, host_counters(), sizeof(bench->drain));
+
+    host_ble_disconnect(conn);
+}
+
+static void boot_case(void *arg) {
+    BENCH_CASE id = *(BENCH_CASE *) arg;
+    uint16_t conn;
+
+    host_ble_receiver(receive);
+
+    // The app of the day case starts the recording while the sensor data is loaded, the command runs once it is
+    if (id == CASE_DAY) {
+        host_start_firmware();
+
+        conn = host_ble_connect(BENCH_CONNECT_INTERVAL);
+
+        CHECK(conn != BLE_HS_CONN_HANDLE_NONE, "%s: app connected", case_names[id]);
+
+        host_ble_subscribe(conn, true);
+
+        memset(host_counters(), 0, DIAG_COUNTER_COUNT * sizeof(uint32_t));
+        bench->frames = 0;
+
+        CHECK(!sensors_ready() && host_ble_write(conn, "R") == 0, "%s: recording started while loading",
+              case_names[id]);
+
+        host_run((bench->samples - 1) * BENCH_INTERVAL + BENCH_INTERVAL / 2);
+
+        drain_case(id, conn);
+        return;
+    }
+
+    host_boot_firmware();
+
+    conn = connect_app(id);
+
+    memset(host_counters(), 0, DIAG_COUNTER_COUNT * sizeof(uint32_t));
+    bench->frames = 0;
+
+    // The deep sleep recording ends the boot and the connection, the samples are taken by the wakeups
+    if (id == CASE_DEEP_SLEEP) {
+        CHECK(host_ble_write(conn, "D") == 0, "%s: deep sleep recording started", case_names[id]);
+        host_run(1000000);
+        return;
+    }
+
+    CHECK(host_ble_write(conn, "R") == 0, "%s: recording started", case_names[id]);
+
+    // The first sample is taken at once, the last one is followed by half an interval
+    host_run((bench->samples - 1) * BENCH_INTERVAL + BENCH_INTERVAL / 2);
+
+    drain_case(id, conn);
+}
+
+/**
+ * Deep sleep wakeup, like app_main. The periodic full boot advertises before it returns to deep sleep, the app
+ * connects to the one after the last sample and drains the recording
+ */
+static void boot_wake(void *arg) {
+    BENCH_CASE id = *(BENCH_CASE *) arg;
+
+    host_ble_receiver(receive);
+
+    bench->wakes++;
+
+    sensors_handle_deep_sleep_wake();
+
+    host_boot_firmware();
+
+    if (bench->wakes < bench->samples) {
+        CHECK(sensors_deep_sleep_active(), "%s: deep sleep recording active", case_names[id]);
+
+        sensors_deep_sleep_schedule();
+        host_run(BENCH_ADVERTISE_WINDOW + 1000000);
+        return;
+    }
+
+    uint16_t conn = connect_app(id);
+
+    CHECK(host_ble_write(conn, "I") == 0, "%s: deep sleep info read", case_names[id]);
+    host_run(1000000);
+
+    drain_case(id, conn);
+}
+
+int main(int argc, char **argv) {
+    const char *baseline = NULL;
+    double tolerance = 0.05;
+    int option;
+
+    while ((option = getopt(argc, argv, "b:t:")) != -1) {
+        switch (option) {
+            case 'b':
+                baseline = optarg;
+                break;
+            case 't':
+                tolerance = strtod(optarg, NULL) / 100;
+                break;
+            default:
+                host_bench_usage(argv[0]);
+                return 1;
+        }
+    }
+
+    bench = host_shared(sizeof(bench_case_t));
+
+    // Allocated before the first boot, so the wakeups of the deep sleep case count into the same counters
+    host_counters();
+
+    static const uint32_t samples[CASE_COUNT] = {
+        [CASE_DAY] = 24 * 60,
+        [CASE_WEEK] = 7 * 24 * 60,
+        [CASE_FULL] = BENCH_CAPACITY + BENCH_OVERFLOW_SAMPLES,
+        [CASE_DEEP_SLEEP] = 24 * 60
+    };
+
+    metric_t metrics[CASE_COUNT * 9];
+    char names[CASE_COUNT * 9][64];
+    int metric_count = 0;
+
+    printf("{\n");
+
+    for (BENCH_CASE id = 0; id < CASE_COUNT; id++) {
+        memset(bench, 0, sizeof(*bench));
+
+        bench->samples = samples[id];
+        bench->expected_records = samples[id] < BENCH_CAPACITY ? samples[id] : BENCH_CAPACITY;
+
+        host_flash_init(BENCH_PARTITIONS);
+
+        int res = host_boot(boot_case, &id);
+
+        if (id == CASE_DEEP_SLEEP) {
+            CHECK(res == HOST_DEEP_SLEEP, "%s: boot exited with %d", case_names[id], res);
+
+            // Every wakeup but the last ends in deep sleep again
+            while (res == HOST_DEEP_SLEEP && bench->wakes < bench->samples) {
+                res = host_boot(boot_wake, &id);
+
+                CHECK(res == (bench->wakes < bench->samples ? HOST_DEEP_SLEEP : 0), "%s: wakeup %u exited with %d",
+                      case_names[id], bench->wakes, res);
+            }
+        } else {
+            CHECK(res == 0, "%s: boot exited with %d", case_names[id], res);
+        }
+
+        const uint32_t *recording = bench->recording;
+        const uint32_t *drain = bench->drain;
+        uint32_t records = recording[DIAG_COUNTER_RECORDS];
+        uint32_t live_frames = id == CASE_DEEP_SLEEP ? 0 : bench->samples;
+
+        CHECK(bench->stored_records == bench->expected_records, "%s: %u records stored, expected %u",
+              case_names[id], bench->stored_records, bench->expected_records);
+        CHECK(bench->live_frames == live_frames, "%s: %u live frames received, expected %u", case_names[id],
+              bench->live_frames, live_frames);
+        CHECK(bench->played_frames == bench->stored_records && bench->played_misses == 0,
+              "%s: %u records played of %u, %u out of order", case_names[id], bench->played_frames,
+              bench->stored_records, bench->played_misses);
+        CHECK(recording[DIAG_COUNTER_NOTIFICATIONS] == bench->recording_frames &&
+              drain[DIAG_COUNTER_NOTIFICATIONS] == bench->frames - bench->recording_frames,
+              "%s: %u and %u notifications counted, %u and %u received", case_names[id],
+              recording[DIAG_COUNTER_NOTIFICATIONS], drain[DIAG_COUNTER_NOTIFICATIONS], bench->recording_frames,
+              bench->frames - bench->recording_frames);
+
+        const metric_t case_metrics[] = {
+            {"flash_writes_per_record", host_ratio(recording[DIAG_COUNTER_FLASH_WRITES], records)},
+            {"flash_bytes_per_record", host_ratio(recording[DIAG_COUNTER_FLASH_WRITE_BYTES], records)},
+            {"flash_erases_per_1000_records", host_ratio(recording[DIAG_COUNTER_FLASH_ERASES], records) * 1000},
+            {"nvs_commits_per_record", host_ratio(recording[DIAG_COUNTER_NVS_COMMITS], records)},
+            {"notifications_per_record", host_ratio(recording[DIAG_COUNTER_NOTIFICATIONS], records)},
+            {"notify_bytes_per_notification",
+             host_ratio(recording[DIAG_COUNTER_NOTIFY_BYTES], recording[DIAG_COUNTER_NOTIFICATIONS])},
+            {"awake_us_per_sample", id == CASE_DEEP_SLEEP ? bench->wake_average_us :
+             host_ratio(recording[DIAG_COUNTER_SAMPLE_AWAKE_US], recording[DIAG_COUNTER_SAMPLES])},
+            {"drain_ms_per_record", host_ratio(drain[DIAG_COUNTER_DRAIN_MS], drain[DIAG_COUNTER_DRAIN_RECORDS])},
+            {"drain_notify_bytes_per_record",
+             host_ratio(drain[DIAG_COUNTER_NOTIFY_BYTES], drain[DIAG_COUNTER_DRAIN_RECORDS])},
+        };
+
+        printf("  \"%s\": {\n    \"samples\": %u,\n    \"records\": %u,\n", case_names[id], bench->samples,
+               bench->stored_records);
+        printf("    \"recording\": {\"flash_writes\": %u, \"flash_write_bytes\": %u, \"flash_erases\": %u, "
+               "\"nvs_commits\": %u, \"notifications\": %u, \"notify_bytes\": %u},\n",
+               recording[DIAG_COUNTER_FLASH_WRITES], recording[DIAG_COUNTER_FLASH_WRITE_BYTES],
+               recording[DIAG_COUNTER_FLASH_ERASES], recording[DIAG_COUNTER_NVS_COMMITS],
+               recording[DIAG_COUNTER_NOTIFICATIONS], recording[DIAG_COUNTER_NOTIFY_BYTES]);
+        printf("    \"drain\": {\"records\": %u, \"ms\": %u, \"notifications\": %u, \"notify_bytes\": %u, "
+               "\"flash_reads\": %u},\n",
+               drain[DIAG_COUNTER_DRAIN_RECORDS], drain[DIAG_COUNTER_DRAIN_MS], drain[DIAG_COUNTER_NOTIFICATIONS],
+               drain[DIAG_COUNTER_NOTIFY_BYTES], drain[DIAG_COUNTER_FLASH_READS]);
+        printf("    \"metrics\": {\n");
+        print_metrics(case_metrics, sizeof(case_metrics) / sizeof(case_metrics[0]), "      ");
+        printf("    }\n  },\n");
+
+        for (size_t i = 0; i < sizeof(case_metrics) / sizeof(case_metrics[0]); i++) {
+            snprintf(names[metric_count], sizeof(names[0]), "%s_%s", case_names[id], case_metrics[i].name);
+
+            metrics[metric_count].name = names[metric_count];
+            metrics[metric_count].value = case_metrics[i].value;
+            metric_count++;
+        }
+    }
+
+    printf("  \"failures\": %d\n}\n", host_failures());
+
+    int regressions = baseline ? compare_baseline(baseline, metrics, metric_count, tolerance) : 0;
+
+    if (regressions < 0)
+        return 1;
+
+    return host_failures() > 0 || regressions > 0 ? 2 : 0;
+}
@@ -0,0 +1,530 @@
+#include <stdio.h>
+#include <esp_timer.h>
+#include "host/ble_hs.h"
+#include "host/util/util.h"
+#include "nimble/nimble_port.h"
+#include "nimble/nimble_port_freertos.h"
+#include "services/gap/ble_svc_gap.h"
+#include "services/gatt/ble_svc_gatt.h"
+#include "sdkconfig.h"
+#include "host.h"
+
+/*
+ * Nimble host with a simulated peer, the app on a phone. Notifications take a block of the mbuf pool until a
+ * connection event of the peer takes them, at most HOST_BLE_EVENT_PACKETS per event. Gap and gatt events of the peer
+ * are called from the test like the host task would, the connection events run from a timer on the simulated clock
+ */
+
+#define MSYS_BLOCKS CONFIG_BT_NIMBLE_MSYS_1_BLOCK_COUNT
+#define CONNECTIONS CONFIG_BT_NIMBLE_MAX_CONNECTIONS
+
+// Mtu of a connection before the exchange
+#define DEFAULT_MTU 23
+
+// Reason of a disconnect by the peer, remote user terminated connection
+#define DISCONNECT_REASON 0x213
+
+typedef struct {
+    bool used;
+    uint16_t handle;
+    uint16_t itvl;              // Connection interval in 1.25 ms
+    uint16_t requested_itvl;    // Interval requested by the firmware, applied with the next event, 0 if none
+    uint16_t mtu;
+    bool subscribed;
+    ble_gatt_mtu_fn *mtu_cb;    // Callback of a pending mtu exchange
+    void *mtu_arg;
+    int64_t next_event;
+    uint8_t head;
+    uint8_t count;
+    struct os_mbuf *queue[MSYS_BLOCKS];
+} connection_t;
+
+struct ble_hs_cfg ble_hs_cfg;
+
+static struct os_mbuf msys[MSYS_BLOCKS];
+static bool msys_used[MSYS_BLOCKS];
+
+static connection_t connections[CONNECTIONS];
+static uint16_t last_handle = 0;
+
+static bool synced = false;
+static bool advertising = false;
+static ble_gap_event_fn *gap_cb = NULL;
+static void *gap_arg = NULL;
+
+static const struct ble_gatt_svc_def *services = NULL;
+
+static esp_timer_handle_t event_timer = NULL;
+
+static host_ble_receive_t receiver = NULL;
+
+static void mbuf_free(struct os_mbuf *om) {
+    msys_used[om - msys] = false;
+}
+
+int os_msys_num_free() {
+    int free = 0;
+
+    for (int i = 0; i < MSYS_BLOCKS; i++)
+        free += !msys_used[i];
+
+    return free;
+}
+
+int os_msys_count() {
+    return MSYS_BLOCKS;
+}
+
+struct os_mbuf *ble_hs_mbuf_from_flat(const void *buf, uint16_t len) {
+    for (int i = 0; i < MSYS_BLOCKS; i++) {
+        if (msys_used[i])
+            continue;
+
+        msys_used[i] = true;
+        msys[i].om_len = 0;
+
+        if (os_mbuf_append(&msys[i], buf, len) != 0) {
+            mbuf_free(&msys[i]);
+            return NULL;
+        }
+
+        return &msys[i];
+    }
+
+    return NULL;
+}
+
+int ble_hs_mbuf_to_flat(const struct os_mbuf *om, void *flat, uint16_t max_len, uint16_t *out_copy_len) {
+    uint16_t length = om->om_len < max_len ? om->om_len : max_len;
+
+    memcpy(flat, om->buffer, length);
+
+    if (out_copy_len)
+        *out_copy_len = length;
+
+    return length < om->om_len ? BLE_HS_EINVAL : 0;
+}
+
+static connection_t *connection_find(uint16_t conn_handle) {
+    for (int i = 0; i < CONNECTIONS; i++) {
+        if (connections[i].used && connections[i].handle == conn_handle)
+            return &connections[i];
+    }
+
+    return NULL;
+}
+
+static void gap_event(struct ble_gap_event *event) {
+    if (gap_cb)
+        gap_cb(event, gap_arg);
+}
+
+/**
+ * Applies a requested interval and passes up to HOST_BLE_EVENT_PACKETS queued notifications to the receiver
+ */
+static void connection_event(connection_t *conn) {
+    if (conn->requested_itvl) {
+        conn->itvl = conn->requested_itvl;
+        conn->requested_itvl = 0;
+
+        gap_event(&(struct ble_gap_event) {
+            .type = BLE_GAP_EVENT_CONN_UPDATE,
+            .conn_update = {.status = 0, .conn_handle = conn->handle}
+        });
+    }
+
+    for (int i = 0; i < HOST_BLE_EVENT_PACKETS && conn->count > 0; i++) {
+        struct os_mbuf *om = conn->queue[conn->head];
+
+        conn->head = (conn->head + 1) % MSYS_BLOCKS;
+        conn->count--;
+
+        if (receiver)
+            receiver(conn->handle, om->buffer, om->om_len);
+
+        mbuf_free(om);
+    }
+}
+
+static void event_timer_cb(void *arg);
+
+/**
+ * Arms the timer for the earliest connection event
+ */
+static void events_schedule() {
+    if (!event_timer) {
+        const esp_timer_create_args_t args = {
+            .callback = event_timer_cb,
+            .name = "ble_conn_event"
+        };
+
+        if (esp_timer_create(&args, &event_timer) != ESP_OK) {
+            fprintf(stderr, "No timer left for the connection events\n");
+            exit(1);
+        }
+    }
+
+    if (esp_timer_is_active(event_timer))
+        esp_timer_stop(event_timer);
+
+    int64_t next = INT64_MAX;
+
+    for (int i = 0; i < CONNECTIONS; i++) {
+        if (connections[i].used && connections[i].next_event < next)
+            next = connections[i].next_event;
+    }
+
+    if (next == INT64_MAX)
+        return;
+
+    int64_t now = esp_timer_get_time();
+
+    esp_timer_start_once(event_timer, next > now ? next - now : 0);
+}
+
+static void event_timer_cb(void *arg) {
+    int64_t now = esp_timer_get_time();
+
+    for (int i = 0; i < CONNECTIONS; i++) {
+        connection_t *conn = &connections[i];
+
+        if (!conn->used || conn->next_event > now)
+            continue;
+
+        connection_event(conn);
+
+        // Events missed while the clock was moved by busy time are skipped
+        while (conn->next_event <= now)
+            conn->next_event += conn->itvl * 1250LL;
+    }
+
+    events_schedule();
+}
+
+uint16_t ble_att_mtu(uint16_t conn_handle) {
+    connection_t *conn = connection_find(conn_handle);
+
+    return conn ? conn->mtu : 0;
+}
+
+int ble_gatts_count_cfg(const struct ble_gatt_svc_def *defs) {
+    return 0;
+}
+
+/**
+ * Assigns the handles in the order of the definitions, a characteristic takes a definition and a value handle and a
+ * notifying one the handle of its client configuration descriptor
+ */
+int ble_gatts_add_svcs(const struct ble_gatt_svc_def *svcs) {
+    uint16_t handle = 1;
+
+    services = svcs;
+
+    for (const struct ble_gatt_svc_def *svc = svcs; svc->type != 0; svc++) {
+        struct ble_gatt_register_ctxt context = {
+            .op = BLE_GATT_REGISTER_OP_SVC,
+            .svc = {.handle = handle++, .svc_def = svc}
+        };
+
+        if (ble_hs_cfg.gatts_register_cb)
+            ble_hs_cfg.gatts_register_cb(&context, NULL);
+
+        for (const struct ble_gatt_chr_def *chr = svc->characteristics; chr && chr->uuid; chr++) {
+            context.op = BLE_GATT_REGISTER_OP_CHR;
+            context.chr.def_handle = handle++;
+            context.chr.val_handle = handle++;
+            context.chr.chr_def = chr;
+
+            if (chr->val_handle)
+                *chr->val_handle = context.chr.val_handle;
+
+            if (chr->flags & BLE_GATT_CHR_F_NOTIFY)
+                handle++;
+
+            if (ble_hs_cfg.gatts_register_cb)
+                ble_hs_cfg.gatts_register_cb(&context, NULL);
+        }
+    }
+
+    return 0;
+}
+
+/**
+ * @return The first registered characteristic with one of the flags, NULL if none
+ */
+static const struct ble_gatt_chr_def *characteristic_find(uint16_t flags) {
+    for (const struct ble_gatt_svc_def *svc = services; svc && svc->type != 0; svc++) {
+        for (const struct ble_gatt_chr_def *chr = svc->characteristics; chr && chr->uuid; chr++) {
+            if (chr->flags & flags)
+                return chr;
+        }
+    }
+
+    return NULL;
+}
+
+int ble_gatts_notify_custom(uint16_t conn_handle, uint16_t att_handle, struct os_mbuf *om) {
+    connection_t *conn = connection_find(conn_handle);
+
+    if (!conn) {
+        mbuf_free(om);
+        return BLE_HS_ENOTCONN;
+    }
+
+    // Every queued notification holds a block of the pool, so the queue can not overflow
+    conn->queue[(conn->head + conn->count) % MSYS_BLOCKS] = om;
+    conn->count++;
+
+    return 0;
+}
+
+int ble_gattc_exchange_mtu(uint16_t conn_handle, ble_gatt_mtu_fn *cb, void *cb_arg) {
+    connection_t *conn = connection_find(conn_handle);
+
+    if (!conn)
+        return BLE_HS_ENOTCONN;
+
+    conn->mtu_cb = cb;
+    conn->mtu_arg = cb_arg;
+
+    return 0;
+}
+
+int ble_gap_adv_set_fields(const struct ble_hs_adv_fields *adv_fields) {
+    return 0;
+}
+
+int ble_gap_adv_rsp_set_fields(const struct ble_hs_adv_fields *rsp_fields) {
+    return 0;
+}
+
+int ble_gap_adv_start(uint8_t own_addr_type, const ble_addr_t *direct_addr, int32_t duration_ms,
+                      const struct ble_gap_adv_params *adv_params, ble_gap_event_fn *cb, void *cb_arg) {
+    if (advertising)
+        return BLE_HS_EALREADY;
+
+    advertising = true;
+    gap_cb = cb;
+    gap_arg = cb_arg;
+
+    return 0;
+}
+
+int ble_gap_conn_find(uint16_t handle, struct ble_gap_conn_desc *out_desc) {
+    connection_t *conn = connection_find(handle);
+
+    if (!conn)
+        return BLE_HS_ENOTCONN;
+
+    memset(out_desc, 0, sizeof(*out_desc));
+
+    out_desc->conn_handle = conn->handle;
+    out_desc->conn_itvl = conn->itvl;
+
+    return 0;
+}
+
+int ble_gap_update_params(uint16_t conn_handle, const struct ble_gap_upd_params *params) {
+    connection_t *conn = connection_find(conn_handle);
+
+    if (!conn)
+        return BLE_HS_ENOTCONN;
+
+    conn->requested_itvl = params->itvl_min;
+
+    return 0;
+}
+
+int ble_hs_synced() {
+    return synced;
+}
+
+int ble_hs_util_ensure_addr(int prefer_random) {
+    return 0;
+}
+
+int ble_hs_id_infer_auto(int privacy, uint8_t *out_addr_type) {
+    *out_addr_type = 0;
+
+    return 0;
+}
+
+int ble_hs_id_copy_addr(uint8_t id_addr_type, uint8_t *out_id_addr, int *out_is_nrpa) {
+    static const uint8_t address[6] = {0x01, 0x02, 0x03, 0x04, 0x05, 0x06};
+
+    memcpy(out_id_addr, address, sizeof(address));
+
+    if (out_is_nrpa)
+        *out_is_nrpa = 0;
+
+    return 0;
+}
+
+int ble_store_util_delete_peer(const ble_addr_t *peer_id_addr) {
+    return 0;
+}
+
+int ble_store_util_status_rr(void *event, void *arg) {
+    return 0;
+}
+
+char *ble_uuid_to_str(const ble_uuid_t *uuid, char *dst) {
+    const uint8_t *value = ((const ble_uuid128_t *) uuid)->value;
+    char *cursor = dst;
+
+    // Printed from the most significant byte, the value is little endian
+    for (int i = 15; i >= 0; i--) {
+        cursor += sprintf(cursor, "%02x", value[i]);
+
+        if (i == 12 || i == 10 || i == 8 || i == 6)
+            *cursor++ = '-';
+    }
+
+    return dst;
+}
+
+void ble_svc_gap_init() {
+}
+
+void ble_svc_gatt_init() {
+}
+
+int ble_svc_gap_device_name_set(const char *name) {
+    return 0;
+}
+
+esp_err_t nimble_port_init() {
+    return ESP_OK;
+}
+
+void nimble_port_run() {
+}
+
+void nimble_port_freertos_init(TaskFunction_t host_task_fn) {
+    synced = true;
+
+    if (ble_hs_cfg.sync_cb)
+        ble_hs_cfg.sync_cb();
+}
+
+void nimble_port_freertos_deinit() {
+}
+
+uint16_t host_ble_connect(uint16_t interval_ms) {
+    connection_t *conn = NULL;
+
+    for (int i = 0; i < CONNECTIONS && !conn; i++) {
+        if (!connections[i].used)
+            conn = &connections[i];
+    }
+
+    if (!advertising || !conn)
+        return BLE_HS_CONN_HANDLE_NONE;
+
+    memset(conn, 0, sizeof(*conn));
+
+    conn->used = true;
+    conn->handle = ++last_handle;
+    // 7.5 ms is the shortest interval of the specification
+    conn->itvl = interval_ms < 8 ? 6 : BLE_GAP_CONN_ITVL_MS(interval_ms);
+    conn->mtu = DEFAULT_MTU;
+    conn->next_event = esp_timer_get_time() + conn->itvl * 1250LL;
+
+    // A connection ends the advertising
+    advertising = false;
+
+    gap_event(&(struct ble_gap_event) {
+        .type = BLE_GAP_EVENT_CONNECT,
+        .connect = {.status = 0, .conn_handle = conn->handle}
+    });
+
+    // The peer supports a larger mtu than the preferred one of the firmware
+    if (conn->mtu_cb) {
+        conn->mtu = CONFIG_BT_NIMBLE_ATT_PREFERRED_MTU;
+        conn->mtu_cb(conn->handle, &(struct ble_gatt_error) {.status = 0}, conn->mtu, conn->mtu_arg);
+
+        gap_event(&(struct ble_gap_event) {
+            .type = BLE_GAP_EVENT_MTU,
+            .mtu = {.conn_handle = conn->handle, .channel_id = 4, .value = conn->mtu}
+        });
+    }
+
+    events_schedule();
+
+    return conn->handle;
+}
+
+void host_ble_disconnect(uint16_t conn_handle) {
+    connection_t *conn = connection_find(conn_handle);
+
+    if (!conn)
+        return;
+
+    struct ble_gap_event event = {
+        .type = BLE_GAP_EVENT_DISCONNECT,
+        .disconnect = {.reason = DISCONNECT_REASON}
+    };
+
+    ble_gap_conn_find(conn_handle, &event.disconnect.conn);
+
+    for (; conn->count > 0; conn->count--) {
+        mbuf_free(conn->queue[conn->head]);
+        conn->head = (conn->head + 1) % MSYS_BLOCKS;
+    }
+
+    conn->used = false;
+
+    gap_event(&event);
+
+    events_schedule();
+}
+
+void host_ble_subscribe(uint16_t conn_handle, bool enabled) {
+    connection_t *conn = connection_find(conn_handle);
+    const struct ble_gatt_chr_def *chr = characteristic_find(BLE_GATT_CHR_F_NOTIFY);
+
+    if (!conn || !chr)
+        return;
+
+    gap_event(&(struct ble_gap_event) {
+        .type = BLE_GAP_EVENT_SUBSCRIBE,
+        .subscribe = {
+            .conn_handle = conn_handle,
+            .attr_handle = *chr->val_handle,
+            .reason = 1,
+            .prev_notify = conn->subscribed,
+            .cur_notify = enabled
+        }
+    });
+
+    conn->subscribed = enabled;
+}
+
+int host_ble_write(uint16_t conn_handle, const char *command) {
+    const struct ble_gatt_chr_def *chr = characteristic_find(BLE_GATT_CHR_F_WRITE);
+
+    if (!connection_find(conn_handle) || !chr)
+        return BLE_HS_ENOTCONN;
+
+    struct os_mbuf om = {0};
+
+    os_mbuf_append(&om, command, strlen(command));
+
+    struct ble_gatt_access_ctxt context = {
+        .op = BLE_GATT_ACCESS_OP_WRITE_CHR,
+        .om = &om,
+        .chr = chr
+    };
+
+    return chr->access_cb(conn_handle, *chr->val_handle, &context, chr->arg);
+}
+
+void host_ble_receiver(host_ble_receive_t receive) {
+    receiver = receive;
+}
+
+uint16_t host_ble_interval(uint16_t conn_handle) {
+    connection_t *conn = connection_find(conn_handle);
+
+    return conn ? conn->itvl * 5 / 4 : 0;
+}
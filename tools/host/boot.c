@@ -0,0 +1,23 @@
+#include <esp_err.h>
+#include "nimble/nimble_port.h"
+#include "host.h"
+#include "ble_host.h"
+#include "sensors.h"
+
+void host_start_firmware() {
+    sensors_start_service_task();
+
+    CHECK(nimble_port_init() == ESP_OK, "nimble port init");
+    CHECK(ble_host_init() == 0, "gatt server init");
+    CHECK(ble_host_set_device_name() == 0, "device name set");
+
+    ble_host_start();
+}
+
+void host_boot_firmware() {
+    host_start_firmware();
+
+    host_run(1000000);
+
+    CHECK(sensors_ready(), "sensor data loaded");
+}
@@ -0,0 +1,64 @@
+#include <string.h>
+#include "host/ble_hs.h"
+#include "diagnostics.h"
+#include "energy.h"
+#include "power.h"
+#include <esp_timer.h>
+#include "host.h"
+
+/*
+ * Stand-ins of the firmware modules around the store and the sensor service, for tests that do not build them. The
+ * diagnostics counters are kept and read as the only diagnostics page, the energy and power accounting is dropped
+ */
+
+static uint32_t *counters = NULL;
+
+uint32_t *host_counters() {
+    if (!counters)
+        counters = host_shared(DIAG_COUNTER_COUNT * sizeof(uint32_t));
+
+    return counters;
+}
+
+void diag_count(DIAG_COUNTER counter, uint32_t value) {
+    host_counters()[counter] += value;
+}
+
+void diag_hist_add(DIAG_HIST hist, uint32_t cycles) {
+}
+
+int diag_select_page(uint8_t page) {
+    return page == DIAG_PAGE_COUNTERS;
+}
+
+void diag_reset() {
+    memset(host_counters(), 0, DIAG_COUNTER_COUNT * sizeof(uint32_t));
+}
+
+int diag_read(struct os_mbuf *om) {
+    uint8_t header[5] = {DIAG_PAGE_COUNTERS, DIAG_COUNTER_COUNT, 0, 0, 0};
+
+    int res = os_mbuf_append(om, header, sizeof(header));
+    if (res != 0)
+        return res;
+
+    return os_mbuf_append(om, host_counters(), DIAG_COUNTER_COUNT * sizeof(uint32_t));
+}
+
+void energy_begin(ENERGY_SUBSYSTEM subsystem) {
+}
+
+void energy_end(ENERGY_SUBSYSTEM subsystem) {
+}
+
+void energy_radio_packet(ENERGY_SUBSYSTEM subsystem, uint16_t length) {
+}
+
+void energy_radio_state(ENERGY_RADIO_STATE state, uint32_t interval_ms) {
+}
+
+void power_begin(POWER_ACTIVITY activity) {
+}
+
+void power_end(POWER_ACTIVITY activity) {
+}
@@ -0,0 +1,341 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+#include <unistd.h>
+#include "esp_partition.h"
+#include "nvs.h"
+#include "host.h"
+
+// Size of a program page, a write crossing pages is programmed page by page
+#define HOST_FLASH_PAGE 256
+
+// Bytes of the keys and namespaces, including the terminator
+#define HOST_NVS_KEY_SIZE 16
+
+typedef enum {
+    NVS_TYPE_NONE = 0,
+    NVS_TYPE_U8,
+    NVS_TYPE_U32,
+    NVS_TYPE_BLOB
+} NVS_TYPE;
+
+typedef struct {
+    char namespace_name[HOST_NVS_KEY_SIZE];
+    char key[HOST_NVS_KEY_SIZE];
+    uint8_t type;           // NVS_TYPE, NVS_TYPE_NONE if the entry is free
+    bool dirty;             // Changed since the last commit
+    uint16_t length;
+    uint8_t value[HOST_NVS_VALUE_SIZE];
+} nvs_entry_t;
+
+/**
+ * State of flash and nvs, shared over the reboots
+ */
+typedef struct {
+    uint8_t flash[HOST_FLASH_SIZE];
+    esp_partition_t partitions[HOST_PARTITIONS];
+    int partition_count;
+    uint32_t cut_remaining;                 // Bytes programmed until the power is cut, UINT32_MAX if not armed
+    host_flash_stats_t stats;
+    nvs_entry_t nvs[HOST_NVS_ENTRIES];      // Values as seen by the firmware
+    nvs_entry_t committed[HOST_NVS_ENTRIES];
+    char namespaces[HOST_NVS_ENTRIES][HOST_NVS_KEY_SIZE];   // Namespace of the handle with the index
+} flash_state_t;
+
+static flash_state_t *state = NULL;
+
+static flash_state_t *flash_state() {
+    if (!state) {
+        state = host_shared(sizeof(*state));
+        state->cut_remaining = UINT32_MAX;
+    }
+
+    return state;
+}
+
+/**
+ * Places the partitions of the map one after the other from address 0
+ */
+static void partitions_layout(flash_state_t *flash, const char *partitions) {
+    char map[256];
+
+    memset(flash->partitions, 0, sizeof(flash->partitions));
+    flash->partition_count = 0;
+
+    snprintf(map, sizeof(map), "%s", partitions);
+
+    uint32_t address = 0;
+
+    for (char *entry = strtok(map, ","); entry; entry = strtok(NULL, ",")) {
+        char *size = strchr(entry, '=');
+
+        if (!size || flash->partition_count == HOST_PARTITIONS) {
+            fprintf(stderr, "Invalid partition map %s\n", partitions);
+            exit(1);
+        }
+
+        *size++ = '\0';
+
+        esp_partition_t *partition = &flash->partitions[flash->partition_count++];
+
+        partition->type = ESP_PARTITION_TYPE_DATA;
+        partition->subtype = ESP_PARTITION_SUBTYPE_ANY;
+        partition->address = address;
+        partition->size = strtoul(size, NULL, 0);
+        snprintf(partition->label, sizeof(partition->label), "%s", entry);
+
+        address += partition->size;
+    }
+
+    if (address > HOST_FLASH_SIZE) {
+        fprintf(stderr, "Partition map %s exceeds the flash\n", partitions);
+        exit(1);
+    }
+}
+
+void host_flash_init(const char *partitions) {
+    flash_state_t *flash = flash_state();
+
+    memset(flash->flash, 0xff, sizeof(flash->flash));
+    memset(&flash->stats, 0, sizeof(flash->stats));
+    memset(flash->nvs, 0, sizeof(flash->nvs));
+    memset(flash->committed, 0, sizeof(flash->committed));
+
+    flash->cut_remaining = UINT32_MAX;
+
+    partitions_layout(flash, partitions);
+}
+
+void host_flash_repartition(const char *partitions) {
+    partitions_layout(flash_state(), partitions);
+}
+
+void host_flash_cut(uint32_t bytes) {
+    flash_state()->cut_remaining = bytes;
+}
+
+host_flash_stats_t *host_flash_stats() {
+    return &flash_state()->stats;
+}
+
+const esp_partition_t *esp_partition_find_first(esp_partition_type_t type, esp_partition_subtype_t subtype,
+                                                const char *label) {
+    flash_state_t *flash = flash_state();
+
+    for (int i = 0; i < flash->partition_count; i++) {
+        if (flash->partitions[i].type == type && strcmp(flash->partitions[i].label, label) == 0)
+            return &flash->partitions[i];
+    }
+
+    return NULL;
+}
+
+esp_err_t esp_partition_read(const esp_partition_t *partition, size_t src_offset, void *dst, size_t size) {
+    if (src_offset + size > partition->size)
+        return ESP_ERR_INVALID_SIZE;
+
+    memcpy(dst, &state->flash[partition->address + src_offset], size);
+
+    state->stats.reads++;
+    state->stats.read_bytes += size;
+
+    host_busy(HOST_FLASH_CALL_US + size * HOST_FLASH_READ_NS / 1000);
+
+    return ESP_OK;
+}
+
+esp_err_t esp_partition_write(const esp_partition_t *partition, size_t dst_offset, const void *src, size_t size) {
+    if (dst_offset + size > partition->size)
+        return ESP_ERR_INVALID_SIZE;
+
+    uint32_t address = partition->address + dst_offset;
+    uint32_t pages = (address + size - 1) / HOST_FLASH_PAGE - address / HOST_FLASH_PAGE + 1;
+    size_t programmed = size < state->cut_remaining ? size : state->cut_remaining;
+
+    // Programming only clears bits, a torn write leaves the bytes behind the cut erased
+    for (size_t i = 0; i < programmed; i++)
+        state->flash[address + i] &= ((const uint8_t *) src)[i];
+
+    if (state->cut_remaining != UINT32_MAX) {
+        state->cut_remaining -= programmed;
+
+        if (state->cut_remaining == 0) {
+            state->cut_remaining = UINT32_MAX;
+            fflush(stdout);
+            _exit(HOST_POWER_LOSS);
+        }
+    }
+
+    state->stats.writes++;
+    state->stats.write_bytes += size;
+
+    host_busy(HOST_FLASH_CALL_US + pages * HOST_FLASH_PAGE_US + size * HOST_FLASH_PROGRAM_NS / 1000);
+
+    return ESP_OK;
+}
+
+esp_err_t esp_partition_erase_range(const esp_partition_t *partition, size_t offset, size_t size) {
+    if (offset % HOST_FLASH_SECTOR != 0 || size % HOST_FLASH_SECTOR != 0)
+        return ESP_ERR_INVALID_ARG;
+
+    if (offset + size > partition->size)
+        return ESP_ERR_INVALID_SIZE;
+
+    memset(&state->flash[partition->address + offset], 0xff, size);
+
+    state->stats.erased_sectors += size / HOST_FLASH_SECTOR;
+
+    host_busy(HOST_FLASH_CALL_US + size / HOST_FLASH_SECTOR * HOST_FLASH_ERASE_US);
+
+    return ESP_OK;
+}
+
+void host_nvs_reboot() {
+    flash_state_t *flash = flash_state();
+
+    memcpy(flash->nvs, flash->committed, sizeof(flash->nvs));
+    memset(flash->namespaces, 0, sizeof(flash->namespaces));
+}
+
+esp_err_t nvs_open(const char *namespace_name, nvs_open_mode_t open_mode, nvs_handle_t *out_handle) {
+    flash_state_t *flash = flash_state();
+    bool exists = false;
+
+    for (int i = 0; i < HOST_NVS_ENTRIES; i++)
+        exists |= flash->nvs[i].type != NVS_TYPE_NONE && strcmp(flash->nvs[i].namespace_name, namespace_name) == 0;
+
+    if (!exists && open_mode == NVS_READONLY)
+        return ESP_ERR_NVS_NOT_FOUND;
+
+    for (int i = 0; i < HOST_NVS_ENTRIES; i++) {
+        if (flash->namespaces[i][0] == '\0') {
+            snprintf(flash->namespaces[i], HOST_NVS_KEY_SIZE, "%s", namespace_name);
+            *out_handle = i + 1;
+            return ESP_OK;
+        }
+    }
+
+    return ESP_ERR_NO_MEM;
+}
+
+void nvs_close(nvs_handle_t handle) {
+    if (handle > 0 && handle <= HOST_NVS_ENTRIES)
+        state->namespaces[handle - 1][0] = '\0';
+}
+
+esp_err_t nvs_commit(nvs_handle_t handle) {
+    // Only the changed entries are copied, the store commits with every record
+    for (int i = 0; i < HOST_NVS_ENTRIES; i++) {
+        if (!state->nvs[i].dirty)
+            continue;
+
+        state->nvs[i].dirty = false;
+        state->committed[i] = state->nvs[i];
+    }
+
+    state->stats.nvs_commits++;
+
+    host_busy(HOST_NVS_COMMIT_US);
+
+    return ESP_OK;
+}
+
+static nvs_entry_t *entry_find(nvs_handle_t handle, const char *key) {
+    const char *namespace_name = state->namespaces[handle - 1];
+
+    for (int i = 0; i < HOST_NVS_ENTRIES; i++) {
+        nvs_entry_t *entry = &state->nvs[i];
+
+        if (entry->type != NVS_TYPE_NONE && strcmp(entry->namespace_name, namespace_name) == 0 &&
+            strcmp(entry->key, key) == 0)
+            return entry;
+    }
+
+    return NULL;
+}
+
+static esp_err_t entry_get(nvs_handle_t handle, const char *key, NVS_TYPE type, void *value, size_t *length) {
+    nvs_entry_t *entry = entry_find(handle, key);
+
+    if (!entry)
+        return ESP_ERR_NVS_NOT_FOUND;
+
+    if (entry->type != type)
+        return ESP_ERR_NVS_TYPE_MISMATCH;
+
+    // Without a buffer only the length is returned
+    if (value && *length < entry->length)
+        return ESP_ERR_NVS_INVALID_LENGTH;
+
+    if (value)
+        memcpy(value, entry->value, entry->length);
+
+    *length = entry->length;
+
+    return ESP_OK;
+}
+
+static esp_err_t entry_set(nvs_handle_t handle, const char *key, NVS_TYPE type, const void *value, size_t length) {
+    nvs_entry_t *entry = entry_find(handle, key);
+
+    if (length > HOST_NVS_VALUE_SIZE)
+        return ESP_ERR_NVS_NOT_ENOUGH_SPACE;
+
+    for (int i = 0; i < HOST_NVS_ENTRIES && !entry; i++) {
+        if (state->nvs[i].type == NVS_TYPE_NONE)
+            entry = &state->nvs[i];
+    }
+
+    if (!entry)
+        return ESP_ERR_NVS_NOT_ENOUGH_SPACE;
+
+    snprintf(entry->namespace_name, HOST_NVS_KEY_SIZE, "%s", state->namespaces[handle - 1]);
+    snprintf(entry->key, HOST_NVS_KEY_SIZE, "%s", key);
+    entry->type = type;
+    entry->dirty = true;
+    entry->length = length;
+    memcpy(entry->value, value, length);
+
+    return ESP_OK;
+}
+
+esp_err_t nvs_erase_key(nvs_handle_t handle, const char *key) {
+    nvs_entry_t *entry = entry_find(handle, key);
+
+    if (!entry)
+        return ESP_ERR_NVS_NOT_FOUND;
+
+    entry->type = NVS_TYPE_NONE;
+    entry->dirty = true;
+
+    return ESP_OK;
+}
+
+esp_err_t nvs_get_u8(nvs_handle_t handle, const char *key, uint8_t *out_value) {
+    size_t length = sizeof(*out_value);
+
+    return entry_get(handle, key, NVS_TYPE_U8, out_value, &length);
+}
+
+esp_err_t nvs_set_u8(nvs_handle_t handle, const char *key, uint8_t value) {
+    return entry_set(handle, key, NVS_TYPE_U8, &value, sizeof(value));
+}
+
+esp_err_t nvs_get_u32(nvs_handle_t handle, const char *key, uint32_t *out_value) {
+    size_t length = sizeof(*out_value);
+
+    return entry_get(handle, key, NVS_TYPE_U32, out_value, &length);
+}
+
+esp_err_t nvs_set_u32(nvs_handle_t handle, const char *key, uint32_t value) {
+    return entry_set(handle, key, NVS_TYPE_U32, &value, sizeof(value));
+}
+
+esp_err_t nvs_get_blob(nvs_handle_t handle, const char *key, void *out_value, size_t *length) {
+    return entry_get(handle, key, NVS_TYPE_BLOB, out_value, length);
+}
+
+esp_err_t nvs_set_blob(nvs_handle_t handle, const char *key, const void *value, size_t length) {
+    return entry_set(handle, key, NVS_TYPE_BLOB, value, length);
+}
@@ -0,0 +1,336 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdarg.h>
+#include <stdbool.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/time.h>
+#include <sys/wait.h>
+#include <esp_timer.h>
+#include <esp_cpu.h>
+#include <esp_rom_crc.h>
+#include <esp_rom_sys.h>
+#include <esp_sleep.h>
+#include <esp_private/esp_clk.h>
+#include "host/ble_hs.h"
+#include "sensors.h"
+#include "record.h"
+#include "host.h"
+
+// Cpu clock of the cycle counter
+#define HOST_CPU_MHZ 160
+
+struct esp_timer {
+    esp_timer_cb_t callback;
+    void *arg;
+    bool active;
+    int64_t expiry;
+};
+
+// Simulated time in us, shared so it continues over the reboots
+static int64_t *now = NULL;
+
+static struct esp_timer timers[HOST_TIMERS];
+static int timer_count = 0;
+
+// Failed checks, shared so checks of the boots count
+static int *failures = NULL;
+
+// The RTC_DATA_ATTR variables of the firmware sources, defined by the linker if there are any
+extern uint8_t __start_rtc_data[] __attribute__((weak));
+extern uint8_t __stop_rtc_data[] __attribute__((weak));
+
+/**
+ * Rtc memory kept by esp_deep_sleep for the next boot
+ */
+typedef struct {
+    bool retained;
+    uint8_t data[HOST_RTC_SIZE];
+} host_rtc_t;
+
+static host_rtc_t *rtc = NULL;
+
+// Set in a boot woken from deep sleep
+static bool woken = false;
+
+static int64_t *clock_now() {
+    if (!now)
+        now = host_shared(sizeof(*now));
+
+    return now;
+}
+
+void host_check(int condition, const char *expression, const char *format, ...) {
+    if (condition)
+        return;
+
+    va_list args;
+
+    va_start(args, format);
+    fprintf(stderr, "Failed: ");
+    vfprintf(stderr, format, args);
+    fprintf(stderr, " (%s)\n", expression);
+    va_end(args);
+
+    if (!failures)
+        failures = host_shared(sizeof(*failures));
+
+    (*failures)++;
+}
+
+int host_failures() {
+    return failures ? *failures : 0;
+}
+
+const char *esp_err_to_name(esp_err_t code) {
+    static char name[16];
+
+    snprintf(name, sizeof(name), "0x%x", code);
+
+    return name;
+}
+
+int64_t esp_timer_get_time() {
+    return *clock_now();
+}
+
+uint32_t esp_cpu_get_cycle_count() {
+    return (uint32_t) (*clock_now() * HOST_CPU_MHZ);
+}
+
+esp_err_t esp_timer_create(const esp_timer_create_args_t *create_args, esp_timer_handle_t *out_handle) {
+    if (timer_count == HOST_TIMERS)
+        return ESP_ERR_NO_MEM;
+
+    esp_timer_handle_t timer = &timers[timer_count++];
+
+    timer->callback = create_args->callback;
+    timer->arg = create_args->arg;
+    timer->active = false;
+
+    *out_handle = timer;
+
+    return ESP_OK;
+}
+
+esp_err_t esp_timer_start_once(esp_timer_handle_t timer, uint64_t timeout_us) {
+    if (timer->active)
+        return ESP_ERR_INVALID_STATE;
+
+    timer->active = true;
+    timer->expiry = *clock_now() + timeout_us;
+
+    return ESP_OK;
+}
+
+esp_err_t esp_timer_stop(esp_timer_handle_t timer) {
+    if (!timer->active)
+        return ESP_ERR_INVALID_STATE;
+
+    timer->active = false;
+
+    return ESP_OK;
+}
+
+bool esp_timer_is_active(esp_timer_handle_t timer) {
+    return timer->active;
+}
+
+int64_t host_timer_next() {
+    int64_t next = INT64_MAX;
+
+    for (int i = 0; i < timer_count; i++) {
+        if (timers[i].active && timers[i].expiry < next)
+            next = timers[i].expiry;
+    }
+
+    return next;
+}
+
+void host_advance(int64_t us) {
+    int64_t end = *clock_now() + us;
+
+    while (1) {
+        esp_timer_handle_t next = NULL;
+
+        for (int i = 0; i < timer_count; i++) {
+            if (timers[i].active && timers[i].expiry <= end && (!next || timers[i].expiry < next->expiry))
+                next = &timers[i];
+        }
+
+        if (!next)
+            break;
+
+        // Timers expired during busy time run late
+        if (next->expiry > *now)
+            *now = next->expiry;
+
+        next->active = false;
+        next->callback(next->arg);
+
+        if (*now > end)
+            end = *now;
+    }
+
+    *now = end;
+}
+
+void host_busy(int64_t us) {
+    *clock_now() += us;
+}
+
+void esp_rom_delay_us(uint32_t us) {
+    host_busy(us);
+}
+
+uint64_t esp_clk_rtc_time() {
+    return *clock_now();
+}
+
+esp_sleep_wakeup_cause_t esp_sleep_get_wakeup_cause() {
+    return woken ? ESP_SLEEP_WAKEUP_TIMER : ESP_SLEEP_WAKEUP_UNDEFINED;
+}
+
+void esp_deep_sleep(uint64_t time_in_us) {
+    host_busy(time_in_us);
+
+    memcpy(rtc->data, __start_rtc_data, __stop_rtc_data - __start_rtc_data);
+    rtc->retained = true;
+
+    fflush(stdout);
+    _exit(HOST_DEEP_SLEEP);
+}
+
+int host_settimeofday(const struct timeval *time, const void *zone) {
+    return 0;
+}
+
+void host_sample(uint32_t index, bool fine, sensor_data_t *data) {
+    memset(data, 0, sizeof(*data));
+
+    data->data_flag = fine ? SENSOR_DATA_LIVE_FINE : 11;
+    data->time = HOST_SAMPLE_START_TIME + index * HOST_SAMPLE_INTERVAL;
+
+    for (int i = 0; i < RECORD_SENSORS; i++)
+        data->sensor_values[i] = (index * 7 + i) % 200;
+
+    if (fine)
+        memset(data->sensor_fractions, index & 0xff, SENSOR_FRACTIONS_SIZE);
+}
+
+double host_ratio(double value, uint32_t count) {
+    return count == 0 ? 0 : value / count;
+}
+
+void host_bench_usage(const char *name) {
+    fprintf(stderr, "Usage: %s [-b baseline] [-t tolerance_percent]\n", name);
+}
+
+void *host_shared(size_t size) {
+    void *memory = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+
+    if (memory == MAP_FAILED) {
+        perror("Allocating shared memory failed");
+        exit(1);
+    }
+
+    return memory;
+}
+
+// Drops the nvs values set after the last commit, in flash.c
+void host_nvs_reboot();
+
+int host_boot(void (*boot)(void *arg), void *arg) {
+    clock_now();
+
+    if (!failures)
+        failures = host_shared(sizeof(*failures));
+
+    if (!rtc)
+        rtc = host_shared(sizeof(*rtc));
+
+    long rtc_size = __stop_rtc_data - __start_rtc_data;
+
+    if (rtc_size > HOST_RTC_SIZE) {
+        fprintf(stderr, "The rtc data of %ld bytes exceeds HOST_RTC_SIZE\n", rtc_size);
+        exit(1);
+    }
+
+    fflush(stdout);
+    fflush(stderr);
+
+    pid_t pid = fork();
+
+    if (pid < 0) {
+        perror("Forking the boot failed");
+        exit(1);
+    }
+
+    if (pid == 0) {
+        // Any boot but the one after a deep sleep starts with the initial rtc data
+        woken = rtc->retained;
+        rtc->retained = false;
+
+        if (woken)
+            memcpy(__start_rtc_data, rtc->data, __stop_rtc_data - __start_rtc_data);
+
+        host_nvs_reboot();
+        boot(arg);
+
+        fflush(stdout);
+        _exit(0);
+    }
+
+    int status = 0;
+
+    if (waitpid(pid, &status, 0) < 0 || !WIFEXITED(status))
+        return -1;
+
+    return WEXITSTATUS(status);
+}
+
+uint8_t esp_rom_crc8_le(uint8_t crc, const uint8_t *buf, uint32_t len) {
+    crc = ~crc;
+
+    for (uint32_t i = 0; i < len; i++) {
+        crc ^= buf[i];
+
+        for (int bit = 0; bit < 8; bit++)
+            crc = crc & 1 ? (crc >> 1) ^ 0xe0 : crc >> 1;
+    }
+
+    return ~crc;
+}
+
+uint16_t esp_rom_crc16_le(uint16_t crc, const uint8_t *buf, uint32_t len) {
+    crc = ~crc;
+
+    for (uint32_t i = 0; i < len; i++) {
+        crc ^= buf[i];
+
+        for (int bit = 0; bit < 8; bit++)
+            crc = crc & 1 ? (crc >> 1) ^ 0x8408 : crc >> 1;
+    }
+
+    return ~crc;
+}
+
+int os_mbuf_append(struct os_mbuf *om, const void *data, uint16_t len) {
+    if (om->om_len + len > sizeof(om->buffer))
+        return BLE_HS_ENOMEM;
+
+    memcpy(om->buffer + om->om_len, data, len);
+    om->om_len += len;
+
+    return 0;
+}
+
+int os_mbuf_copydata(const struct os_mbuf *om, int off, int len, void *dst) {
+    if (off < 0 || len < 0 || off + len > om->om_len)
+        return -1;
+
+    memcpy(dst, om->buffer + off, len);
+
+    return 0;
+}
@@ -0,0 +1,259 @@
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+
+#ifndef AISOLE_HOST_H
+#define AISOLE_HOST_H
+
+/*
+ * Host stand-ins for the esp-idf services used by firmware sources built into the tests in tools/. The firmware code
+ * runs unchanged on a simulated clock, which only moves forward by host_advance, host_run and by the modeled time of
+ * flash and sensor bus accesses. The clock, flash, nvs and counters are kept in memory shared over the simulated
+ * reboots of host_boot
+ */
+
+// Records a failed check of a test with the expression and a formatted description
+#define CHECK(condition, ...) host_check(condition, #condition, __VA_ARGS__)
+
+// One-shot esp_timers that can exist at once
+#define HOST_TIMERS 8
+
+// Tasks of xTaskCreateStatic that can exist at once and the stack allocated for each of them
+#define HOST_TASKS 4
+#define HOST_TASK_STACK (256 * 1024)
+
+// Simulated flash holding the partitions of host_flash_init one after the other from address 0
+#define HOST_FLASH_SIZE 0x400000
+#define HOST_FLASH_SECTOR 4096
+#define HOST_PARTITIONS 4
+
+// Flash timing charged to the simulated clock, datasheet values of the spi flash of the esp32-c3 modules. The absolute
+// times are a model, the tests compare the variants of the firmware on it
+#define HOST_FLASH_CALL_US 15           // Per partition access, api, cache disable and command overhead
+#define HOST_FLASH_READ_NS 25           // Per byte read at 40 MB/s
+#define HOST_FLASH_PAGE_US 100          // Per 256 byte page programmed
+#define HOST_FLASH_PROGRAM_NS 2400      // Per byte programmed
+#define HOST_FLASH_ERASE_US 45000       // Per sector erased
+#define HOST_NVS_COMMIT_US 1500
+
+// Sensor bus timing, 9 clocks per byte at 100 kHz and the driver overhead of a transaction, one-shot conversion time
+// of the max31725
+#define HOST_I2C_BYTE_US 90
+#define HOST_I2C_CALL_US 60
+#define HOST_I2C_CONVERSION_US 45000
+
+// Notifications the simulated peer of ble.c takes per connection event, phones allow 4 to 7 packets per event
+#define HOST_BLE_EVENT_PACKETS 4
+
+// Keys kept by the simulated nvs over all namespaces
+#define HOST_NVS_ENTRIES 32
+#define HOST_NVS_VALUE_SIZE 2560
+
+// Exit code of a boot cut by the power loss of host_flash_cut
+#define HOST_POWER_LOSS 3
+// Exit code of a boot ended by esp_deep_sleep
+#define HOST_DEEP_SLEEP 4
+
+// Rtc slow memory of the esp32-c3 kept over a deep sleep, the RTC_DATA_ATTR variables have to fit
+#define HOST_RTC_SIZE 8192
+
+// Wall clock time of the monotonic time 0 of timebase_now, so records decode to plausible dates
+#define HOST_WALL_OFFSET 1700000000
+
+// Monotonic time of the first sample of host_sample and the sample interval in s
+#define HOST_SAMPLE_START_TIME 1000
+#define HOST_SAMPLE_INTERVAL 60
+
+/**
+ * Flash accesses since host_flash_init
+ */
+typedef struct {
+    uint32_t reads;
+    uint64_t read_bytes;
+    uint32_t writes;
+    uint64_t write_bytes;
+    uint32_t erased_sectors;
+    uint32_t nvs_commits;
+} host_flash_stats_t;
+
+/**
+ * Prints a failed check to stderr and counts it, used by CHECK
+ */
+void host_check(int condition, const char *expression, const char *format, ...);
+
+/**
+ * @return The count of failed checks, including the checks of the boots run by host_boot
+ */
+int host_failures();
+
+/**
+ * Moves the simulated clock forward and runs the callbacks of the timers expiring until then in order
+ * @param us - The time to advance in us
+ */
+void host_advance(int64_t us);
+
+/**
+ * Moves the simulated clock forward without running timers, the time a blocking call keeps the caller busy. Timers
+ * expired meanwhile run late on the next host_advance
+ * @param us - The busy time in us
+ */
+void host_busy(int64_t us);
+
+/**
+ * @return The expiry of the next active timer, INT64_MAX if none
+ */
+int64_t host_timer_next();
+
+/**
+ * Runs the tasks of xTaskCreateStatic and the timers for the given simulated time. A ready task runs until it blocks,
+ * only its busy time moves the clock meanwhile. Must not be called from a task
+ * @param us - The time to run in us
+ */
+void host_run(int64_t us);
+
+struct timeval;
+
+/**
+ * Stand-in of settimeofday for firmware sources built with settimeofday=host_settimeofday, the host time is left alone
+ */
+int host_settimeofday(const struct timeval *time, const void *zone);
+
+/**
+ * Allocates zeroed memory kept over the simulated reboots, so allocate before the first host_boot
+ * @param size - The bytes to allocate
+ * @return The memory, the test exits if the allocation fails
+ */
+void *host_shared(size_t size);
+
+/**
+ * Runs a boot of the firmware in a child process, all static state of the firmware sources starts from its initial
+ * values, the timers and tasks are dropped and nvs values set after the last commit are lost. A boot following one
+ * ended by esp_deep_sleep wakes by the timer and keeps the RTC_DATA_ATTR variables
+ * @param boot - The code of the boot, returning ends it like a reset
+ * @param arg - Passed to boot
+ * @return The exit code of the boot, HOST_POWER_LOSS if host_flash_cut cut it, HOST_DEEP_SLEEP after esp_deep_sleep
+ */
+int host_boot(void (*boot)(void *arg), void *arg);
+
+/**
+ * Erases the flash and nvs and lays out the partitions
+ * @param partitions - Comma separated label=size list, e.g. "nvs_ext=0xf0000,rec_ext=0x190000"
+ */
+void host_flash_init(const char *partitions);
+
+/**
+ * Lays out the partitions again without erasing, like a serial flash of a changed partition table. A partition
+ * placed over the range of an old one starts with its bytes
+ * @param partitions - Comma separated label=size list
+ */
+void host_flash_repartition(const char *partitions);
+
+/**
+ * Cuts the power after the given count of bytes was programmed, the write in progress is torn there and the boot
+ * exits with HOST_POWER_LOSS
+ * @param bytes - The bytes programmed before the cut, UINT32_MAX disarms the cut
+ */
+void host_flash_cut(uint32_t bytes);
+
+/**
+ * @return The flash accesses, the caller may reset them
+ */
+host_flash_stats_t *host_flash_stats();
+
+/**
+ * Removes sensors from the simulated bus of i2c.c, their transactions are not acknowledged
+ * @param mask - Bit n removes the sensor n of sensor_address
+ */
+void host_i2c_missing(uint32_t mask);
+
+/**
+ * @param sensor - The index of the sensor in sensor_address
+ * @param time - The simulated time in us
+ * @return The temperature a one-shot conversion of the simulated sensor ending at the time reads, in 1/256 °C
+ */
+int16_t host_i2c_temperature(int sensor, int64_t time);
+
+/**
+ * Receives the notifications the simulated peer took with a connection event
+ * @param conn_handle - The connection
+ * @param data - The value of the notification
+ * @param length - The length of the value
+ */
+typedef void (*host_ble_receive_t)(uint16_t conn_handle, const uint8_t *data, uint16_t length);
+
+/**
+ * Connects the simulated peer to the advertising firmware and exchanges the preferred mtu
+ * @param interval_ms - The connection interval until the firmware requests another one
+ * @return The connection handle, BLE_HS_CONN_HANDLE_NONE if the firmware does not advertise
+ */
+uint16_t host_ble_connect(uint16_t interval_ms);
+
+/**
+ * Closes the connection, notifications not taken yet are dropped
+ */
+void host_ble_disconnect(uint16_t conn_handle);
+
+/**
+ * Enables or disables the notifications of the characteristic with the notify flag
+ */
+void host_ble_subscribe(uint16_t conn_handle, bool enabled);
+
+/**
+ * Writes a command to the characteristic with the write flag, like the app
+ * @param command - The command string, written without the terminator
+ * @return The att error of the write, 0 on success
+ */
+int host_ble_write(uint16_t conn_handle, const char *command);
+
+/**
+ * @param receive - Called for every notification taken by a connection event, NULL drops them
+ */
+void host_ble_receiver(host_ble_receive_t receive);
+
+/**
+ * @param conn_handle - The connection
+ * @return The connection interval in ms
+ */
+uint16_t host_ble_interval(uint16_t conn_handle);
+
+/**
+ * Starts the firmware like app_main without the power management, the service task runs with the next host_run. In
+ * boot.c, only linked into tests built with main/sensors.c and main/ble_host.c
+ */
+void host_start_firmware();
+
+/**
+ * Starts the firmware and runs it for a second, checks that the sensor data was loaded meanwhile
+ */
+void host_boot_firmware();
+
+struct sensor_data;
+
+/**
+ * Fills a live sample of the record tests, the time and the values follow from the index so records read back can be
+ * compared with the sample of their data counter - 1
+ * @param index - The index of the sample
+ * @param fine - If the sample is in the fine resolution, its fractions follow from the index as well
+ * @param data - The sample
+ */
+void host_sample(uint32_t index, bool fine, struct sensor_data *data);
+
+/**
+ * @return The value per count, 0 if the count is 0
+ */
+double host_ratio(double value, uint32_t count);
+
+/**
+ * Prints the options of the benchmarks to stderr, a baseline file and the tolerance in percent
+ * @param name - The program name
+ */
+void host_bench_usage(const char *name);
+
+/**
+ * Stand-ins of the firmware modules a host test does not build, library host_firmware. diag_count adds to counters
+ * shared over the reboots
+ * @return The counters, the caller may reset them
+ */
+uint32_t *host_counters();
+
+#endif //AISOLE_HOST_H
@@ -0,0 +1,158 @@
+#include <stdint.h>
+#include <stdbool.h>
+#include <esp_err.h>
+#include <esp_timer.h>
+#include "driver/i2c.h"
+#include "sensors.h"
+#include "host.h"
+
+/*
+ * Sensor bus of max31725 sensors at the addresses of sensor_address. A one-shot conversion started by a config write
+ * takes HOST_I2C_CONVERSION_US, the one-shot bit reads as set until then
+ */
+
+#define MAX_31725_TEMPERATURE 0x00
+#define MAX_31725_CONFIG 0x01
+
+typedef struct {
+    uint8_t pointer;
+    uint8_t config;
+    int64_t conversion_end;     // 0 if no conversion is running
+    int16_t temperature;
+} sensor_state_t;
+
+static sensor_state_t sensors[MAX_SENSORS];
+
+// Sensors not answering, shared so it is kept over the reboots
+static uint32_t *missing = NULL;
+
+static uint32_t *missing_mask() {
+    if (!missing)
+        missing = host_shared(sizeof(*missing));
+
+    return missing;
+}
+
+void host_i2c_missing(uint32_t mask) {
+    *missing_mask() = mask;
+}
+
+int16_t host_i2c_temperature(int sensor, int64_t time) {
+    // About 30 °C spread over the sole, rising by 1/16 °C per minute in a 2.5 °C saw tooth
+    return 30 * 256 + sensor * 64 + (time / 60000000 % 40) * 16;
+}
+
+/**
+ * @return The sensor at the 7 bit address, -1 if none answers
+ */
+static int sensor_find(uint8_t device_address) {
+    for (int i = 0; i < MAX_SENSORS; i++) {
+        if (sensor_address[i] >> 1 == device_address)
+            return *missing_mask() & (1UL << i) ? -1 : i;
+    }
+
+    return -1;
+}
+
+/**
+ * Finishes a conversion that ended until now
+ */
+static void sensor_update(int index) {
+    sensor_state_t *sensor = &sensors[index];
+
+    if (sensor->conversion_end == 0 || esp_timer_get_time() < sensor->conversion_end)
+        return;
+
+    sensor->temperature = host_i2c_temperature(index, sensor->conversion_end);
+    sensor->config &= ~MAX_31725_ONE_SHOT;
+    sensor->conversion_end = 0;
+}
+
+static void sensor_write(int index, const uint8_t *data, size_t size) {
+    sensor_state_t *sensor = &sensors[index];
+
+    if (size == 0)
+        return;
+
+    sensor->pointer = data[0];
+
+    if (size < 2 || sensor->pointer != MAX_31725_CONFIG)
+        return;
+
+    sensor->config = data[1];
+
+    if ((sensor->config & MAX_31725_ONE_SHOT) && (sensor->config & MAX_31725_SHUTDOWN))
+        sensor->conversion_end = esp_timer_get_time() + HOST_I2C_CONVERSION_US;
+}
+
+static void sensor_read(int index, uint8_t *data, size_t size) {
+    sensor_state_t *sensor = &sensors[index];
+
+    for (size_t i = 0; i < size; i++) {
+        if (sensor->pointer == MAX_31725_CONFIG)
+            data[i] = sensor->config;
+        else if (sensor->pointer == MAX_31725_TEMPERATURE)
+            data[i] = i % 2 == 0 ? (uint16_t) sensor->temperature >> 8 : sensor->temperature & 0xff;
+        else
+            data[i] = 0;
+    }
+}
+
+esp_err_t i2c_param_config(i2c_port_t port, const i2c_config_t *config) {
+    return ESP_OK;
+}
+
+esp_err_t i2c_driver_install(i2c_port_t port, i2c_mode_t mode, size_t slv_rx_buf_len, size_t slv_tx_buf_len,
+                             int intr_alloc_flags) {
+    return ESP_OK;
+}
+
+esp_err_t i2c_driver_delete(i2c_port_t port) {
+    return ESP_OK;
+}
+
+esp_err_t gpio_sleep_set_direction(int gpio_num, gpio_mode_t mode) {
+    return ESP_OK;
+}
+
+esp_err_t gpio_sleep_set_pull_mode(int gpio_num, gpio_pull_mode_t pull) {
+    return ESP_OK;
+}
+
+esp_err_t i2c_master_write_read_device(i2c_port_t port, uint8_t device_address, const uint8_t *write_buffer,
+                                       size_t write_size, uint8_t *read_buffer, size_t read_size,
+                                       TickType_t ticks_to_wait) {
+    int index = sensor_find(device_address);
+
+    // Without an acknowledge the transaction ends after the address byte
+    if (index < 0) {
+        host_busy(HOST_I2C_CALL_US + HOST_I2C_BYTE_US);
+        return ESP_FAIL;
+    }
+
+    sensor_update(index);
+    sensor_write(index, write_buffer, write_size);
+    sensor_read(index, read_buffer, read_size);
+
+    // Address, register and address again with the repeated start
+    host_busy(HOST_I2C_CALL_US + (2 + write_size + read_size) * HOST_I2C_BYTE_US);
+
+    return ESP_OK;
+}
+
+esp_err_t i2c_master_write_to_device(i2c_port_t port, uint8_t device_address, const uint8_t *write_buffer,
+                                     size_t write_size, TickType_t ticks_to_wait) {
+    int index = sensor_find(device_address);
+
+    if (index < 0) {
+        host_busy(HOST_I2C_CALL_US + HOST_I2C_BYTE_US);
+        return ESP_FAIL;
+    }
+
+    sensor_update(index);
+    sensor_write(index, write_buffer, write_size);
+
+    host_busy(HOST_I2C_CALL_US + (1 + write_size) * HOST_I2C_BYTE_US);
+
+    return ESP_OK;
+}
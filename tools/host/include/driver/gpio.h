@@ -0,0 +1,27 @@
+#include <esp_err.h>
+
+#ifndef AISOLE_HOST_DRIVER_GPIO_H
+#define AISOLE_HOST_DRIVER_GPIO_H
+
+/*
+ * Sleep configuration of the pins, without effect on the host
+ */
+
+typedef enum {
+    GPIO_MODE_INPUT_OUTPUT_OD = 1
+} gpio_mode_t;
+
+typedef enum {
+    GPIO_PULLUP_ONLY = 0
+} gpio_pull_mode_t;
+
+typedef enum {
+    GPIO_PULLUP_DISABLE = 0,
+    GPIO_PULLUP_ENABLE
+} gpio_pullup_t;
+
+esp_err_t gpio_sleep_set_direction(int gpio_num, gpio_mode_t mode);
+
+esp_err_t gpio_sleep_set_pull_mode(int gpio_num, gpio_pull_mode_t pull);
+
+#endif //AISOLE_HOST_DRIVER_GPIO_H
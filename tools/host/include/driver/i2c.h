@@ -0,0 +1,53 @@
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <esp_err.h>
+#include "driver/gpio.h"
+#include "freertos/FreeRTOS.h"
+
+#ifndef AISOLE_HOST_DRIVER_I2C_H
+#define AISOLE_HOST_DRIVER_I2C_H
+
+/*
+ * Master transactions on the simulated sensor bus of tools/host/i2c.c, max31725 sensors at the addresses of
+ * sensor_address. The bus time is charged to the simulated clock
+ */
+
+typedef enum {
+    I2C_NUM_0 = 0
+} i2c_port_t;
+
+typedef enum {
+    I2C_MODE_SLAVE = 0,
+    I2C_MODE_MASTER
+} i2c_mode_t;
+
+typedef struct {
+    i2c_mode_t mode;
+    int sda_io_num;
+    int scl_io_num;
+    bool sda_pullup_en;
+    bool scl_pullup_en;
+    union {
+        struct {
+            uint32_t clk_speed;
+        } master;
+    };
+    uint32_t clk_flags;
+} i2c_config_t;
+
+esp_err_t i2c_param_config(i2c_port_t port, const i2c_config_t *config);
+
+esp_err_t i2c_driver_install(i2c_port_t port, i2c_mode_t mode, size_t slv_rx_buf_len, size_t slv_tx_buf_len,
+                             int intr_alloc_flags);
+
+esp_err_t i2c_driver_delete(i2c_port_t port);
+
+esp_err_t i2c_master_write_read_device(i2c_port_t port, uint8_t device_address, const uint8_t *write_buffer,
+                                       size_t write_size, uint8_t *read_buffer, size_t read_size,
+                                       TickType_t ticks_to_wait);
+
+esp_err_t i2c_master_write_to_device(i2c_port_t port, uint8_t device_address, const uint8_t *write_buffer,
+                                     size_t write_size, TickType_t ticks_to_wait);
+
+#endif //AISOLE_HOST_DRIVER_I2C_H
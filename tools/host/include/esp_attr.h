@@ -0,0 +1,11 @@
+#ifndef AISOLE_HOST_ESP_ATTR_H
+#define AISOLE_HOST_ESP_ATTR_H
+
+/*
+ * The rtc memory is the section rtc_data, host_boot keeps it over a deep sleep and starts every other boot like a
+ * power on
+ */
+
+#define RTC_DATA_ATTR __attribute__((section("rtc_data")))
+
+#endif //AISOLE_HOST_ESP_ATTR_H
@@ -0,0 +1,8 @@
+#ifndef AISOLE_HOST_ESP_BT_H
+#define AISOLE_HOST_ESP_BT_H
+
+/*
+ * Nothing of the controller is used by the firmware sources built for the host
+ */
+
+#endif //AISOLE_HOST_ESP_BT_H
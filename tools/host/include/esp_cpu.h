@@ -0,0 +1,11 @@
+#include <stdint.h>
+
+#ifndef AISOLE_HOST_ESP_CPU_H
+#define AISOLE_HOST_ESP_CPU_H
+
+/**
+ * @return The cycles of a 160 MHz cpu on the simulated clock
+ */
+uint32_t esp_cpu_get_cycle_count();
+
+#endif //AISOLE_HOST_ESP_CPU_H
@@ -0,0 +1,25 @@
+#include <stdint.h>
+
+#ifndef AISOLE_HOST_ESP_ERR_H
+#define AISOLE_HOST_ESP_ERR_H
+
+/*
+ * Subset of the esp-idf error codes used by the firmware sources built for the host
+ */
+
+typedef int esp_err_t;
+
+#define ESP_OK 0
+#define ESP_FAIL -1
+#define ESP_ERR_NO_MEM 0x101
+#define ESP_ERR_INVALID_ARG 0x102
+#define ESP_ERR_INVALID_STATE 0x103
+#define ESP_ERR_INVALID_SIZE 0x104
+#define ESP_ERR_NOT_FOUND 0x105
+#define ESP_ERR_TIMEOUT 0x107
+#define ESP_ERR_INVALID_RESPONSE 0x108
+#define ESP_ERR_INVALID_CRC 0x109
+
+const char *esp_err_to_name(esp_err_t code);
+
+#endif //AISOLE_HOST_ESP_ERR_H
@@ -0,0 +1,24 @@
+#include <stdio.h>
+
+#ifndef AISOLE_HOST_ESP_LOG_H
+#define AISOLE_HOST_ESP_LOG_H
+
+/*
+ * Errors and warnings are printed to stderr, the rest only with HOST_LOG_INFO so the output of the tests stays short
+ */
+
+#define HOST_LOG(level, tag, format, ...) fprintf(stderr, level " (%s) " format "\n", tag, ##__VA_ARGS__)
+
+#define ESP_LOGE(tag, format, ...) HOST_LOG("E", tag, format, ##__VA_ARGS__)
+#define ESP_LOGW(tag, format, ...) HOST_LOG("W", tag, format, ##__VA_ARGS__)
+
+#ifdef HOST_LOG_INFO
+#define ESP_LOGI(tag, format, ...) HOST_LOG("I", tag, format, ##__VA_ARGS__)
+#else
+#define ESP_LOGI(tag, format, ...) ((void) (tag))
+#endif
+
+#define ESP_LOGD(tag, format, ...) ((void) (tag))
+#define ESP_LOGV(tag, format, ...) ((void) (tag))
+
+#endif //AISOLE_HOST_ESP_LOG_H
@@ -0,0 +1,12 @@
+#include <stdint.h>
+
+#ifndef AISOLE_HOST_ESP_CLK_H
+#define AISOLE_HOST_ESP_CLK_H
+
+/*
+ * The rtc timer follows the simulated clock
+ */
+
+uint64_t esp_clk_rtc_time();
+
+#endif //AISOLE_HOST_ESP_CLK_H
@@ -0,0 +1,14 @@
+#include <stdint.h>
+
+#ifndef AISOLE_HOST_ESP_ROM_CRC_H
+#define AISOLE_HOST_ESP_ROM_CRC_H
+
+/*
+ * Bitwise equivalents of the crc routines in the esp rom
+ */
+
+uint8_t esp_rom_crc8_le(uint8_t crc, const uint8_t *buf, uint32_t len);
+
+uint16_t esp_rom_crc16_le(uint16_t crc, const uint8_t *buf, uint32_t len);
+
+#endif //AISOLE_HOST_ESP_ROM_CRC_H
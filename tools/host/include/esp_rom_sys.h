@@ -0,0 +1,12 @@
+#include <stdint.h>
+
+#ifndef AISOLE_HOST_ESP_ROM_SYS_H
+#define AISOLE_HOST_ESP_ROM_SYS_H
+
+/*
+ * Busy wait on the simulated clock, see host_busy
+ */
+
+void esp_rom_delay_us(uint32_t us);
+
+#endif //AISOLE_HOST_ESP_ROM_SYS_H
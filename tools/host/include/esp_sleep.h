@@ -0,0 +1,19 @@
+#include <stdint.h>
+
+#ifndef AISOLE_HOST_ESP_SLEEP_H
+#define AISOLE_HOST_ESP_SLEEP_H
+
+/*
+ * Deep sleep ends the simulated boot with HOST_DEEP_SLEEP, the next boot wakes by the timer with the rtc memory kept
+ */
+
+typedef enum {
+    ESP_SLEEP_WAKEUP_UNDEFINED = 0,
+    ESP_SLEEP_WAKEUP_TIMER = 4
+} esp_sleep_wakeup_cause_t;
+
+esp_sleep_wakeup_cause_t esp_sleep_get_wakeup_cause();
+
+void esp_deep_sleep(uint64_t time_in_us) __attribute__((noreturn));
+
+#endif //AISOLE_HOST_ESP_SLEEP_H
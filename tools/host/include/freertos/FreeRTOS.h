@@ -0,0 +1,97 @@
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+#ifndef AISOLE_HOST_FREERTOS_H
+#define AISOLE_HOST_FREERTOS_H
+
+/*
+ * Tasks, queues, semaphores and event groups on the simulated clock of tools/host/host.h, implemented in rtos.c. The
+ * tasks run cooperatively in host_run, a task runs until it blocks, so critical sections are empty
+ */
+
+typedef uint32_t TickType_t;
+typedef int BaseType_t;
+typedef unsigned int UBaseType_t;
+typedef uint8_t StackType_t;
+
+typedef struct {
+    int owner;
+} portMUX_TYPE;
+
+#define portMUX_INITIALIZER_UNLOCKED {0}
+#define portENTER_CRITICAL(mux) ((void) (mux))
+#define portEXIT_CRITICAL(mux) ((void) (mux))
+
+#define pdTRUE 1
+#define pdFALSE 0
+#define pdPASS pdTRUE
+
+// CONFIG_FREERTOS_HZ of sdkconfig
+#define portTICK_PERIOD_MS 1
+#define portMAX_DELAY ((TickType_t) UINT32_MAX)
+
+#define pdMS_TO_TICKS(ms) ((TickType_t) (ms))
+#define pdTICKS_TO_MS(ticks) ((uint32_t) (ticks))
+
+typedef void (*TaskFunction_t)(void *arg);
+
+/**
+ * Queue, also the counting semaphores and mutexes without items
+ */
+typedef struct host_queue {
+    uint8_t *storage;
+    size_t item_size;
+    UBaseType_t length;
+    UBaseType_t head;
+    UBaseType_t count;
+} StaticQueue_t;
+
+typedef StaticQueue_t StaticSemaphore_t;
+typedef struct host_queue *QueueHandle_t;
+typedef struct host_queue *SemaphoreHandle_t;
+
+typedef uint32_t EventBits_t;
+
+typedef struct host_event_group {
+    EventBits_t bits;
+} StaticEventGroup_t;
+
+typedef struct host_event_group *EventGroupHandle_t;
+
+// The stack of a task is allocated by rtos.c, the stacks of the firmware are too small for the host libc
+typedef struct {
+    int unused;
+} StaticTask_t;
+
+typedef struct host_task *TaskHandle_t;
+
+TaskHandle_t xTaskCreateStatic(TaskFunction_t function, const char *name, uint32_t stack_depth, void *arg,
+                               UBaseType_t priority, StackType_t *stack, StaticTask_t *task_buffer);
+
+TickType_t xTaskGetTickCount();
+
+void vTaskDelay(TickType_t ticks);
+
+QueueHandle_t xQueueCreateStatic(UBaseType_t length, UBaseType_t item_size, uint8_t *storage,
+                                 StaticQueue_t *queue_buffer);
+
+BaseType_t xQueueSend(QueueHandle_t queue, const void *item, TickType_t timeout);
+
+BaseType_t xQueueReceive(QueueHandle_t queue, void *item, TickType_t timeout);
+
+SemaphoreHandle_t xSemaphoreCreateMutexStatic(StaticSemaphore_t *semaphore_buffer);
+
+SemaphoreHandle_t xSemaphoreCreateBinaryStatic(StaticSemaphore_t *semaphore_buffer);
+
+BaseType_t xSemaphoreTake(SemaphoreHandle_t semaphore, TickType_t timeout);
+
+BaseType_t xSemaphoreGive(SemaphoreHandle_t semaphore);
+
+EventGroupHandle_t xEventGroupCreateStatic(StaticEventGroup_t *event_group_buffer);
+
+EventBits_t xEventGroupSetBits(EventGroupHandle_t event_group, EventBits_t bits);
+
+EventBits_t xEventGroupGetBits(EventGroupHandle_t event_group);
+
+#endif //AISOLE_HOST_FREERTOS_H
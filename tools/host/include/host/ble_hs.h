@@ -0,0 +1,317 @@
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#include "esp_log.h"
+#include "host/ble_uuid.h"
+
+#ifndef AISOLE_HOST_BLE_HS_H
+#define AISOLE_HOST_BLE_HS_H
+
+/*
+ * The parts of the nimble host used by the firmware, implemented by the simulated peer of tools/host/ble.c. Memory
+ * buffers are reduced to a flat buffer, enough for the notifications and the diagnostics pages of the firmware
+ */
+
+#define BLE_HS_EALREADY 2
+#define BLE_HS_EINVAL 3
+#define BLE_HS_ENOMEM 6
+#define BLE_HS_ENOTCONN 7
+#define BLE_HS_ENOENT 5
+
+#define BLE_HS_FOREVER INT32_MAX
+#define BLE_HS_CONN_HANDLE_NONE 0xffff
+
+// Bytes of a memory buffer, a read of the diagnostics characteristic is at most 512 bytes
+#define HOST_MBUF_SIZE 512
+
+struct os_mbuf {
+    uint16_t om_len;
+    uint8_t buffer[HOST_MBUF_SIZE];
+};
+
+#define OS_MBUF_PKTLEN(om) ((om)->om_len)
+
+int os_mbuf_append(struct os_mbuf *om, const void *data, uint16_t len);
+
+int os_mbuf_copydata(const struct os_mbuf *om, int off, int len, void *dst);
+
+/**
+ * @return The free blocks of the mbuf pool shared by the notifications of all connections
+ */
+int os_msys_num_free();
+
+int os_msys_count();
+
+/**
+ * @return A buffer of the mbuf pool holding the data, NULL if the pool is exhausted
+ */
+struct os_mbuf *ble_hs_mbuf_from_flat(const void *buf, uint16_t len);
+
+int ble_hs_mbuf_to_flat(const struct os_mbuf *om, void *flat, uint16_t max_len, uint16_t *out_copy_len);
+
+typedef struct {
+    uint8_t type;
+    uint8_t val[6];
+} ble_addr_t;
+
+// Att
+
+#define BLE_ATT_ERR_INVALID_ATTR_VALUE_LEN 0x0d
+#define BLE_ATT_ERR_UNLIKELY 0x0e
+#define BLE_ATT_ERR_INSUFFICIENT_RES 0x11
+
+uint16_t ble_att_mtu(uint16_t conn_handle);
+
+// Gatt
+
+#define BLE_GATT_ACCESS_OP_READ_CHR 0
+#define BLE_GATT_ACCESS_OP_WRITE_CHR 1
+#define BLE_GATT_ACCESS_OP_READ_DSC 2
+#define BLE_GATT_ACCESS_OP_WRITE_DSC 3
+
+#define BLE_GATT_REGISTER_OP_SVC 1
+#define BLE_GATT_REGISTER_OP_CHR 2
+#define BLE_GATT_REGISTER_OP_DSC 3
+
+#define BLE_GATT_SVC_TYPE_PRIMARY 1
+
+#define BLE_GATT_CHR_F_READ 0x0002
+#define BLE_GATT_CHR_F_WRITE_NO_RSP 0x0004
+#define BLE_GATT_CHR_F_WRITE 0x0008
+#define BLE_GATT_CHR_F_NOTIFY 0x0010
+
+struct ble_gatt_error {
+    uint16_t status;
+    uint16_t att_handle;
+};
+
+struct ble_gatt_access_ctxt;
+
+typedef int ble_gatt_access_fn(uint16_t conn_handle, uint16_t attr_handle, struct ble_gatt_access_ctxt *ctxt,
+                               void *arg);
+
+struct ble_gatt_chr_def {
+    const ble_uuid_t *uuid;
+    ble_gatt_access_fn *access_cb;
+    void *arg;
+    uint16_t flags;
+    uint16_t *val_handle;
+};
+
+struct ble_gatt_dsc_def {
+    const ble_uuid_t *uuid;
+};
+
+struct ble_gatt_svc_def {
+    uint8_t type;
+    const ble_uuid_t *uuid;
+    const struct ble_gatt_chr_def *characteristics;
+};
+
+struct ble_gatt_access_ctxt {
+    uint8_t op;
+    struct os_mbuf *om;
+    const struct ble_gatt_chr_def *chr;
+};
+
+struct ble_gatt_register_ctxt {
+    uint8_t op;
+    union {
+        struct {
+            uint16_t handle;
+            const struct ble_gatt_svc_def *svc_def;
+        } svc;
+        struct {
+            uint16_t def_handle;
+            uint16_t val_handle;
+            const struct ble_gatt_chr_def *chr_def;
+        } chr;
+        struct {
+            uint16_t handle;
+            const struct ble_gatt_dsc_def *dsc_def;
+        } dsc;
+    };
+};
+
+typedef int ble_gatt_mtu_fn(uint16_t conn_handle, const struct ble_gatt_error *error, uint16_t mtu, void *arg);
+
+int ble_gatts_count_cfg(const struct ble_gatt_svc_def *defs);
+
+int ble_gatts_add_svcs(const struct ble_gatt_svc_def *svcs);
+
+/**
+ * Queues the notification until the next connection event of the peer, the buffer is consumed also on failure
+ */
+int ble_gatts_notify_custom(uint16_t conn_handle, uint16_t att_handle, struct os_mbuf *om);
+
+int ble_gattc_exchange_mtu(uint16_t conn_handle, ble_gatt_mtu_fn *cb, void *cb_arg);
+
+// Gap
+
+#define BLE_GAP_EVENT_CONNECT 0
+#define BLE_GAP_EVENT_DISCONNECT 1
+#define BLE_GAP_EVENT_CONN_UPDATE 3
+#define BLE_GAP_EVENT_CONN_UPDATE_REQ 4
+#define BLE_GAP_EVENT_ADV_COMPLETE 9
+#define BLE_GAP_EVENT_ENC_CHANGE 10
+#define BLE_GAP_EVENT_PASSKEY_ACTION 11
+#define BLE_GAP_EVENT_NOTIFY_TX 13
+#define BLE_GAP_EVENT_SUBSCRIBE 14
+#define BLE_GAP_EVENT_MTU 15
+#define BLE_GAP_EVENT_REPEAT_PAIRING 17
+#define BLE_GAP_EVENT_TRANSMIT_POWER 27
+#define BLE_GAP_EVENT_PATHLOSS_THRESHOLD 28
+
+#define BLE_GAP_REPEAT_PAIRING_RETRY 1
+
+#define BLE_GAP_CONN_MODE_UND 2
+#define BLE_GAP_DISC_MODE_GEN 2
+
+// Intervals in the units of the controller, 0.625 ms for advertising and 1.25 ms for connections
+#define BLE_GAP_ADV_ITVL_MS(t) ((t) * 1000 / 625)
+#define BLE_GAP_CONN_ITVL_MS(t) ((t) * 1000 / 1250)
+#define BLE_GAP_SUPERVISION_TIMEOUT_MS(t) ((t) / 10)
+
+#define BLE_HS_ADV_F_DISC_GEN 0x02
+#define BLE_HS_ADV_F_BREDR_UNSUP 0x04
+#define BLE_HS_ADV_TX_PWR_LVL_AUTO (-128)
+
+struct ble_gap_conn_desc {
+    uint16_t conn_handle;
+    uint16_t conn_itvl;
+    uint16_t conn_latency;
+    uint16_t supervision_timeout;
+    ble_addr_t peer_id_addr;
+};
+
+struct ble_gap_upd_params {
+    uint16_t itvl_min;
+    uint16_t itvl_max;
+    uint16_t latency;
+    uint16_t supervision_timeout;
+    uint16_t min_ce_len;
+    uint16_t max_ce_len;
+};
+
+struct ble_gap_adv_params {
+    uint8_t conn_mode;
+    uint8_t disc_mode;
+    uint16_t itvl_min;
+    uint16_t itvl_max;
+};
+
+struct ble_hs_adv_fields {
+    uint8_t flags;
+    const ble_uuid128_t *uuids128;
+    uint8_t num_uuids128;
+    unsigned uuids128_is_complete: 1;
+    const uint8_t *name;
+    uint8_t name_len;
+    unsigned name_is_complete: 1;
+    int8_t tx_pwr_lvl;
+    unsigned tx_pwr_lvl_is_present: 1;
+    const uint8_t *svc_data_uuid16;
+    uint8_t svc_data_uuid16_len;
+};
+
+struct ble_gap_event {
+    uint8_t type;
+    union {
+        struct {
+            int status;
+            uint16_t conn_handle;
+        } connect;
+        struct {
+            int reason;
+            struct ble_gap_conn_desc conn;
+        } disconnect;
+        struct {
+            int status;
+            uint16_t conn_handle;
+        } conn_update;
+        struct {
+            const struct ble_gap_upd_params *peer_params;
+            struct ble_gap_upd_params *self_params;
+            uint16_t conn_handle;
+        } conn_update_req;
+        struct {
+            int reason;
+        } adv_complete;
+        struct {
+            int status;
+            uint16_t conn_handle;
+        } enc_change;
+        struct {
+            int status;
+            uint16_t conn_handle;
+            uint16_t attr_handle;
+            uint8_t indication;
+        } notify_tx;
+        struct {
+            uint16_t conn_handle;
+            uint16_t attr_handle;
+            uint8_t reason;
+            uint8_t prev_notify: 1;
+            uint8_t cur_notify: 1;
+            uint8_t prev_indicate: 1;
+            uint8_t cur_indicate: 1;
+        } subscribe;
+        struct {
+            uint16_t conn_handle;
+            uint16_t channel_id;
+            uint16_t value;
+        } mtu;
+        struct {
+            uint16_t conn_handle;
+        } repeat_pairing;
+    };
+};
+
+typedef int ble_gap_event_fn(struct ble_gap_event *event, void *arg);
+
+int ble_gap_adv_set_fields(const struct ble_hs_adv_fields *adv_fields);
+
+int ble_gap_adv_rsp_set_fields(const struct ble_hs_adv_fields *rsp_fields);
+
+int ble_gap_adv_start(uint8_t own_addr_type, const ble_addr_t *direct_addr, int32_t duration_ms,
+                      const struct ble_gap_adv_params *adv_params, ble_gap_event_fn *cb, void *cb_arg);
+
+int ble_gap_conn_find(uint16_t handle, struct ble_gap_conn_desc *out_desc);
+
+/**
+ * Requests new connection parameters, the peer applies the minimum interval with its next connection event
+ */
+int ble_gap_update_params(uint16_t conn_handle, const struct ble_gap_upd_params *params);
+
+// Host
+
+typedef void ble_hs_reset_fn(int reason);
+
+typedef void ble_hs_sync_fn();
+
+typedef void ble_gatt_register_fn(struct ble_gatt_register_ctxt *ctxt, void *arg);
+
+typedef int ble_store_status_fn(void *event, void *arg);
+
+struct ble_hs_cfg {
+    ble_hs_reset_fn *reset_cb;
+    ble_hs_sync_fn *sync_cb;
+    ble_gatt_register_fn *gatts_register_cb;
+    ble_store_status_fn *store_status_cb;
+};
+
+extern struct ble_hs_cfg ble_hs_cfg;
+
+int ble_hs_synced();
+
+int ble_hs_id_infer_auto(int privacy, uint8_t *out_addr_type);
+
+int ble_hs_id_copy_addr(uint8_t id_addr_type, uint8_t *out_id_addr, int *out_is_nrpa);
+
+int ble_store_util_delete_peer(const ble_addr_t *peer_id_addr);
+
+int ble_store_util_status_rr(void *event, void *arg);
+
+#endif //AISOLE_HOST_BLE_HS_H
@@ -0,0 +1,33 @@
+#include <stdint.h>
+
+#ifndef AISOLE_HOST_BLE_UUID_H
+#define AISOLE_HOST_BLE_UUID_H
+
+/*
+ * Uuids of the nimble host, only the 128 bit uuids of the gatt service are used by the firmware
+ */
+
+#define BLE_UUID_TYPE_128 128
+
+// Length of the string of ble_uuid_to_str including the terminator
+#define BLE_UUID_STR_LEN 37
+
+typedef struct {
+    uint8_t type;
+} ble_uuid_t;
+
+typedef struct {
+    ble_uuid_t u;
+    uint8_t value[16];
+} ble_uuid128_t;
+
+#define BLE_UUID128_INIT(uuid128...) {.u = {.type = BLE_UUID_TYPE_128}, .value = {uuid128}}
+
+#define BLE_UUID128_DECLARE(uuid128...) ((ble_uuid_t *) (&(ble_uuid128_t) BLE_UUID128_INIT(uuid128)))
+
+/**
+ * @return The uuid formatted into the buffer of BLE_UUID_STR_LEN bytes
+ */
+char *ble_uuid_to_str(const ble_uuid_t *uuid, char *dst);
+
+#endif //AISOLE_HOST_BLE_UUID_H
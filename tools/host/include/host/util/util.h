@@ -0,0 +1,10 @@
+#ifndef AISOLE_HOST_BLE_UTIL_H
+#define AISOLE_HOST_BLE_UTIL_H
+
+/*
+ * Address helper of the nimble host, the simulated device always has a public address
+ */
+
+int ble_hs_util_ensure_addr(int prefer_random);
+
+#endif //AISOLE_HOST_BLE_UTIL_H
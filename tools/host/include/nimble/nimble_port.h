@@ -0,0 +1,15 @@
+#include <esp_err.h>
+
+#ifndef AISOLE_HOST_NIMBLE_PORT_H
+#define AISOLE_HOST_NIMBLE_PORT_H
+
+/*
+ * Port of the nimble host, there is no controller and no host task on the host. tools/host/ble.c runs the events
+ * of the simulated peer from the test instead
+ */
+
+esp_err_t nimble_port_init();
+
+void nimble_port_run();
+
+#endif //AISOLE_HOST_NIMBLE_PORT_H
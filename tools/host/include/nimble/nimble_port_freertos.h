@@ -0,0 +1,13 @@
+#include "freertos/FreeRTOS.h"
+
+#ifndef AISOLE_HOST_NIMBLE_PORT_FREERTOS_H
+#define AISOLE_HOST_NIMBLE_PORT_FREERTOS_H
+
+/**
+ * Syncs the host at once instead of starting the host task, the sync callback of ble_hs_cfg runs before the return
+ */
+void nimble_port_freertos_init(TaskFunction_t host_task_fn);
+
+void nimble_port_freertos_deinit();
+
+#endif //AISOLE_HOST_NIMBLE_PORT_FREERTOS_H
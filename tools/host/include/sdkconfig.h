@@ -0,0 +1,14 @@
+#ifndef AISOLE_HOST_SDKCONFIG_H
+#define AISOLE_HOST_SDKCONFIG_H
+
+/*
+ * Options of the sdkconfig of the firmware used by the sources built for the host
+ */
+
+#define CONFIG_FREERTOS_HZ 1000
+#define CONFIG_BT_NIMBLE_MAX_CONNECTIONS 3
+#define CONFIG_BT_NIMBLE_ATT_PREFERRED_MTU 64
+#define CONFIG_BT_NIMBLE_MSYS_1_BLOCK_COUNT 12
+#define CONFIG_BT_NIMBLE_MSYS_1_BLOCK_SIZE 256
+
+#endif //AISOLE_HOST_SDKCONFIG_H
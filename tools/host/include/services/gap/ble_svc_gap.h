@@ -0,0 +1,8 @@
+#ifndef AISOLE_HOST_BLE_SVC_GAP_H
+#define AISOLE_HOST_BLE_SVC_GAP_H
+
+void ble_svc_gap_init();
+
+int ble_svc_gap_device_name_set(const char *name);
+
+#endif //AISOLE_HOST_BLE_SVC_GAP_H
@@ -0,0 +1,6 @@
+#ifndef AISOLE_HOST_BLE_SVC_GATT_H
+#define AISOLE_HOST_BLE_SVC_GATT_H
+
+void ble_svc_gatt_init();
+
+#endif //AISOLE_HOST_BLE_SVC_GATT_H
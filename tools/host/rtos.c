@@ -0,0 +1,293 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ucontext.h>
+#include <esp_timer.h>
+#include "freertos/FreeRTOS.h"
+#include "host.h"
+
+/*
+ * Cooperative tasks on the simulated clock. host_run switches to the ready tasks one after the other, a task runs
+ * until it blocks on a delay, queue, semaphore or event group. When no task is ready the clock moves to the next
+ * timeout or timer expiry
+ */
+
+typedef enum {
+    TASK_READY = 0,
+    TASK_BLOCKED,
+    TASK_DONE
+} TASK_STATE;
+
+struct host_task {
+    ucontext_t context;
+    TaskFunction_t function;
+    void *arg;
+    const char *name;
+    TASK_STATE state;
+    const void *object;         // Object the task waits for, NULL for a delay
+    int64_t deadline;           // Time the wait times out, INT64_MAX if it does not
+    bool woken;                 // The object changed, the task checks its condition again
+};
+
+static struct host_task tasks[HOST_TASKS];
+static int task_count = 0;
+
+static ucontext_t scheduler;
+static struct host_task *current = NULL;
+
+static int64_t deadline_of(TickType_t timeout) {
+    if (timeout == portMAX_DELAY)
+        return INT64_MAX;
+
+    return esp_timer_get_time() + (int64_t) timeout * portTICK_PERIOD_MS * 1000;
+}
+
+/**
+ * Blocks the current task until the object changes or the deadline passes, returns at once outside of a task
+ * @return If the object changed, false on the timeout
+ */
+static bool task_block(const void *object, int64_t deadline) {
+    if (!current || deadline <= esp_timer_get_time())
+        return false;
+
+    struct host_task *task = current;
+
+    task->state = TASK_BLOCKED;
+    task->object = object;
+    task->deadline = deadline;
+    task->woken = false;
+
+    swapcontext(&task->context, &scheduler);
+
+    return task->woken;
+}
+
+/**
+ * Makes the tasks waiting for the object ready, they check their condition when they run again
+ */
+static void task_wake(const void *object) {
+    for (int i = 0; i < task_count; i++) {
+        if (tasks[i].state == TASK_BLOCKED && tasks[i].object == object && object) {
+            tasks[i].state = TASK_READY;
+            tasks[i].woken = true;
+        }
+    }
+}
+
+static void task_entry() {
+    current->function(current->arg);
+
+    current->state = TASK_DONE;
+
+    swapcontext(&current->context, &scheduler);
+}
+
+TaskHandle_t xTaskCreateStatic(TaskFunction_t function, const char *name, uint32_t stack_depth, void *arg,
+                               UBaseType_t priority, StackType_t *stack, StaticTask_t *task_buffer) {
+    if (task_count == HOST_TASKS) {
+        fprintf(stderr, "No task left for %s\n", name);
+        exit(1);
+    }
+
+    struct host_task *task = &tasks[task_count++];
+
+    memset(task, 0, sizeof(*task));
+
+    task->function = function;
+    task->arg = arg;
+    task->name = name;
+    task->state = TASK_READY;
+
+    getcontext(&task->context);
+
+    task->context.uc_stack.ss_sp = malloc(HOST_TASK_STACK);
+    task->context.uc_stack.ss_size = HOST_TASK_STACK;
+    task->context.uc_link = NULL;
+
+    if (!task->context.uc_stack.ss_sp) {
+        perror("Allocating a task stack failed");
+        exit(1);
+    }
+
+    makecontext(&task->context, task_entry, 0);
+
+    return task;
+}
+
+/**
+ * @return The earliest deadline of the blocked tasks, INT64_MAX if none
+ */
+static int64_t next_deadline() {
+    int64_t next = INT64_MAX;
+
+    for (int i = 0; i < task_count; i++) {
+        if (tasks[i].state == TASK_BLOCKED && tasks[i].deadline < next)
+            next = tasks[i].deadline;
+    }
+
+    return next;
+}
+
+/**
+ * Runs the ready tasks until all of them block
+ */
+static void run_ready() {
+    bool ran = true;
+
+    while (ran) {
+        ran = false;
+
+        for (int i = 0; i < task_count; i++) {
+            int64_t now = esp_timer_get_time();
+
+            // Busy time of the other tasks may have passed the deadline
+            if (tasks[i].state == TASK_BLOCKED && tasks[i].deadline <= now)
+                tasks[i].state = TASK_READY;
+
+            if (tasks[i].state != TASK_READY)
+                continue;
+
+            current = &tasks[i];
+            swapcontext(&scheduler, &current->context);
+            current = NULL;
+
+            ran = true;
+        }
+    }
+}
+
+void host_run(int64_t us) {
+    if (current) {
+        fprintf(stderr, "host_run called from task %s\n", current->name);
+        exit(1);
+    }
+
+    int64_t end = esp_timer_get_time() + us;
+
+    while (1) {
+        run_ready();
+
+        int64_t now = esp_timer_get_time();
+
+        if (now >= end)
+            break;
+
+        int64_t next = next_deadline();
+        int64_t timer = host_timer_next();
+
+        if (timer < next)
+            next = timer;
+        if (end < next)
+            next = end;
+
+        // Timers run late after busy time, they may make tasks ready
+        host_advance(next > now ? next - now : 0);
+    }
+}
+
+TickType_t xTaskGetTickCount() {
+    return esp_timer_get_time() / 1000 / portTICK_PERIOD_MS;
+}
+
+void vTaskDelay(TickType_t ticks) {
+    int64_t deadline = deadline_of(ticks);
+
+    // Outside of a task the delay runs the tasks and timers meanwhile
+    if (!current) {
+        host_run(deadline - esp_timer_get_time());
+        return;
+    }
+
+    task_block(NULL, deadline);
+}
+
+QueueHandle_t xQueueCreateStatic(UBaseType_t length, UBaseType_t item_size, uint8_t *storage,
+                                 StaticQueue_t *queue_buffer) {
+    memset(queue_buffer, 0, sizeof(*queue_buffer));
+
+    queue_buffer->storage = storage;
+    queue_buffer->item_size = item_size;
+    queue_buffer->length = length;
+
+    return queue_buffer;
+}
+
+BaseType_t xQueueSend(QueueHandle_t queue, const void *item, TickType_t timeout) {
+    int64_t deadline = deadline_of(timeout);
+
+    while (queue->count == queue->length) {
+        if (!task_block(queue, deadline) && queue->count == queue->length)
+            return pdFALSE;
+    }
+
+    if (queue->item_size > 0)
+        memcpy(queue->storage + (queue->head + queue->count) % queue->length * queue->item_size, item,
+               queue->item_size);
+
+    queue->count++;
+
+    task_wake(queue);
+
+    return pdTRUE;
+}
+
+BaseType_t xQueueReceive(QueueHandle_t queue, void *item, TickType_t timeout) {
+    int64_t deadline = deadline_of(timeout);
+
+    while (queue->count == 0) {
+        if (!task_block(queue, deadline) && queue->count == 0)
+            return pdFALSE;
+    }
+
+    if (queue->item_size > 0)
+        memcpy(item, queue->storage + queue->head * queue->item_size, queue->item_size);
+
+    queue->head = (queue->head + 1) % queue->length;
+    queue->count--;
+
+    task_wake(queue);
+
+    return pdTRUE;
+}
+
+SemaphoreHandle_t xSemaphoreCreateMutexStatic(StaticSemaphore_t *semaphore_buffer) {
+    xQueueCreateStatic(1, 0, NULL, semaphore_buffer);
+
+    semaphore_buffer->count = 1;
+
+    return semaphore_buffer;
+}
+
+SemaphoreHandle_t xSemaphoreCreateBinaryStatic(StaticSemaphore_t *semaphore_buffer) {
+    return xQueueCreateStatic(1, 0, NULL, semaphore_buffer);
+}
+
+BaseType_t xSemaphoreTake(SemaphoreHandle_t semaphore, TickType_t timeout) {
+    return xQueueReceive(semaphore, NULL, timeout);
+}
+
+BaseType_t xSemaphoreGive(SemaphoreHandle_t semaphore) {
+    // A binary semaphore given twice stays given
+    if (semaphore->count == semaphore->length)
+        return pdFALSE;
+
+    return xQueueSend(semaphore, NULL, 0);
+}
+
+EventGroupHandle_t xEventGroupCreateStatic(StaticEventGroup_t *event_group_buffer) {
+    event_group_buffer->bits = 0;
+
+    return event_group_buffer;
+}
+
+EventBits_t xEventGroupSetBits(EventGroupHandle_t event_group, EventBits_t bits) {
+    event_group->bits |= bits;
+
+    task_wake(event_group);
+
+    return event_group->bits;
+}
+
+EventBits_t xEventGroupGetBits(EventGroupHandle_t event_group) {
+    return event_group->bits;
+}
@@ -0,0 +1,29 @@
+#include <esp_timer.h>
+#include "timebase.h"
+#include "host.h"
+
+/*
+ * Stand-in of timebase.c for tests that do not build it. The monotonic time follows the simulated clock, which
+ * continues over the reboots, and the wall clock is offset by HOST_WALL_OFFSET. Syncs are ignored, so the system time
+ * of the host is left alone
+ */
+
+void timebase_init(uint32_t last_time) {
+}
+
+uint32_t timebase_now() {
+    return esp_timer_get_time() / 1000000;
+}
+
+void timebase_sync(uint32_t wall) {
+}
+
+void timebase_clear() {
+}
+
+uint32_t timebase_to_wall(uint32_t mono) {
+    return mono + HOST_WALL_OFFSET;
+}
+
+void timebase_notify() {
+}
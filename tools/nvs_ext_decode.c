@@ -0,0 +1,494 @@
+/**
+ * Decodes a dump of the nvs_ext partition into CSV or column files and prints the aggregates of the records.\n
+ * The dump is read with esptool (read_flash 0x310000 0xf0000 nvs_ext.bin), the partitions following nvs_ext in
+ * STORE_EXTENT_LABELS are appended to it in order. The dump is memory mapped and the blocks are decoded in parallel.
+ * The record layout and codec are shared with the firmware by main/record.h
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <inttypes.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "record.h"
+#include "timebase.h"
+#include "phase.h"
+
+// Legacy records decoded by one work item
+#define LEGACY_CHUNK 1024
+
+typedef struct {
+    uint32_t counter;
+    uint32_t time;
+    uint8_t format;
+    uint8_t valid;
+    uint16_t pair_id;                   // PHASE_PAIR_NONE for records sampled without phase alignment
+    uint16_t values[RECORD_SENSORS];    // 1/16 °C
+} row_t;
+
+/**
+ * Consecutive records of one format, a block or a chunk of the legacy records
+ */
+typedef struct {
+    uint32_t address;       // Address of the first record
+    uint32_t first_counter;
+    uint32_t count;
+    uint8_t format;
+    uint8_t record_size;
+    uint32_t time_base;
+    uint16_t pair_id;
+    size_t row;             // Index of the first record in rows
+} work_t;
+
+typedef struct {
+    uint64_t records;
+    uint64_t torn;
+    uint32_t first_time;
+    uint32_t last_time;
+    uint32_t min[RECORD_SENSORS];
+    uint32_t max[RECORD_SENSORS];
+    uint64_t sum[RECORD_SENSORS];
+    uint64_t samples[RECORD_SENSORS];
+    uint64_t format_records[RECORD_FORMAT_FINE + 1];
+    uint8_t format_sizes[RECORD_FORMAT_FINE + 1];
+} aggregates_t;
+
+static const uint8_t *image;
+static size_t image_size;
+
+static work_t *works;
+static size_t work_count;
+static size_t next_work;
+
+static row_t *rows;
+static size_t row_count;
+
+static timebase_sync_t sync_entry;
+static int has_sync = 0;
+
+static const char *format_names[] = {
+    [RECORD_FORMAT_LEGACY] = "legacy",
+    [RECORD_FORMAT_RAW] = "raw",
+    [RECORD_FORMAT_RELATIVE] = "relative",
+    [RECORD_FORMAT_FINE] = "fine",
+};
+
+static void add_work(work_t work) {
+    works = realloc(works, (work_count + 1) * sizeof(work_t));
+    if (!works) {
+        perror("realloc");
+        exit(1);
+    }
+
+    work.row = row_count;
+    works[work_count++] = work;
+    row_count += work.count;
+}
+
+static const record_block_header_t *header_at(uint32_t address) {
+    if (address + RECORD_BLOCK_SIZE > image_size)
+        return NULL;
+
+    const record_block_header_t *header = (const record_block_header_t *) (image + address);
+
+    return record_block_header_valid(header) ? header : NULL;
+}
+
+/**
+ * @return Count of legacy records in front of the first block, read until the first erased record
+ */
+static uint32_t detect_legacy() {
+    uint32_t store_start = 0;
+
+    while (store_start + RECORD_BLOCK_SIZE <= image_size && !header_at(store_start))
+        store_start += RECORD_BLOCK_SIZE;
+
+    uint32_t count = 0;
+
+    while ((count + 1) * RECORD_LEGACY_SIZE <= store_start &&
+           !record_is_erased(image + count * RECORD_LEGACY_SIZE, RECORD_LEGACY_SIZE))
+        count++;
+
+    return count;
+}
+
+/**
+ * Collects the legacy chunks and the chain of blocks, following the same rules as the firmware store
+ */
+static void scan(uint32_t legacy_count) {
+    for (uint32_t first = 0; first < legacy_count; first += LEGACY_CHUNK) {
+        work_t work = {
+            .address = first * RECORD_LEGACY_SIZE,
+            .first_counter = first + 1,
+            .count = legacy_count - first < LEGACY_CHUNK ? legacy_count - first : LEGACY_CHUNK,
+            .format = RECORD_FORMAT_LEGACY,
+            .record_size = RECORD_LEGACY_SIZE,
+            .pair_id = PHASE_PAIR_NONE
+        };
+
+        add_work(work);
+    }
+
+    uint32_t block = (legacy_count * RECORD_LEGACY_SIZE + RECORD_BLOCK_SIZE - 1) / RECORD_BLOCK_SIZE *
+                     RECORD_BLOCK_SIZE;
+    uint32_t counter = legacy_count + 1;
+
+    const record_block_header_t *header;
+
+    while ((header = header_at(block)) && header->first_counter == counter) {
+        const record_block_header_t *next = header_at(block + RECORD_BLOCK_SIZE);
+        uint32_t capacity = RECORD_BLOCK_CAPACITY(header->record_size);
+        uint32_t count = 0;
+
+        if (next && next->first_counter > header->first_counter &&
+            next->first_counter - header->first_counter <= capacity) {
+            count = next->first_counter - header->first_counter;
+        } else {
+            // Last block or closed early, the records end at the first erased one
+            uint32_t address = block + sizeof(record_block_header_t);
+
+            while (count < capacity && !record_is_erased(image + address, header->record_size)) {
+                count++;
+                address = record_next_slot(address, header->record_size);
+            }
+        }
+
+        work_t work = {
+            .address = block + sizeof(record_block_header_t),
+            .first_counter = header->first_counter,
+            .count = count,
+            .format = header->format,
+            .record_size = header->record_size,
+            .time_base = header->time_base,
+            .pair_id = header->pair_id
+        };
+
+        add_work(work);
+
+        counter += count;
+        block += RECORD_BLOCK_SIZE;
+    }
+}
+
+static void decode_work(const work_t *work) {
+    uint32_t address = work->address;
+
+    for (uint32_t i = 0; i < work->count; i++) {
+        const uint8_t *record = image + address;
+        row_t *row = &rows[work->row + i];
+
+        row->counter = work->first_counter + i;
+        row->format = work->format;
+        row->pair_id = work->pair_id;
+        row->time = record_time(work->format, work->time_base, record);
+        for (int s = 0; s < RECORD_SENSORS; s++)
+            row->values[s] = record_value_fine(work->format, record, s);
+
+        if (work->format == RECORD_FORMAT_LEGACY) {
+            row->valid = !record_is_erased(record, work->record_size);
+            address += work->record_size;
+        } else {
+            row->valid = record_valid(record, work->record_size);
+            address = record_next_slot(address, work->record_size);
+        }
+
+        if ((work->format == RECORD_FORMAT_RELATIVE || work->format == RECORD_FORMAT_FINE) && has_sync)
+            row->time = timebase_map(&sync_entry, row->time);
+    }
+}
+
+static void *decode_thread(void *arg) {
+    (void) arg;
+
+    size_t index;
+
+    while ((index = __atomic_fetch_add(&next_work, 1, __ATOMIC_RELAXED)) < work_count)
+        decode_work(&works[index]);
+
+    return NULL;
+}
+
+static void aggregate(aggregates_t *aggregates) {
+    memset(aggregates, 0, sizeof(*aggregates));
+
+    for (int s = 0; s < RECORD_SENSORS; s++)
+        aggregates->min[s] = UINT16_MAX;
+
+    // Storage cost per format, to compare the fine records with the 7.1 records
+    for (size_t i = 0; i < work_count; i++) {
+        if (works[i].format > RECORD_FORMAT_FINE)
+            continue;
+
+        aggregates->format_records[works[i].format] += works[i].count;
+        aggregates->format_sizes[works[i].format] = works[i].record_size;
+    }
+
+    for (size_t i = 0; i < row_count; i++) {
+        const row_t *row = &rows[i];
+
+        if (!row->valid) {
+            aggregates->torn++;
+            continue;
+        }
+
+        if (aggregates->records == 0)
+            aggregates->first_time = row->time;
+
+        aggregates->last_time = row->time;
+        aggregates->records++;
+
+        for (int s = 0; s < RECORD_SENSORS; s++) {
+            // The firmware stores 0 for a failed sensor read and RECORD_VALUE_NONE for a sensor not sampled
+            if (row->values[s] == 0 || row->values[s] >> RECORD_FRACTION_BITS == RECORD_VALUE_NONE)
+                continue;
+
+            if (row->values[s] < aggregates->min[s])
+                aggregates->min[s] = row->values[s];
+            if (row->values[s] > aggregates->max[s])
+                aggregates->max[s] = row->values[s];
+
+            aggregates->sum[s] += row->values[s];
+            aggregates->samples[s]++;
+        }
+    }
+}
+
+static void print_aggregates(const aggregates_t *aggregates) {
+    fprintf(stderr, "records %" PRIu64 ", torn %" PRIu64 ", time %u - %u", aggregates->records, aggregates->torn,
+            aggregates->first_time, aggregates->last_time);
+
+    if (aggregates->records > 1)
+        fprintf(stderr, ", mean interval %.1f s",
+                (double) (aggregates->last_time - aggregates->first_time) / (aggregates->records - 1));
+
+    fprintf(stderr, "\n");
+
+    for (int format = 0; format <= RECORD_FORMAT_FINE; format++) {
+        if (aggregates->format_records[format] > 0)
+            fprintf(stderr, "%s records %" PRIu64 ", %u bytes each\n", format_names[format],
+                    aggregates->format_records[format], aggregates->format_sizes[format]);
+    }
+
+    fprintf(stderr, "sensor,samples,min,max,mean\n");
+
+    for (int s = 0; s < RECORD_SENSORS; s++) {
+        if (aggregates->samples[s] == 0) {
+            fprintf(stderr, "%d,0,,,\n", s);
+            continue;
+        }
+
+        fprintf(stderr, "%d,%" PRIu64 ",%g,%g,%.3f\n", s, aggregates->samples[s], aggregates->min[s] / 16.0,
+                aggregates->max[s] / 16.0, (double) aggregates->sum[s] / aggregates->samples[s] / 16.0);
+    }
+}
+
+static void write_csv() {
+    printf("counter,time,format,valid");
+    for (int s = 0; s < RECORD_SENSORS; s++)
+        printf(",s%d", s);
+    printf(",pair\n");
+
+    for (size_t i = 0; i < row_count; i++) {
+        const row_t *row = &rows[i];
+
+        const char *format = row->format <= RECORD_FORMAT_FINE ? format_names[row->format] : "unknown";
+
+        printf("%u,%u,%s,%u", row->counter, row->time, format, row->valid);
+        for (int s = 0; s < RECORD_SENSORS; s++) {
+            // Empty for sensors the record did not sample
+            if (row->values[s] >> RECORD_FRACTION_BITS == RECORD_VALUE_NONE) {
+                printf(",");
+            } else {
+                printf(row->format == RECORD_FORMAT_FINE ? ",%.4f" : ",%.1f", row->values[s] / 16.0);
+            }
+        }
+
+        // Empty for records sampled without phase alignment
+        if (row->pair_id != PHASE_PAIR_NONE) {
+            printf(",%u\n", row->pair_id);
+        } else {
+            printf(",\n");
+        }
+    }
+}
+
+static FILE *open_column(const char *directory, const char *name) {
+    char path[4096];
+    snprintf(path, sizeof(path), "%s/%s", directory, name);
+
+    FILE *file = fopen(path, "wb");
+    if (!file)
+        perror(path);
+
+    return file;
+}
+
+/**
+ * Writes one little endian array per column, counter and time as u32, the pair id as u16, the rest as u8.
+ * The values are 7.1 fixed point, the fraction columns hold the 1/16 °C steps below them, 0 for other formats
+ */
+static int write_columns(const char *directory) {
+    if (mkdir(directory, 0755) != 0 && errno != EEXIST) {
+        perror(directory);
+        return 1;
+    }
+
+    char name[32];
+
+    for (int column = -4; column <= 2 * RECORD_SENSORS; column++) {
+        static const char *names[] = {"counter.u32", "time.u32", "format.u8", "valid.u8"};
+
+        if (column < 0) {
+            snprintf(name, sizeof(name), "%s", names[column + 4]);
+        } else if (column < RECORD_SENSORS) {
+            snprintf(name, sizeof(name), "s%02d.u8", column);
+        } else if (column == 2 * RECORD_SENSORS) {
+            snprintf(name, sizeof(name), "pair.u16");
+        } else {
+            snprintf(name, sizeof(name), "f%02d.u8", column - RECORD_SENSORS);
+        }
+
+        FILE *file = open_column(directory, name);
+        if (!file)
+            return 1;
+
+        for (size_t i = 0; i < row_count; i++) {
+            const row_t *row = &rows[i];
+
+            switch (column) {
+                case -4:
+                    fwrite(&row->counter, sizeof(row->counter), 1, file);
+                    break;
+                case -3:
+                    fwrite(&row->time, sizeof(row->time), 1, file);
+                    break;
+                case -2:
+                    fputc(row->format, file);
+                    break;
+                case -1:
+                    fputc(row->valid, file);
+                    break;
+                case 2 * RECORD_SENSORS:
+                    fwrite(&row->pair_id, sizeof(row->pair_id), 1, file);
+                    break;
+                default:
+                    if (column < RECORD_SENSORS) {
+                        fputc(row->values[column] >> RECORD_FRACTION_BITS, file);
+                    } else {
+                        fputc(row->values[column - RECORD_SENSORS] & ((1 << RECORD_FRACTION_BITS) - 1), file);
+                    }
+                    break;
+            }
+        }
+
+        fclose(file);
+    }
+
+    return 0;
+}
+
+static void usage(const char *name) {
+    fprintf(stderr, "Usage: %s [-l legacy_count] [-s mono:wall[:drift_ppm]] [-c column_dir] [-j threads] dump\n"
+                    "  -l  count of records of the flat layout, detected if not given\n"
+                    "  -s  sync entry mapping the monotonic time of relative records to the wall clock\n"
+                    "  -c  writes column files instead of CSV to stdout\n"
+                    "  -j  decode threads, defaults to the count of cores\n", name);
+}
+
+int main(int argc, char **argv) {
+    long legacy_count = -1;
+    long threads = sysconf(_SC_NPROCESSORS_ONLN);
+    const char *column_dir = NULL;
+    int option;
+
+    while ((option = getopt(argc, argv, "l:s:c:j:")) != -1) {
+        switch (option) {
+            case 'l':
+                legacy_count = strtol(optarg, NULL, 10);
+                break;
+            case 's':
+                if (sscanf(optarg, "%u:%u:%d", &sync_entry.mono, &sync_entry.wall, &sync_entry.drift_ppm) < 2) {
+                    usage(argv[0]);
+                    return 1;
+                }
+
+                has_sync = 1;
+                break;
+            case 'c':
+                column_dir = optarg;
+                break;
+            case 'j':
+                threads = strtol(optarg, NULL, 10);
+                break;
+            default:
+                usage(argv[0]);
+                return 1;
+        }
+    }
+
+    if (optind != argc - 1) {
+        usage(argv[0]);
+        return 1;
+    }
+
+    int fd = open(argv[optind], O_RDONLY);
+    struct stat st;
+
+    if (fd < 0 || fstat(fd, &st) != 0) {
+        perror(argv[optind]);
+        return 1;
+    }
+
+    image_size = st.st_size;
+    image = mmap(NULL, image_size, PROT_READ, MAP_PRIVATE, fd, 0);
+
+    if (image == MAP_FAILED) {
+        perror("mmap");
+        return 1;
+    }
+
+    if (legacy_count < 0)
+        legacy_count = detect_legacy();
+
+    if ((size_t) legacy_count * RECORD_LEGACY_SIZE > image_size) {
+        fprintf(stderr, "Legacy count %ld exceeds the dump\n", legacy_count);
+        return 1;
+    }
+
+    scan(legacy_count);
+
+    rows = calloc(row_count ? row_count : 1, sizeof(row_t));
+    if (!rows) {
+        perror("calloc");
+        return 1;
+    }
+
+    if (threads < 1)
+        threads = 1;
+
+    pthread_t thread_ids[threads];
+
+    for (long i = 0; i < threads; i++)
+        pthread_create(&thread_ids[i], NULL, decode_thread, NULL);
+
+    for (long i = 0; i < threads; i++)
+        pthread_join(thread_ids[i], NULL);
+
+    fprintf(stderr, "%zu blocks and chunks, %ld legacy records\n", work_count, legacy_count);
+
+    aggregates_t aggregates;
+    aggregate(&aggregates);
+    print_aggregates(&aggregates);
+
+    int res = column_dir ? write_columns(column_dir) : (write_csv(), 0);
+
+    munmap((void *) image, image_size);
+    close(fd);
+
+    return res;
+}
@@ -0,0 +1,296 @@
+/**
+ * Simulates the phase aligned recording of a left and right sole with independently drifting clocks.\n
+ * Both soles run the scheduling of main/phase.h on their own clock, the app aligns them periodically with a jittered
+ * command latency. Prints the deviation of the paired samples as JSON, the exit code is 2 if a pair sampled after the
+ * first drift estimate of both soles deviates by more than the limit or a slot was sampled twice or skipped
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <math.h>
+#include <unistd.h>
+#include "phase.h"
+
+// Time from the trigger of a sample until the next slot is scheduled in us, the conversion and reading the sensors
+#define SIM_SAMPLE_TIME 80000
+// Period of the simulated temperature change of the crystals in s
+#define SIM_WANDER_PERIOD 21600
+
+/**
+ * Simulated sole, the local clock runs slow by drift_ppm plus a periodic wander
+ */
+typedef struct {
+    double offset;              // Local clock at the simulation start in us
+    double drift_ppm;
+    double wander_ppm;
+    phase_t phase;
+    uint32_t next_slot;
+    int64_t next_sample;        // True time of the next sample in us
+    int64_t next_alignment;     // True time the next align command is received in us
+    int64_t settled;            // True time of the first drift estimate in us, -1 before
+    int64_t *sample_times;      // True time of the sample of every slot, -1 if not sampled
+    uint32_t duplicates;
+} sole_t;
+
+static double wander_integral(const sole_t *sole, double time) {
+    double period = SIM_WANDER_PERIOD * 1e6;
+
+    return sole->wander_ppm * period / (2 * M_PI) * (1 - cos(2 * M_PI * time / period));
+}
+
+/**
+ * @return The local clock of the sole at the true time in us
+ */
+static int64_t local_clock(const sole_t *sole, double time) {
+    return llround(sole->offset + time - (sole->drift_ppm * time + wander_integral(sole, time)) / 1e6);
+}
+
+/**
+ * @return The true time the local clock of the sole reaches the given value in us
+ */
+static double true_time(const sole_t *sole, int64_t local) {
+    double time = local - sole->offset;
+
+    for (int i = 0; i < 4; i++)
+        time += local - local_clock(sole, time);
+
+    return time;
+}
+
+/**
+ * Waits as the service task for the local clock of the slot, the wait ends on a whole tick of 1 ms
+ */
+static void wait_slot(sole_t *sole, int64_t local, int64_t slot_local) {
+    int64_t delay = slot_local > local ? slot_local - local : 0;
+
+    sole->next_sample = llround(true_time(sole, local + delay / 1000 * 1000));
+}
+
+/**
+ * Takes the next slot as phase_schedule
+ */
+static void schedule(sole_t *sole, int64_t now) {
+    int64_t local = local_clock(sole, now);
+    uint32_t slot;
+
+    wait_slot(sole, local, phase_next_slot(&sole->phase, local, sole->next_slot, &slot));
+    sole->next_slot = slot + 1;
+
+    if (sole->sample_times[slot] >= 0)
+        sole->duplicates++;
+}
+
+/**
+ * Corrects the wait for the slot taken last as phase_reschedule
+ */
+static void reschedule(sole_t *sole, int64_t now) {
+    int64_t local = local_clock(sole, now);
+
+    wait_slot(sole, local, phase_slot_local(&sole->phase, sole->next_slot - 1));
+}
+
+static void usage(const char *name) {
+    fprintf(stderr, "Usage: %s [-H hours] [-i interval_ms] [-a align_interval_s] [-j jitter_ms] "
+                    "[-l left_ppm] [-r right_ppm] [-w wander_ppm] [-m max_pair_error_ms] [-s seed]\n", name);
+}
+
+int main(int argc, char **argv) {
+    double hours = 24;
+    uint32_t interval = 60000;
+    uint32_t align_interval = 900;
+    uint32_t jitter = 30;
+    double left_ppm = 20;
+    double right_ppm = -30;
+    double wander_ppm = 10;
+    double max_error = 100;
+    unsigned int seed = 1;
+    int option;
+
+    while ((option = getopt(argc, argv, "H:i:a:j:l:r:w:m:s:")) != -1) {
+        switch (option) {
+            case 'H':
+                hours = strtod(optarg, NULL);
+                break;
+            case 'i':
+                interval = strtoul(optarg, NULL, 10);
+                break;
+            case 'a':
+                align_interval = strtoul(optarg, NULL, 10);
+                break;
+            case 'j':
+                jitter = strtoul(optarg, NULL, 10);
+                break;
+            case 'l':
+                left_ppm = strtod(optarg, NULL);
+                break;
+            case 'r':
+                right_ppm = strtod(optarg, NULL);
+                break;
+            case 'w':
+                wander_ppm = strtod(optarg, NULL);
+                break;
+            case 'm':
+                max_error = strtod(optarg, NULL);
+                break;
+            case 's':
+                seed = strtoul(optarg, NULL, 10);
+                break;
+            default:
+                usage(argv[0]);
+                return 1;
+        }
+    }
+
+    if (optind != argc || interval < PHASE_MIN_INTERVAL || align_interval == 0 || hours <= 0) {
+        usage(argv[0]);
+        return 1;
+    }
+
+    srand(seed);
+
+    // Wall clock of the app at the simulation start, the epoch is the next full minute
+    const int64_t wall_start = 1700000000123LL;
+    const uint32_t epoch = wall_start / 60000 * 60 + 60;
+    const int64_t end = hours * 3600e6;
+    const uint32_t slot_count = end / 1000 / interval + 2;
+
+    sole_t soles[2] = {
+        {.offset = 12345678, .drift_ppm = left_ppm, .wander_ppm = wander_ppm},
+        {.offset = 987654321, .drift_ppm = right_ppm, .wander_ppm = -wander_ppm}
+    };
+
+    for (int i = 0; i < 2; i++) {
+        soles[i].phase.pair_id = PHASE_PAIR_NONE;
+        soles[i].next_sample = -1;
+        soles[i].settled = -1;
+        soles[i].sample_times = malloc(slot_count * sizeof(int64_t));
+
+        for (uint32_t slot = 0; slot < slot_count; slot++)
+            soles[i].sample_times[slot] = -1;
+    }
+
+    uint64_t samples = 0;
+
+    // The app sends the align command to both soles at the same wall clock, the latency differs per sole
+    for (int64_t sent = 0; sent < end; sent += align_interval * 1000000LL) {
+        for (int i = 0; i < 2; i++)
+            soles[i].next_alignment = sent + 5000 + (int64_t) (rand() % (jitter * 1000 + 1));
+
+        for (int i = 0; i < 2; i++) {
+            sole_t *sole = &soles[i];
+            int64_t next_sent = sent + align_interval * 1000000LL;
+
+            while (sole->next_alignment >= 0 || (sole->next_sample >= 0 && sole->next_sample < next_sent)) {
+                if (sole->next_alignment >= 0 &&
+                    (sole->next_sample < 0 || sole->next_alignment <= sole->next_sample)) {
+                    bool first = sole->phase.pair_id == PHASE_PAIR_NONE;
+
+                    sole->phase.pair_id = 1;
+                    sole->phase.epoch = epoch;
+                    sole->phase.interval = interval;
+
+                    phase_align(&sole->phase, local_clock(sole, sole->next_alignment), wall_start + sent / 1000);
+
+                    if (first) {
+                        schedule(sole, sole->next_alignment);
+                    } else {
+                        reschedule(sole, sole->next_alignment);
+                    }
+
+                    if (sole->settled < 0 && sole->phase.drift_estimates > 0)
+                        sole->settled = sole->next_alignment;
+
+                    sole->next_alignment = -1;
+                    continue;
+                }
+
+                if (sole->next_sample >= end)
+                    break;
+
+                uint32_t slot = sole->next_slot - 1;
+
+                sole->sample_times[slot] = sole->next_sample;
+                samples++;
+
+                schedule(sole, sole->next_sample + SIM_SAMPLE_TIME);
+            }
+        }
+    }
+
+    uint32_t pairs = 0;
+    uint32_t missed = 0;
+    uint32_t first_slot = UINT32_MAX;
+    uint32_t last_slot = 0;
+    double max_pair = 0;
+    double sum_pair = 0;
+    double max_settled = 0;
+    double max_slot = 0;
+    int64_t settled = soles[0].settled > soles[1].settled ? soles[0].settled : soles[1].settled;
+
+    for (uint32_t slot = 0; slot < slot_count; slot++) {
+        int64_t left = soles[0].sample_times[slot];
+        int64_t right = soles[1].sample_times[slot];
+
+        if (left >= 0 || right >= 0) {
+            if (slot < first_slot)
+                first_slot = slot;
+            last_slot = slot;
+        }
+
+        for (int i = 0; i < 2; i++) {
+            int64_t time = soles[i].sample_times[slot];
+
+            if (time < 0)
+                continue;
+
+            // Deviation from the wall clock of the slot
+            double deviation = fabs((wall_start + time / 1000.0) - ((double) epoch * 1000 + (double) slot * interval));
+            if (deviation > max_slot)
+                max_slot = deviation;
+        }
+
+        if (left < 0 || right < 0)
+            continue;
+
+        double deviation = fabs((double) (left - right)) / 1000;
+
+        pairs++;
+        sum_pair += deviation;
+        if (deviation > max_pair)
+            max_pair = deviation;
+
+        if (soles[0].settled >= 0 && soles[1].settled >= 0 && left >= settled && right >= settled &&
+            deviation > max_settled)
+            max_settled = deviation;
+    }
+
+    for (uint32_t slot = first_slot + 1; pairs > 0 && slot < last_slot; slot++) {
+        for (int i = 0; i < 2; i++)
+            missed += soles[i].sample_times[slot] < 0;
+    }
+
+    uint32_t duplicates = soles[0].duplicates + soles[1].duplicates;
+
+    printf("{\n");
+    printf("  \"samples\": %llu,\n", (unsigned long long) samples);
+    printf("  \"pairs\": %u,\n", pairs);
+    printf("  \"missed_slots\": %u,\n", missed);
+    printf("  \"duplicate_slots\": %u,\n", duplicates);
+    printf("  \"drift_ppm\": [%d, %d],\n", soles[0].phase.drift_ppm, soles[1].phase.drift_ppm);
+    printf("  \"mean_pair_error_ms\": %.3f,\n", pairs > 0 ? sum_pair / pairs : 0);
+    printf("  \"max_pair_error_ms\": %.3f,\n", max_pair);
+    printf("  \"settled_s\": %.1f,\n", settled / 1e6);
+    printf("  \"max_settled_pair_error_ms\": %.3f,\n", max_settled);
+    printf("  \"max_slot_error_ms\": %.3f\n", max_slot);
+    printf("}\n");
+
+    for (int i = 0; i < 2; i++)
+        free(soles[i].sample_times);
+
+    if (pairs == 0 || settled < 0 || missed > 0 || duplicates > 0 || max_settled > max_error) {
+        fprintf(stderr, "Alignment failed\n");
+        return 2;
+    }
+
+    return 0;
+}
@@ -0,0 +1,158 @@
+/**
+ * Benchmarks the playback reader of main/store.c on the simulated flash of tools/host.\n
+ * Stores relative and fine records with a block closed early by a pair change, then reads all of them back one by one
+ * without a read buffer and through the double buffer with a prefetch after every record like the playback. Checks
+ * that both return the same records, prints the flash reads and read time per 1000 records as JSON and compares them
+ * with a baseline file of "metric max" lines. The exit code is 2 on a failed check or a regression
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <unistd.h>
+#include <esp_timer.h>
+#include "host.h"
+#include "record.h"
+#include "store.h"
+#include "baseline.h"
+
+// Data partitions of partitions.csv
+#define BENCH_PARTITIONS "nvs_ext=0xf0000,rec_ext=0x180000"
+
+#define BENCH_RECORDS 12000
+// Records of the fine resolution, the rest is relative
+#define BENCH_FINE_START 4000
+#define BENCH_FINE_END 5000
+#define BENCH_FINE(index) ((index) >= BENCH_FINE_START && (index) < BENCH_FINE_END)
+// Record opening a block for a new phase alignment pair
+#define BENCH_PAIR_START 8000
+
+/**
+ * Reads of a variant of the reader
+ */
+typedef struct {
+    uint32_t records;
+    uint32_t reads;
+    int64_t read_us;            // Time of all flash reads
+    int64_t next_us;            // Time of the flash reads in store_reader_next, the rest overlaps the notification
+    uint32_t checksum;
+} read_result_t;
+
+static void record() {
+    sensor_data_t data;
+
+    for (uint32_t i = 0; i < BENCH_RECORDS; i++) {
+        if (i == BENCH_PAIR_START)
+            store_set_pair_id(1);
+
+        host_sample(i, BENCH_FINE(i), &data);
+
+        CHECK(store_write(&data, 1) == ESP_OK, "write of record %u", i);
+    }
+}
+
+static void read_all(store_read_buffer_t *buffer, read_result_t *result) {
+    store_reader_t reader = {.buffer = buffer};
+    sensor_data_t data;
+    sensor_data_t expected;
+
+    host_flash_stats_t *stats = host_flash_stats();
+    uint32_t reads = stats->reads;
+    int64_t start = esp_timer_get_time();
+
+    CHECK(store_reader_seek(&reader, 1) == ESP_OK, "seek of the first record");
+
+    while (1) {
+        int64_t next_start = esp_timer_get_time();
+        esp_err_t res = store_reader_next(&reader, &data);
+
+        result->next_us += esp_timer_get_time() - next_start;
+
+        if (res != ESP_OK)
+            break;
+
+        host_sample(data.counter - 1, BENCH_FINE(data.counter - 1), &expected);
+
+        CHECK(data.time == expected.time + HOST_WALL_OFFSET &&
+              memcmp(data.sensor_values, expected.sensor_values, RECORD_SENSORS) == 0 &&
+              memcmp(data.sensor_fractions, expected.sensor_fractions, SENSOR_FRACTIONS_SIZE) == 0,
+              "record %u read %s", (uint32_t) data.counter, buffer ? "buffered" : "unbuffered");
+
+        result->records++;
+        result->checksum = result->checksum * 31 + data.counter + data.sensor_values[0];
+
+        // The playback loads the next chunk while the notification is sent
+        store_reader_prefetch(&reader);
+    }
+
+    result->reads = stats->reads - reads;
+    result->read_us = esp_timer_get_time() - start;
+}
+
+static double per_1000(double value, uint32_t records) {
+    return records == 0 ? 0 : value * 1000 / records;
+}
+
+int main(int argc, char **argv) {
+    const char *baseline = NULL;
+    double tolerance = 0.05;
+    int option;
+
+    while ((option = getopt(argc, argv, "b:t:")) != -1) {
+        switch (option) {
+            case 'b':
+                baseline = optarg;
+                break;
+            case 't':
+                tolerance = strtod(optarg, NULL) / 100;
+                break;
+            default:
+                host_bench_usage(argv[0]);
+                return 1;
+        }
+    }
+
+    host_flash_init(BENCH_PARTITIONS);
+
+    CHECK(store_init() == ESP_OK, "init of the erased store");
+
+    record();
+
+    read_result_t unbuffered = {0};
+    read_result_t buffered = {0};
+    static store_read_buffer_t buffer;
+
+    read_all(NULL, &unbuffered);
+    read_all(&buffer, &buffered);
+
+    CHECK(unbuffered.records == BENCH_RECORDS && buffered.records == BENCH_RECORDS, "records read %u and %u",
+          unbuffered.records, buffered.records);
+    CHECK(unbuffered.checksum == buffered.checksum, "same records of both readers");
+
+    const metric_t metrics[] = {
+        {"flash_reads_per_1000_unbuffered", per_1000(unbuffered.reads, unbuffered.records)},
+        {"flash_read_ms_per_1000_unbuffered", per_1000(unbuffered.read_us / 1000.0, unbuffered.records)},
+        {"flash_reads_per_1000_buffered", per_1000(buffered.reads, buffered.records)},
+        {"flash_read_ms_per_1000_buffered", per_1000(buffered.read_us / 1000.0, buffered.records)},
+        {"next_ms_per_1000_buffered", per_1000(buffered.next_us / 1000.0, buffered.records)},
+    };
+    int metric_count = sizeof(metrics) / sizeof(metrics[0]);
+
+    printf("{\n  \"records\": %u,\n  \"metrics\": {\n", buffered.records);
+    print_metrics(metrics, metric_count, "    ");
+    printf("  },\n  \"failures\": %d\n}\n", host_failures());
+
+    if (host_failures() > 0)
+        return 2;
+
+    if (!baseline)
+        return 0;
+
+    int regressions = compare_baseline(baseline, metrics, metric_count, tolerance);
+
+    if (regressions < 0)
+        return 1;
+
+    return regressions > 0 ? 2 : 0;
+}
@@ -0,0 +1,195 @@
+/**
+ * Checks the i2c capture and the I2C_REPLAY backend of main/i2c_bus.c with the sensor service of main/sensors.c on the
+ * simulated clock and sensor bus of tools/host. Built twice from this file:\n
+ * replay_capture runs the boot and REPLAY_SAMPLES samples on the simulated bus with a missing sensor, captures every
+ * transaction into the trace ring and writes the trace pages to the given file. The build decodes them with
+ * trace_decode -g into the i2c_replay_data.h of replay_test.\n
+ * replay_test runs the same boot and samples answered by the capture and checks the stored values, including the
+ * missing sensor, then one more sample behind the end of the capture, which has to fail. Prints the failed checks,
+ * the exit code is 2 if any
+ */
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include "esp_err.h"
+#include "host/ble_hs.h"
+#include "host.h"
+#include "notify.h"
+#include "record.h"
+#include "sensors.h"
+#include "store.h"
+#include "i2c_bus.h"
+#include "trace.h"
+
+// Data partitions of partitions.csv
+#define REPLAY_PARTITIONS "nvs_ext=0xf0000,rec_ext=0x180000"
+
+#define REPLAY_SAMPLES 3
+// Sensor not answering on the bus
+#define REPLAY_MISSING 5
+
+// DATA_VALUE_INTERVAL of sensors.c in us
+#define REPLAY_INTERVAL 60000000LL
+// Time of the first sample, the service task initialized the sensors and loaded the store before
+#define REPLAY_START 1000000LL
+
+// Transactions of a sample, a trigger and a read of each sensor and the ready check of the last one
+#define REPLAY_SAMPLE_TRANSACTIONS (2 * MAX_SENSORS + 1)
+
+// Diagnostics page of the trace ring
+#define REPLAY_TRACE_PAGE 2
+
+// The notifications and the advertising are not part of the replay
+bool notify_send(const uint8_t *frame, uint8_t length, NOTIFY_POLICY policy) {
+    return true;
+}
+
+bool notify_wait_space() {
+    return true;
+}
+
+void ble_host_update_advertising() {
+}
+
+/**
+ * Starts the service task and records the given count of samples
+ */
+static void record(int samples) {
+    sensors_start_service_task();
+
+    host_run(REPLAY_START);
+
+    CHECK(sensors_ready(), "service task ready");
+
+    sensors_start_measurement();
+    host_run((samples - 1) * REPLAY_INTERVAL + REPLAY_START);
+    sensors_stop_measurement();
+    host_run(REPLAY_START);
+}
+
+#if !I2C_REPLAY
+
+/**
+ * Writes the trace ring as the concatenated reads of the trace diagnostics page
+ * @return The count of entries written since the startup
+ */
+static uint32_t write_pages(FILE *file) {
+    uint8_t page = REPLAY_TRACE_PAGE;
+    trace_page_header_t header;
+    uint32_t cursor = 0;
+
+    do {
+        struct os_mbuf om = {0};
+
+        trace_set_cursor(cursor);
+        trace_read(&om);
+
+        memcpy(&header, om.buffer, sizeof(header));
+
+        fwrite(&page, 1, 1, file);
+        fwrite(om.buffer, 1, om.om_len, file);
+
+        cursor = header.first + header.count;
+    } while (header.count > 0);
+
+    return header.written;
+}
+
+int main(int argc, char **argv) {
+    if (argc != 2) {
+        fprintf(stderr, "Usage: %s <trace dump>\n", argv[0]);
+        return 1;
+    }
+
+    FILE *file = fopen(argv[1], "wb");
+    if (!file) {
+        perror(argv[1]);
+        return 1;
+    }
+
+    host_flash_init(REPLAY_PARTITIONS);
+    host_i2c_missing(1UL << REPLAY_MISSING);
+
+    // The boot is captured as well, so the replay starts with the same transactions
+    i2c_bus_capture(true);
+
+    record(REPLAY_SAMPLES);
+
+    uint32_t written = write_pages(file);
+
+    fclose(file);
+
+    // The init writes two registers of each sensor, it stops at the first one of the missing sensor
+    CHECK(written == 2 * MAX_SENSORS - 1 + REPLAY_SAMPLES * REPLAY_SAMPLE_TRANSACTIONS, "%u transactions captured",
+          written);
+    CHECK(written <= TRACE_RING_SIZE, "capture fits the trace ring");
+
+    printf("{\n  \"transactions\": %u,\n  \"failures\": %d\n}\n", written, host_failures());
+
+    return host_failures() > 0 ? 2 : 0;
+}
+
+#else
+
+/**
+ * Checks the values of the stored record against the simulated sensors
+ * @param sampled - If the values were read, otherwise all of them are 0
+ */
+static void check_record(uint32_t counter, bool sampled) {
+    store_reader_t reader = {0};
+    sensor_data_t data;
+
+    if (store_reader_seek(&reader, counter) != ESP_OK || store_reader_next(&reader, &data) != ESP_OK) {
+        CHECK(0, "record %u stored", counter);
+        return;
+    }
+
+    int mismatches = 0;
+
+    for (int i = 0; i < MAX_SENSORS; i++) {
+        int64_t time = (counter - 1) * REPLAY_INTERVAL + REPLAY_START;
+        uint8_t expected = host_i2c_temperature(i, time) >> 7;
+
+        if (!sampled || i == REPLAY_MISSING)
+            expected = 0;
+
+        mismatches += data.sensor_values[i] != expected;
+    }
+
+    CHECK(mismatches == 0, "record %u has %d values differing from the %s", counter, mismatches,
+          sampled ? "sensors" : "failed reads");
+}
+
+int main() {
+    host_flash_init(REPLAY_PARTITIONS);
+
+    record(REPLAY_SAMPLES);
+
+    uint32_t mismatches = i2c_bus_replay_mismatches();
+
+    CHECK(mismatches == 0, "%u transactions did not match the capture", mismatches);
+    CHECK(store_count() == REPLAY_SAMPLES, "%u records stored", store_count());
+
+    for (uint32_t counter = 1; counter <= REPLAY_SAMPLES; counter++)
+        check_record(counter, true);
+
+    // The capture repeats with the boot, which does not match the transactions of a sample
+    sensors_start_measurement();
+    host_run(REPLAY_START);
+    sensors_stop_measurement();
+    host_run(REPLAY_START);
+
+    uint32_t failed = i2c_bus_replay_mismatches() - mismatches;
+
+    CHECK(failed == REPLAY_SAMPLE_TRANSACTIONS, "%u transactions behind the capture failed", failed);
+
+    check_record(REPLAY_SAMPLES + 1, false);
+
+    printf("{\n  \"samples\": %u,\n  \"failed_behind_capture\": %u,\n  \"failures\": %d\n}\n", store_count(), failed,
+           host_failures());
+
+    return host_failures() > 0 ? 2 : 0;
+}
+
+#endif
@@ -0,0 +1,245 @@
+/**
+ * Benchmarks the recovery of main/store.c after power losses on the simulated flash of tools/host.\n
+ * Each case records on the partition layout of partitions.csv, cuts the power and boots again: a record written but
+ * not committed to nvs, a record torn in the middle, a torn block header, and a full store written in deep sleep
+ * without any commit or with the commit of the last record. Checks the recovered data counter and every record read
+ * back, prints the recovery time and flash reads of store_init as JSON and compares them with a baseline file of
+ * "metric max" lines. The exit code is 2 on a failed check or a regression
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <unistd.h>
+#include <esp_timer.h>
+#include "host.h"
+#include "record.h"
+#include "store.h"
+#include "baseline.h"
+
+// Data partitions of partitions.csv
+#define BENCH_PARTITIONS "nvs_ext=0xf0000,rec_ext=0x180000"
+
+// Bytes of the partitions
+#define BENCH_STORE_SIZE (0xf0000 + 0x180000)
+
+// Records written at once by a deep sleep wakeup, DEEP_SLEEP_STAGED_RECORDS of main/sensors.c
+#define BENCH_STAGED_RECORDS 8
+
+// Relative records fitting the store
+#define BENCH_CAPACITY (BENCH_STORE_SIZE / RECORD_BLOCK_SIZE * RECORD_BLOCK_CAPACITY(sizeof(record_relative_t)))
+
+typedef enum {
+    CASE_COMMIT_LOST,           // Power lost after the record write, before the nvs commit
+    CASE_TORN_RECORD,           // Power lost in the middle of a record write
+    CASE_TORN_HEADER,           // Power lost in the middle of the header of a new block
+    CASE_FULL_UNCOMMITTED,      // Store filled in deep sleep, the position in nvs is still at the start
+    CASE_FULL_COMMITTED,        // Store filled in deep sleep, the last record was committed
+    CASE_COUNT
+} BENCH_CASE;
+
+static const char *case_names[CASE_COUNT] = {"commit_lost", "torn_record", "torn_header", "full_uncommitted",
+                                             "full_committed"};
+
+/**
+ * Case description and results, shared with the boots
+ */
+typedef struct {
+    BENCH_CASE id;
+    uint32_t committed;         // Records appended with nvs commit first
+    uint32_t uncommitted;       // Records written without commit next
+    bool commit_last;           // The last record is appended with commit
+    uint32_t cut;               // Bytes programmed of the following record before the power loss, UINT32_MAX if none
+    uint32_t expected_counter;  // Data counter after the recovery
+    uint32_t expected_torn;     // Records skipped by the readers
+    uint32_t written;           // Records written before the cut
+    uint32_t recovered_counter;
+    uint32_t read_back;
+    int64_t recovery_us;
+    uint32_t recovery_reads;
+} bench_case_t;
+
+/**
+ * First boot on an erased store, records until the power is cut
+ */
+static void boot_record(void *arg) {
+    bench_case_t *bench = arg;
+    sensor_data_t data;
+
+    CHECK(store_init() == ESP_OK, "%s: init of the erased store", case_names[bench->id]);
+
+    for (uint32_t i = 0; i < bench->committed; i++) {
+        host_sample(bench->written++, false, &data);
+        store_append(&data);
+    }
+
+    // Deep sleep wakeups write their staged records without commit
+    for (uint32_t i = 0; i < bench->uncommitted; i += BENCH_STAGED_RECORDS) {
+        sensor_data_t staged[BENCH_STAGED_RECORDS];
+        uint8_t count = bench->uncommitted - i < BENCH_STAGED_RECORDS ? bench->uncommitted - i : BENCH_STAGED_RECORDS;
+
+        for (int j = 0; j < count; j++)
+            host_sample(bench->written + j, false, &staged[j]);
+
+        esp_err_t res = store_write(staged, count);
+
+        CHECK(res == ESP_OK, "%s: deep sleep write returned %s", case_names[bench->id], esp_err_to_name(res));
+
+        bench->written += count;
+    }
+
+    if (bench->commit_last) {
+        host_sample(bench->written++, false, &data);
+        store_append(&data);
+    }
+
+    if (bench->cut == UINT32_MAX)
+        return;
+
+    host_flash_cut(bench->cut);
+
+    host_sample(bench->written, false, &data);
+    store_append(&data);
+
+    CHECK(0, "%s: the power was not cut", case_names[bench->id]);
+}
+
+/**
+ * Boot after the power loss, recovers the store and reads every record back
+ */
+static void boot_recover(void *arg) {
+    bench_case_t *bench = arg;
+    const char *name = case_names[bench->id];
+
+    uint32_t reads = host_flash_stats()->reads;
+    int64_t start = esp_timer_get_time();
+
+    CHECK(store_init() == ESP_OK, "%s: init after the power loss", name);
+
+    bench->recovery_us = esp_timer_get_time() - start;
+    bench->recovery_reads = host_flash_stats()->reads - reads;
+    bench->recovered_counter = store_count();
+
+    CHECK(bench->recovered_counter == bench->expected_counter, "%s: data counter %u, expected %u", name,
+          bench->recovered_counter, bench->expected_counter);
+
+    store_read_buffer_t buffer;
+    store_reader_t reader = {.buffer = &buffer};
+    sensor_data_t data;
+    sensor_data_t expected;
+    uint32_t mismatches = 0;
+
+    if (store_reader_seek(&reader, 1) == ESP_OK) {
+        while (store_reader_next(&reader, &data) == ESP_OK) {
+            host_sample(data.counter - 1, false, &expected);
+
+            if (data.time != expected.time + HOST_WALL_OFFSET ||
+                memcmp(data.sensor_values, expected.sensor_values, RECORD_SENSORS) != 0)
+                mismatches++;
+
+            bench->read_back++;
+        }
+    }
+
+    CHECK(mismatches == 0, "%s: %u records differ from the written samples", name, mismatches);
+    CHECK(bench->read_back + bench->expected_torn == bench->expected_counter, "%s: %u records read back", name,
+          bench->read_back);
+
+    // Recording continues behind the recovered records, a full store stays full
+    host_sample(bench->expected_counter, false, &data);
+
+    esp_err_t res = store_append(&data);
+    bool full = bench->expected_counter == BENCH_CAPACITY;
+
+    CHECK(full ? res == ESP_ERR_NO_MEM : res == ESP_OK && store_count() == bench->expected_counter + 1,
+          "%s: append after the recovery returned %s", name, esp_err_to_name(res));
+}
+
+static void run_case(bench_case_t *bench) {
+    host_flash_init(BENCH_PARTITIONS);
+
+    int res = host_boot(boot_record, bench);
+    bool cut = bench->cut != UINT32_MAX;
+
+    CHECK(res == (cut ? HOST_POWER_LOSS : 0), "%s: recording boot exited with %d", case_names[bench->id], res);
+
+    if (bench->expected_counter == 0)
+        bench->expected_counter = bench->written + (cut ? 1 : 0);
+
+    res = host_boot(boot_recover, bench);
+
+    CHECK(res == 0, "%s: recovery boot exited with %d", case_names[bench->id], res);
+}
+
+int main(int argc, char **argv) {
+    const char *baseline = NULL;
+    double tolerance = 0.05;
+    int option;
+
+    while ((option = getopt(argc, argv, "b:t:")) != -1) {
+        switch (option) {
+            case 'b':
+                baseline = optarg;
+                break;
+            case 't':
+                tolerance = strtod(optarg, NULL) / 100;
+                break;
+            default:
+                host_bench_usage(argv[0]);
+                return 1;
+        }
+    }
+
+    const uint32_t block_records = RECORD_BLOCK_CAPACITY(sizeof(record_relative_t));
+
+    bench_case_t *cases = host_shared(CASE_COUNT * sizeof(bench_case_t));
+
+    // The power is lost when the record is programmed, before store_append commits
+    cases[CASE_COMMIT_LOST] = (bench_case_t) {CASE_COMMIT_LOST, 1000, 30, false, sizeof(record_relative_t)};
+    cases[CASE_TORN_RECORD] = (bench_case_t) {CASE_TORN_RECORD, 1000, 30, false, sizeof(record_relative_t) / 2};
+    cases[CASE_TORN_RECORD].expected_torn = 1;
+    // The blocks are full, the next record opens a block
+    cases[CASE_TORN_HEADER] = (bench_case_t) {CASE_TORN_HEADER, 2 * block_records, 0, false,
+                                              sizeof(record_block_header_t) / 2};
+    cases[CASE_TORN_HEADER].expected_counter = 2 * block_records;
+    cases[CASE_FULL_UNCOMMITTED] = (bench_case_t) {CASE_FULL_UNCOMMITTED, 0, BENCH_CAPACITY, false, UINT32_MAX};
+    cases[CASE_FULL_COMMITTED] = (bench_case_t) {CASE_FULL_COMMITTED, 0, BENCH_CAPACITY - 1, true, UINT32_MAX};
+
+    metric_t metrics[2 * CASE_COUNT];
+    char names[2 * CASE_COUNT][64];
+
+    for (int i = 0; i < CASE_COUNT; i++) {
+        run_case(&cases[i]);
+
+        snprintf(names[2 * i], sizeof(names[0]), "recovery_ms_%s", case_names[i]);
+        snprintf(names[2 * i + 1], sizeof(names[0]), "recovery_reads_%s", case_names[i]);
+
+        metrics[2 * i] = (metric_t) {names[2 * i], cases[i].recovery_us / 1000.0};
+        metrics[2 * i + 1] = (metric_t) {names[2 * i + 1], cases[i].recovery_reads};
+    }
+
+    printf("{\n  \"cases\": {\n");
+    for (int i = 0; i < CASE_COUNT; i++) {
+        printf("    \"%s\": {\"written\": %u, \"recovered_counter\": %u, \"read_back\": %u, \"torn\": %u}%s\n",
+               case_names[i], cases[i].written, cases[i].recovered_counter, cases[i].read_back,
+               cases[i].expected_torn, i < CASE_COUNT - 1 ? "," : "");
+    }
+
+    printf("  },\n  \"metrics\": {\n");
+    print_metrics(metrics, 2 * CASE_COUNT, "    ");
+    printf("  },\n  \"failures\": %d\n}\n", host_failures());
+
+    if (host_failures() > 0)
+        return 2;
+
+    if (!baseline)
+        return 0;
+
+    int regressions = compare_baseline(baseline, metrics, 2 * CASE_COUNT, tolerance);
+
+    if (regressions < 0)
+        return 1;
+
+    return regressions > 0 ? 2 : 0;
+}
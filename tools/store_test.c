@@ -0,0 +1,194 @@
+/**
+ * Checks the extents of main/store.c on partition maps of the simulated flash of tools/host, built with the labels
+ * "nvs_ext", "rec_ext", "rec_ext2".\n
+ * Fills stores of partitions with unaligned sizes, a missing middle and a missing first partition, and the migration
+ * of partitions.csv: flat records of old firmware in nvs_ext, then rec_ext added over the range of the shrunk app.
+ * Every record is read back. Prints the failed checks, the exit code is 2 if any
+ */
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include "esp_partition.h"
+#include "nvs.h"
+#include "host.h"
+#include "record.h"
+#include "store.h"
+
+#define BLOCK_RECORDS RECORD_BLOCK_CAPACITY(sizeof(record_relative_t))
+
+/**
+ * Store filled on a partition map, shared with the boots
+ */
+typedef struct {
+    const char *name;
+    esp_err_t init_result;
+    uint32_t legacy;            // Flat records of old firmware in front
+    uint32_t capacity;          // Data counter of the full store
+    uint32_t full_counter;
+    uint32_t read_back;
+} test_case_t;
+
+/**
+ * Appends records until the store is full and reads all of them back
+ */
+static void boot_fill(void *arg) {
+    test_case_t *test = arg;
+    sensor_data_t data;
+
+    esp_err_t res = store_init();
+
+    CHECK(res == test->init_result, "%s: init returned %s", test->name, esp_err_to_name(res));
+
+    if (res != ESP_OK) {
+        host_sample(0, false, &data);
+        res = store_append(&data);
+
+        CHECK(res == ESP_ERR_NOT_FOUND, "%s: append without store returned %s", test->name, esp_err_to_name(res));
+        return;
+    }
+
+    do {
+        host_sample(store_count(), false, &data);
+        res = store_append(&data);
+    } while (res == ESP_OK);
+
+    test->full_counter = store_count();
+
+    CHECK(res == ESP_ERR_NO_MEM, "%s: append stopped with %s", test->name, esp_err_to_name(res));
+    CHECK(test->full_counter == test->capacity, "%s: full at data counter %u, expected %u", test->name,
+          test->full_counter, test->capacity);
+
+    store_read_buffer_t buffer;
+    store_reader_t reader = {.buffer = &buffer};
+    sensor_data_t expected;
+
+    test->read_back = 0;
+
+    CHECK(store_reader_seek(&reader, 1) == ESP_OK, "%s: seek of the first record", test->name);
+
+    while (store_reader_next(&reader, &data) == ESP_OK) {
+        host_sample(data.counter - 1, false, &expected);
+
+        // Flat records hold the wall clock time
+        uint32_t time = data.counter <= test->legacy ? expected.time : expected.time + HOST_WALL_OFFSET;
+
+        CHECK(data.counter == test->read_back + 1, "%s: record %u follows %u", test->name, data.counter,
+              test->read_back);
+        CHECK(data.time == time && memcmp(data.sensor_values, expected.sensor_values, RECORD_SENSORS) == 0,
+              "%s: record %u differs", test->name, data.counter);
+
+        test->read_back++;
+    }
+
+    CHECK(test->read_back == test->full_counter, "%s: %u records read back", test->name, test->read_back);
+}
+
+static void run_fill(test_case_t *test) {
+    int res = host_boot(boot_fill, test);
+
+    CHECK(res == 0, "%s: boot exited with %d", test->name, res);
+}
+
+/**
+ * @return If the range of the partition is erased
+ */
+static bool partition_erased(const char *label, uint32_t offset, uint32_t length) {
+    const esp_partition_t *partition = esp_partition_find_first(ESP_PARTITION_TYPE_DATA, ESP_PARTITION_SUBTYPE_ANY,
+                                                                label);
+    uint8_t data[RECORD_BLOCK_SIZE];
+
+    return partition && length <= sizeof(data) && esp_partition_read(partition, offset, data, length) == ESP_OK &&
+           record_is_erased(data, length);
+}
+
+static void check_unaligned() {
+    // 2, 1 and 3 whole blocks, the tails behind them stay unused
+    host_flash_init("nvs_ext=0x2800,rec_ext=0x1800,rec_ext2=0x3000");
+
+    test_case_t test = {"unaligned", ESP_OK, 0, 6 * BLOCK_RECORDS};
+
+    run_fill(&test);
+
+    CHECK(partition_erased("nvs_ext", 0x2000, 0x800) && partition_erased("rec_ext", 0x1000, 0x800),
+          "unaligned: tails behind the whole blocks are untouched");
+}
+
+static void check_missing() {
+    // The address space ends at the missing rec_ext, rec_ext2 is not used
+    host_flash_init("nvs_ext=0x2000,rec_ext2=0x2000");
+
+    test_case_t middle = {"missing_middle", ESP_OK, 0, 2 * BLOCK_RECORDS};
+
+    run_fill(&middle);
+
+    CHECK(partition_erased("rec_ext2", 0, RECORD_BLOCK_SIZE), "missing_middle: rec_ext2 is untouched");
+
+    host_flash_init("rec_ext=0x2000,rec_ext2=0x2000");
+
+    test_case_t first = {"missing_first", ESP_ERR_NOT_FOUND};
+
+    run_fill(&first);
+}
+
+/**
+ * Writes flat 35 byte records of firmware before the block store and their position to nvs
+ */
+static void write_legacy(uint32_t count) {
+    const esp_partition_t *partition = esp_partition_find_first(ESP_PARTITION_TYPE_DATA, ESP_PARTITION_SUBTYPE_ANY,
+                                                                "nvs_ext");
+    sensor_data_t data;
+
+    for (uint32_t i = 0; i < count; i++) {
+        host_sample(i, false, &data);
+        esp_partition_write(partition, i * RECORD_LEGACY_SIZE, &data.time, RECORD_LEGACY_SIZE);
+    }
+
+    nvs_handle_t handle;
+
+    nvs_open("sensor_data", NVS_READWRITE, &handle);
+    nvs_set_u32(handle, "data_count", count);
+    nvs_set_u32(handle, "address_offset", count * RECORD_LEGACY_SIZE);
+    nvs_commit(handle);
+    nvs_close(handle);
+}
+
+static void check_migration() {
+    const uint32_t legacy = 50;
+
+    // The old partition table, app0 in front of nvs_ext
+    host_flash_init("app0=0x2000,nvs_ext=0x3000");
+
+    const esp_partition_t *app = esp_partition_find_first(ESP_PARTITION_TYPE_DATA, ESP_PARTITION_SUBTYPE_ANY, "app0");
+    uint8_t code[RECORD_BLOCK_SIZE];
+
+    for (int i = 0; i < sizeof(code); i++)
+        code[i] = i * 13;
+
+    esp_partition_write(app, 0, code, sizeof(code));
+    esp_partition_write(app, RECORD_BLOCK_SIZE, code, sizeof(code));
+
+    write_legacy(legacy);
+
+    // The blocks continue behind the flat records in the first whole block
+    test_case_t before = {"before_migration", ESP_OK, legacy, legacy + 2 * BLOCK_RECORDS};
+
+    run_fill(&before);
+
+    // rec_ext takes the end of the shrunk app0 with the old code in it, nvs_ext keeps its address and records
+    host_flash_repartition("rec_ext=0x2000,nvs_ext=0x3000");
+
+    test_case_t after = {"after_migration", ESP_OK, legacy, before.capacity + 2 * BLOCK_RECORDS};
+
+    run_fill(&after);
+}
+
+int main() {
+    check_unaligned();
+    check_missing();
+    check_migration();
+
+    printf("{\n  \"failures\": %d\n}\n", host_failures());
+
+    return host_failures() > 0 ? 2 : 0;
+}
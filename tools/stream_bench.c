@@ -0,0 +1,274 @@
+/**
+ * Benchmarks the streaming mode of main/sensors.c (L command of main/ble_host.c) with the app connected, on the
+ * simulated clock, flash, sensor bus and ble peer of tools/host.\n
+ * Each case boots the firmware on an erased store, the simulated app connects, subscribes and starts a stream of a
+ * minute. The app takes the time every sample arrives with a connection event, the latency of a sample runs from its
+ * sensor read (stream start + time offset of the sample) to the delivery to the app. Streams that store their samples
+ * are read back from the store after a reboot. Prints the counters and the metrics per case as JSON and compares them
+ * with a baseline file of "metric max" lines, the metrics are prefixed with the case. The exit code is 2 on a failed
+ * check or a regression
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <unistd.h>
+#include <esp_timer.h>
+#include "host/ble_hs.h"
+#include "host.h"
+#include "ble_host.h"
+#include "diagnostics.h"
+#include "record.h"
+#include "sensors.h"
+#include "store.h"
+#include "baseline.h"
+
+// Data partitions of partitions.csv
+#define BENCH_PARTITIONS "nvs_ext=0xf0000,rec_ext=0x180000"
+
+// Stream duration of every case in s
+#define BENCH_DURATION 60
+
+// Connection interval of the app until the firmware requests a longer one, in ms
+#define BENCH_CONNECT_INTERVAL 30
+
+typedef enum {
+    CASE_ALL,
+    CASE_FEW,
+    CASE_STORE,
+    CASE_COUNT
+} BENCH_CASE;
+
+static const char *case_names[CASE_COUNT] = {"all", "few", "store"};
+
+/**
+ * Stream settings of a case
+ */
+typedef struct {
+    uint32_t sensor_mask;
+    uint16_t interval;              // Sample interval in ms
+    bool store;
+} bench_stream_t;
+
+static const bench_stream_t streams[CASE_COUNT] = {
+    [CASE_ALL] = {SENSORS_ALL_MASK, 250, false},
+    [CASE_FEW] = {0xf, 100, false},
+    [CASE_STORE] = {0xf, 100, true}
+};
+
+/**
+ * Case results, shared with the boots
+ */
+typedef struct {
+    int64_t start_time;                     // Time of the stream command, the stream starts with it
+    uint32_t received;                      // Samples received by the app
+    uint32_t sequence_gaps;                 // Samples missing in front of a received notification
+    uint32_t next_sequence;
+    uint64_t latency_sum_us;
+    int64_t latency_max_us;
+    uint32_t stored_records;                // Records stored by the stream, read back after a reboot
+    uint32_t recovery_commits;              // Commits of the recovery scan after the reboot, none if all were committed
+    uint32_t mask_mismatches;               // Stored values not matching the sensor selection
+    uint32_t counters[DIAG_COUNTER_COUNT];  // Counters of the stream
+} bench_case_t;
+
+static bench_case_t *bench = NULL;
+
+/**
+ * Receiver of the simulated app, takes the delivery latency of every streamed sample
+ */
+static void receive(uint16_t conn_handle, const uint8_t *data, uint16_t length) {
+    stream_header_t header;
+
+    if (length < sizeof(header))
+        return;
+
+    memcpy(&header, data, sizeof(header));
+
+    if (header.data_flag != 13)
+        return;
+
+    uint8_t sample_size = sizeof(uint32_t) + __builtin_popcount(header.sensor_mask);
+    int64_t now = esp_timer_get_time();
+
+    if (header.sequence != bench->next_sequence)
+        bench->sequence_gaps += header.sequence - bench->next_sequence;
+
+    for (int i = 0; i < header.sample_count && sizeof(header) + (i + 1) * sample_size <= length; i++) {
+        uint32_t offset;
+
+        memcpy(&offset, data + sizeof(header) + i * sample_size, sizeof(offset));
+
+        int64_t latency = now - (bench->start_time + offset * 1000LL);
+
+        bench->latency_sum_us += latency;
+        if (latency > bench->latency_max_us)
+            bench->latency_max_us = latency;
+
+        bench->received++;
+    }
+
+    bench->next_sequence = header.sequence + header.sample_count;
+}
+
+static void boot_case(void *arg) {
+    BENCH_CASE id = *(BENCH_CASE *) arg;
+    const bench_stream_t *stream = &streams[id];
+
+    host_ble_receiver(receive);
+
+    host_boot_firmware();
+
+    uint16_t conn = host_ble_connect(BENCH_CONNECT_INTERVAL);
+
+    CHECK(conn != BLE_HS_CONN_HANDLE_NONE, "%s: app connected", case_names[id]);
+
+    host_ble_subscribe(conn, true);
+    host_run(1000000);
+
+    memset(host_counters(), 0, DIAG_COUNTER_COUNT * sizeof(uint32_t));
+
+    char command[64];
+
+    snprintf(command, sizeof(command), "L%u,%u,%u,%u", stream->sensor_mask, stream->interval, BENCH_DURATION,
+             stream->store);
+
+    bench->start_time = esp_timer_get_time();
+
+    CHECK(host_ble_write(conn, command) == 0, "%s: stream started", case_names[id]);
+
+    host_run(BENCH_DURATION * 1000000LL + 1000000);
+
+    // The last notifications are taken by the next connection events
+    host_run(2 * host_ble_interval(conn) * 1000LL);
+
+    memcpy(bench->counters, host_counters(), sizeof(bench->counters));
+
+    host_ble_disconnect(conn);
+}
+
+/**
+ * Reads the records of a storing stream back after a reboot
+ */
+static void boot_read(void *arg) {
+    BENCH_CASE id = *(BENCH_CASE *) arg;
+    uint32_t mask = streams[id].sensor_mask;
+
+    uint32_t commits = host_counters()[DIAG_COUNTER_NVS_COMMITS];
+
+    CHECK(store_init() == ESP_OK, "%s: store init", case_names[id]);
+
+    bench->recovery_commits = host_counters()[DIAG_COUNTER_NVS_COMMITS] - commits;
+
+    store_reader_t reader = {0};
+    sensor_data_t data;
+
+    if (store_reader_seek(&reader, 1) != ESP_OK)
+        return;
+
+    while (store_reader_next(&reader, &data) == ESP_OK) {
+        for (int i = 0; i < MAX_SENSORS; i++) {
+            bool selected = mask & (1UL << i);
+
+            bench->mask_mismatches += selected == (data.sensor_values[i] == RECORD_VALUE_NONE);
+        }
+
+        bench->stored_records++;
+    }
+}
+
+int main(int argc, char **argv) {
+    const char *baseline = NULL;
+    double tolerance = 0.05;
+    int option;
+
+    while ((option = getopt(argc, argv, "b:t:")) != -1) {
+        switch (option) {
+            case 'b':
+                baseline = optarg;
+                break;
+            case 't':
+                tolerance = strtod(optarg, NULL) / 100;
+                break;
+            default:
+                host_bench_usage(argv[0]);
+                return 1;
+        }
+    }
+
+    bench = host_shared(sizeof(bench_case_t));
+
+    metric_t metrics[CASE_COUNT * 6];
+    char names[CASE_COUNT * 6][64];
+    int metric_count = 0;
+
+    printf("{\n");
+
+    for (BENCH_CASE id = 0; id < CASE_COUNT; id++) {
+        memset(bench, 0, sizeof(*bench));
+
+        host_flash_init(BENCH_PARTITIONS);
+
+        int res = host_boot(boot_case, &id);
+
+        CHECK(res == 0, "%s: boot exited with %d", case_names[id], res);
+
+        const uint32_t *counters = bench->counters;
+        uint32_t samples = counters[DIAG_COUNTER_STREAM_SAMPLES];
+
+        CHECK(samples > 0 && bench->received == samples && bench->sequence_gaps == 0,
+              "%s: %u samples received of %u, %u missing", case_names[id], bench->received, samples,
+              bench->sequence_gaps);
+
+        if (streams[id].store) {
+            res = host_boot(boot_read, &id);
+
+            CHECK(res == 0, "%s: read boot exited with %d", case_names[id], res);
+            CHECK(bench->stored_records == samples, "%s: %u records stored of %u samples", case_names[id],
+                  bench->stored_records, samples);
+            CHECK(bench->recovery_commits == 0, "%s: records recovered behind the committed position", case_names[id]);
+            CHECK(bench->mask_mismatches == 0, "%s: %u stored values not matching the sensor mask", case_names[id],
+                  bench->mask_mismatches);
+        }
+
+        const metric_t case_metrics[] = {
+            {"delivery_ms_mean", host_ratio(bench->latency_sum_us / 1000.0, bench->received)},
+            {"delivery_ms_max", bench->latency_max_us / 1000.0},
+            {"handover_ms_per_sample", host_ratio(counters[DIAG_COUNTER_STREAM_LATENCY_MS], samples)},
+            {"notify_bytes_per_sample", host_ratio(counters[DIAG_COUNTER_NOTIFY_BYTES], samples)},
+            {"flash_writes_per_sample", host_ratio(counters[DIAG_COUNTER_FLASH_WRITES], samples)},
+            {"nvs_commits_per_sample", host_ratio(counters[DIAG_COUNTER_NVS_COMMITS], samples)},
+        };
+
+        printf("  \"%s\": {\n    \"sensor_mask\": %u,\n    \"interval_ms\": %u,\n    \"store\": %u,\n",
+               case_names[id], streams[id].sensor_mask, streams[id].interval, streams[id].store);
+        printf("    \"samples\": %u,\n    \"received\": %u,\n    \"stored\": %u,\n", samples, bench->received,
+               bench->stored_records);
+        printf("    \"stream\": {\"notifications\": %u, \"notify_bytes\": %u, \"flash_writes\": %u, "
+               "\"flash_write_bytes\": %u, \"nvs_commits\": %u},\n",
+               counters[DIAG_COUNTER_STREAM_NOTIFICATIONS], counters[DIAG_COUNTER_NOTIFY_BYTES],
+               counters[DIAG_COUNTER_FLASH_WRITES], counters[DIAG_COUNTER_FLASH_WRITE_BYTES],
+               counters[DIAG_COUNTER_NVS_COMMITS]);
+        printf("    \"metrics\": {\n");
+        print_metrics(case_metrics, sizeof(case_metrics) / sizeof(case_metrics[0]), "      ");
+        printf("    }\n  },\n");
+
+        for (size_t i = 0; i < sizeof(case_metrics) / sizeof(case_metrics[0]); i++) {
+            snprintf(names[metric_count], sizeof(names[0]), "%s_%s", case_names[id], case_metrics[i].name);
+
+            metrics[metric_count].name = names[metric_count];
+            metrics[metric_count].value = case_metrics[i].value;
+            metric_count++;
+        }
+    }
+
+    printf("  \"failures\": %d\n}\n", host_failures());
+
+    int regressions = baseline ? compare_baseline(baseline, metrics, metric_count, tolerance) : 0;
+
+    if (regressions < 0)
+        return 1;
+
+    return host_failures() > 0 || regressions > 0 ? 2 : 0;
+}
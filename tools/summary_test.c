@@ -0,0 +1,142 @@
+/**
+ * Checks the scan response summary of main/summary.h and the rate limit of main/summary.c on the simulated clock of
+ * tools/host.\n
+ * Encodes known samples against their expected bytes, then feeds summary_update a sample per second with flag changes
+ * in between and checks when the advertising data is refreshed. Prints the failed checks, the exit code is 2 if any
+ */
+#include <stdio.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+#include <esp_timer.h>
+#include "host.h"
+#include "summary.h"
+
+typedef struct {
+    int64_t time;               // Simulated time of the update in us
+    summary_t summary;
+} advertisement_t;
+
+static advertisement_t advertisements[64];
+static int advertisement_count = 0;
+
+void ble_host_update_advertising() {
+    if (advertisement_count == sizeof(advertisements) / sizeof(advertisements[0]))
+        return;
+
+    advertisements[advertisement_count].time = esp_timer_get_time();
+    summary_get(&advertisements[advertisement_count].summary);
+    advertisement_count++;
+}
+
+static void check_layout() {
+    uint8_t values[] = {50, 52, 0, 100, 61};
+    summary_t summary = {0};
+
+    CHECK(sizeof(summary_t) == 10, "summary size");
+
+    // Sensor 2 failed, sensor 3 is not selected
+    summary_encode(&summary, 0x123456, 0x0a0b0c, values, 0x17, SUMMARY_FLAG_RECORDING);
+
+    const uint8_t expected[] = {0x56, 0x34, 0x12, SUMMARY_FLAG_SAMPLED | SUMMARY_FLAG_ALERT | SUMMARY_FLAG_RECORDING,
+                                0x0c, 0x0b, 0x0a, SUMMARY_VERSION, 61, 54};
+
+    CHECK(memcmp(&summary, expected, sizeof(expected)) == 0, "encoded bytes");
+
+    // Counters only, max, mean and the sample flags are kept
+    summary_encode(&summary, 0x123457, 0x0a0b0d, NULL, 0, SUMMARY_FLAG_STREAMING);
+
+    CHECK(summary.flags == (SUMMARY_FLAG_SAMPLED | SUMMARY_FLAG_ALERT | SUMMARY_FLAG_STREAMING), "kept flags");
+    CHECK(summary.counter == 0x123457 && summary.stored == 0x0a0b0d, "counters without values");
+    CHECK(summary.max == 61 && summary.mean == 54, "kept max and mean");
+
+    // The mean is rounded, a spread below the alert delta raises no alert
+    const uint8_t close[] = {3, 4, 6};
+
+    summary_encode(&summary, 1, 1, close, 0x07, 0);
+
+    CHECK(summary.mean == 4 && summary.max == 6, "rounded mean");
+    CHECK(summary.flags == SUMMARY_FLAG_SAMPLED, "flags without alert");
+
+    // Only failed sensors, nothing was sampled
+    const uint8_t failed[] = {0, 0};
+
+    summary_encode(&summary, 2, 2, failed, 0x03, SUMMARY_FLAG_RECORDING);
+
+    CHECK(summary.flags == SUMMARY_FLAG_RECORDING && summary.max == 0 && summary.mean == 0, "failed sample");
+}
+
+static void check_update_due() {
+    summary_t advertised = {.flags = SUMMARY_FLAG_SAMPLED};
+    summary_t current = advertised;
+
+    CHECK(!summary_update_due(SUMMARY_MIN_INTERVAL - 1, &advertised, &current), "due before the interval");
+    CHECK(summary_update_due(SUMMARY_MIN_INTERVAL, &advertised, &current), "due after the interval");
+
+    current.flags |= SUMMARY_FLAG_ALERT;
+
+    CHECK(summary_update_due(0, &advertised, &current), "due on changed flags");
+}
+
+static void check_rate_limit() {
+    const uint8_t normal[] = {50, 51, 52};
+    const uint8_t hot[] = {50, 51, 70};
+    uint32_t counter = 0;
+
+    // The first sample is taken after the boot
+    host_advance(1000000);
+
+    const int64_t start = esp_timer_get_time();
+
+    // A sample per second for 25 s, the first one is advertised immediately, then one every SUMMARY_MIN_INTERVAL
+    for (int second = 0; second < 25; second++) {
+        counter++;
+        summary_update(counter, counter, normal, 0x07, SUMMARY_FLAG_RECORDING);
+        host_advance(1000000);
+    }
+
+    CHECK(advertisement_count == 3, "advertisements of steady samples");
+
+    for (int i = 0; i < advertisement_count; i++) {
+        CHECK(advertisements[i].time - start == i * SUMMARY_MIN_INTERVAL * 1000LL, "time of advertisement %d", i);
+
+        // The timer advertises the sample taken last, the second before
+        CHECK(advertisements[i].summary.counter == (i == 0 ? 1 : i * SUMMARY_MIN_INTERVAL / 1000), "counter");
+    }
+
+    // A hot spot changes the flags, advertised without waiting for the rest of the interval
+    host_advance(500000);
+    counter++;
+    summary_update(counter, counter, hot, 0x07, SUMMARY_FLAG_RECORDING);
+
+    CHECK(advertisement_count == 4, "advertisement of changed flags");
+    CHECK(advertisements[3].time - start == 25500000 && (advertisements[3].summary.flags & SUMMARY_FLAG_ALERT),
+          "immediate alert");
+
+    // The last sample before a pause is still advertised once the interval passed
+    host_advance(500000);
+    counter++;
+    summary_update(counter, counter, hot, 0x07, SUMMARY_FLAG_RECORDING);
+    host_advance(30000000);
+
+    CHECK(advertisement_count == 5, "advertisement after the pause");
+    CHECK(advertisements[4].time - start == 35500000 && advertisements[4].summary.counter == counter,
+          "latest sample after the pause");
+
+    for (int i = 1; i < advertisement_count; i++) {
+        bool flags_changed = advertisements[i].summary.flags != advertisements[i - 1].summary.flags;
+
+        CHECK(flags_changed || advertisements[i].time - advertisements[i - 1].time >= SUMMARY_MIN_INTERVAL * 1000LL,
+              "rate limit between advertisement %d and %d", i - 1, i);
+    }
+}
+
+int main() {
+    check_layout();
+    check_update_due();
+    check_rate_limit();
+
+    printf("{\n  \"advertisements\": %d,\n  \"failures\": %d\n}\n", advertisement_count, host_failures());
+
+    return host_failures() > 0 ? 2 : 0;
+}
@@ -0,0 +1,181 @@
+/**
+ * Checks the wall clock mapping of main/timebase.c on the simulated clock and nvs of tools/host.\n
+ * The simulated app syncs in sessions with clock steps in between, more sessions than the ring of older firmware kept,
+ * syncs twice within the drift interval and powers the sole off for hours. Every sampled record has to map to the
+ * wall clock of the app at its sampling, also after the following boots. The sync ring of older firmware is taken
+ * over in order. Prints the failed checks, the exit code is 2 if any
+ */
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <esp_timer.h>
+#include "nvs.h"
+#include "host.h"
+#include "notify.h"
+#include "timebase.h"
+
+#define TEST_RECORDS 64
+#define TEST_SESSIONS 12
+
+// Time between the sessions of the app and the clock step of the app with each of them in s, the step is above the
+// drift limit so it is not taken for drift
+#define TEST_SESSION_INTERVAL 900
+#define TEST_SESSION_STEP 120
+
+// Power off time between two boots in s
+#define TEST_POWER_OFF 3 * 3600
+
+/**
+ * A sampled record, the monotonic time and the wall clock of the app at the sampling
+ */
+typedef struct {
+    uint32_t mono;
+    uint32_t wall;
+} test_record_t;
+
+/**
+ * State shared with the boots
+ */
+typedef struct {
+    int32_t app_offset;         // Deviation of the clock of the app from the simulated clock
+    uint32_t last_time;         // Monotonic time of the last record, passed to timebase_init like the store does
+    uint32_t count;
+    test_record_t records[TEST_RECORDS];
+} test_state_t;
+
+static test_state_t *state = NULL;
+
+/**
+ * Stand-in of main/notify.c, the sync state notification of timebase_notify is not checked
+ */
+bool notify_send(const uint8_t *frame, uint8_t length, NOTIFY_POLICY policy) {
+    return true;
+}
+
+static uint32_t app_wall() {
+    return HOST_WALL_OFFSET + esp_timer_get_time() / 1000000 + state->app_offset;
+}
+
+static void sample() {
+    test_record_t *record = &state->records[state->count++];
+
+    record->mono = timebase_now();
+    record->wall = app_wall();
+
+    state->last_time = record->mono;
+}
+
+static void check_records(const char *step) {
+    for (uint32_t i = 0; i < state->count; i++) {
+        int64_t error = (int64_t) timebase_to_wall(state->records[i].mono) - state->records[i].wall;
+
+        CHECK(error >= -TIMEBASE_SYNC_TOLERANCE && error <= TIMEBASE_SYNC_TOLERANCE,
+              "%s: record %u at monotonic time %u mapped %lld s off", step, i, state->records[i].mono, error);
+    }
+}
+
+/**
+ * Sessions of the app, each syncing with a stepped clock and followed by a record
+ */
+static void boot_sessions(void *arg) {
+    timebase_init(state->last_time);
+
+    host_advance(60000000);
+    timebase_sync(app_wall());
+    sample();
+
+    for (int i = 0; i < TEST_SESSIONS; i++) {
+        host_advance(TEST_SESSION_INTERVAL * 1000000LL);
+        sample();
+
+        host_advance(10000000);
+        state->app_offset += TEST_SESSION_STEP;
+        timebase_sync(app_wall());
+        sample();
+    }
+
+    // A second sync within the drift interval must not move the entry of the records in between
+    host_advance(100000000);
+    state->app_offset += TEST_SESSION_STEP;
+    timebase_sync(app_wall());
+    sample();
+
+    check_records("sessions");
+}
+
+/**
+ * Boot after the power off, records before the first sync are mapped once it arrives
+ */
+static void boot_power_loss(void *arg) {
+    timebase_init(state->last_time);
+
+    sample();
+    host_advance(600000000);
+    sample();
+
+    host_advance(600000000);
+    timebase_sync(app_wall());
+    sample();
+
+    check_records("power loss");
+}
+
+/**
+ * Boot without sync, only maps the records of the earlier boots
+ */
+static void boot_check(void *arg) {
+    timebase_init(state->last_time);
+
+    check_records(arg);
+}
+
+/**
+ * Boot of older firmware that kept the last 8 syncs in a ring
+ */
+static void boot_legacy(void *arg) {
+    timebase_sync_t ring[8];
+    nvs_handle_t handle;
+
+    // 10 syncs an hour apart with a step of 60 s each, entry n at ring position n % 8
+    for (uint32_t i = 0; i < 10; i++)
+        ring[i % 8] = (timebase_sync_t) {1000 + i * 3600, 1700000000 + i * 3660, 0};
+
+    nvs_open("time_sync", NVS_READWRITE, &handle);
+    nvs_set_u32(handle, "count", 10);
+    nvs_set_blob(handle, "entries", ring, sizeof(ring));
+    nvs_commit(handle);
+    nvs_close(handle);
+
+    state->app_offset = 0;
+
+    for (uint32_t i = 2; i < 10; i++) {
+        state->records[state->count++] = (test_record_t) {1000 + i * 3600 + 10, 1700000000 + i * 3660 + 10};
+        state->last_time = 1000 + i * 3600 + 10;
+    }
+}
+
+int main() {
+    state = host_shared(sizeof(test_state_t));
+
+    host_flash_init("nvs_ext=0x1000");
+
+    CHECK(host_boot(boot_sessions, NULL) == 0, "sessions boot");
+
+    host_advance(TEST_POWER_OFF * 1000000LL);
+
+    CHECK(host_boot(boot_power_loss, NULL) == 0, "power loss boot");
+
+    host_advance(TEST_POWER_OFF * 1000000LL);
+
+    CHECK(host_boot(boot_check, "later boot") == 0, "later boot");
+
+    memset(state, 0, sizeof(*state));
+    host_flash_init("nvs_ext=0x1000");
+
+    CHECK(host_boot(boot_legacy, NULL) == 0, "legacy boot");
+    CHECK(host_boot(boot_check, "legacy ring") == 0, "legacy ring boot");
+
+    printf("{\n  \"failures\": %d\n}\n", host_failures());
+
+    return host_failures() > 0 ? 2 : 0;
+}
@@ -0,0 +1,148 @@
+/**
+ * Decodes the binary trace ring of the sole.\n
+ * Input are the concatenated reads of the trace diagnostics page (page byte, trace_page_header_t, entries) as
+ * received by the app, or with -r a raw dump of the trace_ring array (e.g. from gdb).\n
+ * With -g the captured i2c transactions are written as main/i2c_replay_data.h for the I2C_REPLAY backend
+ */
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+#include "trace.h"
+#include "i2c_bus.h"
+
+static const char *event_names[TRACE_EVENT_COUNT] = {
+    [TRACE_NONE] = "none",
+    [TRACE_GAP_CONNECT] = "gap_connect",
+    [TRACE_GAP_DISCONNECT] = "gap_disconnect",
+    [TRACE_GAP_CONN_UPDATE] = "gap_conn_update",
+    [TRACE_GAP_CONN_UPDATE_REQ] = "gap_conn_update_req",
+    [TRACE_GAP_ADV_COMPLETE] = "gap_adv_complete",
+    [TRACE_GAP_ENC_CHANGE] = "gap_enc_change",
+    [TRACE_GAP_NOTIFY_TX] = "gap_notify_tx",
+    [TRACE_GAP_SUBSCRIBE] = "gap_subscribe",
+    [TRACE_GAP_MTU] = "gap_mtu",
+    [TRACE_GATT_ACCESS] = "gatt_access",
+    [TRACE_GATT_WRITE] = "gatt_write",
+    [TRACE_SENSOR_READ] = "sensor_read",
+    [TRACE_I2C_WRITE] = "i2c_write",
+    [TRACE_I2C_READ] = "i2c_read",
+};
+
+// Writes the replay header instead of CSV
+static int generate = 0;
+
+static void print_replay_entry(const trace_entry_t *entry) {
+    if (entry->event != TRACE_I2C_WRITE && entry->event != TRACE_I2C_READ)
+        return;
+
+    printf("    {%d, 0x%02x, %u, %u, {0x%02x, 0x%02x}},\n", entry->event == TRACE_I2C_READ, entry->arg0,
+           entry->arg2 & 0xff, entry->arg2 >> 16, entry->arg1 >> 8, entry->arg1 & 0xff);
+}
+
+static void print_entry(uint32_t sequence, const trace_entry_t *entry) {
+    if (generate) {
+        print_replay_entry(entry);
+        return;
+    }
+
+    const char *name = entry->event < TRACE_EVENT_COUNT && event_names[entry->event] ? event_names[entry->event]
+                                                                                     : "unknown";
+
+    printf("%u,%u,%s,%u,%u,%u\n", sequence, entry->timestamp, name, entry->arg0, entry->arg1, entry->arg2);
+}
+
+static int decode_raw(FILE *file) {
+    trace_entry_t entry;
+    uint32_t sequence = 0;
+
+    while (fread(&entry, sizeof(entry), 1, file) == 1) {
+        if (entry.event != TRACE_NONE)
+            print_entry(sequence, &entry);
+
+        sequence++;
+    }
+
+    return 0;
+}
+
+static int decode_pages(FILE *file) {
+    uint8_t page;
+    trace_page_header_t header;
+    trace_entry_t entry;
+    // Pages may overlap, entries already printed are skipped
+    uint32_t next_sequence = 0;
+
+    while (fread(&page, 1, 1, file) == 1) {
+        if (fread(&header, sizeof(header), 1, file) != 1) {
+            fprintf(stderr, "Truncated page header\n");
+            return 1;
+        }
+
+        if (header.first > next_sequence && next_sequence != 0)
+            fprintf(stderr, "Lost %u entries before sequence %u\n", header.first - next_sequence, header.first);
+
+        for (uint32_t i = 0; i < header.count; i++) {
+            if (fread(&entry, sizeof(entry), 1, file) != 1) {
+                fprintf(stderr, "Truncated page at sequence %u\n", header.first + i);
+                return 1;
+            }
+
+            if (header.first + i < next_sequence)
+                continue;
+
+            print_entry(header.first + i, &entry);
+            next_sequence = header.first + i + 1;
+        }
+    }
+
+    return 0;
+}
+
+int main(int argc, char **argv) {
+    int raw = 0;
+    int option;
+
+    while ((option = getopt(argc, argv, "rg")) != -1) {
+        switch (option) {
+            case 'r':
+                raw = 1;
+                break;
+            case 'g':
+                generate = 1;
+                break;
+            default:
+                optind = argc;
+                break;
+        }
+    }
+
+    if (optind != argc - 1) {
+        fprintf(stderr, "Usage: %s [-r] [-g] <trace dump>\n", argv[0]);
+        return 2;
+    }
+
+    const char *path = argv[optind];
+
+    FILE *file = fopen(path, "rb");
+    if (!file) {
+        perror(path);
+        return 1;
+    }
+
+    if (generate) {
+        printf("// Generated by tools/trace_decode -g from %s\n", path);
+        printf("static const i2c_replay_entry_t i2c_replay_entries[] = {\n");
+    } else {
+        printf("sequence,timestamp_us,event,arg0,arg1,arg2\n");
+    }
+
+    int res = raw ? decode_raw(file) : decode_pages(file);
+
+    if (generate)
+        printf("};\n");
+
+    fclose(file);
+
+    return res;
+}